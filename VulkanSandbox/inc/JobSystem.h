@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+// Job system
+/*
+* A fixed set of worker threads that execute jobs (functions) taken from a shared queue.
+* The threads are created once at startup, creating a thread per task would cost more than most of the tasks we give them (e.g. building a pipeline or recording a command buffer).
+*
+* - submit() pushes a job and wakes up a worker
+* - wait() blocks the calling thread until every submitted job has finished
+* - Every job receives the index of the worker running it (0 to getWorkerCount() - 1), so it can use per thread resources like command pools without locking
+*
+* If a job throws, the first exception is rethrown by wait() on the calling thread.
+* The queue is a vector that is only rewound once it is empty, so a steady number of jobs per frame reuses its storage instead of allocating.
+*/
+class JobSystem {
+public:
+	using Job = std::function<void(uint32_t workerIndex)>;
+
+	//workerCount 0 uses one worker per hardware thread except the main one
+	void init(uint32_t workerCount = 0);
+
+	//Joins the workers if shutdown wasn't called (e.g. an exception during initialization), a joinable std::thread can't be destroyed
+	~JobSystem() { shutdown(); }
+
+	//Finish the queued jobs and join the workers
+	void shutdown();
+
+	void submit(Job job);
+
+	void wait();
+
+	uint32_t getWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+private:
+	std::vector<std::thread> workers;
+	std::vector<Job> jobs;
+	size_t nextJob = 0;//Oldest job of the queue not taken by a worker
+
+	std::mutex mutex;
+	std::condition_variable jobAvailable;//Signaled when a job is pushed or the workers have to stop
+	std::condition_variable jobsDone;//Signaled when the last running job finishes
+
+	uint32_t unfinishedJobs = 0;//Queued plus running jobs
+	bool stopping = false;
+	std::exception_ptr firstException;
+
+	void workerLoop(uint32_t workerIndex);
+};
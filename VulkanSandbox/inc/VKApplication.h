@@ -5,8 +5,31 @@
 #include <vector>
 #include <array>
 #include <optional>
+#include "VKMemoryAllocator.h"
+#include "VKStagingRing.h"
+#include "VKUniformRing.h"
+#include "VKPipelineCache.h"
+#include "VKPipelineManager.h"
+#include "VKShaderHotReload.h"
+#include "JobSystem.h"
+#include "VKScene.h"
+#include "VKMeshCache.h"
+#include "VKVertexDedup.h"
+#include "VKMeshOptimizer.h"
+#include "VKTextureBaker.h"
+#include "VKKtx2File.h"
+#include "VKAssetStreamer.h"
+#include "VKProfiler.h"
+#include "VKBenchmark.h"
+#include "VKTransformSystem.h"
+#include "VKDeletionQueue.h"
+#include "VKFrameArena.h"
+#include "VKBarrierBatch.h"
+#include "VKFrameScheduler.h"
+#include <deque>
 #include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
+#include <glm/gtc/packing.hpp>
 //For Surface
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
@@ -34,11 +57,113 @@ const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
 const std::string MODEL_PATH = "models/robot.obj";
+//Binary copy of the model's meshes written the first time MODEL_PATH is loaded (see VKMeshCache)
+const std::string MESH_CACHE_PATH = "models/robot.meshcache";
+//Upload the meshes as PackedVertex (16 bytes) instead of Vertex (44 bytes), switching it rebuilds the mesh cache
+const bool USE_PACKED_VERTICES = true;
+
+//The OBJ import deduplicates the vertices of every shape in ranges of this many indices on the worker threads, and merges the ranges of a shape afterwards
+const uint32_t OBJ_IMPORT_INDICES_PER_JOB = 256 * 1024;
+//Levels of detail made by the OBJ import, up to MAX_MESH_LODS with the full mesh: level n aims for MESH_LOD_REDUCTION^n of the triangles of the mesh
+//The chain ends before a level under MESH_LOD_MIN_TRIANGLES triangles, or one that keeps more than MESH_LOD_MIN_GAIN of the previous level's triangles
+//(the collapses left would move the surface more than MESH_LOD_MAX_ERROR times the radius of the mesh, or only locked vertices are left). Changing them rebuilds the mesh cache
+const float MESH_LOD_REDUCTION = 0.5f;
+const uint32_t MESH_LOD_MIN_TRIANGLES = 64;
+const float MESH_LOD_MIN_GAIN = 0.85f;
+const float MESH_LOD_MAX_ERROR = 0.05f;
+//The culling shader draws an instance with its least detailed level whose error, projected on the screen, is under this many pixels (0 always draws the full meshes)
+const float MESH_LOD_PIXEL_ERROR = 1.0f;
+//Texture of material 0, used by the shapes of the model without a material or whose material has no diffuse texture
 const std::string TEXTURE_PATH = "textures/robot.jpg";
+//Pre-compressed versions of a texture (KTX2 with every mip level) are next to it, named like it with one of these instead of its extension (textures/robot_bc7.ktx2)
+//The first one in a format the device can sample is used: BC7 and BC1 on desktop GPUs, ASTC on mobile ones
+const std::vector<std::string> TEXTURE_COMPRESSED_SUFFIXES = { "_bc7.ktx2", "_astc.ktx2", "_bc1.ktx2" };
+//Without one the texture is decoded and baked once to a file with this suffix (textures/robot.texcache.ktx2), the next runs load it like a pre-compressed texture (see loadTextureLevels)
+const std::string TEXTURE_CACHE_SUFFIX = ".texcache.ktx2";
+
+//Size of the bindless texture array (clamped to the limits of the device), element 0 is the placeholder and every streamed texture takes a free element while it is resident
+//The descriptors that aren't written are never accessed (partially bound), so a large array costs nothing until it is filled
+const uint32_t MAX_BINDLESS_TEXTURES = 4096;
+
+//Threads of the asset streamer, they read and decode the model and the textures while the main thread renders
+//Few are needed: loading is mostly waiting for the disk, and a baking texture shouldn't take the cores the frame's jobs run on
+const uint32_t STREAMING_WORKER_COUNT = 2;
+//Device memory the streamed textures can take, the least recently visible ones are evicted to stay under it
+const VkDeviceSize STREAMING_TEXTURE_BUDGET = 256ull * 1024 * 1024;
+//Texels copied to the staging ring per frame by the streamer, so a frame where many textures finish loading doesn't stall (one texture is always uploaded)
+const VkDeviceSize STREAMING_UPLOAD_BYTES_PER_FRAME = 8ull * 1024 * 1024;
+
+//Compiled pipelines are saved here at shutdown and loaded at startup, so only the first run compiles the shaders
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+//Built with shaderc (VKSANDBOX_SHADERC), saving a GLSL source recompiles it and swaps the pipelines using it while the application runs
+//The sources are checked every SHADER_RELOAD_POLL_INTERVAL seconds, the compiled SPIR-V is cached in SHADER_CACHE_DIR by hash of the source and defines
+const bool SHADER_HOT_RELOAD = true;
+const double SHADER_RELOAD_POLL_INTERVAL = 0.25;
+const std::string SHADER_CACHE_DIR = "shaders/cache";
+
+//Every profiled frame is a row of this file, the window title shows the averages and is refreshed every PROFILER_SUMMARY_INTERVAL seconds
+const std::string PROFILER_CSV_PATH = "frame_profile.csv";
+const double PROFILER_SUMMARY_INTERVAL = 0.5;
 
 //Allow multiple frames to be in-flight at once, that is to say, allow the rendering of one frame to not interfere with the recording of the next.
 // - Thus, we need multiple command buffers, semaphores, and fences. 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+//The per-frame objects are created for the most frames any frame pacing profile keeps in flight, the active profile only cycles through the first framesInFlight of them
+const int MAX_FRAMES_IN_FLIGHT = 3;
+
+//How frames are paced, switched at runtime with the P key
+enum class FramePacing {
+	LowLatency,//A frame is started once the previous one is on screen, input is at most one frame old
+	Throughput//The CPU can run frames ahead of the GPU, the GPU never waits for the next frame to be submitted
+};
+
+struct FramePacingProfile {
+	uint32_t framesInFlight;//At most MAX_FRAMES_IN_FLIGHT
+	std::vector<VkPresentModeKHR> presentModes;//In order of preference, FIFO (always supported) is the fallback
+	bool waitForPresent;//Wait for the previous frame to be displayed before starting the next (VK_KHR_present_wait, skipped when the device doesn't have it)
+	const char* name;
+};
+
+//IMMEDIATE doesn't wait for the vertical blank (it may tear), MAILBOX replaces the queued image instead of blocking, both show the newest frame as soon as possible
+const FramePacingProfile LOW_LATENCY_PROFILE = { 1, { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR }, true, "low latency" };
+//FIFO queues every image, with three frames in flight the GPU always has the next one ready
+const FramePacingProfile THROUGHPUT_PROFILE = { 3, { VK_PRESENT_MODE_FIFO_KHR }, false, "throughput" };
+const FramePacing DEFAULT_FRAME_PACING = FramePacing::Throughput;
+
+//Multisample anti-aliasing: samples per pixel of the color and depth attachments, clamped to the largest count the device supports for both (VK_SAMPLE_COUNT_1_BIT renders without MSAA)
+//The multisampled attachments only live during the render pass, they are resolved into the swap chain image and the depth image at its end
+const VkSampleCountFlagBits MSAA_SAMPLES = VK_SAMPLE_COUNT_4_BIT;
+//Run the fragment shader for every sample instead of every pixel: also smooths the aliasing inside the triangles (e.g. fine texture detail), at up to MSAA_SAMPLES times the shading cost
+//Needs the sampleRateShading feature, ignored without MSAA
+const bool MSAA_SAMPLE_RATE_SHADING = false;
+
+//Render without render pass and framebuffer objects (dynamic rendering) and record the barriers with synchronization2, both core in Vulkan 1.3
+//Devices that don't have them use the render pass and the legacy barriers
+const bool USE_DYNAMIC_RENDERING = true;
+
+//Longest wait for a present in the low latency profile, a present that never completes (e.g. minimized window) must not freeze the loop
+const uint64_t PRESENT_WAIT_TIMEOUT = 100ull * 1000 * 1000;
+
+//Draws are recorded by the worker threads in chunks of at least this many draws, starting a secondary command buffer for only a few draws costs more than it saves
+//A chunk is a single indirect draw whatever its size, so the scene is only split when it is very large
+const uint32_t MIN_DRAWS_PER_RECORDING_JOB = 4096;
+
+//The model is placed SCENE_GRID_SIZE x SCENE_GRID_SIZE times, SCENE_GRID_SPACING units apart, every copy of a shape is one instance of its draw
+const uint32_t SCENE_GRID_SIZE = 3;
+const float SCENE_GRID_SPACING = 20.0f;
+
+//Local sizes of the compute shaders (cull.comp, compactdraws.comp and depthreduce.comp)
+const uint32_t CULL_WORKGROUP_SIZE = 64;
+const uint32_t DEPTH_REDUCE_WORKGROUP_SIZE = 8;
+
+//Size of the persistently mapped staging ring used for every upload (vertices, indices and textures go through it)
+const VkDeviceSize STAGING_RING_SIZE = 32ull * 1024 * 1024;
+
+//Bytes of the uniform ring for every frame in flight, the frame's uniforms and any other per-frame block are pushed in it
+const VkDeviceSize UNIFORM_RING_FRAME_SIZE = 64 * 1024;
+
+//Initial bytes of the frame arena (transient CPU data of a frame), it grows to the largest frame it has seen
+const size_t FRAME_ARENA_SIZE = 256 * 1024;
 
 const std::vector<const char*> validationLayers = {
 	"VK_LAYER_KHRONOS_validation"
@@ -60,21 +185,29 @@ struct Vertex {
 	glm::vec3 color;
 	//Important aspect for texture mapping, the actual coordinates for each vertex (texture coordinates). The coordinates determine how the image is actually mapped to the geometry.
 	glm::vec2 texCoord;
+	glm::vec3 normal;
 
-	static VkVertexInputBindingDescription getBindingDescription() {
-		//All of our per-vertex data is packed together in one array, so we're only going to have one binding. 
-		VkVertexInputBindingDescription bindingDescription{};
-		bindingDescription.binding = 0;//The binding parameter specifies the index of the binding in the array of bindings. 
-		bindingDescription.stride = sizeof(Vertex);// Specifies the number of bytes from one entry to the next
+	static std::array<VkVertexInputBindingDescription, 2> getBindingDescription() {
+		std::array<VkVertexInputBindingDescription, 2> bindingDescriptions{};
+
+		//All of our per-vertex data is packed together in one array, so we're only going to have one per-vertex binding. 
+		bindingDescriptions[0].binding = 0;//The binding parameter specifies the index of the binding in the array of bindings. 
+		bindingDescriptions[0].stride = sizeof(Vertex);// Specifies the number of bytes from one entry to the next
 		//VK_VERTEX_INPUT_RATE_VERTEX: Move to the next data entry after each vertex
 		//K_VERTEX_INPUT_RATE_INSTANCE: Move to the next data entry after each instance
-		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		//Per-instance model matrix and material, written by the culling shader for the visible instances
+		//Instance i of a draw reads the entry firstInstance + i
+		bindingDescriptions[1].binding = 1;
+		bindingDescriptions[1].stride = sizeof(VKCulledInstanceData);
+		bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
 
-		return bindingDescription;
+		return bindingDescriptions;
 	}
 
-	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescription() {
-		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+	static std::array<VkVertexInputAttributeDescription, 9> getAttributeDescription() {
+		std::array<VkVertexInputAttributeDescription, 9> attributeDescriptions{};
 		
 		//Position
 		//The binding is loading one Vertex at a time and the position attribute (pos) is at an offset of 0 bytes from the beginning of this struct
@@ -104,6 +237,27 @@ struct Vertex {
 		attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
 		attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
 
+		//Instance model matrix
+		//An attribute is at most a vec4, a mat4 input takes 4 consecutive locations (one per column)
+		for (uint32_t column = 0; column < 4; column++) {
+			attributeDescriptions[3 + column].binding = 1;
+			attributeDescriptions[3 + column].location = 3 + column;
+			attributeDescriptions[3 + column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescriptions[3 + column].offset = column * sizeof(glm::vec4);
+		}
+
+		//Normal, after the instance matrix so both vertex formats use the same locations
+		attributeDescriptions[7].binding = 0;
+		attributeDescriptions[7].location = 7;
+		attributeDescriptions[7].format = VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescriptions[7].offset = offsetof(Vertex, normal);
+
+		//Instance texture, the element of the bindless array its material currently uses
+		attributeDescriptions[8].binding = 1;
+		attributeDescriptions[8].location = 8;
+		attributeDescriptions[8].format = VK_FORMAT_R32_UINT;
+		attributeDescriptions[8].offset = offsetof(VKCulledInstanceData, textureIndex);
+
 		return attributeDescriptions;
 	}
 
@@ -112,18 +266,113 @@ struct Vertex {
 	//- Hash calculation (because we used as a key)
 
 	bool operator==(const Vertex& other) const {
-		return pos == other.pos && color == other.color && texCoord == other.texCoord;
+		return pos == other.pos && color == other.color && texCoord == other.texCoord && normal == other.normal;
+	}
+
+	//Key of VKVertexDedup: the raw bytes of the attributes read from the OBJ file (the color isn't, it is always 0)
+	//The normal is part of it, the two sides of a hard edge share their position but not their normal
+	static uint64_t dedupHash(const Vertex& vertex) {
+		return hashBytes(&vertex.normal, sizeof(vertex.normal), hashBytes(&vertex.texCoord, sizeof(vertex.texCoord), hashBytes(&vertex.pos, sizeof(vertex.pos))));
+	}
+
+	static bool dedupEquals(const Vertex& a, const Vertex& b) {
+		return memcmp(&a.pos, &b.pos, sizeof(a.pos)) == 0 && memcmp(&a.texCoord, &b.texCoord, sizeof(a.texCoord)) == 0 && memcmp(&a.normal, &b.normal, sizeof(a.normal)) == 0;
+	}
+};
+
+//Compact vertex format used when USE_PACKED_VERTICES is set, 16 bytes instead of the 44 of Vertex
+//Vertex fetch is a large part of the cost of a vertex, the GPU converts every attribute back to float when it reads it:
+//- Position: 16-bit unorm per axis inside the bounding cube of the mesh, 1/65535 of its size of precision
+//  The culling shader folds positionQuantization into the instance matrix, so the vertex shader uses the position as is
+//- Normal: octahedral encoding, the unit sphere is unfolded into a square stored as two 16-bit snorm and decoded by the vertex shader
+//- Texture coordinates: half floats, unlike unorm they keep the coordinates outside of 0 to 1 of tiled textures
+//The color isn't stored, the OBJ import never sets it
+struct PackedVertex {
+	uint16_t pos[4];//xyz, w is padding so the attribute is a 4 component format (3 component 16-bit formats are rarely supported for vertex buffers)
+	int16_t normal[2];
+	uint16_t texCoord[2];
+
+	//Same bindings as Vertex, only the stride of the vertices changes
+	static std::array<VkVertexInputBindingDescription, 2> getBindingDescription() {
+		std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = Vertex::getBindingDescription();
+		bindingDescriptions[0].stride = sizeof(PackedVertex);
+		return bindingDescriptions;
+	}
+
+	//Same locations as Vertex without the color (location 1)
+	static std::array<VkVertexInputAttributeDescription, 8> getAttributeDescription() {
+		std::array<VkVertexInputAttributeDescription, 8> attributeDescriptions{};
+
+		//Position, UNORM is read as a float from 0 to 1
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = 0;
+		attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+		attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+		//Texture Coordinates
+		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].location = 2;
+		attributeDescriptions[1].format = VK_FORMAT_R16G16_SFLOAT;
+		attributeDescriptions[1].offset = offsetof(PackedVertex, texCoord);
+
+		//Instance model matrix
+		for (uint32_t column = 0; column < 4; column++) {
+			attributeDescriptions[2 + column].binding = 1;
+			attributeDescriptions[2 + column].location = 3 + column;
+			attributeDescriptions[2 + column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescriptions[2 + column].offset = column * sizeof(glm::vec4);
+		}
+
+		//Normal, SNORM is read as a float from -1 to 1
+		attributeDescriptions[6].binding = 0;
+		attributeDescriptions[6].location = 7;
+		attributeDescriptions[6].format = VK_FORMAT_R16G16_SNORM;
+		attributeDescriptions[6].offset = offsetof(PackedVertex, normal);
+
+		//Instance texture
+		attributeDescriptions[7].binding = 1;
+		attributeDescriptions[7].location = 8;
+		attributeDescriptions[7].format = VK_FORMAT_R32_UINT;
+		attributeDescriptions[7].offset = offsetof(VKCulledInstanceData, textureIndex);
+
+		return attributeDescriptions;
+	}
+
+	//positionQuantization of the mesh: offset (xyz) and size (w) of its bounding cube
+	static PackedVertex pack(const Vertex& vertex, const glm::vec4& positionQuantization) {
+		PackedVertex packed{};
+
+		glm::vec3 position = (vertex.pos - glm::vec3(positionQuantization)) / positionQuantization.w;
+		glm::vec2 octahedral = encodeOctahedral(vertex.normal);
+		for (int c = 0; c < 3; c++) {
+			packed.pos[c] = glm::packUnorm1x16(position[c]);//Rounds to the nearest step and clamps to 0 to 1
+		}
+		for (int c = 0; c < 2; c++) {
+			packed.normal[c] = static_cast<int16_t>(glm::packSnorm1x16(octahedral[c]));
+			packed.texCoord[c] = glm::packHalf1x16(vertex.texCoord[c]);
+		}
+
+		return packed;
+	}
+
+	//Projects the normal onto the octahedron |x| + |y| + |z| = 1 and unfolds its lower half over the corners of the square (Cigolle et al. 2014, A Survey of Efficient Representations for Independent Unit Vectors)
+	static glm::vec2 encodeOctahedral(const glm::vec3& normal) {
+		float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+		if (length == 0.0f) {
+			return glm::vec2(0.0f, 0.0f);//Decodes to +Z
+		}
+
+		glm::vec2 octahedral(normal.x / length, normal.y / length);
+		if (normal.z < 0.0f) {
+			octahedral = glm::vec2((1.0f - std::abs(octahedral.y)) * (octahedral.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(octahedral.x)) * (octahedral.y >= 0.0f ? 1.0f : -1.0f));
+		}
+		return octahedral;
 	}
 };
 
-// combining the fields of a struct to create a decent quality hash function
-//^ (XOR): Combines two values in a way that changes bits unpredictably.
-//<< 1 (Left shift): Moves bits to the left, introducing variation.
-//>> 1 (Right shift): Prevents overflow and redistributes bits.
-//nsures that the hash is distributed well across different inputs, reducing collisions.
-//Steps:
-//1. Hashing individual components
-//2. Combining them uniquely
+//Hash of a Vertex for the standard containers
+//Combining the hashes of the fields with XOR and shifts (hash(pos) ^ (hash(color) << 1) >> 1 ^ hash(texCoord) << 1) collides a lot: glm's hashes of floats are weak and the vertices of a mesh are close to each other
+//The same hash as VKVertexDedup is used instead, every input bit changes about half of the output bits
 //When you write:
 //std::unordered_set<Vertex> vertexSet;
 //vertexSet.insert(myVertex);
@@ -138,9 +387,7 @@ struct Vertex {
 namespace std {
 	template<> struct hash<Vertex> {
 		size_t operator()(Vertex const& vertex) const {
-			return ((hash<glm::vec3>()(vertex.pos) ^
-				(hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
-				(hash<glm::vec2>()(vertex.texCoord) << 1);
+			return static_cast<size_t>(Vertex::dedupHash(vertex));
 		}
 	};
 }
@@ -172,10 +419,24 @@ namespace std {
 // - Specify a descriptor layout during pipeline creation
 // - Allocate a descriptor set from a descriptor pool
 // - Bind the descriptor set during rendering
+//Shared by everything drawn in the frame, pushed once per frame to the uniform ring
 struct UniformBufferObject {
-	alignas(16) glm::mat4 model;
 	alignas(16) glm::mat4 view;
 	alignas(16) glm::mat4 proj;
+	glm::vec4 frustumPlanes[6];//World space planes (xyz normal pointing inside, w distance), extracted from proj * view
+};
+
+//Push constants of the draws: the transform of the object, set per draw without any descriptor set
+struct ObjectPushConstants {
+	glm::mat4 model;
+};
+
+//Push constants of cull.comp, the object transform is the same as the one of the draws
+struct CullPushConstants {
+	glm::mat4 model;
+	uint32_t instanceCount;
+	uint32_t occlusionEnabled;
+	float lodErrorScale;//Half the viewport height divided by MESH_LOD_PIXEL_ERROR, 0 disables the levels of detail
 };
 
 //Array of vertex data
@@ -212,12 +473,94 @@ struct QueueFamilyIndices {
 	*/
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
+	//Queue family used for uploads, a dedicated transfer family (no graphics) if the device has one, otherwise the graphics family
+	std::optional<uint32_t> transferFamily;
 
 	bool isComplete() const {
 		return graphicsFamily.has_value() && presentFamily.has_value();
 	}
 };
 
+//Upload command buffer that was submitted but may still be executing, freed once its queue's timeline reaches the value of its submit
+struct PendingUpload {
+	VkCommandBuffer commandBuffer;
+	VkCommandPool commandPool;//Pool the command buffer was allocated from (graphics or transfer)
+	VKQueue queue;
+	uint64_t value;
+};
+
+//Second half of a queue family ownership transfer
+//A resource written by the transfer queue is released there and has to be acquired by the graphics queue with a matching barrier before it can be used
+struct PendingAcquire {
+	uint64_t transferValue;//Transfer timeline value signaled by the submit that released the resource
+	bool isImage;
+	//Their destination stage and access are how the graphics queue uses the resource
+	VkBufferMemoryBarrier2 bufferBarrier;
+	VkImageMemoryBarrier2 imageBarrier;
+	//Texture whose mip chain is generated by the graphics queue once it owns the image (vkCmdBlitImage isn't supported on transfer queues), 0 otherwise
+	uint32_t mipLevels;
+	int32_t width;
+	int32_t height;
+};
+
+//Texture of a material, sampled through the bindless texture array
+struct VKTexture {
+	VkImage image;// Image object to fill with texture pixels
+	VKAllocation allocation;// Allocated memory in GPU device local
+	VkImageView view;//Images are accessed through image views rather than directly.
+	//Block compressed when the device supports it (BC7, BC1 or ASTC), R8G8B8A8_SRGB otherwise
+	VkFormat format;
+	//Full mip chain down to 1x1, each level is half the size of the previous one. Far away surfaces are sampled from a small level: fewer texels fetched and no cache thrashing
+	uint32_t mipLevels;
+};
+
+//Texture of a material, streamed in when an instance using it is visible and evicted when it is the least recently visible one over the budget
+struct StreamedTexture {
+	uint32_t asset;//In the asset streamer, which tracks its state and last use
+	//Written by the load job on a streaming worker, read by the main thread once the streamer has collected the job
+	std::vector<VKTextureLevel> levels;
+	VkFormat format;
+	VKTexture texture{};//From the upload to the eviction
+	uint64_t transferValue = 0;//Transfer timeline value of the upload, the texture is sampled once the graphics queue has acquired it
+	uint32_t slot = 0;//Element of the bindless array the material samples, 0 (the placeholder) unless the texture is resident
+};
+
+//Objects of a swap chain that was replaced, destroyed by the deletion queue once the frames in flight that may still render with them are done
+struct RetiredSwapChain {
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+	std::vector<VkImageView> imageViews;
+	std::vector<VkFramebuffer> framebuffers;
+	VkImage depthImage = VK_NULL_HANDLE;
+	VkImageView depthImageView = VK_NULL_HANDLE;
+	VKAllocation depthImageAllocation;//Empty when the new depth image fits in the same allocation
+	VkImage colorImage = VK_NULL_HANDLE;
+	VkImageView colorImageView = VK_NULL_HANDLE;
+	VKAllocation colorImageAllocation;//The same for the multisampled attachments
+	VkImage msaaDepthImage = VK_NULL_HANDLE;
+	VkImageView msaaDepthImageView = VK_NULL_HANDLE;
+	VKAllocation msaaDepthImageAllocation;
+	VkImage depthPyramid = VK_NULL_HANDLE;
+	VKAllocation depthPyramidAllocation;
+	VkImageView depthPyramidView = VK_NULL_HANDLE;
+	std::vector<VkImageView> depthPyramidMipViews;
+	VkDescriptorPool computeDescriptorPool = VK_NULL_HANDLE;
+};
+
+//Secondary command buffer of the main pass recorded by a worker, allocated in the frame arena
+struct DrawRecordingJob {
+	uint32_t firstDraw;
+	uint32_t drawCount;
+	uint32_t imageIndex;
+	VkCommandBuffer* commandBuffer;//Where the job writes the command buffer it recorded
+};
+
+//Command pool owned by one worker thread for one frame in flight
+struct WorkerCommandPool {
+	VkCommandPool pool;
+	std::vector<VkCommandBuffer> secondaryCommandBuffers;//Allocated when needed and reused every time the frame comes around
+	uint32_t usedCount = 0;//Command buffers handed out since the pool was reset
+};
+
 struct SwapChainSupportDetails {
 	VkSurfaceCapabilitiesKHR capabilities;
 	std::vector<VkSurfaceFormatKHR> formats;
@@ -227,8 +570,20 @@ struct SwapChainSupportDetails {
 class VKApplication {
 public:
 	void run();
+
+	//Headless: no window, surface or swap chain, the frames are rendered into offscreen images with a fixed time step
+	//Renders settings.frameCount frames once the scene and its visible textures are resident, and measures them
+	void runBenchmark(const VKBenchmarkSettings& settings, VKBenchmarkReport& report);
 private:
-	GLFWwindow* window;
+	GLFWwindow* window = nullptr;
+
+	//Set by runBenchmark, the swap chain images are replaced by offscreen images and nothing is presented
+	bool headless = false;
+	VKBenchmarkSettings benchmarkSettings;
+	//Frames rendered since the measurement started, the animation time of the benchmark is replayFrame * timeStep
+	uint64_t replayFrame = 0;
+	//Memory of the offscreen images, they take the place of swapChainImages
+	std::vector<VKAllocation> offscreenImagesAllocation;
 	
 	/*  Vulkan handles */
 
@@ -241,6 +596,9 @@ private:
 	//Main interface to a physical device (active configuration for features we want to use from the physical device) 
 	VkDevice logicalDevice;
 
+	//Sub-allocates buffer and image memory from large blocks instead of calling vkAllocateMemory for every resource
+	VKMemoryAllocator memoryAllocator;
+
 	//Receive commands to be executed on physical device (queues are automatically created along with the logical device)
 	//- We can use the vkGetDeviceQueue function to retrieve queue handles for each queue family. 
 	VkQueue graphicsQueue;
@@ -248,11 +606,18 @@ private:
 	//Queue that supports presentation
 	VkQueue presentQueue;
 
+	//Queue used for uploads, it runs in parallel with the graphics queue when it belongs to a dedicated transfer family (DMA engine)
+	VkQueue transferQueue;
+
+	//Families of the graphics and transfer queues, when they differ every uploaded resource needs a queue family ownership transfer
+	uint32_t graphicsQueueFamily;
+	uint32_t transferQueueFamily;
+
 	//Window of you OS, we conect wulkan and the window system with a extension from glfw
-	VkSurfaceKHR surface;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
 
 	//Send image (presents) to a monitor, provides image to render into
-	VkSwapchainKHR swapChain;
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 
 	//Images from swap chain
 	std::vector<VkImage> swapChainImages;
@@ -263,7 +628,14 @@ private:
 	std::vector<VkImageView> swapChainImageViews;
 
 	//Render pass: Specifies how many color and depth buffers there will be, how many samples to use for each of them and how their contents should be handled throughout the rendering operations. 
-	VkRenderPass renderPass;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+
+	//Dynamic rendering: vkCmdBeginRendering takes the image views of the frame directly, there is no render pass (VK_NULL_HANDLE) and no framebuffer to recreate with the swap chain
+	//The layout transitions the render pass did are then explicit barriers (see beginRendering and endRendering)
+	bool requestedDynamicRendering = USE_DYNAMIC_RENDERING;//The benchmark can override it
+	bool dynamicRenderingEnabled = false;
+	bool synchronization2Enabled = false;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;//Picked with the physical device, the attachments and the pipelines have to agree on it
 
 	//Descriptor Set Layout: Provides details about every descriptor binding used in the shaders for pipeline creation, just like we had to do for every vertex attribute and its location index
 	// The descriptor layout specifies the types of resources that are going to be accessed by the pipeline, just like a render pass specifies the types of attachments that will be accessed. 
@@ -273,8 +645,28 @@ private:
 	//Pipeline layout
 	VkPipelineLayout pipelineLayout;
 
-	//Graphics pipeline
-	VkPipeline graphicsPipeline;
+	//Graphics pipelines: every permutation is owned by the pipeline manager and looked up with the hash of its description
+	VKPipelineManager pipelineManager;
+	uint64_t opaquePipeline;
+	uint64_t alphaPipeline;
+	uint64_t wireframePipeline;
+	uint64_t shadowPipeline;
+
+	//Recompiles the edited shaders on a thread of its own, the pipeline manager swaps the rebuilt pipelines in at the start of a frame
+	VKShaderHotReload shaderHotReload;
+
+	//Wireframe needs the optional fillModeNonSolid feature
+	bool fillModeNonSolidSupported = false;
+
+	//CPU and GPU timings of every frame, the statistics query needs pipelineStatisticsQuery and inheritedQueries (the draws are in secondary command buffers)
+	VKProfiler profiler;
+	bool pipelineStatisticsSupported = false;
+
+	//Worker threads for work that can be split in independent jobs (e.g. compiling pipelines)
+	JobSystem jobSystem;
+
+	//Pipeline cache loaded from PIPELINE_CACHE_PATH, every pipeline is created through it
+	VKPipelineCache pipelineCache;
 
 	//Holds frambuffers: references all of the VkImage view objects that represent the attachments. Create a frame buffer for all the images in the swap chain and use the one that corresponds to the retrieved image at drawing time
 	std::vector<VkFramebuffer> swapChainFramebuffers;
@@ -288,12 +680,45 @@ private:
 	//- Command buffers will be automatically freed when their command pool is destroyed, so we don't need explicit cleanup.
 	std::vector<VkCommandBuffer> commandBuffers;
 
+	//Secondary command buffers recorded by the worker threads, one pool per frame in flight and worker thread [frame][worker]
+	std::vector<std::vector<WorkerCommandPool>> workerCommandPools;
+
+	//Command buffers for the transfer queue can only come from a pool of the transfer family
+	VkCommandPool transferCommandPool;
+
+	//One timeline semaphore per queue, signaled by every submit with an increasing value: the graphics queue waits on the transfer timeline instead of the CPU waiting on the uploads,
+	//and the CPU waits on the graphics timeline instead of a fence per frame in flight
+	VKFrameScheduler frameScheduler;
+	uint64_t completedTransferValue = 0;//Transfer value reached by the GPU, read once per frame
+	uint64_t acquiredTransferValue = 0;//Uploads up to this value have been acquired by the graphics queue
+	uint64_t sceneTransferValue = 0;//Value of the last upload of the model, the model is drawn once it has been acquired
+
+	//Resources released by the transfer queue that the graphics queue still has to acquire
+	std::deque<PendingAcquire> pendingAcquires;
+
+	//Open upload batch, while it is not VK_NULL_HANDLE every copy and barrier for the transfer queue is recorded into it and submitted together
+	VkCommandBuffer uploadBatch = VK_NULL_HANDLE;
+
+	//Staging ring: one host visible buffer, mapped once and reused by every upload. Space is given back when the transfer timeline reaches the value of the upload that read it
+	VkBuffer stagingRingBuffer;
+	VKAllocation stagingRingAllocation;
+	VKStagingRing stagingRing;
+
+	//Upload submits don't wait for the queue to be idle, their command buffers are released once the GPU is done with them
+	std::deque<PendingUpload> pendingUploads;
+
 	//Semaphore to signal that an image has been acquired from the swapchain and is ready for rendering
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	//Semaphore to signal that rendering has finished and presentation can happen
+	//Both have to stay binary semaphores, the swap chain doesn't accept timelines
 	std::vector<VkSemaphore> renderFinishedSemaphores;
-	//A fence to make sure only one frame is rendering at a time
-	std::vector<VkFence> inFlightFences;
+
+	//Objects released once the graphics timeline reaches the frame they were retired on, instead of waiting for the device to be idle
+	VKDeletionQueue deletionQueue;
+	//Transient CPU data of the frame being recorded (textures acquired for mipmapping, recording jobs), rewound every frame
+	VKFrameArena frameArena;
+	//Barriers of the frame's primary command buffer, recorded by the main thread only
+	VKBarrierBatch frameBarriers;
 
 	//Handling resizes explicitly
 	//Although many drivers and platforms trigger VK_ERROR_OUT_OF_DATE_KHR automatically after a window resize, it is not guaranteed to happen.
@@ -302,33 +727,146 @@ private:
 	//To use the right objects every frame, we need to keep track of the current frame.
 	uint32_t currentFrame = 0;
 
-	//We are using tinyobjloader to load vertices and index to the vector
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+	//Active frame pacing profile, the P key sets requestedFramePacing and the next drawFrame switches to it
+	FramePacing framePacing = DEFAULT_FRAME_PACING;
+	FramePacing requestedFramePacing = DEFAULT_FRAME_PACING;
+
+	//VK_KHR_present_id and VK_KHR_present_wait are optional, every present gets an id and the low latency profile waits for the previous one
+	bool presentWaitSupported = false;
+	PFN_vkWaitForPresentKHR vkWaitForPresent = nullptr;
+	uint64_t presentId = 0;//Id of the last present, they keep increasing across swap chains
+	uint64_t waitablePresentId = 0;//Last present of the current swap chain, 0 when there is none yet
 
-	//Vertex Buffer Handle
+	//Every shape of the model loaded with tinyobjloader is a mesh of the scene, its vertices and indices are packed in the megabuffers
+	VKScene scene;
+
+	//Mapped while the scene's geometry is uploaded when the model comes from the cache
+	VKMeshCache meshCache;
+
+	//Vertex Buffer Handle (vertex megabuffer shared by every mesh)
 	VkBuffer vertexBuffer;
 
-	//Allocated Memory for vertex buffer
-	VkDeviceMemory vertexBufferMemory;
+	//Allocated Memory for vertex buffer (range inside a memory block)
+	VKAllocation vertexBufferAllocation;
 
 	//An index buffer is essentially an array of pointers into the vertex buffer.
 	// It allows you to reorder the vertex data, and reuse existing data for multiple vertices
 	VkBuffer indexBuffer;
 
-	//Alocated Memory for the index buffer
-	VkDeviceMemory indexBufferMemory;
+	//Alocated Memory for the index buffer (range inside a memory block)
+	VKAllocation indexBufferAllocation;
+
+	//Per-draw data (bounding sphere of the mesh) of every draw, a storage buffer read by the culling shader
+	VkBuffer drawDataBuffer;
+	VKAllocation drawDataBufferAllocation;
+
+	//One VkDrawIndexedIndirectCommand per draw with instanceCount 0, copied every frame into the frame's instanced indirect buffer where the culling shader counts the visible instances
+	VkBuffer indirectBuffer;
+	VKAllocation indirectBufferAllocation;
+
+	//multiDrawIndirect lets a single vkCmdDrawIndexedIndirect issue many draws, without it every draw needs its own call
+	bool multiDrawIndirectSupported = false;
+
+	// Instancing
+	//Transforms of every instance, written by the CPU every frame into a persistently mapped buffer (one per frame in flight, the GPU may still read the previous one)
+	std::vector<VkBuffer> instanceBuffers;
+	std::vector<VKAllocation> instanceBuffersAllocation;
+	std::vector<VKInstanceData*> instanceBuffersMapped;
+	std::vector<uint64_t> instanceBuffersVersion;//Transform version each instance buffer was last written with, only the matrices changed since then are written
+
+	//Instance transforms: a static node per instance (its place in the grid) with a child node for the spin, the children are the instance matrices
+	VKTransformSystem transforms;
+	uint32_t firstSpinNode = 0;
+
+	//Model matrices of the visible instances packed per draw, bound as the instance rate vertex buffer
+	std::vector<VkBuffer> culledInstanceBuffers;
+	std::vector<VKAllocation> culledInstanceBuffersAllocation;
+
+	// GPU culling
+	//A compute pass before the render pass tests every instance against the frustum and the depth pyramid of the previous frame
+	//A visible instance increments the instanceCount of its draw in the instanced indirect buffer of the frame and writes its transform to the culled instance buffer
+	//With drawIndirectCount a second pass appends the draws with visible instances to the culled indirect buffer and counts them, vkCmdDrawIndexedIndirectCount reads the count on the GPU
+	//Without it the instanced indirect buffer is drawn with vkCmdDrawIndexedIndirect, the draws without visible instances have instanceCount 0
+	bool drawIndirectCountSupported = false;
+	std::vector<VkBuffer> instancedIndirectBuffers;
+	std::vector<VKAllocation> instancedIndirectBuffersAllocation;
+	std::vector<VkBuffer> culledIndirectBuffers;
+	std::vector<VKAllocation> culledIndirectBuffersAllocation;
+	std::vector<VkBuffer> drawCountBuffers;
+	std::vector<VKAllocation> drawCountBuffersAllocation;
+
+	VkDescriptorSetLayout cullDescriptorSetLayout;
+	VkPipelineLayout cullPipelineLayout;
+	uint64_t cullPipeline;
+	CullPushConstants cullConstants{};//The model is updated with the uniform buffer
+
+	VkDescriptorSetLayout compactDescriptorSetLayout;
+	VkPipelineLayout compactPipelineLayout;
+	uint64_t compactPipeline;
+
+	// Depth pyramid (Hi-Z)
+	//Mip chain of the depth buffer where every texel holds the farthest depth of the texels it covers, level 0 has the size of the depth buffer
+	//It is built after the render pass and kept in VK_IMAGE_LAYOUT_GENERAL, the next frame culls against it
+	VkImage depthPyramid;
+	VKAllocation depthPyramidAllocation;
+	VkImageView depthPyramidView;//Every level, sampled by cull.comp
+	std::vector<VkImageView> depthPyramidMipViews;//One level each, written by depthreduce.comp
+	uint32_t depthPyramidLevels;
+	VkSampler depthPyramidSampler;
+	bool depthPyramidValid = false;//False until a frame has been reduced into it (first frame and after the swap chain is recreated)
+
+	VkDescriptorSetLayout depthReduceDescriptorSetLayout;
+	VkPipelineLayout depthReducePipelineLayout;
+	uint64_t depthReducePipeline;
+
+	//Depends on the swap chain extent, recreated with it: culling sets (one per frame) and depth reduce sets (one per level)
+	VkDescriptorPool computeDescriptorPool;
+	std::vector<VkDescriptorSet> cullDescriptorSets;
+	std::vector<VkDescriptorSet> compactDescriptorSets;
+	std::vector<VkDescriptorSet> depthReduceDescriptorSets;
 
 	//Uniform Buffers
-	std::vector<VkBuffer> uniformBuffers; //Buffer objects
-	std::vector<VkDeviceMemory> uniformBuffersMemory;//Allocated memory for vertex buffer
-	std::vector<void*> uniformBuffersMapped;// CPU access meomory to write data to
+	//One buffer with a region per frame in flight, bound with a dynamic offset
+	VkBuffer uniformRingBuffer;
+	VKAllocation uniformRingAllocation;
+	VKUniformRing uniformRing;
+	UniformBufferObject frameUniforms{};//Of the current frame, its frustum planes also select the textures to stream
+	uint32_t frameUniformsOffset = 0;//Dynamic offset of frameUniforms in the ring
 
 	// Descriptor Pool Handle: describe which descriptor types our descriptor sets are going to contain and how many of them
 	VkDescriptorPool descriptorPool;
 
-	//Descriptor set: descriptor set for each VkBuffer resource to bind it to the uniform buffer descriptor.
-	std::vector<VkDescriptorSet> descriptorSets;
+	//Descriptor set: binds the uniform ring to the uniform buffer descriptor, a single set for every frame (the dynamic offset selects the frame's uniforms)
+	VkDescriptorSet descriptorSet;
+
+	// Bindless textures
+	//Every texture of the scene is an element of one array of combined image samplers (set 1), bound once per command buffer whatever the number of materials
+	//The fragment shader indexes it with the material of the instance, so draws with different textures don't need different descriptor sets (descriptor indexing, core in Vulkan 1.2)
+	//The set is update-after-bind: textures can be written to free elements while command buffers that use the set are pending, e.g. when a texture streams in
+	VkDescriptorSetLayout bindlessDescriptorSetLayout;
+	VkDescriptorPool bindlessDescriptorPool;//Created with VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT, the only kind of pool update-after-bind sets can come from
+	VkDescriptorSet bindlessDescriptorSet;
+	//MAX_BINDLESS_TEXTURES clamped to the update-after-bind limits of the device
+	uint32_t bindlessTextureCapacity = 0;
+	//Elements no texture uses, element 0 is never in it
+	std::vector<uint32_t> freeTextureSlots;
+
+	//Bindless element of the texture of every material, read by the culling shader (one per frame in flight, written by the CPU every frame)
+	std::vector<VkBuffer> materialBuffers;
+	std::vector<VKAllocation> materialBuffersAllocation;
+
+	// Asset streaming
+	//The model and the textures are read and decoded on the workers of the streamer while the frames are rendered (see updateStreaming)
+	VKAssetStreamer streamer;
+	uint32_t sceneAsset;
+	//Set by the main thread once the model's load job has been collected and the scene's buffers created, nothing reads the scene before
+	bool sceneLoaded = false;
+	//One per material of the scene, created with its buffers and never resized (the load jobs write to them)
+	std::vector<StreamedTexture> streamedTextures;
+	//Frames drawn so far, the clock of the streamer for the last use of a texture
+	uint64_t frameNumber = 0;
+	//Model matrix of the uniform buffer, the CPU visibility test of the textures places the instances with it like the culling shader
+	glm::mat4 sceneTransform = glm::mat4(1.0f);
 
 	// Texture
 	
@@ -337,8 +875,8 @@ private:
 	//- Fill it with pixels from an image file
 	//- Create an image sampler
 	//- Add a combined image sampler descriptor to sample colors from the texture
-	VkImage textureImage;// Image object to fill with texture pixels
-	VkDeviceMemory textureImageMemory; // Allocated memory in GPU device local
+	//Every material samples it until its own texture has streamed in, element 0 of the bindless array
+	VKTexture placeholderTexture;
 
 	//  Sample an image: Texture Image View and Sampler
 
@@ -362,7 +900,7 @@ private:
 	// - Clamp to border (not fill): Return a solid color when sampling beyond the dimensions of the image.
 	// The repeat mode is probably the most common mode, because it can be used to tile textures like floors and walls.
 
-	VkImageView textureImageView;//Images are accessed through image views rather than directly.
+	//Shared by every texture, its maxLod doesn't limit the levels: the view of each texture covers its own mip chain
 	VkSampler textureSampler; // Textures are usually accessed through samplers, which will apply filtering and transformations to compute the final color that is retrieved. the sampler does not reference a VkImage anywhere. The sampler is a distinct object that provides an interface to extract colors from a texture
 
 	//Depth Buffering
@@ -374,9 +912,26 @@ private:
 	// Every time the rasterizer produces a fragment, the depth test will check if the new fragment is closer than the previous one. If it isn't, then the new fragment is discarded
 	// A fragment that passes the depth test writes its own depth to the depth buffer. It is possible to manipulate this value from the fragment shader, just like you can manipulate the color output.
 	VkImage depthImage;
-	VkDeviceMemory depthImageMemory;
+	VKAllocation depthImageAllocation;//Kept when the swap chain is recreated with an extent whose depth image still fits in it
 	VkImageView depthImageView;
 
+	// Multisampling (MSAA)
+	//With more than one sample the render pass draws into multisampled color and depth attachments, at its end the color is resolved into the swap chain image
+	//and the depth into depthImage (the depth pyramid is built from the resolved depth)
+	//The multisampled attachments are transient: nothing is loaded from or stored to memory, on tiled GPUs they stay in tile memory and their lazily allocated memory is never committed
+	VkSampleCountFlagBits requestedMsaaSamples = MSAA_SAMPLES;//The benchmark can override it
+	bool requestedSampleRateShading = MSAA_SAMPLE_RATE_SHADING;
+	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;//requestedMsaaSamples clamped to the device
+	bool sampleRateShadingEnabled = false;
+	//MAX keeps the farthest sample like the depth pyramid does, so occlusion culling stays conservative; SAMPLE_ZERO (always supported) otherwise
+	VkResolveModeFlagBits depthResolveMode = VK_RESOLVE_MODE_SAMPLE_ZERO_BIT;
+	VkImage colorImage = VK_NULL_HANDLE;
+	VKAllocation colorImageAllocation;
+	VkImageView colorImageView = VK_NULL_HANDLE;
+	VkImage msaaDepthImage = VK_NULL_HANDLE;
+	VKAllocation msaaDepthImageAllocation;
+	VkImageView msaaDepthImageView = VK_NULL_HANDLE;
+
 	//Main funcitions for Run()
 	void initWindows();
 
@@ -396,34 +951,96 @@ private:
 
 	void createLogicalDevice();
 
+	void createMemoryAllocator();
+
 	void createSwapChain();
 
+	//Headless replacement of the swap chain: one color image per frame in flight, frame i renders into image i
+	void createOffscreenImages();
+
 	void createImageViews();
  
 	void createRenderPass();
 
 	void createDescriptorSetLayout();
 
+	void createPipelineCache();
+
 	void createGraphicsPipeline();
 
+	void createComputePipelines();
+
+	//Watch the sources of the SPIR-V files the pipelines were built from (not in headless mode, the benchmark always runs the same shaders)
+	void createShaderHotReload();
+
 	void createFramebuffers();
 
 	void createCommandPool();
 
+	void createFrameScheduler();
+
+	void createStagingRing();
+
 	void createDepthResources();
 
-	void createTextureImage();
+	//Multisampled color attachment, only with MSAA
+	void createColorResources();
+
+	void createDepthPyramid();
+
+	void createInstanceBuffers();
+	void createInstanceTransforms();
+
+	void createCullingBuffers();
+
+	void createComputeDescriptorSets();
+
+	//Point the culling and compaction sets to the scene's buffers, once the scene is loaded
+	void writeCullingDescriptorSets();
+
+	void createMaterialBuffers();
+
+	void createPlaceholderTexture();
+
+	//Upload levels (from the largest) into the open upload batch, generate the rest of the mip chain if there is a single level, and create the view
+	VKTexture createTextureImage(const std::vector<VKTextureLevel>& levels, VkFormat format);
+
+	//Read the levels of the texture at path into CPU memory, runs on a streaming worker
+	void loadTextureLevels(const std::string& path, std::vector<VKTextureLevel>& levels, VkFormat& format);
+
+	//Open a pre-compressed version of the texture at path or the baked one, returns false if none can be used on this device
+	bool openTextureFile(const std::string& path, VKKtx2File& textureFile);
+
+	//Decode the texture at path and turn it into the levels to upload (BC7 mip chain, or level 0 in RGBA8 if BC7 isn't supported), saved to its texture cache
+	void bakeTexture(const std::string& path, std::vector<VKTextureLevel>& levels, VkFormat& format);
+
+	void destroyTexture(VKTexture& texture);
 
-	void createTextureImageView();
+	//The device can sample the format with linear filtering (block compressed formats also need their feature, enabled in createLogicalDevice)
+	bool isTextureFormatUsable(VkFormat format);
 
 	void createTextureSampler();
 
+	//Start loading the model on a streaming worker, the first frames only clear the screen
+	void startSceneLoad();
+
+	//Fill the scene from the mesh cache or MODEL_PATH, runs on a streaming worker
 	void loadModel();
 
+	//Create and upload the buffers of the loaded scene, on the main thread once its load job has been collected
+	void finishSceneLoad();
+
+	//Parse MODEL_PATH with tinyobjloader and add its shapes to the scene, only when the mesh cache can't be used
+	void loadObjModel();
+
 	void createVertexBuffer();
 
 	void createIndexBuffer();
 
+	void createDrawDataBuffer();
+
+	void createIndirectBuffer();
+
 	void createUniformBuffers();
 
 	void createDescriptorPool();
@@ -432,8 +1049,13 @@ private:
 
 	void createCommandBuffers();
 
+	void createWorkerCommandPools();
+
 	void createSyncObjects();
 
+	//One set of queries per frame in flight
+	void createProfiler();
+
 	//Helper functions
 	
 	bool checkValidationLayerSupport();
@@ -449,28 +1071,49 @@ private:
 	//SwapChain
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 
+	//Check an optional extension
+	bool isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName);
+
+	//deviceExtensions, none when headless (nothing is presented)
+	std::vector<const char*> getDeviceExtensions() const;
+
 	//Get surface supported capabilities, formats, and presnet modes
 	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) const;
 
 	//Choosing swap chain settings
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 
+	//First present mode of the frame pacing profile the surface supports
 	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
 
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 
-	//Shader modules
+	// Draw commands
 
-	//To create the SPIR-V bytcode files the command is glslc shader.vert -o vert.spv glslc shader.frag -o frag.spv
+	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 
-	//The readFile function will read all of the bytes from the specified file and return them in a byte array managed by std::vector (for the SPIR-V file)
-	static std::vector<char> readFile(const std::string& filename);
+	//Start and end the main pass: the render pass, or dynamic rendering with the layout transitions of its attachments
+	//The transitions at the end are left in frameBarriers, recordDepthPyramid flushes them with its own first barrier
+	void beginRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void endRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 
-	VkShaderModule createShaderModule(const std::vector<char>& code) const;
+	//Take a secondary command buffer from the worker's pool of the current frame and begin it to continue the render pass
+	VkCommandBuffer beginSecondaryCommandBuffer(uint32_t workerIndex, uint32_t imageIndex);
 
-	// Draw commands
+	//Record the draws [firstDraw, firstDraw + drawCount) of the culled indirect buffer with all the state they need, called from the worker threads
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount);
 
-	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	//Record the acquire barriers of the uploads that finished on the transfer queue (up to completedTransferValue)
+	void recordUploadAcquires(VkCommandBuffer commandBuffer);
+
+	//Blit every level of the image from the one above it, level 0 must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL and every level ends in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	void recordMipmapGeneration(VkCommandBuffer commandBuffer, VkImage image, int32_t width, int32_t height, uint32_t mipLevels);
+
+	//Record the culling dispatches that fill the culled instance buffer, the instanced and culled indirect buffers and the draw count of the current frame, outside of the render pass
+	void recordCulling(VkCommandBuffer commandBuffer);
+
+	//Record the reduction of the depth buffer into the depth pyramid, after the render pass
+	void recordDepthPyramid(VkCommandBuffer commandBuffer);
 
 	//Rendering a frame in Vulkan consists of a common set of steps:
 	// - Wait for the previous frame to finish
@@ -549,49 +1192,120 @@ private:
 	// One of the reasons that could cause this to happen is the size of the window changing. We have to catch these events and recreate the swap chain.
 	void recreateSwapChain();
 
-	//To make sure that the old versions of these objects (swapcahin, framebuffers and image views) are cleaned up before recreating them
+	//Destroy the current swap chain objects, the device must be idle (only on exit, recreateSwapChain retires them instead)
 	void cleanupSwapChain();
 
+	//Release function of the deletion queue for the objects of a replaced swap chain
+	void destroyRetiredSwapChain(RetiredSwapChain& retired);
+
 	//Resize window callback
 	//Set the frambufferResized flag
 	static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
 
+	// Frame pacing
+
+	const FramePacingProfile& getFramePacingProfile() const { return framePacing == FramePacing::LowLatency ? LOW_LATENCY_PROFILE : THROUGHPUT_PROFILE; }
+
+	//Switch to requestedFramePacing: waits for the frames in flight and recreates the swap chain with the profile's present mode
+	void applyFramePacing();
+
+	//P toggles the frame pacing profile
+	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+
+	// Benchmark
+
+	//The scene is loaded and no texture is loading or uploading, the frames that follow all render the same work
+	bool isStreamingIdle() const;
+
 	//Vertex Buffer Creation
 
 	//Graphics cards can offer different types of memory to allocate from. Each type of memory varies in terms of allowed operations and performance characteristics. We need to combine the requirements of the buffer and our own application requirements to find the right type of memory to use
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
 
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VKAllocation& bufferAllocation);
 
 	//Copy the contents from one buffer to another (e.g from a Staging buffer [Host-Visible] to a Vertex buffer [device local])
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+	//The copy runs on the transfer queue, dstStageMask and dstAccessMask describe how the graphics queue uses dstBuffer afterwards
+	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask);
 
 	// Update uniform buffer
 
 	//Generates a new transformation every frame to make the geometry spin around.
 	void updateUniformBuffer(uint32_t currentImage);
 
+	//Write the transform of every instance to the frame's instance buffer, each instance spins around its own origin
+	void updateInstanceBuffer(uint32_t currentImage);
+
+	//Write the bindless element of every material's texture to the frame's material buffer
+	void updateMaterialBuffer(uint32_t currentImage);
+
+	// Asset streaming
+
+	//Once per frame: collect the finished loads, request the textures of the visible instances, upload the loaded ones and swap in the acquired ones
+	void updateStreaming();
+
+	//Mark the textures of the instances in the frustum as used this frame and start loading the ones that aren't loaded
+	void requestVisibleTextures();
+
+	//Upload the loaded textures that fit in the budget (evicting the least recently used ones) and in the per-frame upload limit
+	void uploadStreamedTextures();
+
+	//The material of the texture goes back to the placeholder, the texture is destroyed once no frame in flight uses it
+	void evictTexture(uint32_t asset);
+
 	//Texture images
-	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VKAllocation& imageAllocation, uint32_t mipLevels = 1);
+	//Same as createImage but binds the image to imageAllocation when it fits there (memory type, size and alignment), otherwise imageAllocation is replaced with a new allocation
+	//The previous allocation is never freed, the caller frees it if it was replaced
+	//Lazily allocated memory is only used when properties asks for it and the image has a memory type with it
+	void createImageInAllocation(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VKAllocation& imageAllocation, uint32_t mipLevels = 1, VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT);
+	//The VkImage of createImage, without memory
+	VkImage createImageObject(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, uint32_t mipLevels, VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT);
 
 	// One time Command Buffer Recording
 
 	VkCommandBuffer beginSingleTimeCommands();
 	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 
+	//Same for the transfer queue, the submit signals the transfer timeline and returns the value it signals
+	VkCommandBuffer beginTransferCommands();
+	uint64_t endTransferCommands(VkCommandBuffer commandBuffer);
+
+	// Upload batch
+	//Between beginUploadBatch and submitUploadBatch copyBuffer, copyBufferToImage and the texture transitions don't submit anything,
+	//they are all recorded into one command buffer that is submitted once with one timeline value (returned by submitUploadBatch)
+	void beginUploadBatch();
+	uint64_t submitUploadBatch();
+
+	//Reserve staging ring space for an upload, an open batch is submitted early if it would fill the ring
+	VKStagingRegion allocateStagingRegion(VkDeviceSize size);
+
+	//Free the command buffers of the uploads the GPU already finished (wait: block until every upload is finished)
+	void retireUploads(bool wait);
+
 	// Image Layout Transition
 
-	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels = 1);
 
-	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+	//Hand an uploaded image (every level in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) to the graphics queue, which generates its mip chain when it acquires it
+	void releaseForMipmapGeneration(VkImage image, int32_t width, int32_t height, uint32_t mipLevels);
+
+	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, VkDeviceSize bufferOffset = 0, uint32_t mipLevel = 0);
 
 	// Sample an Image
 
-	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel = 0, uint32_t levelCount = 1);
 
 	// Depth Buffering 
 	//Takes a list of candidate formats in order from most desirable to least desirable, and checks which is the first one that is supported
 	VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
+	bool isFormatSupported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features);
 	VkFormat findDepthFormat();
 	bool hasStencilComponent(VkFormat format);
+
+	// Multisampling
+	//Highest sample count that is supported by both the color and depth framebuffers of the physical device
+	VkSampleCountFlagBits getMaxUsableSampleCount();
+	//Clamp the requested MSAA mode to the device and pick the depth resolve mode, once the physical device is picked
+	void selectMsaaMode();
 };
\ No newline at end of file
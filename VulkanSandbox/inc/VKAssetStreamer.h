@@ -0,0 +1,89 @@
+#pragma once
+
+#include "JobSystem.h"
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+//Where a streamed asset is, it goes from Unloaded to Resident and back to Unloaded when it is evicted
+enum class VKAssetState {
+	Unloaded,//Nothing loaded, the renderer uses a placeholder instead
+	Loading,//Its load job is queued or running on a streaming worker
+	Loaded,//Decoded in CPU memory, waiting for the main thread to upload it
+	Uploading,//Copied by the transfer queue, its device memory already counts against the budget
+	Resident,//Used by the frames
+	Failed//Its load job threw, it isn't loaded again
+};
+
+struct VKStreamedAsset {
+	VKAssetState state = VKAssetState::Unloaded;
+	uint64_t bytes = 0;//Device memory it takes from Uploading on
+	uint64_t lastUsedFrame = 0;
+	bool pinned = false;//Never evicted (e.g. the scene geometry)
+};
+
+//A load job that finished, error holds what it threw (nullptr if it succeeded)
+struct VKAssetLoadResult {
+	uint32_t asset;
+	std::exception_ptr error;
+};
+
+// Asset streamer
+/*
+* Loads assets in the background so the frames keep being rendered while files are read and decoded.
+* - load() runs the load job of an asset (read and decode into CPU memory) on one of the streaming workers, a job system of its own
+*   so a long decode never delays the jobs of the frame (command buffer recording)
+* - collectLoaded() hands the finished jobs to the main thread once per frame, which uploads the assets through the transfer queue
+*   and swaps the placeholders for them once they have been acquired
+* - Resident assets count their device memory against a budget. When an upload doesn't fit, selectEvictions() picks the least
+*   recently used assets to unload first; assets used in the current frame are never picked, so the budget can be exceeded by what is visible
+*
+* Everything but the load jobs runs on the main thread, the states are only read and written there.
+*/
+class VKAssetStreamer {
+public:
+	//budget in bytes of device memory for the assets that aren't pinned
+	void init(uint32_t workerCount, uint64_t budget);
+
+	//Drop the queued loads and wait for the running ones, nothing is collected after it
+	void shutdown();
+
+	uint32_t addAsset(bool pinned = false);
+
+	//Run job on a streaming worker, the asset is Loading until collectLoaded() returns it
+	void load(uint32_t asset, std::function<void()> job);
+
+	//Loads finished since the last call, their assets are now Loaded (or Failed)
+	std::vector<VKAssetLoadResult> collectLoaded();
+
+	void markUsed(uint32_t asset, uint64_t frame);
+
+	//bytes of device memory were allocated for the asset and its upload was submitted
+	void setUploading(uint32_t asset, uint64_t bytes);
+	void setResident(uint32_t asset);
+
+	//Evicted, its device memory no longer counts against the budget
+	void setUnloaded(uint32_t asset);
+
+	//Least recently used resident assets to evict so bytes more fit in the budget, none of them used in frame
+	//Returns false if evicting every candidate still isn't enough, evictions is then empty
+	bool selectEvictions(uint64_t bytes, uint64_t frame, std::vector<uint32_t>& evictions) const;
+
+	const VKStreamedAsset& getAsset(uint32_t asset) const { return assets[asset]; }
+	uint64_t getResidentBytes() const { return residentBytes; }
+	uint64_t getBudget() const { return budget; }
+
+private:
+	JobSystem workers;
+	std::vector<VKStreamedAsset> assets;
+
+	std::mutex mutex;//Protects finished, written by the workers
+	std::vector<VKAssetLoadResult> finished;
+	std::atomic<bool> stopping{ false };//Queued jobs return right away once it is set
+
+	uint64_t budget = 0;
+	uint64_t residentBytes = 0;//Uploading and resident assets that aren't pinned
+};
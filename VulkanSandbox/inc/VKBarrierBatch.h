@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Pipeline barrier batch
+/*
+* Collects the barriers of one synchronization point in their synchronization2 form, where every barrier carries its own stage masks, and records them with a single command.
+* - With synchronization2 (VK_KHR_synchronization2, core in 1.3) flush() records one vkCmdPipelineBarrier2 with the exact stages and accesses of every barrier
+*   (e.g. VK_PIPELINE_STAGE_2_COPY_BIT instead of the whole transfer stage, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT instead of any shader read)
+* - Without it flush() records one vkCmdPipelineBarrier: the masks are translated to the closest legacy ones and the stage masks of the barriers are merged,
+*   which is still correct but makes every barrier wait for all the source stages of the batch
+*
+* A stage mask of VK_PIPELINE_STAGE_2_NONE (e.g. the release of a queue family ownership transfer) becomes TOP_OF_PIPE or BOTTOM_OF_PIPE in the legacy call.
+* The lists are cleared but keep their storage, after the first frames recording a batch doesn't allocate.
+*/
+class VKBarrierBatch {
+public:
+	void init(bool synchronization2Enabled);
+
+	void addMemoryBarrier(const VkMemoryBarrier2& barrier);
+	void addBufferBarrier(const VkBufferMemoryBarrier2& barrier);
+	void addImageBarrier(const VkImageMemoryBarrier2& barrier);
+
+	bool isEmpty() const { return memoryBarriers.empty() && bufferBarriers.empty() && imageBarriers.empty(); }
+
+	//Record the barriers added since the last flush, nothing when there are none
+	void flush(VkCommandBuffer commandBuffer);
+
+	//Closest legacy masks: the stages and accesses that were split in synchronization2 are merged back (COPY and BLIT are TRANSFER, SHADER_STORAGE_READ is SHADER_READ...)
+	static VkPipelineStageFlags toLegacyStages(VkPipelineStageFlags2 stages);
+	static VkAccessFlags toLegacyAccesses(VkAccessFlags2 accesses);
+
+private:
+	bool synchronization2 = false;
+
+	std::vector<VkMemoryBarrier2> memoryBarriers;
+	std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+	std::vector<VkImageMemoryBarrier2> imageBarriers;
+
+	//Translated barriers of the legacy path
+	std::vector<VkMemoryBarrier> legacyMemoryBarriers;
+	std::vector<VkBufferMemoryBarrier> legacyBufferBarriers;
+	std::vector<VkImageMemoryBarrier> legacyImageBarriers;
+
+	void flushLegacy(VkCommandBuffer commandBuffer);
+};
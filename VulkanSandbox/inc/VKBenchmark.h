@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+struct VKBenchmarkSettings {
+	uint32_t frameCount = 1000;//Measured frames, after the warm-up
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	float timeStep = 1.0f / 60.0f;//Seconds of animation between two frames, frame i is rendered at i * timeStep whatever its real duration
+	uint32_t maxWarmupFrames = 100000;//The benchmark fails if the scene and its visible textures aren't resident after this many frames
+	std::string outputPath = "benchmark.json";
+	uint32_t msaaSamples = 0;//0 uses MSAA_SAMPLES, clamped to what the device supports
+	bool sampleRateShading = false;
+	bool dynamicRendering = true;//Falls back to the render pass when the device doesn't support it
+};
+
+//Distribution of per-frame times in milliseconds
+struct VKBenchmarkStats {
+	double mean = 0.0;
+	double p50 = 0.0;
+	double p90 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+
+	//Percentiles are nearest rank on the sorted samples
+	static VKBenchmarkStats compute(std::vector<double> samples);
+};
+
+// Benchmark report
+/*
+* Result of VKApplication::runBenchmark: the scene is rendered offscreen (no window, surface or swap chain) for a fixed number of frames
+* with a fixed time step, so two runs on the same GPU render the same images and can be compared.
+* - cpuFrameMs is the wall time of every drawFrame, it includes the wait for the frame in flight so it is the frame time the application sees
+* - gpuFrameMs is the sum of the timestamp scopes of the profiler, empty when the graphics queue doesn't support timestamps
+* - The memory is what the device memory allocator hands out and has allocated at the end of the run
+*/
+struct VKBenchmarkReport {
+	std::string deviceName;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t framesInFlight = 0;
+	uint32_t warmupFrames = 0;
+	uint32_t frameCount = 0;
+	uint32_t msaaSamples = 1;//Sample count actually used
+	bool sampleRateShading = false;
+	bool dynamicRendering = false;//Paths actually used
+	bool synchronization2 = false;
+
+	double totalSeconds = 0.0;
+	double framesPerSecond = 0.0;
+	VKBenchmarkStats cpuFrameMs;
+	VKBenchmarkStats gpuFrameMs;
+	bool gpuTimingsAvailable = false;
+
+	uint64_t deviceLocalUsedBytes = 0;
+	uint64_t deviceLocalAllocatedBytes = 0;
+	uint64_t hostUsedBytes = 0;
+	uint64_t hostAllocatedBytes = 0;
+	uint64_t streamedTextureBytes = 0;
+
+	//Returns false if the file can't be written
+	bool writeJson(const std::string& path) const;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <cstdint>
+
+// Deferred deletion queue
+/*
+* Releases objects the GPU may still use (evicted textures, the objects of a replaced swap chain) once the submits that could use them are done, without waiting for the device to be idle.
+* - push() queues the release of an object nothing will record commands with anymore
+* - submit(value) is called after a frame was submitted: what was pushed until then is now owned by the graphics timeline value of that submit
+* - flush(completedValue) releases every list whose value the graphics timeline has reached. A value is reached after every command submitted before it on the queue,
+*   so the frames that were in flight when the objects were pushed are done too
+*
+* What is pushed on a frame that returns before its submit (e.g. the swap chain is out of date) waits for the next submit, so it is never released early.
+* The lists are swapped instead of copied, their storage is reused from frame to frame.
+*/
+class VKDeletionQueue {
+public:
+	using Release = std::function<void()>;
+
+	void init();
+
+	void push(Release release);
+
+	void submit(uint64_t value);
+
+	void flush(uint64_t completedValue);
+
+	//Release everything, the device must be idle
+	void flushAll();
+
+private:
+	//Submitted lists, ordered by value
+	struct Submitted {
+		uint64_t value;
+		std::vector<Release> releases;
+	};
+
+	std::vector<Release> pending;
+	std::deque<Submitted> submitted;
+	//Released lists, kept for their storage
+	std::vector<std::vector<Release>> spare;
+
+	static void release(std::vector<Release>& releases);
+};
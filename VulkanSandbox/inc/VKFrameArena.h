@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <cstddef>
+
+// Frame arena
+/*
+* Linear allocator for the transient CPU data of a frame (draw lists, barrier batches, recording jobs), so drawFrame and recordCommandBuffer don't allocate from the heap.
+* - allocate() moves a position forward in a single block, reset() at the start of the next frame rewinds it; nothing is freed one by one
+* - A frame that needs more than the block takes the rest from overflow blocks on the heap, the next reset() replaces them and the block with one block
+*   big enough for that frame, so once the largest frame has been seen the arena never allocates again
+* - Only for trivially destructible types, nothing is destroyed on reset()
+*
+* Used from the main thread only: the jobs it submits can write to what it allocated, but don't allocate themselves.
+*/
+class VKFrameArena {
+public:
+	void init(size_t capacity);
+
+	//Everything allocated since the previous reset is released
+	void reset();
+
+	void* allocate(size_t size, size_t alignment);
+
+	//count value initialized elements (zeroed for the Vulkan structs)
+	template<typename T>
+	T* allocate(size_t count) {
+		static_assert(std::is_trivially_destructible<T>::value, "The frame arena never runs destructors");
+		T* data = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+		for (size_t i = 0; i < count; i++) {
+			new (data + i) T();
+		}
+		return data;
+	}
+
+	size_t getCapacity() const { return capacity; }
+
+private:
+	std::unique_ptr<char[]> block;
+	size_t capacity = 0;
+	size_t head = 0;
+
+	std::vector<std::unique_ptr<char[]>> overflowBlocks;
+	size_t overflowBytes = 0;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <array>
+#include <vector>
+#include <cstdint>
+
+//Queues the scheduler submits to, each one has its own timeline
+enum class VKQueue {
+	Graphics,
+	Transfer,
+	Count
+};
+
+// Frame scheduler
+/*
+* Every submit of the application goes through the scheduler, which owns one timeline semaphore per queue instead of a fence per frame in flight and per upload.
+* - A submit signals the next value of its queue's timeline: the value names the submit, and value N reached means every submit up to the Nth on that queue is done
+* - Submits depend on each other by waiting on a (queue, value) pair before being submitted: the frame waits on the transfer value of the uploads it acquires,
+*   a second graphics submit of the same frame could wait on the value of the first one. Waits and binary semaphores (swap chain acquire and present,
+*   which can't use timelines) are added with waitFor/waitForBinary/signalBinary and consumed by the next submit()
+* - A frame is the graphics submits made between two endFrame() calls, it is retired once the value of its last one is reached.
+*   isFrameRetired/waitForFrame answer "is frame N done?" for any frame still in the history, without the caller keeping fences around
+* - isRetired/wait do the same for a single submit, the staging ring, the upload command buffers and the deletion queue are driven by those values
+*
+* The completed values are cached and only read from the device (vkGetSemaphoreCounterValue) when a query asks for a value that isn't reached yet,
+* blocking waits use vkWaitSemaphores. Timelines are core in Vulkan 1.2, the device must enable the timelineSemaphore feature.
+*/
+class VKFrameScheduler {
+public:
+	//Queues the timelines are signaled on, graphics and transfer can be the same queue
+	void init(VkDevice logicalDevice, VkQueue graphicsQueue, VkQueue transferQueue);
+
+	void destroy();
+
+	VkSemaphore getTimeline(VKQueue queue) const { return queues[static_cast<size_t>(queue)].timeline; }
+
+	// Submits
+
+	//The next submit waits until queue has reached value at stageMask, value 0 is nothing to wait for
+	void waitFor(VKQueue queue, uint64_t value, VkPipelineStageFlags stageMask);
+	void waitForBinary(VkSemaphore semaphore, VkPipelineStageFlags stageMask);
+	void signalBinary(VkSemaphore semaphore);
+
+	//Submit commandBuffers to queue with the waits and binary signals added since the last submit, returns the timeline value it signals
+	uint64_t submit(VKQueue queue, const VkCommandBuffer* commandBuffers, uint32_t commandBufferCount);
+
+	//Value signaled by the last submit to queue, and the one the next submit will signal
+	uint64_t getSubmittedValue(VKQueue queue) const { return queues[static_cast<size_t>(queue)].submittedValue; }
+	uint64_t getNextValue(VKQueue queue) const { return getSubmittedValue(queue) + 1; }
+
+	//Value reached by the GPU, read from the device
+	uint64_t getCompletedValue(VKQueue queue);
+
+	//The submit that signals value is done, doesn't block
+	bool isRetired(VKQueue queue, uint64_t value);
+
+	//Block until the submit that signals value is done
+	void wait(VKQueue queue, uint64_t value);
+
+	//Block until every submit to any queue is done
+	void waitIdle();
+
+	// Frames
+
+	//frame is done with its graphics submits, it is retired once the last of them is
+	void endFrame(uint64_t frame);
+
+	//Frames that were never submitted aren't retired, frames older than the history are once the oldest one in it is
+	bool isFrameRetired(uint64_t frame);
+
+	//Block until frame is retired, frame must have been submitted
+	void waitForFrame(uint64_t frame);
+
+private:
+	//Frames remembered by isFrameRetired, more than any number of frames in flight
+	static const uint32_t FRAME_HISTORY = 16;
+
+	struct Queue {
+		VkQueue queue = VK_NULL_HANDLE;
+		VkSemaphore timeline = VK_NULL_HANDLE;
+		uint64_t submittedValue = 0;
+		uint64_t completedValue = 0;//Last value read from the device
+	};
+
+	struct FrameRecord {
+		uint64_t frame = UINT64_MAX;//UINT64_MAX while the record is unused
+		uint64_t graphicsValue = 0;
+	};
+
+	VkDevice logicalDevice = VK_NULL_HANDLE;
+	std::array<Queue, static_cast<size_t>(VKQueue::Count)> queues;
+	std::array<FrameRecord, FRAME_HISTORY> frames;
+	uint64_t lastFrame = UINT64_MAX;//Last frame passed to endFrame
+
+	//Waits and signals of the next submit, the value of a binary semaphore is ignored
+	std::vector<VkSemaphore> waitSemaphores;
+	std::vector<uint64_t> waitValues;
+	std::vector<VkPipelineStageFlags> waitStages;
+	std::vector<VkSemaphore> signalSemaphores;
+	std::vector<uint64_t> signalValues;
+
+	//Graphics value frame is retired at, false if it was never submitted
+	bool findFrame(uint64_t frame, uint64_t& graphicsValue) const;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "VKMappedFile.h"
+#include "VKTextureBaker.h"
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+//KTX2 file header, followed by the level index (one VKKtx2Level per mip level)
+struct VKKtx2Header {
+	uint8_t identifier[12];//0xAB "KTX 20" 0xBB \r \n 0x1A \n
+	uint32_t vkFormat;//The VkFormat of the texels, KTX2 uses the Vulkan enumeration
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;//0 for 2D textures
+	uint32_t layerCount;//0 if it isn't an array
+	uint32_t faceCount;//6 for cube maps
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;//0: the levels are stored as they are uploaded
+	uint32_t dfdByteOffset;//Data format descriptor
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;//Key/value data
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;//Supercompression global data
+	uint64_t sgdByteLength;
+};
+
+struct VKKtx2Level {
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+// KTX2 texture file
+/*
+* KTX2 is the Khronos container for GPU textures: the texels are stored in the VkFormat they are uploaded with (e.g. BC7 or ASTC blocks) and the file holds every mip level.
+* Loading one is mapping the file and copying each level to the staging ring, there is nothing to decode on the CPU.
+*
+* Only what the renderer uploads is supported: 2D textures without layers or faces, and without supercompression (Basis Universal or Zstandard files have to be transcoded first).
+* write() creates the files of the texture cache (RGBA8 or BC7 levels) with the key/value entries given to it.
+*/
+class VKKtx2File {
+public:
+	//Map the file at path, returns false if it doesn't exist or isn't a KTX2 file the renderer can upload
+	bool open(const std::string& path);
+
+	void close() { file.close(); header = nullptr; }
+
+	//Only valid while the file is open
+	VkFormat getFormat() const { return static_cast<VkFormat>(header->vkFormat); }
+	uint32_t getWidth() const { return header->pixelWidth; }
+	uint32_t getHeight() const { return header->pixelHeight; }
+	uint32_t getLevelCount() const { return std::max(header->levelCount, 1u); }
+	const char* getLevelData(uint32_t level) const;
+	size_t getLevelSize(uint32_t level) const;
+
+	//Value of a key/value entry, empty if the file doesn't have it
+	std::string getValue(const std::string& key) const;
+
+	//Levels from the largest to the smallest, a failure is reported but not fatal (the texture is baked again next run)
+	static bool write(const std::string& path, VkFormat format, const std::vector<VKTextureLevel>& levels, const std::vector<std::pair<std::string, std::string>>& keyValues);
+
+private:
+	VKMappedFile file;
+	const VKKtx2Header* header = nullptr;
+
+	const VKKtx2Level* getLevelIndex() const { return reinterpret_cast<const VKKtx2Level*>(file.data() + sizeof(VKKtx2Header)); }
+
+	//Mip levels of a full chain for this size
+	static uint32_t getMaxLevelCount(uint32_t width, uint32_t height);
+	//Texel block footprint and bytes of the formats the renderer can load, false for the others
+	static bool getBlockFormat(VkFormat format, uint32_t& blockWidth, uint32_t& blockHeight, uint32_t& blockBytes);
+
+	//Data format descriptor of the formats write() supports, empty for the others
+	static std::vector<uint32_t> buildDataFormatDescriptor(VkFormat format);
+};
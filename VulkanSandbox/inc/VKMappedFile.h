@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Read-only memory mapped file
+/*
+* The file is mapped into the address space of the process instead of being read into a buffer: the OS pages it in when it is touched, straight from its file cache.
+* Copying from the mapping into a staging buffer is the only copy the data goes through, and a file that was read recently doesn't touch the disk at all.
+*
+* Uses CreateFileMapping/MapViewOfFile on Windows and mmap everywhere else.
+*/
+class VKMappedFile {
+public:
+	VKMappedFile() = default;
+	~VKMappedFile() { close(); }
+
+	//The mapping is owned by one object only
+	VKMappedFile(const VKMappedFile&) = delete;
+	VKMappedFile& operator=(const VKMappedFile&) = delete;
+
+	//Returns false if the file doesn't exist, is empty or can't be mapped
+	bool open(const std::string& path);
+
+	void close();
+
+	bool isOpen() const { return mappedData != nullptr; }
+	const char* data() const { return mappedData; }
+	size_t size() const { return mappedSize; }
+
+	//Size and modification time of a file, both 0 if it doesn't exist
+	//The caches built from a source file (mesh cache, baked textures) store them to notice when the source changes
+	static void getStamp(const std::string& path, uint64_t& size, int64_t& time);
+
+private:
+	const char* mappedData = nullptr;
+	size_t mappedSize = 0;
+
+#ifdef _WIN32
+	//HANDLEs, kept as void* so windows.h isn't included by every file that includes this header
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+//Sub-allocated range of device memory
+//Instead of owning a VkDeviceMemory per resource, every buffer and image owns a range (offset, size) inside a larger block of memory
+struct VKAllocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;//Block the range lives in (bind the resource to this memory at offset)
+	VkDeviceSize offset = 0;//Offset of the range inside the block, already aligned to VkMemoryRequirements::alignment
+	VkDeviceSize size = 0;
+	void* mapped = nullptr;//CPU pointer to the start of the range (only for host visible memory, nullptr otherwise)
+	uint32_t memoryTypeIndex = 0;
+	uint32_t blockIndex = UINT32_MAX;//Block inside the allocator that owns the range
+};
+
+// Device memory allocator
+/*
+* The maximum number of simultaneous memory allocations is limited by the maxMemoryAllocationCount physical device limit, which may be as low as 4096 even on high end hardware like an NVIDIA GTX 1080.
+* The right way to allocate memory for a large number of objects at the same time is to create a custom allocator that splits up a single allocation among many different objects by using the offset parameters
+*
+* How it works:
+* - Memory is allocated from the driver in large blocks (one vkAllocateMemory per block), each block belongs to a single memory type
+* - Every block keeps a sorted list of free ranges. An allocation takes the first free range that fits (first fit) after aligning the offset to memRequirements.alignment
+* - Freeing a range puts it back in the free list and merges it with its neighbours to reduce fragmentation
+* - Buffers and linear images are kept in different blocks than optimal images, so we never have to care about bufferImageGranularity (linear and non linear resources must be separated by that amount when they are in the same memory)
+* - Host visible blocks are mapped once when they are created (persistent mapping), vkMapMemory can't be called twice on the same memory so resources can't map their own range
+* - Resources bigger than half a block get a dedicated block that is released as soon as the resource is freed
+*/
+class VKMemoryAllocator {
+public:
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkDeviceSize preferredBlockSize = 64ull * 1024 * 1024);
+
+	//Frees every block, all the resources bound to them must be destroyed before
+	void destroy();
+
+	//Reserve a range that fulfills memRequirements inside a block of memoryTypeIndex (picked with findMemoryType)
+	//linear: true for buffers and VK_IMAGE_TILING_LINEAR images, false for VK_IMAGE_TILING_OPTIMAL images
+	VKAllocation allocate(const VkMemoryRequirements& memRequirements, uint32_t memoryTypeIndex, bool linear);
+
+	//Give the range back to its block
+	void free(VKAllocation& allocation);
+
+	//Bytes currently handed out to resources and bytes allocated from the driver for a memory heap
+	VkDeviceSize getHeapUsage(uint32_t heapIndex) const;
+	VkDeviceSize getHeapAllocated(uint32_t heapIndex) const;
+
+	//Heaps and memory types of the physical device
+	const VkPhysicalDeviceMemoryProperties& getMemoryProperties() const { return memProperties; }
+
+	//Print per heap usage: used bytes, allocated bytes, heap size and number of blocks
+	void printHeapUsage() const;
+
+private:
+	//Free range inside a block
+	struct FreeRange {
+		VkDeviceSize offset;
+		VkDeviceSize size;
+	};
+
+	struct Block {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		VkDeviceSize used = 0;
+		uint32_t memoryTypeIndex = 0;
+		uint32_t allocationCount = 0;
+		bool linear = true;
+		bool dedicated = false;
+		void* mapped = nullptr;
+		std::vector<FreeRange> freeRanges;//Sorted by offset
+	};
+
+	VkDevice logicalDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memProperties{};
+	VkDeviceSize preferredBlockSize = 0;
+
+	//Released blocks leave an empty slot (memory == VK_NULL_HANDLE) so the block index stored in the allocations stays valid
+	std::vector<Block> blocks;
+
+	uint32_t createBlock(VkDeviceSize size, uint32_t memoryTypeIndex, bool linear, bool dedicated);
+	void releaseBlock(uint32_t blockIndex);
+	bool allocateFromBlock(uint32_t blockIndex, const VkMemoryRequirements& memRequirements, VKAllocation& allocation);
+
+	//Block size for a memory type, small heaps (like the 256MB device local + host visible heap) get smaller blocks
+	VkDeviceSize getBlockSize(uint32_t memoryTypeIndex) const;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "VKMappedFile.h"
+#include "VKScene.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//Bump when the layout of the file or of the vertex format changes, files with another version are rebuilt from the source model
+const uint32_t MESH_CACHE_VERSION = 6;//2: meshes are optimized (VKMeshOptimizer), 3: packed vertices and 16-bit indices, 4: materials, 5: levels of detail, 6: level of detail settings
+
+//Parameters of the levels of detail made by the import, the levels in a cache built with other ones would be served as they were
+struct VKMeshCacheLodSettings {
+	uint32_t maxLodCount;//MAX_MESH_LODS
+	float reduction;
+	uint32_t minTriangles;
+	float minGain;
+	float maxError;
+};
+
+//File header, followed by meshCount VKMeshCacheMesh, the vertex blob (vertexDataSize bytes), the index blob (indexDataSize bytes of indexType)
+//and the material blob (the texture path of every material, each one ending with a 0)
+struct VKMeshCacheHeader {
+	uint32_t magic;//MESH_CACHE_MAGIC
+	uint32_t version;
+	uint32_t vertexStride;//Size of the vertex format of the application that wrote it
+	uint32_t meshCount;
+	uint32_t indexType;//VkIndexType of the index blob
+	uint32_t materialCount;
+	uint32_t materialDataSize;
+	VKMeshCacheLodSettings lodSettings;
+	uint64_t sourceSize;//Size and modification time of the model the cache was built from
+	int64_t sourceTime;
+	uint64_t vertexDataSize;
+	uint64_t indexDataSize;
+};
+
+//Same content as VKSceneMeshLod with a fixed layout
+struct VKMeshCacheLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;
+	uint32_t padding;
+};
+
+//Same content as VKSceneMesh with a fixed layout, every blob after the table stays 16 byte aligned
+struct VKMeshCacheMesh {
+	int32_t vertexOffset;
+	uint32_t vertexCount;
+	uint32_t materialIndex;
+	uint32_t lodCount;
+	float boundingSphere[4];
+	float positionQuantization[4];
+	VKMeshCacheLod lods[MAX_MESH_LODS];//The first lodCount are used
+};
+
+// Binary mesh cache
+/*
+* Parsing an OBJ file and deduplicating its vertices takes most of the loading time of a model, and it gives the same result every run.
+* The first run writes the scene's geometry to a cache file exactly as it is uploaded: the vertex and index megabuffers and the mesh ranges inside them.
+* The next runs map the file and give its blobs to the scene, the upload copies them straight from the mapping into the staging ring.
+*
+* The cache is rebuilt when it doesn't match:
+* - MESH_CACHE_VERSION or the vertex stride changed (the vertex format is part of the file)
+* - The level of detail settings changed (the levels are part of the file)
+* - The source model's size or modification time changed
+* - The file is truncated (a crash while writing it)
+*/
+class VKMeshCache {
+public:
+	//Map the cache at path, returns false if it doesn't exist or wasn't built from sourcePath with this vertex format and these level of detail settings
+	bool open(const std::string& path, const std::string& sourcePath, uint32_t vertexStride, const VKMeshCacheLodSettings& lodSettings);
+
+	void close() { file.close(); header = nullptr; }
+
+	//Write the geometry and meshes of scene, a failure is reported but not fatal (the next run parses the model again)
+	static void write(const std::string& path, const std::string& sourcePath, const VKScene& scene, const VKMeshCacheLodSettings& lodSettings);
+
+	//Only valid while the cache is open
+	const VKMeshCacheMesh* getMeshes() const;
+	uint32_t getMeshCount() const { return header->meshCount; }
+	const char* getVertexData() const;
+	size_t getVertexDataSize() const { return static_cast<size_t>(header->vertexDataSize); }
+	const char* getIndexData() const;
+	size_t getIndexDataSize() const { return static_cast<size_t>(header->indexDataSize); }
+	VkIndexType getIndexType() const { return static_cast<VkIndexType>(header->indexType); }
+	//In the order of VKScene::getMaterials(), so the material indices of the meshes stay valid
+	std::vector<std::string> getMaterialTexturePaths() const;
+
+private:
+	VKMappedFile file;
+	const VKMeshCacheHeader* header = nullptr;
+
+	static const uint32_t MESH_CACHE_MAGIC = 0x434D4B56;//"VKMC"
+};
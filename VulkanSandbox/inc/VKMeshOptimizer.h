@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//Number of entries of the simulated post-transform cache, small enough to be a lower bound of what GPUs have
+const uint32_t VERTEX_CACHE_SIZE = 16;
+
+// Mesh optimizer
+/*
+* Reorders the triangles and vertices of an indexed triangle list, the mesh looks the same but draws faster:
+* - optimizeVertexCache(): the GPU keeps the outputs of the last vertex shader invocations in a small cache, triangles that reuse recent vertices don't shade them again.
+*   Tipsify (Sander, Nehab and Barczak, Fast Triangle Reordering for Vertex Locality and Reduced Overdraw, 2007) fans around a vertex until it is used up, then moves to a vertex still in the cache.
+* - optimizeOverdraw(): the vertex cache order is split in clusters that keep most of the cache hits, the clusters facing out from the center of the mesh are drawn first so they hide the ones behind them.
+* - optimizeVertexFetch(): vertices are stored in the order the index buffer first uses them, so vertex fetches go through memory mostly forward.
+* Call them in that order, every step keeps the gains of the previous ones.
+*
+* simplify() makes a version of the mesh with fewer triangles for the levels of detail, by collapsing the edges whose removal moves the surface the least (quadric error metrics).
+* It only writes new indices: a simplified mesh uses a subset of the vertices of the full one, so every level shares its vertex range.
+*
+* The vertex format isn't known, vertices are bytes with a stride and positions are 3 floats at positionOffset in every vertex.
+*
+* computeACMR() gives the average cache miss ratio: the number of vertex shader invocations per triangle with a FIFO cache of VERTEX_CACHE_SIZE entries.
+* 3 is the worst case, about 0.5 to 0.7 is the best a regular mesh can get.
+*/
+class VKMeshOptimizer {
+public:
+	//Reorder the triangles of indices in place
+	static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+	//Reorder the triangles of indices in place, it must already be sorted for the vertex cache
+	//threshold is how much worse than the vertex cache order the ACMR of a cluster can get (1.05: 5% more vertex shader invocations)
+	static void optimizeOverdraw(std::vector<uint32_t>& indices, const char* vertexData, size_t vertexStride, size_t positionOffset, size_t vertexCount, float threshold = 1.05f);
+
+	//Reorder the vertexCount vertices of vertexData in place in the order indices first use them and remap indices
+	//Returns the new vertex count, vertices that no triangle uses are dropped from the end
+	static size_t optimizeVertexFetch(void* vertexData, size_t vertexCount, size_t vertexStride, std::vector<uint32_t>& indices);
+
+	//Write to destination a simplified copy of indices with at most targetIndexCount indices, or more if reaching it would move the surface farther than targetError
+	//Vertices on a border or a seam (several vertices at the same position) are never moved. Returns the error of the result, about how far it is from the mesh in mesh units
+	static float simplify(std::vector<uint32_t>& destination, const std::vector<uint32_t>& indices, const char* vertexData, size_t vertexStride, size_t positionOffset, size_t vertexCount, size_t targetIndexCount, float targetError);
+
+	static float computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount);
+
+private:
+	//Tipsify, writes the first triangle of every run that starts after a dead end to clusters when it isn't null
+	static void tipsify(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>* clusters);
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+
+// Pipeline cache persisted on disk
+/*
+* Creating a pipeline compiles its shaders to the GPU's machine code, which is the slowest part of the startup.
+* A VkPipelineCache stores the result of those compilations, vkCreateGraphicsPipelines looks the pipeline up in the cache before compiling it again.
+* The content of a cache can be read with vkGetPipelineCacheData and given back as initial data the next time the application starts, so only the first run pays for the compilation.
+*
+* The data is only valid for the same driver and GPU, it starts with a header (VkPipelineCacheHeaderVersionOne) that we check before using the file:
+* - headerVersion must be VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+* - vendorID and deviceID must match the physical device
+* - pipelineCacheUUID must match VkPhysicalDeviceProperties::pipelineCacheUUID (it changes when the driver is updated)
+* If any of them doesn't match the file is ignored and the cache starts empty, it is overwritten when the application closes.
+*/
+class VKPipelineCache {
+public:
+	//Create the cache, loading path if it holds valid data for physicalDevice
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, const std::string& path);
+
+	//Write the cache content back to the file
+	void save() const;
+
+	void destroy();
+
+	//Pass it to every vkCreate*Pipelines call
+	VkPipelineCache get() const { return pipelineCache; }
+
+private:
+	VkDevice logicalDevice = VK_NULL_HANDLE;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	std::string path;
+
+	VkPhysicalDeviceProperties deviceProperties{};
+
+	//Check that data was created by the same driver and GPU
+	bool isCompatible(const char* data, size_t size) const;
+};
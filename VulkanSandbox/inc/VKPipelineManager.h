@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include "JobSystem.h"
+
+//Description of a pipeline permutation: the states createGraphicsPipeline used to hard code
+//Two descriptions with the same states have the same hash, which is the key to look the pipeline up at draw time
+struct VKPipelineDesc {
+	//SPIR-V files, a pipeline without fragment shader only writes depth (e.g. shadow pass)
+	std::string vertShader;
+	std::string fragShader;
+
+	//Vertex input
+	std::vector<VkVertexInputBindingDescription> bindings;
+	std::vector<VkVertexInputAttributeDescription> attributes;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	//Rasterizer
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;//VK_POLYGON_MODE_LINE needs the fillModeNonSolid feature
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	bool depthBiasEnable = false;
+	float depthBiasConstantFactor = 0.0f;
+	float depthBiasSlopeFactor = 0.0f;
+
+	//Multisampling
+	VkSampleCountFlagBits rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	bool sampleShadingEnable = false;//Needs the sampleRateShading feature
+	float minSampleShading = 1.0f;//Fraction of the samples shaded separately, 1.0 shades every sample
+
+	//Depth
+	bool depthTestEnable = true;
+	bool depthWriteEnable = true;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+
+	//Color blending (alpha blending when blendEnable is true)
+	bool blendEnable = false;
+	VkColorComponentFlags colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	//Attachment formats, only used when the pipeline is built without a render pass (dynamic rendering)
+	VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+	uint64_t hash() const;
+};
+
+// Pipeline manager
+/*
+* Owns every pipeline permutation (opaque, alpha, wireframe, shadow, ...).
+* - build() compiles a list of descriptions at load time, one job per pipeline spread across the worker threads of the job system
+* - All the workers create their pipelines through the same VkPipelineCache, so the compiled results end up in the single cache saved to disk
+* - get() finds a pipeline by the hash of its description, it never compiles anything so it is safe to call while recording a frame
+* - buildCompute() adds compute pipelines (e.g. culling) to the same map, keyed by their shader and layout
+* - prepareReload() rebuilds every pipeline using a shader with new SPIR-V (the hot reload calls it on its worker thread), applyReloads() swaps them in
+*   on the main thread between frames. The keys don't change, the code that looks the pipelines up doesn't know they were replaced
+* Shader modules are loaded once per SPIR-V file for a build and destroyed when every pipeline using them has been created.
+*/
+class VKPipelineManager {
+public:
+	//fillModeNonSolid: the device feature was enabled, otherwise wireframe descriptions fall back to VK_POLYGON_MODE_FILL
+	void init(VkDevice logicalDevice, VkPipelineCache pipelineCache, JobSystem* jobSystem, bool fillModeNonSolid);
+
+	//Create every description that isn't built yet and return their keys (same order as descs)
+	//renderPass is VK_NULL_HANDLE for dynamic rendering, the descriptions then give the attachment formats
+	std::vector<uint64_t> build(const std::vector<VKPipelineDesc>& descs, VkPipelineLayout layout, VkRenderPass renderPass);
+
+	//Create a compute pipeline on the calling thread, a compute pipeline only has its shader and layout so there is no description
+	uint64_t buildCompute(const std::string& compShader, VkPipelineLayout layout);
+
+	//Throws if the pipeline wasn't built, pipelines are never created on the hot path
+	VkPipeline get(uint64_t key) const;
+
+	//Create new versions of the pipelines using shader (a SPIR-V file name) from spirv, on the calling thread. Returns how many, throws if one fails
+	//The shader keeps this code for the pipelines built afterwards
+	uint32_t prepareReload(const std::string& shader, const std::vector<char>& spirv);
+
+	//Replace the pipelines prepared since the last call, on the main thread while no command buffer is recorded
+	//The replaced pipelines may still be used by the frames in flight, they are passed to retire instead of being destroyed
+	void applyReloads(const std::function<void(VkPipeline)>& retire);
+
+	void destroy();
+
+private:
+	struct PipelineEntry {
+		VkPipeline pipeline;
+		//What it was built from, to build it again when one of its shaders is reloaded
+		VKPipelineDesc desc;//Graphics pipelines
+		std::string compShader;//Compute pipelines, empty for graphics pipelines
+		VkPipelineLayout layout;
+		VkRenderPass renderPass;
+	};
+
+	VkDevice logicalDevice = VK_NULL_HANDLE;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	JobSystem* jobSystem = nullptr;
+	bool fillModeNonSolid = false;
+
+	//Only changed by the main thread, which holds the mutex while it does so the reload worker can read it
+	std::unordered_map<uint64_t, PipelineEntry> pipelines;
+
+	//Written by prepareReload, protected by the mutex
+	std::mutex mutex;
+	std::unordered_map<std::string, std::vector<char>> reloadedShaders;//Latest code of every reloaded shader
+	std::vector<std::pair<uint64_t, VkPipeline>> preparedReloads;
+	std::atomic<bool> hasPreparedReloads{ false };//Checked every frame without taking the mutex
+
+	VkPipeline createPipeline(const VKPipelineDesc& desc, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, VkPipelineLayout layout, VkRenderPass renderPass) const;
+	VkPipeline createComputePipeline(VkShaderModule compShaderModule, VkPipelineLayout layout) const;
+
+	//Shader modules
+
+	//To create the SPIR-V bytcode files the command is glslc shader.vert -o vert.spv glslc shader.frag -o frag.spv
+
+	//The readFile function will read all of the bytes from the specified file and return them in a byte array managed by std::vector (for the SPIR-V file)
+	static std::vector<char> readFile(const std::string& filename);
+
+	//Code of shader: the reloaded one, or the SPIR-V file
+	std::vector<char> loadShaderCode(const std::string& shader);
+
+	VkShaderModule createShaderModule(const std::vector<char>& code) const;
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <array>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+
+//CPU work of drawFrame
+enum class VKCpuScope {
+	FenceWait,//Waiting for the GPU to finish the frame that used the same objects
+	Acquire,
+	Update,//Uniform, instance and material buffers, streaming
+	Record,
+	Submit,
+	Present,
+	Count
+};
+
+//Passes of the frame's command buffer, a timestamp is written at the start of the frame and at the end of every pass
+enum class VKGpuScope {
+	Uploads,//Acquiring the transfer queue uploads, generating the mip chains of the new textures
+	Culling,
+	MainPass,
+	DepthPyramid,
+	Count
+};
+
+//Pipeline statistics of a frame, in the order of their VkQueryPipelineStatisticFlagBits (the results are written in bit order)
+enum class VKPipelineStatistic {
+	InputVertices,
+	InputPrimitives,
+	VertexInvocations,
+	ClippingInvocations,
+	ClippingPrimitives,
+	FragmentInvocations,
+	ComputeInvocations,
+	Count
+};
+
+struct VKProfilerFrame {
+	uint64_t frame = 0;
+	std::array<double, static_cast<size_t>(VKCpuScope::Count)> cpuMs{};
+	std::array<double, static_cast<size_t>(VKGpuScope::Count)> gpuMs{};//0 when the queue doesn't support timestamps
+	std::array<uint64_t, static_cast<size_t>(VKPipelineStatistic::Count)> statistics{};//0 when pipeline statistics aren't supported
+};
+
+// Frame profiler
+/*
+* Times the CPU side of drawFrame with a steady clock and the passes of the command buffer with timestamp queries, and counts the work of the frame with a pipeline statistics query.
+* - Every frame in flight has its own query pools. They are reset at the start of its command buffer and read right after the frame was waited on, when the results are
+*   already available, so reading them never stalls the CPU or the GPU
+* - A finished frame is written as a row of the CSV file (one column per scope and statistic, in milliseconds) and added to the averages returned by getSummary()
+*
+* The draws are recorded in secondary command buffers, so the statistics query is only used when the device can inherit it (inheritedQueries),
+* the secondary command buffers then have to be begun with getStatisticsFlags() in their inheritance info.
+*/
+class VKProfiler {
+public:
+	//queueFamily is the family the frames are submitted to, statisticsEnabled if pipelineStatisticsQuery and inheritedQueries were enabled on the device
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamily, uint32_t frameCount, bool statisticsEnabled, const std::string& csvPath);
+
+	void destroy();
+
+	// CPU
+
+	//Start the CPU timings of a new frame, the ones of a frame that wasn't submitted are dropped
+	void beginFrame(uint64_t frame);
+	void beginCpu(VKCpuScope scope);
+	void endCpu(VKCpuScope scope);
+
+	//The frame was submitted with the queries of slot, the frame in flight it used
+	void endFrame(uint32_t slot);
+
+	//Read the queries of slot, the frame that last used it must be retired
+	void collect(uint32_t slot);
+
+	//Read every slot, after vkDeviceWaitIdle (e.g. before the number of frames in flight changes)
+	void collectAll();
+
+	// GPU, recorded in the frame's primary command buffer outside of any render pass
+
+	//Reset the queries of slot, write the start timestamp and begin the statistics query
+	void beginGpuFrame(VkCommandBuffer commandBuffer, uint32_t slot);
+	//Timestamp written once every command before it has completed
+	void endGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, VKGpuScope scope);
+	void endGpuFrame(VkCommandBuffer commandBuffer, uint32_t slot);
+
+	//Statistics the secondary command buffers inherit, 0 when they aren't collected
+	VkQueryPipelineStatisticFlags getStatisticsFlags() const { return statisticsEnabled ? STATISTICS_FLAGS : 0; }
+
+	//Averages of the frames collected since the last call, returns false until summaryInterval has passed
+	bool getSummary(std::string& summary, double summaryInterval);
+
+	//Keep every collected frame in memory (for the benchmark report), off by default
+	void setKeepFrames(bool keep) { keepFrames = keep; }
+	const std::vector<VKProfilerFrame>& getFrames() const { return frames; }
+	bool hasTimestamps() const { return timestampsEnabled; }
+
+private:
+	static const VkQueryPipelineStatisticFlags STATISTICS_FLAGS;
+	static const char* const CPU_SCOPE_NAMES[];
+	static const char* const GPU_SCOPE_NAMES[];
+	static const char* const STATISTIC_NAMES[];
+
+	struct FrameSlot {
+		VkQueryPool timestampPool = VK_NULL_HANDLE;
+		VkQueryPool statisticsPool = VK_NULL_HANDLE;
+		VKProfilerFrame frame;//CPU timings of the frame submitted with the queries
+		bool pending = false;
+	};
+
+	VkDevice logicalDevice = VK_NULL_HANDLE;
+	std::vector<FrameSlot> slots;
+	bool timestampsEnabled = false;
+	bool statisticsEnabled = false;
+	double timestampPeriod = 1.0;//Nanoseconds per tick
+	uint64_t timestampMask = ~0ull;//Only timestampValidBits bits of a timestamp are meaningful
+
+	VKProfilerFrame currentFrame;
+	std::array<std::chrono::steady_clock::time_point, static_cast<size_t>(VKCpuScope::Count)> cpuStart{};
+
+	std::ofstream csv;
+
+	bool keepFrames = false;
+	std::vector<VKProfilerFrame> frames;
+
+	//Sums of the frames collected since the last summary
+	VKProfilerFrame summarySum;
+	uint32_t summaryFrameCount = 0;
+	std::chrono::steady_clock::time_point summaryStart;
+
+	void recordFrame(const VKProfilerFrame& frame);
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+//Levels of detail of a mesh at most, the culling shader reads the errors of the levels as a vec4
+const uint32_t MAX_MESH_LODS = 4;
+
+//Index range of a level of detail, every level of a mesh uses the same vertices
+struct VKSceneMeshLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;//How far the level can be from the full mesh in mesh space, 0 for level 0
+};
+
+//Range of a mesh inside the scene's megabuffers
+struct VKSceneMesh {
+	uint32_t lodCount;//At least 1
+	VKSceneMeshLod lods[MAX_MESH_LODS];//Level 0 is the full mesh, every next one has fewer triangles and a larger error
+	int32_t vertexOffset;//Added to every index of the mesh, its indices start at 0 like if it had its own vertex buffer
+	uint32_t vertexCount;
+	glm::vec4 boundingSphere;//Center (xyz) and radius (w) in mesh space, used for culling
+	glm::vec4 positionQuantization;//Stored positions p (0 to 1) are offset (xyz) + scale (w) * p in mesh space, (0, 0, 0, 1) for float positions
+	uint32_t materialIndex;//Into the materials of the scene
+};
+
+//What a mesh is shaded with, for now only the texture it samples
+struct VKSceneMaterial {
+	std::string texturePath;
+};
+
+//A mesh placed in the world
+struct VKSceneInstance {
+	uint32_t meshIndex;
+	uint32_t drawIndex;//Draw of the mesh, set by buildDraws()
+	glm::mat4 transform;
+};
+
+//Every level of detail of a mesh is a single instanced draw, the culling shader moves every visible instance to the draw of the level it picks
+struct VKSceneDraw {
+	uint32_t meshIndex;
+	uint32_t lod;
+	uint32_t firstInstance;//Where the visible instances of the draw start in the culled instance buffer
+	uint32_t instanceCount;//Instances of the mesh, every level has room for all of them
+};
+
+//Per-draw data read by the culling shader from a storage buffer (std430 layout)
+struct VKDrawData {
+	alignas(16) glm::vec4 boundingSphere;//Bounding sphere of the mesh
+	glm::vec4 positionQuantization;//Folded into the instance matrices written by the culling shader, so the vertex shader doesn't decode the positions
+	uint32_t materialIndex;//The culling shader looks up the texture of the material and copies it next to the matrix of every visible instance
+	uint32_t lodCount;//Levels of the mesh, the draws of the levels follow this one
+	uint32_t padding[2];
+	glm::vec4 lodErrors;//Error of every level in mesh space
+};
+
+//Per-instance data written by the CPU every frame and read by the culling shader (std430 layout)
+struct VKInstanceData {
+	alignas(16) glm::mat4 model;
+	uint32_t drawIndex;//Draw of level 0 of the mesh
+	uint32_t padding[3];
+};
+
+//Per-instance data written by the culling shader for the visible instances and read by the instance rate vertex binding (std430 layout)
+struct VKCulledInstanceData {
+	alignas(16) glm::mat4 model;
+	uint32_t textureIndex;//Element of the bindless texture array the fragments sample
+	uint32_t padding[3];
+};
+
+// Scene
+/*
+* Packs every mesh into one vertex and one index "megabuffer", so all the draws share the same vertex and index buffer bindings.
+* - addMaterial() adds the material of some meshes, addMesh() appends the vertices and indices of a mesh and returns its index
+* - addInstance() places a copy of a mesh with its own transform
+* - addMeshLod() adds a simplified level of detail to a mesh, its indices go to the index megabuffer and it uses the vertices of the mesh
+* - buildDraws() groups the instances by mesh, each level of a mesh with instances becomes one instanced draw
+* - buildDrawCommands() creates the VkDrawIndexedIndirectCommand of every draw, and buildDrawData() the matching per-draw data
+*
+* The draw commands live in a GPU buffer and the whole scene is issued with a single vkCmdDrawIndexedIndirect, so the CPU cost of recording doesn't depend on the number of instances.
+* A draw reads its transforms from an instance rate vertex binding: instance i of the draw fetches element firstInstance + i, so the instances of a draw must be contiguous.
+* The level of an instance is picked on the GPU every frame, so every level of a mesh gets room for all the instances of the mesh in the culled instance buffer.
+*
+* The scene doesn't know the vertex format, vertices are stored as bytes with the stride given to init().
+* Every material streams in its own texture, so the materials are deduplicated by texture: two materials never load the same texture twice.
+* Indices are added as 32-bit, selectIndexType() switches the whole index megabuffer to 16-bit when every mesh is small enough.
+* The geometry can also come already packed (e.g. from a memory mapped mesh cache) with setGeometry(), it isn't copied and must stay valid until it has been uploaded.
+*/
+class VKScene {
+public:
+	void init(uint32_t vertexStride);
+
+	//Returns the index of the material with this texture, adding it if the scene doesn't have one yet
+	uint32_t addMaterial(const std::string& texturePath);
+
+	//indexData is relative to the first vertex of the mesh, boundingSphere encloses every vertex (center xyz, radius w)
+	//positionQuantization describes how the vertex format stores the positions (see VKSceneMesh), materialIndex must have been returned by addMaterial()
+	uint32_t addMesh(const void* vertexData, uint32_t vertexCount, const uint32_t* indexData, uint32_t indexCount, const glm::vec4& boundingSphere, const glm::vec4& positionQuantization = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), uint32_t materialIndex = 0);
+	//indexData is relative to the first vertex of the mesh like the one of addMesh(), levels are added from the most detailed to the least
+	void addMeshLod(uint32_t meshIndex, const uint32_t* indexData, uint32_t indexCount, float error);
+
+	//Call once every mesh has been added, uses 16-bit indices if every mesh has less than 65536 vertices
+	//The indices are relative to the first vertex of their mesh, so the size of the whole scene doesn't matter
+	void selectIndexType();
+
+	//Use megabuffers that already hold every mesh instead of adding them one by one, the meshes are then ranges of them added with addMesh(mesh)
+	void setGeometry(const char* vertexData, size_t vertexDataSize, const char* indexData, size_t indexDataSize, VkIndexType indexType);
+	uint32_t addMesh(const VKSceneMesh& mesh);
+
+	//The geometry isn't needed on the CPU once it has been copied to the staging ring
+	void releaseGeometry();
+
+	void addInstance(uint32_t meshIndex, const glm::mat4& transform);
+
+	//Call once every instance has been added, reorders the instances so the ones of each mesh are contiguous
+	void buildDraws();
+
+	//Same order as the draws, command i draws every instance of draw i
+	std::vector<VkDrawIndexedIndirectCommand> buildDrawCommands() const;
+	std::vector<VKDrawData> buildDrawData() const;
+
+	const char* getVertexData() const { return externalVertexData ? externalVertexData : vertexData.data(); }
+	size_t getVertexDataSize() const { return externalVertexData ? externalVertexDataSize : vertexData.size(); }
+	const char* getIndexData() const;
+	size_t getIndexDataSize() const;
+	uint32_t getIndexCount() const { return static_cast<uint32_t>(getIndexDataSize() / (indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t))); }
+	//Kept by releaseGeometry(), the index buffer is bound with it
+	VkIndexType getIndexType() const { return indexType; }
+	uint32_t getVertexStride() const { return vertexStride; }
+	uint32_t getDrawCount() const { return static_cast<uint32_t>(draws.size()); }
+	uint32_t getInstanceCount() const { return static_cast<uint32_t>(instances.size()); }
+	//Elements of the culled instance buffer, the room of every draw
+	uint32_t getCulledInstanceCount() const { return culledInstanceCount; }
+	const std::vector<VKSceneMesh>& getMeshes() const { return meshes; }
+	const std::vector<VKSceneMaterial>& getMaterials() const { return materials; }
+	const std::vector<VKSceneInstance>& getInstances() const { return instances; }
+
+private:
+	uint32_t vertexStride = 0;
+
+	//Megabuffers content
+	std::vector<char> vertexData;
+	std::vector<uint32_t> indexData;
+	std::vector<uint16_t> shortIndexData;//Replaces indexData when indexType is VK_INDEX_TYPE_UINT16
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+	//Set by setGeometry(), owned by the caller
+	const char* externalVertexData = nullptr;
+	size_t externalVertexDataSize = 0;
+	const char* externalIndexData = nullptr;
+	size_t externalIndexDataSize = 0;
+
+	std::vector<VKSceneMaterial> materials;
+	std::vector<VKSceneMesh> meshes;
+	std::vector<VKSceneInstance> instances;
+	std::vector<VKSceneDraw> draws;
+	uint32_t culledInstanceCount = 0;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Shader compiler
+/*
+* Compiles GLSL files to SPIR-V at runtime with shaderc, the library glslc is built on, and keeps every result in a disk cache.
+* - The stage comes from the extension of the file (.vert, .frag, .comp), the defines are NAME or NAME=VALUE
+* - The cache file of a compilation is named after the hash of the source, the defines and the stage, so a source that goes back to
+*   an earlier version (or a define set that was already compiled) is read from the cache instead of compiled again
+* - Compilation errors are returned in log, they are never fatal: the caller keeps using the SPIR-V it had
+*
+* shaderc is optional, it is only used when the application is built with VKSANDBOX_SHADERC (CMake defines it when it finds the package).
+* Without it isAvailable() is false and compile() always fails, the precompiled SPIR-V files are used instead.
+*/
+class VKShaderCompiler {
+public:
+	void init(const std::string& cacheDir);
+
+	static bool isAvailable();
+
+	//Compile sourcePath, false if it can't be read or doesn't compile (the reason is in log)
+	bool compile(const std::string& sourcePath, const std::vector<std::string>& defines, std::vector<char>& spirv, std::string& log);
+
+private:
+	//Part of the cache key, changed when the compile options change so older cache files aren't used
+	static const uint32_t CACHE_VERSION = 1;
+
+	std::string cacheDir;
+
+	static uint64_t hashSource(const std::string& source, const std::vector<std::string>& defines, const std::string& extension);
+	std::string getCachePath(uint64_t key) const;
+
+	static bool readFile(const std::string& path, std::vector<char>& contents);
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "VKShaderCompiler.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <filesystem>
+
+//GLSL file watched by the hot reload
+struct VKShaderSource {
+	std::string source;
+	std::string spirv;//SPIR-V file the pipelines were built from, the name the pipeline manager knows the shader by
+	std::vector<std::string> defines;//NAME or NAME=VALUE
+};
+
+// Shader hot reload
+/*
+* Watches the GLSL sources of the pipelines and recompiles them in the background when they are saved, so a shader change shows up without restarting.
+* - A worker thread of its own checks the write time of every source each pollInterval seconds, nothing runs on the thread that renders
+* - A changed source is compiled with the VKShaderCompiler (through its disk cache) and the SPIR-V is handed to onCompiled, still on the worker:
+*   the callback rebuilds the pipelines using the shader there, and they are swapped in by the main thread between frames
+* - A source that doesn't compile is reported on std::cerr and the pipelines keep the code they had
+*
+* The sources aren't compiled at startup, the pipelines are built from the precompiled SPIR-V files and only the files edited afterwards are reloaded.
+*/
+class VKShaderHotReload {
+public:
+	using Compiled = std::function<void(const VKShaderSource& shader, const std::vector<char>& spirv)>;
+
+	//Start watching sources, returns false (and starts nothing) when shaderc isn't available
+	bool init(const std::vector<VKShaderSource>& sources, const std::string& cacheDir, double pollInterval, Compiled onCompiled);
+
+	//Joins the worker if shutdown wasn't called, a joinable std::thread can't be destroyed
+	~VKShaderHotReload() { shutdown(); }
+
+	//Stop watching, a compilation or pipeline rebuild that is running finishes first
+	void shutdown();
+
+private:
+	struct WatchedSource {
+		VKShaderSource shader;
+		std::filesystem::file_time_type writeTime;//Of the version the pipelines use, the minimum while the file doesn't exist
+	};
+
+	std::vector<WatchedSource> watched;//Only used by the worker once it started
+	VKShaderCompiler compiler;
+	Compiled onCompiled;
+	double pollInterval = 0.25;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;//Signaled by shutdown, so the worker doesn't finish its sleep
+	bool stopping = false;
+
+	void workerLoop();
+
+	//Compile the changed sources and hand them over
+	void poll();
+};
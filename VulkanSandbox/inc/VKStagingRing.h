@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+
+//Range of the staging ring reserved for one upload
+struct VKStagingRegion {
+	VkBuffer buffer = VK_NULL_HANDLE;//Source buffer for vkCmdCopyBuffer/vkCmdCopyBufferToImage
+	VkDeviceSize offset = 0;//srcOffset/bufferOffset of the copy
+	void* mapped = nullptr;//CPU pointer to write the data to
+};
+
+// Staging ring buffer
+/*
+* Instead of creating, mapping and destroying a staging buffer for every upload, a single host visible buffer is created once, mapped persistently and reused for every upload.
+* The buffer is used as a ring (circular buffer):
+* - allocate() hands out the next free range after the head, wrapping around to the start of the buffer when the end is reached
+* - markSubmitted(value) closes every range handed out since the previous call and ties them to the timeline value of the submit that reads them
+* - Once the GPU reaches that value the ranges are free again and the tail moves forward (reclaim)
+* - If the ring is full, allocate() blocks on the oldest value instead of allocating more memory
+*
+* This way several uploads can write into the ring, be copied with a single submit and share a single timeline value.
+*/
+class VKStagingRing {
+public:
+	//buffer and mapped come from a host visible, coherent, VK_BUFFER_USAGE_TRANSFER_SRC_BIT buffer; the ring doesn't own them
+	//timeline is the timeline semaphore of the queue the ranges are read by
+	void init(VkDevice logicalDevice, VkBuffer buffer, void* mapped, VkDeviceSize size, VkSemaphore timeline);
+
+	//Reserve size bytes aligned to alignment (must be a power of two)
+	VKStagingRegion allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+	//Every range allocated since the last call is read by the submit that signals value on the timeline
+	void markSubmitted(uint64_t value);
+
+	//Free the ranges whose value is already reached, doesn't block
+	void reclaim();
+
+	//Block until every submitted range is free
+	void waitIdle();
+
+	VkDeviceSize getCapacity() const { return capacity; }
+
+	//Bytes allocated since the last markSubmitted, they can't be reclaimed until they are submitted
+	VkDeviceSize getOpenBytes() const { return openBytes; }
+
+private:
+	//Ranges closed by markSubmitted, from the previous region end to end
+	struct SubmittedRegion {
+		uint64_t value;
+		VkDeviceSize end;//Tail position once the region is free
+		VkDeviceSize bytes;//Bytes used by the region, including padding and space skipped when wrapping around
+	};
+
+	VkDevice logicalDevice = VK_NULL_HANDLE;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkSemaphore timeline = VK_NULL_HANDLE;
+	char* mapped = nullptr;
+	VkDeviceSize capacity = 0;
+
+	VkDeviceSize head = 0;//Next write position
+	VkDeviceSize tail = 0;//Start of the oldest range still in use
+	VkDeviceSize used = 0;//Bytes between tail and head (head == tail is ambiguous without it)
+	VkDeviceSize openBytes = 0;//Bytes allocated since the last markSubmitted
+
+	std::deque<SubmittedRegion> submittedRegions;
+
+	//Pop the oldest submitted region and move the tail after it
+	void retireOldest();
+
+	//Block until the timeline reaches value
+	void waitForValue(uint64_t value);
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+//Bump when the baked textures change (encoder or mip generation), the texture cache is then baked again
+const uint32_t TEXTURE_BAKE_VERSION = 1;
+
+//A mip level of a texture, RGBA8 texels or compressed blocks depending on the format it belongs to
+struct VKTextureLevel {
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint8_t> data;
+};
+
+// Texture baker
+/*
+* Turns the decoded pixels of an image into what the GPU samples best: a full mip chain of block compressed levels.
+* A block compressed format stores every 4x4 texels in a fixed size block that the texture units decode on the fly, the texture stays compressed in VRAM and in the caches.
+*
+* BC7 (16 bytes per block, 1 byte per texel instead of 4 for RGBA8) is encoded with mode 6 only: one pair of RGBA endpoints and 16 interpolated colors per block.
+* The other modes (partitions, separate alpha) give better quality on blocks with several distinct colors, but mode 6 alone is far simpler and is already close to a real encoder on photos and painted textures.
+*
+* Baking is slow compared to loading, it is done once and its result saved (see VKKtx2File).
+*/
+class VKTextureBaker {
+public:
+	//Every level down to 1x1 from RGBA8 sRGB pixels, a texel of a level is the average of the 2x2 texels it covers in the level above
+	//The average is done in linear space, averaging the sRGB values directly makes the small levels darker
+	static std::vector<VKTextureLevel> buildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height);
+
+	//BC7 blocks of an RGBA8 level, encoded on the calling thread: bakes run on the streaming workers, several textures are baked at the same time
+	static VKTextureLevel compressBC7(const VKTextureLevel& level);
+
+private:
+	//Encode the rows of blocks [firstRow, lastRow) of level into compressed, which has the size of the whole level
+	static void compressBC7Rows(const VKTextureLevel& level, VKTextureLevel& compressed, uint32_t firstRow, uint32_t lastRow);
+
+	//texels in row order, block receives the 128 bits of the mode 6 block
+	static void encodeBC7Block(const uint8_t texels[16][4], uint8_t block[16]);
+};
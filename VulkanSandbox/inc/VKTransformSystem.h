@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Transform hierarchy
+/*
+* Local transforms (position, rotation, uniform scale) of every node stored as structure of arrays: one contiguous array per component,
+* so the local matrices of 4 nodes are built at once with SSE, one node per lane.
+* - A node's parent is always added before it, so one pass in index order updates every parent before its children
+* - set*() only marks the node dirty, update() rebuilds the world matrices of the dirty subtrees (a node whose parent changed is updated too)
+* - The local matrices aren't stored, they are built from the SoA arrays by groups of 4 when a group changes
+* - Every node remembers the update its world matrix last changed in, writeWorldMatrices() only copies the matrices that changed since the destination was last written
+*
+* The world matrix is parent world * local, the same as a glm::translate * glm::mat4_cast * glm::scale chain. The products use SSE (two columns at once when built with AVX),
+* without SSE the kernels fall back to scalar code.
+*/
+class VKTransformSystem {
+public:
+	static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+	//parent must already exist, returns the index of the node
+	uint32_t addNode(const glm::vec3& position, const glm::quat& rotation, float scale, uint32_t parent = NO_PARENT);
+
+	void clear();
+
+	void setPosition(uint32_t node, const glm::vec3& position);
+	void setRotation(uint32_t node, const glm::quat& rotation);
+	void setScale(uint32_t node, float scale);
+
+	//Rebuild the matrices of the dirty nodes and their subtrees, returns the number of world matrices that changed
+	uint32_t update();
+
+	const glm::mat4& getWorldMatrix(uint32_t node) const { return worldMatrices[node]; }
+	uint32_t getNodeCount() const { return nodeCount; }
+
+	//Copy the world matrices of the nodes [firstNode, firstNode + count) that changed after writtenVersion to dst, the one of firstNode + i at dst + i * stride
+	//writtenVersion is then the current version. Returns the number of matrices written
+	uint32_t writeWorldMatrices(void* dst, size_t stride, uint32_t firstNode, uint32_t count, uint64_t& writtenVersion) const;
+
+private:
+	uint32_t nodeCount = 0;
+	uint64_t version = 0;//Number of update() calls that changed something, 0 is "never written"
+	uint32_t firstDirty = NO_PARENT;//Lowest dirty node, NO_PARENT when update() has nothing to do
+
+	//SoA local transforms, padded to a multiple of 4 nodes with identity transforms so the SIMD kernels never need a tail
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scales;
+
+	std::vector<uint32_t> parents;
+	std::vector<uint8_t> dirty;//Local transform changed since the last update
+	std::vector<uint64_t> changedVersion;//Update its world matrix last changed in, the children of a node changed in this update are updated too
+
+	std::vector<glm::mat4> worldMatrices;
+
+	//Build the local matrices of the nodes [first, first + 4) into localMatrices[0..3]
+	void buildLocalMatrices4(uint32_t first, glm::mat4* localMatrices) const;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+// Uniform ring buffer
+/*
+* A single host visible uniform buffer, mapped persistently and split in one region per frame in flight, instead of one small buffer per frame.
+* - beginFrame(frame) rewinds the region of the frame, the frame that last used it must be retired
+* - push() copies the data after the previous push of the frame and returns its offset in the buffer, aligned to minUniformBufferOffsetAlignment
+* - The buffer is bound once with a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor, the offset is given as a dynamic offset to vkCmdBindDescriptorSets
+*
+* So the same descriptor set is used by every frame and every block of uniforms written in it, whatever the number of pushes.
+*/
+class VKUniformRing {
+public:
+	//buffer and mapped come from a host visible, coherent, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT buffer of getBufferSize() bytes; the ring doesn't own them
+	void init(VkBuffer buffer, void* mapped, VkDeviceSize frameSize, uint32_t frameCount, VkDeviceSize alignment);
+
+	//Size of the buffer for frameCount regions of frameSize bytes (rounded up to alignment, a power of two)
+	static VkDeviceSize getBufferSize(VkDeviceSize frameSize, uint32_t frameCount, VkDeviceSize alignment);
+
+	void beginFrame(uint32_t frame);
+
+	//Copy size bytes to the region of the current frame, returns the dynamic offset to bind them with
+	uint32_t push(const void* data, VkDeviceSize size);
+
+	template<typename T>
+	uint32_t push(const T& data) { return push(&data, sizeof(T)); }
+
+	VkBuffer getBuffer() const { return buffer; }
+
+private:
+	VkBuffer buffer = VK_NULL_HANDLE;
+	char* mapped = nullptr;
+	VkDeviceSize frameSize = 0;//Aligned, so every region starts aligned
+	uint32_t frameCount = 0;
+	VkDeviceSize alignment = 1;
+
+	VkDeviceSize frameStart = 0;//Region of the current frame
+	VkDeviceSize head = 0;//Next write position in the region
+};
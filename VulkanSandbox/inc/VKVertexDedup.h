@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+//64-bit finalizer of MurmurHash3, every input bit affects every output bit
+inline uint64_t hashMix(uint64_t value) {
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdull;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53ull;
+	value ^= value >> 33;
+	return value;
+}
+
+//Hash of raw bytes, 8 at a time, chain calls through seed to hash fields that aren't contiguous
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = seed ^ (size * 0x9e3779b97f4a7c15ull);
+	while (size >= sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, bytes, sizeof(word));
+		hash = hashMix(hash ^ word);
+		bytes += sizeof(word);
+		size -= sizeof(word);
+	}
+	if (size > 0) {
+		uint64_t word = 0;
+		memcpy(&word, bytes, size);
+		hash = hashMix(hash ^ word);
+	}
+	return hash;
+}
+
+// Vertex deduplication table
+/*
+* Flat open addressing hash table that maps a vertex to its index in a vertex array, used to build an index buffer out of unindexed triangles.
+* - The slots are a single array (no node per entry like std::unordered_map), probing walks neighbouring slots that are usually in the same cache line
+* - A slot holds the index of the vertex and the upper bits of its hash, most mismatches are rejected without reading the vertex
+* - insert() finds the vertex or the free slot to put it in with one probe sequence, instead of a count() followed by an operator[]
+*
+* VertexType provides the key with two static functions:
+* - uint64_t dedupHash(const VertexType& vertex)
+* - bool dedupEquals(const VertexType& a, const VertexType& b)
+* Both should look at the same raw bytes, two vertices can only be merged if they are identical.
+*/
+template<typename VertexType>
+class VKVertexDedup {
+public:
+	//expectedVertices is an upper bound of the number of unique vertices (e.g. the number of indices), it avoids growing the table
+	explicit VKVertexDedup(size_t expectedVertices) {
+		size_t capacity = 16;
+		//Keep the load factor under 1/2 so probe sequences stay short
+		while (capacity < expectedVertices * 2) {
+			capacity *= 2;
+		}
+		slots.assign(capacity, Slot{ EMPTY_SLOT, 0 });
+	}
+
+	//Index of vertex in vertices, appended to it if it isn't there yet
+	uint32_t insert(const VertexType& vertex, std::vector<VertexType>& vertices) {
+		if ((count + 1) * 2 > slots.size()) {
+			grow(vertices);
+		}
+
+		uint64_t hash = VertexType::dedupHash(vertex);
+		uint32_t tag = static_cast<uint32_t>(hash >> 32);
+		size_t mask = slots.size() - 1;
+
+		//Linear probing from the slot of the hash
+		for (size_t slot = static_cast<size_t>(hash) & mask;; slot = (slot + 1) & mask) {
+			Slot& entry = slots[slot];
+			if (entry.index == EMPTY_SLOT) {
+				entry.index = static_cast<uint32_t>(vertices.size());
+				entry.tag = tag;
+				vertices.push_back(vertex);
+				count++;
+				return entry.index;
+			}
+			if (entry.tag == tag && VertexType::dedupEquals(vertices[entry.index], vertex)) {
+				return entry.index;
+			}
+		}
+	}
+
+private:
+	struct Slot {
+		uint32_t index;
+		uint32_t tag;//Upper 32 bits of the hash, the lower bits pick the slot
+	};
+
+	static const uint32_t EMPTY_SLOT = UINT32_MAX;
+
+	std::vector<Slot> slots;
+	size_t count = 0;
+
+	//Double the capacity, every vertex is inserted again from the array
+	void grow(const std::vector<VertexType>& vertices) {
+		std::vector<Slot> oldSlots(slots.size() * 2, Slot{ EMPTY_SLOT, 0 });
+		slots.swap(oldSlots);
+		size_t mask = slots.size() - 1;
+
+		for (const Slot& oldEntry : oldSlots) {
+			if (oldEntry.index == EMPTY_SLOT) {
+				continue;
+			}
+			uint64_t hash = VertexType::dedupHash(vertices[oldEntry.index]);
+			size_t slot = static_cast<size_t>(hash) & mask;
+			while (slots[slot].index != EMPTY_SLOT) {
+				slot = (slot + 1) & mask;
+			}
+			slots[slot] = oldEntry;
+		}
+	}
+};
@@ -1,11 +1,15 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 //Descriptor
-layout(binding = 1) uniform sampler2D texSampler;
+//Bindless texture array (set 1), its size is chosen when the set is allocated
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
 //Vertex buffer
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 fragNormal;//World space, not used until there is lighting
+layout(location = 3) flat in uint fragTextureIndex;
 
 //Output
 layout(location = 0) out vec4 outColor;
@@ -13,6 +17,7 @@ layout(location = 0) out vec4 outColor;
 void main(){
 	//outColor = vec4(fragTexCoord, 0.0, 1.0);
 	//Texture is sampled: It takes a sampler and coordinate as arguments. The sampler automatically takes care of the filtering and transformations in the background.
-	outColor = texture(texSampler, fragTexCoord);
-	//outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, 1.0);
+	//The fragments packed in a subgroup can come from instances with different materials, nonuniformEXT makes the index valid even when it isn't the same for all of them
+	outColor = texture(textures[nonuniformEXT(fragTextureIndex)], fragTexCoord);
+	//outColor = vec4(fragColor * texture(textures[nonuniformEXT(fragTextureIndex)], fragTexCoord).rgb, 1.0);
 }
\ No newline at end of file
@@ -1,20 +1,40 @@
 #version 450
 
+//Shared by everything drawn in the frame, bound with the dynamic offset of the frame in the uniform ring
 layout(binding = 0) uniform UniformBufferObject {
-	mat4 model;
 	mat4 view;
 	mat4 proj;
+	vec4 frustumPlanes[6];
 } ubo;
 
+//Transform of the object drawn (ObjectPushConstants), applied on top of the model matrix of every instance
+layout(push_constant) uniform ObjectConstants {
+	mat4 model;
+} object;
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
+//Per-instance model matrix from the instance rate binding, a mat4 takes the locations 3 to 6
+layout(location = 3) in mat4 inModel;
+
+layout(location = 7) in vec3 inNormal;
+
+//Per-instance texture, the element of the bindless texture array its fragments sample (the placeholder while the material's texture streams in)
+layout(location = 8) in uint inTextureIndex;
+
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragNormal;
+//Integers can't be interpolated, every fragment gets the value of the provoking vertex
+layout(location = 3) flat out uint fragTextureIndex;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    gl_Position = ubo.proj * ubo.view * object.model * inModel * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord; // values will be smoothly interpolated across the area of the square by the rasterizer. We can visualize this by having the fragment shader output the texture coordinates as colors
+    //The instance transforms only rotate, translate and scale uniformly, so the normals don't need the inverse transpose
+    fragNormal = normalize(mat3(object.model * inModel) * inNormal);
+    fragTextureIndex = inTextureIndex;
 }
\ No newline at end of file
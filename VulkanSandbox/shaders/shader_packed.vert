@@ -0,0 +1,51 @@
+#version 450
+
+//Vertex shader of PackedVertex (USE_PACKED_VERTICES), same outputs as shader.vert
+
+//Shared by everything drawn in the frame, bound with the dynamic offset of the frame in the uniform ring
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 view;
+	mat4 proj;
+	vec4 frustumPlanes[6];
+} ubo;
+
+//Transform of the object drawn (ObjectPushConstants), applied on top of the model matrix of every instance
+layout(push_constant) uniform ObjectConstants {
+	mat4 model;
+} object;
+
+//Position inside the bounding cube of the mesh (0 to 1), inModel maps it back to mesh space
+layout(location = 0) in vec4 inPosition;
+layout(location = 2) in vec2 inTexCoord;
+
+//Per-instance model matrix from the instance rate binding, a mat4 takes the locations 3 to 6
+layout(location = 3) in mat4 inModel;
+
+//Octahedral encoded normal
+layout(location = 7) in vec2 inNormal;
+
+//Per-instance texture, the element of the bindless texture array its fragments sample (the placeholder while the material's texture streams in)
+layout(location = 8) in uint inTextureIndex;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragNormal;
+//Integers can't be interpolated, every fragment gets the value of the provoking vertex
+layout(location = 3) flat out uint fragTextureIndex;
+
+//Folds the corners of the square back onto the lower half of the octahedron and projects it onto the unit sphere
+vec3 decodeOctahedral(vec2 octahedral) {
+	vec3 normal = vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));
+	float fold = max(-normal.z, 0.0);
+	normal.xy += mix(vec2(fold), vec2(-fold), greaterThanEqual(normal.xy, vec2(0.0)));
+	return normalize(normal);
+}
+
+void main() {
+    gl_Position = ubo.proj * ubo.view * object.model * inModel * vec4(inPosition.xyz, 1.0);
+    fragColor = vec3(1.0);//PackedVertex has no color
+    fragTexCoord = inTexCoord;
+    //The quantization adds a uniform scale to inModel, normalize() removes it
+    fragNormal = normalize(mat3(object.model * inModel) * decodeOctahedral(inNormal));
+    fragTextureIndex = inTextureIndex;
+}
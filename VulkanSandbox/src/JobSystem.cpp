@@ -0,0 +1,88 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+void JobSystem::init(uint32_t workerCount){
+	if (workerCount == 0) {
+		//hardware_concurrency can return 0 when it is not known
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = std::max(1u, hardwareThreads > 1 ? hardwareThreads - 1 : 1u);
+	}
+
+	stopping = false;
+	for (uint32_t i = 0; i < workerCount; i++) {
+		workers.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+void JobSystem::shutdown(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+}
+
+void JobSystem::submit(Job job){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+		unfinishedJobs++;
+	}
+	jobAvailable.notify_one();
+}
+
+void JobSystem::wait(){
+	std::unique_lock<std::mutex> lock(mutex);
+	jobsDone.wait(lock, [this] { return unfinishedJobs == 0; });
+
+	if (firstException) {
+		std::exception_ptr exception = firstException;
+		firstException = nullptr;
+		std::rethrow_exception(exception);
+	}
+}
+
+void JobSystem::workerLoop(uint32_t workerIndex){
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this] { return stopping || nextJob < jobs.size(); });
+
+			//Only stop once the queue is empty, so shutdown never drops submitted jobs
+			if (nextJob == jobs.size()) {
+				return;
+			}
+
+			job = std::move(jobs[nextJob++]);
+			//Every job was taken, the next submit starts at the front again (clear keeps the capacity)
+			if (nextJob == jobs.size()) {
+				jobs.clear();
+				nextJob = 0;
+			}
+		}
+
+		try {
+			job(workerIndex);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!firstException) {
+				firstException = std::current_exception();
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			unfinishedJobs--;
+			if (unfinishedJobs == 0) {
+				jobsDone.notify_all();
+			}
+		}
+	}
+}
@@ -7,6 +7,9 @@
 #include <chrono>
 #include <unordered_map>
 #include <map>
+#include <limits>
+#include <cstring>
+#include <filesystem>
 //Load an image library
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -14,6 +17,13 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
+namespace {
+	//textures/robot.jpg with the suffix _bc7.ktx2 is textures/robot_bc7.ktx2
+	std::string replaceExtension(const std::string& path, const std::string& suffix) {
+		return std::filesystem::path(path).replace_extension().string() + suffix;
+	}
+}
+
 void VKApplication::run() {
 	initWindows();
 	initVulkan();
@@ -21,6 +31,88 @@ void VKApplication::run() {
 	cleanup();
 }
 
+void VKApplication::runBenchmark(const VKBenchmarkSettings& settings, VKBenchmarkReport& report){
+	headless = true;
+	benchmarkSettings = settings;
+	if (settings.msaaSamples > 0) {
+		requestedMsaaSamples = static_cast<VkSampleCountFlagBits>(settings.msaaSamples);
+	}
+	requestedSampleRateShading = settings.sampleRateShading;
+	requestedDynamicRendering = settings.dynamicRendering;
+	initVulkan();
+
+	//Warm-up: the model and its textures are streamed in while frames are rendered at time 0, the measurement starts once nothing is loading
+	//Which textures are visible doesn't depend on the spin, so nothing is requested during the measurement
+	uint32_t warmupFrames = 0;
+	while (!isStreamingIdle()) {
+		if (warmupFrames == settings.maxWarmupFrames) {
+			throw std::runtime_error("Failed to stream the scene in before the benchmark!");
+		}
+		drawFrame();
+		warmupFrames++;
+	}
+
+	//The warm-up frames are collected before the profiler starts keeping frames
+	vkDeviceWaitIdle(logicalDevice);
+	profiler.collectAll();
+	profiler.setKeepFrames(true);
+
+	std::vector<double> frameTimes;
+	frameTimes.reserve(settings.frameCount);
+	auto startTime = std::chrono::steady_clock::now();
+	for (replayFrame = 0; replayFrame < settings.frameCount; replayFrame++) {
+		auto frameStart = std::chrono::steady_clock::now();
+		drawFrame();
+		frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+	}
+	//The throughput includes the frames still in flight at the end
+	vkDeviceWaitIdle(logicalDevice);
+	double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	profiler.collectAll();
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	report.deviceName = deviceProperties.deviceName;
+	report.width = swapChainExtent.width;
+	report.height = swapChainExtent.height;
+	report.framesInFlight = getFramePacingProfile().framesInFlight;
+	report.msaaSamples = static_cast<uint32_t>(msaaSamples);
+	report.sampleRateShading = sampleRateShadingEnabled;
+	report.dynamicRendering = dynamicRenderingEnabled;
+	report.synchronization2 = synchronization2Enabled;
+	report.warmupFrames = warmupFrames;
+	report.frameCount = settings.frameCount;
+	report.totalSeconds = totalSeconds;
+	report.framesPerSecond = totalSeconds > 0.0 ? settings.frameCount / totalSeconds : 0.0;
+	report.cpuFrameMs = VKBenchmarkStats::compute(frameTimes);
+
+	report.gpuTimingsAvailable = profiler.hasTimestamps();
+	std::vector<double> gpuFrameTimes;
+	for (const VKProfilerFrame& frame : profiler.getFrames()) {
+		double gpuMs = 0.0;
+		for (double scopeMs : frame.gpuMs) {
+			gpuMs += scopeMs;
+		}
+		gpuFrameTimes.push_back(gpuMs);
+	}
+	report.gpuFrameMs = VKBenchmarkStats::compute(gpuFrameTimes);
+
+	const VkPhysicalDeviceMemoryProperties& memoryProperties = memoryAllocator.getMemoryProperties();
+	for (uint32_t heapIndex = 0; heapIndex < memoryProperties.memoryHeapCount; heapIndex++) {
+		if (memoryProperties.memoryHeaps[heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			report.deviceLocalUsedBytes += memoryAllocator.getHeapUsage(heapIndex);
+			report.deviceLocalAllocatedBytes += memoryAllocator.getHeapAllocated(heapIndex);
+		}
+		else {
+			report.hostUsedBytes += memoryAllocator.getHeapUsage(heapIndex);
+			report.hostAllocatedBytes += memoryAllocator.getHeapAllocated(heapIndex);
+		}
+	}
+	report.streamedTextureBytes = streamer.getResidentBytes();
+
+	cleanup();
+}
+
 void VKApplication::initWindows() {
 	glfwInit();
 	
@@ -33,32 +125,56 @@ void VKApplication::initWindows() {
 	glfwSetWindowUserPointer(window, this);
 	//Detect window resizes
 	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+	//Frame pacing profile switch
+	glfwSetKeyCallback(window, keyCallback);
 }
 
 void VKApplication::initVulkan() {
+	//Start the worker threads first, loading already uses them
+	jobSystem.init();
+
 	createInstance();
-	createSurface();
+	//Headless has no window to present to
+	if (!headless) {
+		createSurface();
+	}
 	pickPhysicalDevice();
 	createLogicalDevice();
-	createSwapChain();
+	createMemoryAllocator();
+	if (headless) {
+		createOffscreenImages();
+	}
+	else {
+		createSwapChain();
+	}
 	createImageViews();
 	createRenderPass();
 	createDescriptorSetLayout();
+	createPipelineCache();
 	createGraphicsPipeline();
+	createComputePipelines();
+	createShaderHotReload();
 	createCommandPool();
+	createFrameScheduler();
+	createStagingRing();
+	createColorResources();
 	createDepthResources();
+	createDepthPyramid();
 	createFramebuffers();
-	createTextureImage();
-	createTextureImageView();
 	createTextureSampler();
-	loadModel();
-	createVertexBuffer();
-	createIndexBuffer();
+	//The only texture uploaded here, the model and its textures are streamed in while the first frames are rendered
+	createPlaceholderTexture();
 	createUniformBuffers();
 	createDescriptorPool();
 	createDescriptorSets();
+	createComputeDescriptorSets();
 	createCommandBuffers();
+	createWorkerCommandPools();
 	createSyncObjects();
+	createProfiler();
+
+	//Nothing is waited on here: the model is loaded on a streaming worker, its uploads run on the transfer queue and it shows up once they are done
+	startSceneLoad();
 }
 
 void VKApplication::mainLoop() {
@@ -74,49 +190,117 @@ void VKApplication::mainLoop() {
 }
 
 void VKApplication::cleanup() {
+	//The load jobs write to the scene and the streamed textures, they have to be done before anything is destroyed
+	streamer.shutdown();
+	//Same for a pipeline rebuild of the hot reload
+	shaderHotReload.shutdown();
+
 	cleanupSwapChain();
+	//The device is idle: the retired swap chains and the evicted textures can all be destroyed
+	deletionQueue.flushAll();
 
-	vkDestroyPipeline(logicalDevice, graphicsPipeline, nullptr);
+	pipelineManager.destroy();
 	vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+
+	//Write the compiled pipelines back to disk for the next run
+	pipelineCache.save();
+	pipelineCache.destroy();
+
+	//The device is idle, the last frames in flight can be read and exported
+	profiler.collectAll();
+	profiler.destroy();
 	vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		vkDestroyBuffer(logicalDevice, uniformBuffers[i], nullptr);
-		vkFreeMemory(logicalDevice, uniformBuffersMemory[i], nullptr);
-	}
+	vkDestroyBuffer(logicalDevice, uniformRingBuffer, nullptr);
+	memoryAllocator.free(uniformRingAllocation);
 
 	vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+	vkDestroyDescriptorPool(logicalDevice, bindlessDescriptorPool, nullptr);
 
 	vkDestroySampler(logicalDevice, textureSampler, nullptr);
-	vkDestroyImageView(logicalDevice, textureImageView, nullptr);
-
-	vkDestroyImage(logicalDevice, textureImage, nullptr);
-	vkFreeMemory(logicalDevice, textureImageMemory, nullptr);
+	destroyTexture(placeholderTexture);
+	for (StreamedTexture& streamed : streamedTextures) {
+		destroyTexture(streamed.texture);
+	}
 
 	vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, bindlessDescriptorSetLayout, nullptr);
+
+	//The scene's buffers only exist once it has been loaded, the window can be closed before
+	if (sceneLoaded) {
+		vkDestroyBuffer(logicalDevice, indexBuffer, nullptr);
+		memoryAllocator.free(indexBufferAllocation);
+
+		vkDestroyBuffer(logicalDevice, vertexBuffer, nullptr);
+		memoryAllocator.free(vertexBufferAllocation);
+
+		vkDestroyBuffer(logicalDevice, drawDataBuffer, nullptr);
+		memoryAllocator.free(drawDataBufferAllocation);
+
+		vkDestroyBuffer(logicalDevice, indirectBuffer, nullptr);
+		memoryAllocator.free(indirectBufferAllocation);
+
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			vkDestroyBuffer(logicalDevice, instanceBuffers[i], nullptr);
+			memoryAllocator.free(instanceBuffersAllocation[i]);
+			vkDestroyBuffer(logicalDevice, culledInstanceBuffers[i], nullptr);
+			memoryAllocator.free(culledInstanceBuffersAllocation[i]);
+			vkDestroyBuffer(logicalDevice, instancedIndirectBuffers[i], nullptr);
+			memoryAllocator.free(instancedIndirectBuffersAllocation[i]);
+			vkDestroyBuffer(logicalDevice, culledIndirectBuffers[i], nullptr);
+			memoryAllocator.free(culledIndirectBuffersAllocation[i]);
+			vkDestroyBuffer(logicalDevice, drawCountBuffers[i], nullptr);
+			memoryAllocator.free(drawCountBuffersAllocation[i]);
+			vkDestroyBuffer(logicalDevice, materialBuffers[i], nullptr);
+			memoryAllocator.free(materialBuffersAllocation[i]);
+		}
+	}
 
-	vkDestroyBuffer(logicalDevice, indexBuffer, nullptr);
-	vkFreeMemory(logicalDevice, indexBufferMemory, nullptr);
-
-	vkDestroyBuffer(logicalDevice, vertexBuffer, nullptr);
-	vkFreeMemory(logicalDevice, vertexBufferMemory, nullptr);
+	vkDestroySampler(logicalDevice, depthPyramidSampler, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, cullPipelineLayout, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, compactPipelineLayout, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, depthReducePipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, cullDescriptorSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, compactDescriptorSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, depthReduceDescriptorSetLayout, nullptr);
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 		vkDestroySemaphore(logicalDevice, renderFinishedSemaphores[i], nullptr);
 		vkDestroySemaphore(logicalDevice, imageAvailableSemaphores[i], nullptr);
-		vkDestroyFence(logicalDevice, inFlightFences[i], nullptr);
 	}
 
+	retireUploads(true);
+	vkDestroyBuffer(logicalDevice, stagingRingBuffer, nullptr);
+	memoryAllocator.free(stagingRingAllocation);
+
 	vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
+	vkDestroyCommandPool(logicalDevice, transferCommandPool, nullptr);
+
+	//Destroying a pool frees its secondary command buffers
+	for (auto& framePools : workerCommandPools) {
+		for (WorkerCommandPool& workerPool : framePools) {
+			vkDestroyCommandPool(logicalDevice, workerPool.pool, nullptr);
+		}
+	}
+	frameScheduler.destroy();
+
+	//Every resource has been destroyed, release the memory blocks
+	memoryAllocator.destroy();
 
 	vkDestroyDevice(logicalDevice, nullptr);
 
-	vkDestroySurfaceKHR(instance, surface, nullptr);
+	if (!headless) {
+		vkDestroySurfaceKHR(instance, surface, nullptr);
+	}
 	vkDestroyInstance(instance, nullptr);
 
-	glfwDestroyWindow(window);
+	jobSystem.shutdown();
 
-	glfwTerminate();
+	if (!headless) {
+		glfwDestroyWindow(window);
+
+		glfwTerminate();
+	}
 }
 
 void VKApplication::createInstance(){
@@ -136,8 +320,11 @@ void VKApplication::createInstance(){
 
 	//Funciton to return the GLFW extensions it needs
 	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	const char** glfwExtensions = nullptr;
+	//Headless doesn't create a surface, GLFW isn't initialized
+	if (!headless) {
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	}
 
 	//Tells vulkan driver which global extensions and validation layers we want to use. Global means they apply to entire program not a specific device
 	VkInstanceCreateInfo createInfo{};
@@ -229,6 +416,53 @@ void VKApplication::pickPhysicalDevice(){
 		throw std::runtime_error("failed to find a suitable GPU!");
 	}*/
 
+	selectMsaaMode();
+	depthFormat = findDepthFormat();
+}
+
+VkSampleCountFlagBits VKApplication::getMaxUsableSampleCount(){
+	//The sample counts are in the framebuffer limits, we use depth buffering so the count has to be supported by both the color and the depth attachments
+	VkPhysicalDeviceProperties physicalDeviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+	VkSampleCountFlags counts = physicalDeviceProperties.limits.framebufferColorSampleCounts & physicalDeviceProperties.limits.framebufferDepthSampleCounts;
+	for (VkSampleCountFlagBits count : { VK_SAMPLE_COUNT_64_BIT, VK_SAMPLE_COUNT_32_BIT, VK_SAMPLE_COUNT_16_BIT, VK_SAMPLE_COUNT_8_BIT, VK_SAMPLE_COUNT_4_BIT, VK_SAMPLE_COUNT_2_BIT }) {
+		if (counts & count) {
+			return count;
+		}
+	}
+	return VK_SAMPLE_COUNT_1_BIT;
+}
+
+void VKApplication::selectMsaaMode(){
+	//The largest supported count that isn't above the requested one, every count up to the maximum isn't guaranteed to be supported
+	VkPhysicalDeviceProperties physicalDeviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+	VkSampleCountFlags counts = physicalDeviceProperties.limits.framebufferColorSampleCounts & physicalDeviceProperties.limits.framebufferDepthSampleCounts;
+	VkSampleCountFlagBits maxSamples = getMaxUsableSampleCount();
+
+	//Only single bits are sample counts, a request that isn't a power of two (e.g. 6) starts from the count below it
+	msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	uint32_t limit = std::min<uint32_t>(requestedMsaaSamples, maxSamples);
+	for (uint32_t count = VK_SAMPLE_COUNT_64_BIT; count > 1; count /= 2) {
+		if (count <= limit && (counts & count)) {
+			msaaSamples = static_cast<VkSampleCountFlagBits>(count);
+			break;
+		}
+	}
+
+	//Depth resolve (core in Vulkan 1.2): MAX when supported, SAMPLE_ZERO is always supported
+	VkPhysicalDeviceDepthStencilResolveProperties depthResolveProperties{};
+	depthResolveProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DEPTH_STENCIL_RESOLVE_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties2{};
+	properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties2.pNext = &depthResolveProperties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+	depthResolveMode = (depthResolveProperties.supportedDepthResolveModes & VK_RESOLVE_MODE_MAX_BIT) ? VK_RESOLVE_MODE_MAX_BIT : VK_RESOLVE_MODE_SAMPLE_ZERO_BIT;
+
+	if (msaaSamples != requestedMsaaSamples) {
+		std::cout << "MSAA: " << requestedMsaaSamples << " samples requested, using " << msaaSamples << std::endl;
+	}
 }
 
 void VKApplication::createLogicalDevice(){
@@ -243,7 +477,7 @@ void VKApplication::createLogicalDevice(){
 
 	//We need multiple VKDeviceQUeueCreateIngot stucts to create a queue form both families (graphics and presentation)
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value(), indices.transferFamily.value() };
 
 	//Vulkan lets you assign priorities to queues to influence the scheduling of command buffer execution using floating point numbers between 0.0 and 1.0
 	float queuePriority = 1.0f;
@@ -268,17 +502,116 @@ void VKApplication::createLogicalDevice(){
 	VkPhysicalDeviceFeatures deviceFeatures{}; 
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+	//Wireframe pipelines need fillModeNonSolid, it is optional so it is only enabled when the device has it
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+	fillModeNonSolidSupported = supportedFeatures.fillModeNonSolid == VK_TRUE;
+	deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+
+	//The indirect draw commands use firstInstance to tell every draw where its instances start in the instance rate vertex buffer
+	//Required: isDeviceSuitable (through ratePhysicalDeviceSuitability) never picks a device without it
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	//Optional, without it the scene is drawn with one vkCmdDrawIndexedIndirect per draw
+	multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE;
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	//Block compressed textures, each family is optional: the texture loader only picks formats the device can sample
+	deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+	deviceFeatures.textureCompressionASTC_LDR = supportedFeatures.textureCompressionASTC_LDR;
+	//The profiler's statistics query stays active while the secondary command buffers execute, so it needs both
+	pipelineStatisticsSupported = supportedFeatures.pipelineStatisticsQuery == VK_TRUE && supportedFeatures.inheritedQueries == VK_TRUE;
+	deviceFeatures.pipelineStatisticsQuery = pipelineStatisticsSupported ? VK_TRUE : VK_FALSE;
+	deviceFeatures.inheritedQueries = pipelineStatisticsSupported ? VK_TRUE : VK_FALSE;
+	//Sample rate shading is an option of MSAA, it only matters with more than one sample
+	sampleRateShadingEnabled = requestedSampleRateShading && msaaSamples != VK_SAMPLE_COUNT_1_BIT && supportedFeatures.sampleRateShading == VK_TRUE;
+	deviceFeatures.sampleRateShading = sampleRateShadingEnabled ? VK_TRUE : VK_FALSE;
+
+	//Features added after Vulkan 1.0 are enabled by chaining their structs in pNext, pEnabledFeatures still holds the 1.0 ones
+	//Only the queried features are enabled, the required ones were checked by isDeviceSuitable when the device was picked
+	VkPhysicalDeviceVulkan12Features supportedVulkan12Features{};
+	supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 supportedFeatures2{};
+	supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures2.pNext = &supportedVulkan12Features;
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+
+	//Timeline semaphores (core in 1.2) let the upload submits signal an increasing value that the graphics queue waits on and the CPU can query without blocking
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.timelineSemaphore = supportedVulkan12Features.timelineSemaphore;
+
+	//drawIndirectCount (core in 1.2) lets the culling shader write how many draws are visible, it is optional
+	drawIndirectCountSupported = supportedVulkan12Features.drawIndirectCount == VK_TRUE;
+	vulkan12Features.drawIndirectCount = supportedVulkan12Features.drawIndirectCount;
+
+	//Descriptor indexing (VK_EXT_descriptor_indexing, core in 1.2) for the bindless texture array, required by isDeviceSuitable:
+	//- runtimeDescriptorArray: the shader declares the array without a size
+	//- descriptorBindingVariableDescriptorCount: the size is chosen when the set is allocated
+	//- descriptorBindingPartiallyBound: the elements no material uses are never written
+	//- descriptorBindingSampledImageUpdateAfterBind: elements can be written after the set is bound
+	//- descriptorBindingUpdateUnusedWhilePending: elements the pending command buffers don't sample can be written while they execute (textures streaming in)
+	//- shaderSampledImageArrayNonUniformIndexing: the index can differ between the invocations of a draw (fragments of different instances)
+	vulkan12Features.runtimeDescriptorArray = supportedVulkan12Features.runtimeDescriptorArray;
+	vulkan12Features.descriptorBindingVariableDescriptorCount = supportedVulkan12Features.descriptorBindingVariableDescriptorCount;
+	vulkan12Features.descriptorBindingPartiallyBound = supportedVulkan12Features.descriptorBindingPartiallyBound;
+	vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = supportedVulkan12Features.descriptorBindingSampledImageUpdateAfterBind;
+	vulkan12Features.descriptorBindingUpdateUnusedWhilePending = supportedVulkan12Features.descriptorBindingUpdateUnusedWhilePending;
+	vulkan12Features.shaderSampledImageArrayNonUniformIndexing = supportedVulkan12Features.shaderSampledImageArrayNonUniformIndexing;
+
+	//Present ids (VK_KHR_present_id) and waiting for them (VK_KHR_present_wait) for the low latency profile, without them it only relies on one frame in flight
+	std::vector<const char*> enabledExtensions = getDeviceExtensions();
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+	presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+	presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	if (!headless && isDeviceExtensionSupported(physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) && isDeviceExtensionSupported(physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+		presentIdFeatures.pNext = &presentWaitFeatures;
+		VkPhysicalDeviceFeatures2 supportedPresentFeatures{};
+		supportedPresentFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedPresentFeatures.pNext = &presentIdFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedPresentFeatures);
+		presentWaitSupported = presentIdFeatures.presentId == VK_TRUE && presentWaitFeatures.presentWait == VK_TRUE;
+	}
+	if (presentWaitSupported) {
+		enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+		enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+		vulkan12Features.pNext = &presentIdFeatures;
+	}
+
+	//Dynamic rendering and synchronization2 (VK_KHR_dynamic_rendering and VK_KHR_synchronization2, core in 1.3), both optional
+	//The Vulkan 1.3 features struct can only be chained on a device that supports 1.3, older ones keep the render pass and the legacy barriers
+	VkPhysicalDeviceVulkan13Features vulkan13Features{};
+	vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	if (requestedDynamicRendering && deviceProperties.apiVersion >= VK_API_VERSION_1_3) {
+		VkPhysicalDeviceVulkan13Features supportedVulkan13Features{};
+		supportedVulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+		VkPhysicalDeviceFeatures2 supportedFeatures13{};
+		supportedFeatures13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeatures13.pNext = &supportedVulkan13Features;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures13);
+		dynamicRenderingEnabled = supportedVulkan13Features.dynamicRendering == VK_TRUE;
+		synchronization2Enabled = supportedVulkan13Features.synchronization2 == VK_TRUE;
+	}
+	vulkan13Features.dynamicRendering = dynamicRenderingEnabled ? VK_TRUE : VK_FALSE;
+	vulkan13Features.synchronization2 = synchronization2Enabled ? VK_TRUE : VK_FALSE;
+
 	/* Creating the logical device */
 
 	//Here we add pointers to the queue creation info and device feature structs
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = &vulkan12Features;
+	if (dynamicRenderingEnabled || synchronization2Enabled) {
+		vulkan13Features.pNext = &vulkan12Features;
+		createInfo.pNext = &vulkan13Features;
+	}
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pEnabledFeatures = &deviceFeatures;
 	//Specify extensions and validation layers (device specific)
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+	createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 	if (enableValidationLayers) {
 		createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
 		createInfo.ppEnabledLayerNames = validationLayers.data();
@@ -297,6 +630,25 @@ void VKApplication::createLogicalDevice(){
 
 	//Stores a handle to the presentation queue (created along with logical device)
 	vkGetDeviceQueue(logicalDevice, indices.presentFamily.value(), 0, &presentQueue);
+
+	//Stores a handle to the transfer queue, it is the graphics queue itself when there is no dedicated transfer family
+	vkGetDeviceQueue(logicalDevice, indices.transferFamily.value(), 0, &transferQueue);
+
+	graphicsQueueFamily = indices.graphicsFamily.value();
+	transferQueueFamily = indices.transferFamily.value();
+
+	frameBarriers.init(synchronization2Enabled);
+
+	//Extension commands aren't exported by the loader, they are looked up on the device
+	if (presentWaitSupported) {
+		vkWaitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(logicalDevice, "vkWaitForPresentKHR"));
+		presentWaitSupported = vkWaitForPresent != nullptr;
+	}
+}
+
+void VKApplication::createMemoryAllocator(){
+	//The allocator needs the logical device to allocate blocks and the physical device memory properties to know the heaps and which memory types can be mapped
+	memoryAllocator.init(physicalDevice, logicalDevice);
 }
 
 void VKApplication::createSwapChain(){
@@ -350,7 +702,10 @@ void VKApplication::createSwapChain(){
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE; //If the clipped member is set to VK_TRUE then that means that we don't care about the color of pixels that are obscured, for example because another window is in front of them. Unless you really need to be able to read these pixels back and get predictable results, you'll get the best performance by enabling clipping.
-	//createInfo.oldSwapchain = VK_NULL_HANDLE; //With Vulkan it's possible that your swap chain becomes invalid or unoptimized while your application is running, for example because the window was resized. In that case the swap chain actually needs to be recreated from scratch and a reference to the old one must be specified in this field. For now we assume that we'll only ever create onw swap chaim
+	//With Vulkan it's possible that your swap chain becomes invalid or unoptimized while your application is running, for example because the window was resized. In that case the swap chain actually needs to be recreated from scratch and a reference to the old one must be specified in this field.
+	//The old swap chain is retired: its images that were already presented stay valid and the presentation engine can reuse its resources, but no new image can be acquired from it
+	//VK_NULL_HANDLE the first time
+	createInfo.oldSwapchain = swapChain;
 	
 	//Create Swapchain 
 	if (vkCreateSwapchainKHR(logicalDevice, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
@@ -367,6 +722,19 @@ void VKApplication::createSwapChain(){
 	swapChainExtent = extent;
 }
 
+void VKApplication::createOffscreenImages(){
+	//The format of the windowed application when the surface has it, the render pass and pipelines are the same
+	swapChainImageFormat = findSupportedFormat({ VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+	swapChainExtent = { benchmarkSettings.width, benchmarkSettings.height };
+
+	//No presentation engine holds the images, the graphics timeline value of a frame in flight guarantees its image is done before it is rendered to again
+	swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+	offscreenImagesAllocation.resize(MAX_FRAMES_IN_FLIGHT);
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], offscreenImagesAllocation[i], 1);
+	}
+}
+
 void VKApplication::createImageViews()
 {
 	//To use any VkImage, including those in the swap chain, in the render pipeline we have to create a VkImageView object. An image view is quite literally a view into an image. It describes how to access the image and which part of the image to access, for example if it should be treated as a 2D texture depth texture without any mipmapping levels.
@@ -382,11 +750,21 @@ void VKApplication::createImageViews()
 }
 
 void VKApplication::createRenderPass(){
+	//Dynamic rendering describes the attachments when it begins, every frame
+	if (dynamicRenderingEnabled) {
+		return;
+	}
+
+	//The render pass is created with vkCreateRenderPass2 (core in Vulkan 1.2): the depth resolve of MSAA is only available through the *2 structs
+	bool msaa = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
 	//Attachment Description
 	//In this case a single color buffer attachment represented by on of the images from the swp chain
-	VkAttachmentDescription colorAttachment{};
+	//With MSAA it is the multisampled color image instead, resolved into the swap chain image (the resolve attachment below)
+	VkAttachmentDescription2 colorAttachment{};
+	colorAttachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
 	colorAttachment.format = swapChainImageFormat;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT; //Not mulitsampling so just 1 sample
+	colorAttachment.samples = msaaSamples; //1 sample without MSAA
 	//loadOp and storeOp determine what to do with the data in the attachment before rendering and after rendering. 
 	//For loadOp:
 	//VK_ATTACHMENT_LOAD_OP_LOAD: Preserve the existing contents of the attachment
@@ -409,17 +787,56 @@ void VKApplication::createRenderPass(){
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; //we don't care what previous layout the image was in. The caveat of this special value is that the contents of the image are not guaranteed to be preserved, but that doesn't matter since we're going to clear it anyway.
 	//Finallayout: specifies the layout to automatically transition to when the render pass finishes.
 	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; //We want the image to be ready for presentation using the swap chain after rendering
+	//Headless: the offscreen images are never presented (and the layout needs VK_KHR_swapchain)
+	if (headless) {
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
 
 	// Depth attachment
-	VkAttachmentDescription depthAttachment{};
-	depthAttachment.format = findDepthFormat();
-	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT; //Just like the color buffer, we don't care about the previous depth contents
+	VkAttachmentDescription2 depthAttachment{};
+	depthAttachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+	depthAttachment.format = depthFormat;
+	depthAttachment.samples = msaaSamples; //Must be the same as the color attachment
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; //Clear values at the start
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE; //ontents of the framebuffer will be undefined after the rendering operation we dont need depth values in framebuffer after rendering has finished
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; //The depth values are kept after rendering, they are reduced into the depth pyramid used to cull the next frame
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; //Sampled by depthreduce.comp after the render pass
+
+	// Resolve attachments (MSAA)
+	//The multisampled attachments are only needed inside the render pass: they are cleared at the start and never stored, the resolve writes the single sampled images
+	//On tiled GPUs they then never leave the tile memory
+	if (msaa) {
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	}
+
+	//The swap chain image, every texel is the average of the samples of its pixel
+	VkAttachmentDescription2 colorResolveAttachment{};
+	colorResolveAttachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+	colorResolveAttachment.format = swapChainImageFormat;
+	colorResolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorResolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; //Every texel is written by the resolve
+	colorResolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorResolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorResolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorResolveAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorResolveAttachment.finalLayout = headless ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	//The depth image the depth pyramid is built from, with depthResolveMode
+	VkAttachmentDescription2 depthResolveAttachment{};
+	depthResolveAttachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+	depthResolveAttachment.format = depthAttachment.format;
+	depthResolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthResolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthResolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depthResolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthResolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthResolveAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthResolveAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 
 	//Subpasses and attachment references
@@ -430,17 +847,36 @@ void VKApplication::createRenderPass(){
 
 	//Attachment references
 	//Every subpass references one or more of the attachments that we've described using the structure in the previous sections. These references are themselves VkAttachmentReference structs that look like this:
-	VkAttachmentReference colorAttachmentRef{};
+	VkAttachmentReference2 colorAttachmentRef{};
+	colorAttachmentRef.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
 	colorAttachmentRef.attachment = 0; //specifies which attachment to reference by its index in the attachment descriptions array.
 	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL; //specifies which layout we would like the attachment to have during a subpass that uses this reference. Vulkan will automatically transition the attachment to this layout when the subpass is started. We intend to use the attachment to function as a color buffer 
 
-	VkAttachmentReference depthAttachmentRef{};
+	VkAttachmentReference2 depthAttachmentRef{};
+	depthAttachmentRef.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
 	depthAttachmentRef.attachment = 1;
 	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+	VkAttachmentReference2 colorResolveAttachmentRef{};
+	colorResolveAttachmentRef.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+	colorResolveAttachmentRef.attachment = 2;
+	colorResolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference2 depthResolveAttachmentRef{};
+	depthResolveAttachmentRef.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+	depthResolveAttachmentRef.attachment = 3;
+	depthResolveAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	//The depth resolve is chained to the subpass
+	VkSubpassDescriptionDepthStencilResolve depthResolve{};
+	depthResolve.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_DEPTH_STENCIL_RESOLVE;
+	depthResolve.depthResolveMode = depthResolveMode;
+	depthResolve.stencilResolveMode = VK_RESOLVE_MODE_NONE;//The depth format may have a stencil component, it isn't used
+	depthResolve.pDepthStencilResolveAttachment = &depthResolveAttachmentRef;
 
 	//Subpass description
-	VkSubpassDescription subpass{};
+	VkSubpassDescription2 subpass{};
+	subpass.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2;
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;//Vulkan may also support compute subpasses in the future, so we have to be explicit about this being a graphics subpass.
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &colorAttachmentRef; //The index of the attachment in this array is directly referenced from the fragment shader with the layout(location = 0) out vec4 outColor directive!
@@ -451,6 +887,10 @@ void VKApplication::createRenderPass(){
 	//pResolveAttachments: Attachments used for multisampling color attachments
 	//pDepthStencilAttachment: Attachment for depth and stencil data
 	//pPreserveAttachments: Attachments that are not used by this subpass, but for which the data must be preserved
+	if (msaa) {
+		subpass.pResolveAttachments = &colorResolveAttachmentRef;//One per color attachment
+		subpass.pNext = &depthResolve;
+	}
 
 	// Subpass dependencies
 
@@ -464,7 +904,8 @@ void VKApplication::createRenderPass(){
 	//We define a VkSubpassDependency struct to create an explicit dependency between the previous implicit stage (VK_SUBPASS_EXTERNAL) and the color attachment output stage (subpass 0 in our case).
 	//A subpass dependency ensures that writing to the color attachment only happens after the swap chain releases the image.
 	//This avoids race conditions and ensures proper image layout transitions.
-	VkSubpassDependency dependency{};
+	VkSubpassDependency2 dependency{};
+	dependency.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
 	//The first two fields specify the indices of the dependency and the dependent subpass.
 	dependency.srcSubpass = VK_SUBPASS_EXTERNAL; //This refers to operations happening before the render pass starts (e.g., image acquisition by the swap chain).
 	dependency.dstSubpass = 0; // This refers to the first (and only) subpass, where the color attachment is written.
@@ -472,7 +913,7 @@ void VKApplication::createRenderPass(){
 	//The next two fields specify the operations to wait on and the stages in which these operations occur
 	//We need to wait for the swap chain to finish reading from the image before we can access it.
 	//This can be accomplished by waiting on the color attachment output stage itself.
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT; //(Stages to wait on where the operations occur) This ensures the render pass waits until the swap chain finishes reading from the image.
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT; //(Stages to wait on where the operations occur) This ensures the render pass waits until the swap chain finishes reading from the image, and until the previous frame's depth reduction finished reading the depth image.
 	dependency.srcAccessMask = 0; //(Operation to wait on) No memory access needed before this
 	
 	//The operations that should wait on this are in the color attachment and early fragment stage and involve the writing of the color attachment and depth attachment. 
@@ -484,20 +925,34 @@ void VKApplication::createRenderPass(){
 	// we need to extend our subpass dependencies to make sure that there is no conflict between the transitioning of the depth image and it being cleared as part of its load operation.
 	// The depth image is first accessed in the early fragment test pipeline stage and because we have a load operation that clears, we should specify the access mask for writes.
 
+	//Dependency out of the render pass: the depth writes (and the transition to the final layout) must be done before the compute shader samples the depth image
+	//Resolves run in the color attachment output stage with color attachment accesses, also for depth: the resolved depth is written there with MSAA
+	VkSubpassDependency2 depthReadDependency{};
+	depthReadDependency.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
+	depthReadDependency.srcSubpass = 0;
+	depthReadDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+	depthReadDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	depthReadDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	depthReadDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	depthReadDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	std::array<VkSubpassDependency2, 2> dependencies = { dependency, depthReadDependency };
+
 	//Render Pass
 	
 	//Unlike color attachments, a subpass can only use a single depth (+stencil) attachment. It wouldn't really make any sense to do depth tests on multiple buffers.
-	std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
-	VkRenderPassCreateInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	//The resolve attachments only exist with MSAA, the framebuffers have the same attachments (see createFramebuffers)
+	std::array<VkAttachmentDescription2, 4> attachments = { colorAttachment, depthAttachment, colorResolveAttachment, depthResolveAttachment };
+	VkRenderPassCreateInfo2 renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
+	renderPassInfo.attachmentCount = msaa ? 4 : 2;
 	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
 
-	if (vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+	if (vkCreateRenderPass2(logicalDevice, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create render pass!");
 	}
 }
@@ -507,23 +962,19 @@ void VKApplication::createDescriptorSetLayout(){
 
 	// Descriptor Set Layout Bindings 
 
-	//Binding for the model, view, proj uniform variable in shader
+	//Binding for the view, proj uniform variable in shader
+	//Dynamic: the offset in the uniform ring is given when the set is bound, so one set serves every frame
 	VkDescriptorSetLayoutBinding uboLayoutBinding{};
 	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBinding.descriptorCount = 1;// It is possible for the shader variable to represent an array of uniform buffer objects, and descriptorCount specifies the number of values in the array.
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	uboLayoutBinding.pImmutableSamplers = nullptr;
 
-	//Sampler Layout Binding for texture
-	VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-	samplerLayoutBinding.binding = 1;
-	samplerLayoutBinding.descriptorCount = 1;
-	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT; //It is possible to use texture sampling in the vertex shader, for example to dynamically deform a grid of vertices by a heightmap.
-
 	//Create Info for layout
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };//Array of descriptor set layout binsings we specify previously
+	//The model matrix of every instance comes from the instance rate vertex binding and the object transform from the push constants, not from a descriptor
+	//The textures are in the bindless set, the per-frame set only holds what changes every frame
+	std::array<VkDescriptorSetLayoutBinding, 1> bindings = { uboLayoutBinding };//Array of descriptor set layout binsings we specify previously
 	VkDescriptorSetLayoutCreateInfo layoutInfo{};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());//Number of bindings
@@ -532,257 +983,319 @@ void VKApplication::createDescriptorSetLayout(){
 	if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create descriptor set layout!");
 	}
-}
-
-void VKApplication::createGraphicsPipeline(){
-	//Read shader SPIR-V Files
-	auto vertShaderCode = readFile("shaders/vert.spv");
-	auto fragShaderCode = readFile("shaders/frag.spv");
-
-	//Create Shader modules
-	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-	//Shader stage creation
-
-	//Vertex shader stage
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
-	vertShaderStageInfo.pName = "main"; //Entrypoint of shader
-
-	//Fragment shader stage
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
-	fragShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-	//Vertex Input
-	//Describes the format of the vertex data that will be passed to the vertex shader
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescription = Vertex::getAttributeDescription();
-
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescription.size());
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescription.data();
-
-	//Input Assembly
-	//Describes what kind o feometry will be drawn form the vertices (points, lines, or triangles), and the topology type
-	//VK_PRIMITIVE_TOPOLOGY_POINT_LIST: points from vertices
-	//VK_PRIMITIVE_TOPOLOGY_LINE_LIST: line from every 2 vertices without reuse
-	//VK_PRIMITIVE_TOPOLOGY_LINE_STRIP : the end vertex of every line is used as start vertex for the next line
-	//VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST : triangle from every 3 vertices without reuse
-	//VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP : the second and third vertex of every triangle are used as first two vertices of the next triangle
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE; //If you set the primitiveRestartEnable member to VK_TRUE, then it's possible to break up lines and triangles in the _STRIP topology modes by using a special index of 0xFFFF or 0xFFFFFFFF in the vertex buffer.
-
-	//Viewports and Sissors
-	//Viewports (transformation) define the transformation from the image to the framebuffer
-	//Sissor (filter) rectangles define in which regions pixels will actually be stored, any pixels outside the siccor rectangles will be discarded by rasterizer
-	
-	//Scissor that covers entire framebuffer (only needed to specify when we don use dynamic states)
-	//VkRect2D scissor{};
-	//scissor.offset = { 0, 0 };
-	//scissor.extent = swapChainExtent;
 
-	//Enable Dynamic states for scissor and viewport
-	//Viewport(s) and scissor rectangle(s) can either be specified as a static part of the pipeline or as a dynamic state set in the command buffer. 
-	
-	//Viewport
-	VkPipelineViewportStateCreateInfo viewportState{};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.scissorCount = 1;
-
-	//Rasterizer
-	//Takes the geometry that is shaped by hte vertices from the vertex shader and turns it into fragments
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE; //If depthClampEnable is set to VK_TRUE, then fragments that are beyond the near and far planes are clamped to them as opposed to discarding them. This is useful in some special cases like shadow maps.
-	rasterizer.rasterizerDiscardEnable = VK_FALSE; //If rasterizerDiscardEnable is set to VK_TRUE, then geometry never passes through the rasterizer stage. This basically disables any output to the framebuffer.
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	//The polygonMode determines how fragments are generated for geometry. The following modes are available:
-	//VK_POLYGON_MODE_FILL: fill the area of the polygon with fragments
-	//VK_POLYGON_MODE_LINE : polygon edges are drawn as lines
-	//VK_POLYGON_MODE_POINT : polygon vertices are drawn as points
-	rasterizer.lineWidth = 1.0f;//escribes the thickness of lines in terms of number of fragments. The maximum line width that is supported depends on the hardware and any line thicker than 1.0f requires you to enable the wideLines GPU feature.
-	//because of the Y-flip we did in the projection matrix, the vertices are now being drawn in counter-clockwise order instead of clockwise order. This causes backface culling to kick in and prevents any geometry from being drawn.
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;// The cullMode variable determines the type of face culling to use. You can disable culling, cull the front faces, cull the back faces or both.
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;// The frontFace variable specifies the vertex order for faces to be considered front-facing and can be clockwise or counterclockwise.
-	rasterizer.depthBiasEnable = VK_FALSE;
-	//The rasterizer can alter the depth values by adding a constant value or biasing them based on a fragment's slope. 
-	rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-	rasterizer.depthBiasClamp = 0.0f; // Optional
-	rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
-
-	//Multisampling
-	//One of the ways to perform anti-aliasing. It works by combining the fragment shader results of multiple polygons that rasterize to the same pixel. This mainly occurs along edges, which is also where the most noticeable aliasing artifacts occur.
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	multisampling.minSampleShading = 1.0f; // Optional
-	multisampling.pSampleMask = nullptr; // Optional
-	multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-	multisampling.alphaToOneEnable = VK_FALSE; // Optional
-
-	//Depth Stencil
-	VkPipelineDepthStencilStateCreateInfo depthStencil{};
-	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE; //specifies if the depth of new fragments should be compared to the depth buffer to see if they should be discarded.
-	depthStencil.depthWriteEnable = VK_TRUE;//specifies if the new depth of fragments that pass the depth test should actually be written to the depth buffer.
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS; //pecifies the comparison that is performed to keep or discard fragments. We're sticking to the convention of lower depth = closer, so the depth of new fragments should be less.
-	depthStencil.depthBoundsTestEnable = VK_FALSE;//The depthBoundsTestEnable, minDepthBounds and maxDepthBounds fields are used for the optional depth bound test. Basically, this allows you to only keep fragments that fall within the specified depth range. We won't be using this functionality.
-	depthStencil.minDepthBounds = 0.0f; // Optional
-	depthStencil.maxDepthBounds = 1.0f; // Optional
-	//The last three fields configure stencil buffer operations
-	//If you want to use these operations, then you will have to make sure that the format of the depth/stencil image contains a stencil component.
-	depthStencil.stencilTestEnable = VK_FALSE;
-	depthStencil.front = {}; // Optional
-	depthStencil.back = {}; // Optional
-
-	//Color blending
-	//After a fragment shader has returned a color, it needs to be combined with the color that is already in the framebuffer. This transformation is known as color blending and there are two ways to do it:
-	//		Mix the old and new value to produce a final color
-	//		Combine the old and new value using a bitwise operation
-
-	//Color blend attachment: contains the configuration per attached framebuffer and the second
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-	//Pseudocode that represent how previous struct uses the paramenters to calculate the blend
-	/*if (blendEnable) {
-		finalColor.rgb = (srcColorBlendFactor * newColor.rgb) < colorBlendOp > (dstColorBlendFactor * oldColor.rgb);
-		finalColor.a = (srcAlphaBlendFactor * newColor.a) < alphaBlendOp > (dstAlphaBlendFactor * oldColor.a);
-	}
-	else {
-		finalColor = newColor;
+	// Bindless texture array
+	//Combined image samplers count against both the sampler and the sampled image limits, update-after-bind descriptors have their own limits
+	VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+	vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties2{};
+	properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties2.pNext = &vulkan12Properties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+	bindlessTextureCapacity = std::min({ MAX_BINDLESS_TEXTURES,
+		vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers, vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages });
+
+	//descriptorCount is the largest size, the actual size of the set is given when it is allocated (variable descriptor count)
+	VkDescriptorSetLayoutBinding texturesLayoutBinding{};
+	texturesLayoutBinding.binding = 0;
+	texturesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	texturesLayoutBinding.descriptorCount = bindlessTextureCapacity;
+	texturesLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	//The variable descriptor count is only allowed on the last binding of the set
+	//A streamed texture is written to an element no frame in flight samples (a free one), unused while pending allows it without waiting for the frames
+	VkDescriptorBindingFlags texturesBindingFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsInfo.bindingCount = 1;
+	bindingFlagsInfo.pBindingFlags = &texturesBindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo bindlessLayoutInfo{};
+	bindlessLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	bindlessLayoutInfo.pNext = &bindingFlagsInfo;
+	bindlessLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	bindlessLayoutInfo.bindingCount = 1;
+	bindlessLayoutInfo.pBindings = &texturesLayoutBinding;
+
+	if (vkCreateDescriptorSetLayout(logicalDevice, &bindlessLayoutInfo, nullptr, &bindlessDescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create bindless descriptor set layout!");
 	}
+}
 
-	finalColor = finalColor & colorWriteMask;
-	
-	//The parameters we passed are using alpha blending, where we want the new color to be blended with the old color based on opacity
-
-	finalColor.rgb = newAlpha * newColor + (1 - newAlpha) * oldColor;
-	finalColor.a = newAlpha.a;
-	*/
-
-	//Color blending State: contains the global color blending settings. In our case we only have one framebuffer
-
-	VkPipelineColorBlendStateCreateInfo colorBlending{};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE; //If you want to use the second method of blending (bitwise combination), then you should set logicOpEnable to VK_TRUE
-	colorBlending.logicOp = VK_LOGIC_OP_COPY; // The bitwise operation can then be specified in the logicOp field. Note that this will automatically disable the first method, as if you had set blendEnable to VK_FALSE
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	//Source and destination values are combined according to the blend operation, quadruplets of source and destination weighting factors determined by the blend factors, and a blend constant, to obtain a new set of R, G, B, and A values
-	colorBlending.blendConstants[0] = 0.0f; // Optional Rc
-	colorBlending.blendConstants[1] = 0.0f; // Optional Gc
-	colorBlending.blendConstants[2] = 0.0f; // Optional Bc
-	colorBlending.blendConstants[3] = 0.0f; // Optional Ac
-
-	//Dynamic States: scissor and viewport
-	//While most of the pipeline state needs to be baked into the pipeline state, a limited amount of the state can actually be changed without recreating the pipeline at draw time
-	std::vector<VkDynamicState> dynamicStates = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR
-	};
-
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-	dynamicState.pDynamicStates = dynamicStates.data();
+void VKApplication::createPipelineCache(){
+	//If the file is missing or was written by another driver/GPU the cache starts empty and is filled by the pipelines we create
+	pipelineCache.init(physicalDevice, logicalDevice, PIPELINE_CACHE_PATH);
+}
 
+void VKApplication::createGraphicsPipeline(){
 	//Pipeline Layout creation
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	//Descriptor sets are used to bind resources(textures, buffers, etc.) to shaders
-	pipelineLayoutInfo.setLayoutCount = 1; //means that no descriptor sets are used in this pipeline. 
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;//descriptor set layouts.
+	//Set 0 is the per-frame set, set 1 the bindless textures
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, bindlessDescriptorSetLayout };
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();//descriptor set layouts.
 	//Push constants are small amounts of data that can be passed directly to shaders.
-	pipelineLayoutInfo.pushConstantRangeCount = 0; //no push constants are used
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+	//The transform of the object drawn, so drawing another object only needs a vkCmdPushConstants and no descriptor set
+	VkPushConstantRange objectPushConstantRange{};
+	objectPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	objectPushConstantRange.offset = 0;
+	objectPushConstantRange.size = sizeof(ObjectPushConstants);
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &objectPushConstantRange;
 
 	if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create pipeline layout!");
 	}
 
-	//Create Graphics Pipeline using:
-	//Shader stages: the shader modules that define the functionality of the programmable stages of the graphics pipeline
-	//Fixed-function state: all of the structures that define the fixed-function stages of the pipeline, like input assembly, rasterizer, viewport and color blending
-	//Pipeline layout: the uniform and push values referenced by the shader that can be updated at draw time
-	//Render pass: the attachments referenced by the pipeline stages and their usage
-
-	VkGraphicsPipelineCreateInfo pipelineInfo{};
-	//Shader stages
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2; //Vertex shader and fragment shader
-	pipelineInfo.pStages = shaderStages;
-	//Fixed-functions states
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = &depthStencil;
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = &dynamicState;
-	//Pipeline layout
-	pipelineInfo.layout = pipelineLayout;
-	//Render pass
-	pipelineInfo.renderPass = renderPass;
-	pipelineInfo.subpass = 0;// index of the sub pass where this graphics pipeline will be used.
-	//Vulkan allows you to create a new graphics pipeline by deriving from an existing pipeline. The idea of pipeline derivatives is that it is less expensive to set up pipelines when they have much functionality in common with an existing pipeline and switching between pipelines from the same parent can also be done quicker. Using either the handle of an exisiting pipeline or reference another pipeline that is about to be created by index with 
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-	pipelineInfo.basePipelineIndex = -1; // Optional
-
-	if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create graphics pipeline!");
-	}
-
-	//Destroy shader modules
-	vkDestroyShaderModule(logicalDevice, fragShaderModule, nullptr);
-	vkDestroyShaderModule(logicalDevice, vertShaderModule, nullptr);
+	//Pipeline permutations
+	//Every variant starts from the opaque states and only changes what makes it different, the pipeline manager compiles all of them in parallel
+	VKPipelineDesc opaque{};
+	opaque.fragShader = "shaders/frag.spv";
+	//Every pipeline of the render pass has its sample count, with dynamic rendering they also need the formats of the attachments
+	opaque.rasterizationSamples = msaaSamples;
+	opaque.colorFormat = swapChainImageFormat;
+	opaque.depthFormat = depthFormat;
+	opaque.sampleShadingEnable = sampleRateShadingEnabled;
+
+	//The vertex shader and the vertex input states depend on the vertex format of the scene
+	if (USE_PACKED_VERTICES) {
+		opaque.vertShader = "shaders/vert_packed.spv";
+		auto bindingDescription = PackedVertex::getBindingDescription();
+		auto attributeDescription = PackedVertex::getAttributeDescription();
+		opaque.bindings.assign(bindingDescription.begin(), bindingDescription.end());
+		opaque.attributes.assign(attributeDescription.begin(), attributeDescription.end());
+	}
+	else {
+		opaque.vertShader = "shaders/vert.spv";
+		auto bindingDescription = Vertex::getBindingDescription();
+		auto attributeDescription = Vertex::getAttributeDescription();
+		opaque.bindings.assign(bindingDescription.begin(), bindingDescription.end());
+		opaque.attributes.assign(attributeDescription.begin(), attributeDescription.end());
+	}
+
+	//Alpha blended: mixed with the color already in the framebuffer, depth is tested but not written so the geometry behind stays visible
+	VKPipelineDesc alpha = opaque;
+	alpha.blendEnable = true;
+	alpha.depthWriteEnable = false;
+	alpha.cullMode = VK_CULL_MODE_NONE;
+
+	//Wireframe: polygon edges are drawn as lines
+	VKPipelineDesc wireframe = opaque;
+	wireframe.polygonMode = VK_POLYGON_MODE_LINE;
+	wireframe.cullMode = VK_CULL_MODE_NONE;
+
+	//Shadow: depth only (no fragment shader and no color writes), front faces are culled and the depth is biased to avoid shadow acne
+	//Built against the main render pass until there is a shadow map pass
+	VKPipelineDesc shadow = opaque;
+	shadow.fragShader.clear();
+	shadow.colorWriteMask = 0;
+	shadow.cullMode = VK_CULL_MODE_FRONT_BIT;
+	shadow.depthBiasEnable = true;
+	shadow.depthBiasConstantFactor = 1.25f;
+	shadow.depthBiasSlopeFactor = 1.75f;
+
+	pipelineManager.init(logicalDevice, pipelineCache.get(), &jobSystem, fillModeNonSolidSupported);
+	std::vector<uint64_t> keys = pipelineManager.build({ opaque, alpha, wireframe, shadow }, pipelineLayout, renderPass);
+	opaquePipeline = keys[0];
+	alphaPipeline = keys[1];
+	wireframePipeline = keys[2];
+	shadowPipeline = keys[3];
+}
+
+void VKApplication::createComputePipelines(){
+	// Culling
+
+	//Bindings of cull.comp: the frame's uniform buffer, the frame's instances, the draw data, the frame's instanced draw commands, the culled instances, the depth pyramid and the frame's material textures
+	std::array<VkDescriptorSetLayoutBinding, 7> cullBindings{};
+	std::array<VkDescriptorType, 7> cullTypes = {
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+	};
+	for (uint32_t i = 0; i < cullBindings.size(); i++) {
+		cullBindings[i].binding = i;
+		cullBindings[i].descriptorType = cullTypes[i];
+		cullBindings[i].descriptorCount = 1;
+		cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo cullLayoutInfo{};
+	cullLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	cullLayoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+	cullLayoutInfo.pBindings = cullBindings.data();
+
+	if (vkCreateDescriptorSetLayout(logicalDevice, &cullLayoutInfo, nullptr, &cullDescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create culling descriptor set layout!");
+	}
+
+	//The frustum planes change every frame, push constants avoid another uniform buffer
+	VkPushConstantRange cullPushConstantRange{};
+	cullPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullPushConstantRange.offset = 0;
+	cullPushConstantRange.size = sizeof(CullPushConstants);
+
+	VkPipelineLayoutCreateInfo cullPipelineLayoutInfo{};
+	cullPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	cullPipelineLayoutInfo.setLayoutCount = 1;
+	cullPipelineLayoutInfo.pSetLayouts = &cullDescriptorSetLayout;
+	cullPipelineLayoutInfo.pushConstantRangeCount = 1;
+	cullPipelineLayoutInfo.pPushConstantRanges = &cullPushConstantRange;
+
+	if (vkCreatePipelineLayout(logicalDevice, &cullPipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create culling pipeline layout!");
+	}
+
+	// Draw compaction
+
+	//Bindings of compactdraws.comp: the frame's instanced draw commands, the culled draw commands and the draw count
+	std::array<VkDescriptorSetLayoutBinding, 3> compactBindings{};
+	for (uint32_t i = 0; i < compactBindings.size(); i++) {
+		compactBindings[i].binding = i;
+		compactBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		compactBindings[i].descriptorCount = 1;
+		compactBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo compactLayoutInfo{};
+	compactLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	compactLayoutInfo.bindingCount = static_cast<uint32_t>(compactBindings.size());
+	compactLayoutInfo.pBindings = compactBindings.data();
+
+	if (vkCreateDescriptorSetLayout(logicalDevice, &compactLayoutInfo, nullptr, &compactDescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compaction descriptor set layout!");
+	}
+
+	//Only the number of draws
+	VkPushConstantRange compactPushConstantRange{};
+	compactPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	compactPushConstantRange.offset = 0;
+	compactPushConstantRange.size = sizeof(uint32_t);
+
+	VkPipelineLayoutCreateInfo compactPipelineLayoutInfo{};
+	compactPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	compactPipelineLayoutInfo.setLayoutCount = 1;
+	compactPipelineLayoutInfo.pSetLayouts = &compactDescriptorSetLayout;
+	compactPipelineLayoutInfo.pushConstantRangeCount = 1;
+	compactPipelineLayoutInfo.pPushConstantRanges = &compactPushConstantRange;
+
+	if (vkCreatePipelineLayout(logicalDevice, &compactPipelineLayoutInfo, nullptr, &compactPipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compaction pipeline layout!");
+	}
+
+	// Depth reduction
+
+	//Bindings of depthreduce.comp: the level it reads (sampled) and the level it writes (storage image)
+	std::array<VkDescriptorSetLayoutBinding, 2> reduceBindings{};
+	reduceBindings[0].binding = 0;
+	reduceBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	reduceBindings[0].descriptorCount = 1;
+	reduceBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	reduceBindings[1].binding = 1;
+	reduceBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	reduceBindings[1].descriptorCount = 1;
+	reduceBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo reduceLayoutInfo{};
+	reduceLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	reduceLayoutInfo.bindingCount = static_cast<uint32_t>(reduceBindings.size());
+	reduceLayoutInfo.pBindings = reduceBindings.data();
+
+	if (vkCreateDescriptorSetLayout(logicalDevice, &reduceLayoutInfo, nullptr, &depthReduceDescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth reduce descriptor set layout!");
+	}
+
+	VkPipelineLayoutCreateInfo reducePipelineLayoutInfo{};
+	reducePipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	reducePipelineLayoutInfo.setLayoutCount = 1;
+	reducePipelineLayoutInfo.pSetLayouts = &depthReduceDescriptorSetLayout;
+
+	if (vkCreatePipelineLayout(logicalDevice, &reducePipelineLayoutInfo, nullptr, &depthReducePipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth reduce pipeline layout!");
+	}
+
+	//Shader file names are the keys the hot reload uses to find the pipelines, they match createShaderHotReload
+	cullPipeline = pipelineManager.buildCompute("shaders/cull.spv", cullPipelineLayout);
+	compactPipeline = pipelineManager.buildCompute("shaders/compactdraws.spv", compactPipelineLayout);
+	depthReducePipeline = pipelineManager.buildCompute("shaders/depthreduce.spv", depthReducePipelineLayout);
+
+	//Both shaders read texels with texelFetch, the sampler only has to allow every mip level
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	if (vkCreateSampler(logicalDevice, &samplerInfo, nullptr, &depthPyramidSampler) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth pyramid sampler!");
+	}
+}
+
+void VKApplication::createShaderHotReload(){
+	if (!SHADER_HOT_RELOAD || headless) {
+		return;
+	}
+
+	//Same sources as the glslc commands of CMakeLists.txt
+	std::vector<VKShaderSource> sources = {
+		{ "shaders/shader.vert", "shaders/vert.spv", {} },
+		{ "shaders/shader_packed.vert", "shaders/vert_packed.spv", {} },
+		{ "shaders/shader.frag", "shaders/frag.spv", {} },
+		{ "shaders/cull.comp", "shaders/cull.spv", {} },
+		{ "shaders/compactdraws.comp", "shaders/compactdraws.spv", {} },
+		{ "shaders/depthreduce.comp", "shaders/depthreduce.spv", {} },
+	};
+
+	//Called on the hot reload worker: the pipelines are created there, drawFrame only swaps them in
+	bool started = shaderHotReload.init(sources, SHADER_CACHE_DIR, SHADER_RELOAD_POLL_INTERVAL, [this](const VKShaderSource& shader, const std::vector<char>& spirv) {
+		pipelineManager.prepareReload(shader.spirv, spirv);
+	});
+	if (!started) {
+		std::cout << "Built without shaderc, shader hot reload is disabled" << std::endl;
+	}
 }
 
 void VKApplication::createFramebuffers(){
 	//The attachments specified during render pass creation are bound by wrapping them into a VkFramebuffer object. A framebuffer object references all of the VkImageView objects that represent the attachments
 	//However, the image that we have to use for the attachment depends on which image the swap chain returns when we retrieve one for presentation. That means that we have to create a framebuffer for all of the images in the swap chain and use the one that corresponds to the retrieved image at drawing time.
 
+	//Dynamic rendering renders into the image views directly
+	if (dynamicRenderingEnabled) {
+		return;
+	}
+
 	swapChainFramebuffers.resize(swapChainImageViews.size());
 
 	//Iterate thorugh the image views and create framebuffers
 	for (size_t i = 0; i < swapChainImageViews.size(); i++) {
 		//The color attachment differs for every swap chain image, but the same depth image can be used by all of them because only a single subpass is running at the same time due to our semaphores.
-		std::array<VkImageView, 2> attachments = {
+		//With MSAA the same goes for the multisampled images, the swap chain image and the depth image are the resolve attachments
+		std::array<VkImageView, 4> attachments = {
 			swapChainImageViews[i],
 			depthImageView
 		};
+		uint32_t attachmentCount = 2;
+		if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+			attachments = { colorImageView, msaaDepthImageView, swapChainImageViews[i], depthImageView };
+			attachmentCount = 4;
+		}
 
 		VkFramebufferCreateInfo framebufferInfo{};
 		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		framebufferInfo.renderPass = renderPass; //You can only use a framebuffer with the render passes that it is compatible with, which roughly means that they use the same number and type of attachments.
-		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		framebufferInfo.attachmentCount = attachmentCount;
 		framebufferInfo.pAttachments = attachments.data(); //specify the VkImageView objects that should be bound to the respective attachment descriptions in the render pass pAttachment array
 		framebufferInfo.width = swapChainExtent.width;
 		framebufferInfo.height = swapChainExtent.height;
@@ -811,6 +1324,28 @@ void VKApplication::createCommandPool(){
 	if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create command pool!");
 	}
+
+	//Upload command buffers are recorded once, submitted once and freed, so the transfer pool gets the transient hint
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamiliyIndices.transferFamily.value();
+
+	if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &transferCommandPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create transfer command pool!");
+	}
+}
+
+void VKApplication::createFrameScheduler(){
+	//Every submit signals the next value of its queue's timeline, so a single semaphore per queue tracks all of them: value N reached means every submit up to the Nth is done
+	frameScheduler.init(logicalDevice, graphicsQueue, transferQueue);
+}
+
+void VKApplication::createStagingRing(){
+	//The ring is a regular host visible staging buffer, but it is created once for the whole application instead of once per upload
+	createBuffer(STAGING_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingRingBuffer, stagingRingAllocation);
+
+	//The allocator keeps host visible memory mapped, so the ring writes straight into stagingRingAllocation.mapped
+	//Its ranges are only read by the transfer queue
+	stagingRing.init(logicalDevice, stagingRingBuffer, stagingRingAllocation.mapped, STAGING_RING_SIZE, frameScheduler.getTimeline(VKQueue::Transfer));
 }
 
 void VKApplication::createDepthResources(){
@@ -827,79 +1362,257 @@ void VKApplication::createDepthResources(){
 	// - VK_FORMAT_D24_UNORM_S8_UINT: 24-bit float for depth and 8 bit stencil component
 	//The stencil component is used for stencil tests, which is an additional test that can be combined with depth testing. 
 
-	//Find supported depth format
-	VkFormat depthFormat = findDepthFormat();
-
 	//Create depth image
-	createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+	//Sampled to build the depth pyramid
+	//When the swap chain is recreated the new depth image goes in the allocation of the previous one if it fits (same size or smaller window), so resizing doesn't allocate device memory
+	//The previous depth image may still be used by the frames in flight: they are on the same queue and the render pass waits for the depth reduction of the previous frame before writing depth
+	//With MSAA it is the resolve attachment, it still has a single sample
+	createImageInAllocation(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageAllocation);
 
 	//Create depth image view
 	depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
+	//The multisampled depth attachment the render pass tests against, only read and written inside the render pass
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		createImageInAllocation(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, msaaDepthImage, msaaDepthImageAllocation, 1, msaaSamples);
+		msaaDepthImageView = createImageView(msaaDepthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	}
+
 	//Note: We don't need to map it or copy another image to it, because we're going to clear it at the start of the render pass like the color attachment.
 
 	// Explicitly transitioning the depth image
-	//We don't need to explicitly transition the layout of the image to a depth attachment because we'll take care of this in the render pass. However, for completeness I'll still describe the process in this section. You may skip it if you like.
-	transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	//We don't need to explicitly transition the layout of the image to a depth attachment because we'll take care of this in the render pass (its initial layout is VK_IMAGE_LAYOUT_UNDEFINED).
+	//It isn't done here: the one time command buffer waits for the graphics queue to be idle, which would stall the frames in flight every time the swap chain is recreated
 }
 
-void VKApplication::createTextureImage(){
-	//Load an image and upload it into a Vulkan image object.
+void VKApplication::createColorResources(){
+	//Without MSAA the render pass draws directly into the swap chain image
+	if (msaaSamples == VK_SAMPLE_COUNT_1_BIT) {
+		return;
+	}
 
-	// Load image
-	int texWidth, texHeight, texChannels;
-	//The STBI_rgb_alpha value forces the image to be loaded with an alpha channel, even if it doesn't have one
-	stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	//The pixels are laid out row by row with 4 bytes per pixel in the case of STBI_rgb_alpha for a total of texWidth * texHeight * 4 values.
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
+	//A single multisampled color image is enough: like the depth image, only one frame renders at a time
+	//VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT: only used as an attachment inside a render pass, never loaded or stored, so it can live in lazily allocated memory
+	createImageInAllocation(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, colorImage, colorImageAllocation, 1, msaaSamples);
+	colorImageView = createImageView(colorImage, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+}
 
-	if (!pixels) {
-		throw std::runtime_error("Failed to load texture image!");
+void VKApplication::createDepthPyramid(){
+	//Level 0 has the size of the depth image, every level halves the size until 1x1
+	depthPyramidLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(swapChainExtent.width, swapChainExtent.height)))) + 1;
+
+	//Written as a storage image by depthreduce.comp and sampled by cull.comp and by the reduction of the next level
+	createImage(swapChainExtent.width, swapChainExtent.height, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthPyramid, depthPyramidAllocation, depthPyramidLevels);
+
+	depthPyramidView = createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, depthPyramidLevels);
+
+	//A storage image descriptor can only see one level, every level needs its own view
+	depthPyramidMipViews.resize(depthPyramidLevels);
+	for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+		depthPyramidMipViews[level] = createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1);
 	}
 
-	// Staging buffer
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	//The content is undefined until the first reduction, the first frame after this is not occlusion culled
+	depthPyramidValid = false;
+}
 
-	//The buffer should be in host visible memory so that we can map it and it should be usable as a transfer source so that we can copy it to an image later on:
-	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-	// Copy the pixel values that we got from the image loading library to the buffer:
-	void* data;
-	vkMapMemory(logicalDevice, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(logicalDevice, stagingBufferMemory);
+void VKApplication::createPlaceholderTexture(){
+	//2x2 mid grey texels, what a material looks like until its texture has streamed in (or if it fails to load)
+	std::vector<VKTextureLevel> levels(1);
+	levels[0].width = 2;
+	levels[0].height = 2;
+	levels[0].data = { 128, 128, 128, 255, 128, 128, 128, 255, 128, 128, 128, 255, 128, 128, 128, 255 };
 
-	//clean up the original pixel array
-	stbi_image_free(pixels);
+	beginUploadBatch();
+	placeholderTexture = createTextureImage(levels, VK_FORMAT_R8G8B8A8_SRGB);
+	submitUploadBatch();
+}
+
+VKTexture VKApplication::createTextureImage(const std::vector<VKTextureLevel>& levels, VkFormat format){
+	//Upload the levels into a Vulkan image object.
+	VKTexture texture{};
+	texture.format = format;
+	uint32_t texWidth = levels[0].width;
+	uint32_t texHeight = levels[0].height;
+	uint32_t fileLevels = static_cast<uint32_t>(levels.size());
+
+	// Mipmaps
+	//Compressed textures come with their mip chain. A texture with a single level gets its chain from level 0 with vkCmdBlitImage,
+	//which needs the format to support blits and linear filtering with optimal tiling (never the case of block compressed formats)
+	//Without that support the texture keeps a single level, it is still sampled correctly, only without the savings of the smaller levels
+	texture.mipLevels = fileLevels;
+	bool generateMipmaps = fileLevels == 1 && isFormatSupported(texture.format, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+	if (generateMipmaps) {
+		//Halve the largest side until it is 1 (floor(log2(max(width, height))) + 1 levels)
+		for (uint32_t size = std::max(texWidth, texHeight); size > 1; size /= 2) {
+			texture.mipLevels++;
+		}
+	}
 
 	//Create Image
+	//With generated mipmaps the levels are both written (blit destination) and read (blit source)
 	createImage(
 		texWidth, 
 		texHeight, 
-		VK_FORMAT_R8G8B8A8_SRGB, 
+		texture.format, 
 		VK_IMAGE_TILING_OPTIMAL, 
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
+		(generateMipmaps ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0) | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-		textureImage, 
-		textureImageMemory);
+		texture.image, 
+		texture.allocation,
+		texture.mipLevels);
 
 	//Copy the staging buffer to the texture image. Steps:
 	//- Transition the texture image to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
 	//- Execute the buffer to image copy operation
 
 	//The image was created with the VK_IMAGE_LAYOUT_UNDEFINED layout, so that one should be specified as old layout when transitioning textureImage. Remember that we can do this because we don't care about its contents before performing the copy operation.
-	transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+	//Every level is transitioned, the ones that aren't copied are the destinations of the blits
+	transitionImageLayout(texture.image, texture.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.mipLevels);
+
+	// Staging buffer
+	//The levels go through the staging ring (host visible memory that can be mapped and is usable as a transfer source)
+	//The range is reserved right before the copy, so it is tied to the timeline value of the submit that reads it
+	//The buffer offset of a copy to an image must be a multiple of the texel (or block) size, the levels are placed at multiples of 16 bytes
+	std::vector<VkDeviceSize> levelOffsets(fileLevels);
+	VkDeviceSize imageSize = 0;
+	for (uint32_t level = 0; level < fileLevels; level++) {
+		levelOffsets[level] = imageSize;
+		imageSize = (imageSize + levels[level].data.size() + 15) & ~VkDeviceSize(15);
+	}
+	VKStagingRegion stagingRegion = allocateStagingRegion(imageSize);
+
+	// Copy the texels of every level to the buffer
+	for (uint32_t level = 0; level < fileLevels; level++) {
+		memcpy(static_cast<char*>(stagingRegion.mapped) + levelOffsets[level], levels[level].data.data(), levels[level].data.size());
+		copyBufferToImage(stagingRegion.buffer, texture.image, std::max(texWidth >> level, 1u), std::max(texHeight >> level, 1u), stagingRegion.offset + levelOffsets[level], level);
+	}
 
 	//To be able to start sampling from the texture image in the shader, we need one last transition to prepare it for shader access:
-	transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	//The copy runs on the transfer queue, so this transition also releases the image to the graphics queue (acquired in recordUploadAcquires)
+	//With generated mipmaps the graphics queue generates the levels first, it does the transition of every level after its blit
+	if (generateMipmaps && texture.mipLevels > 1) {
+		releaseForMipmapGeneration(texture.image, static_cast<int32_t>(texWidth), static_cast<int32_t>(texHeight), texture.mipLevels);
+	}
+	else {
+		transitionImageLayout(texture.image, texture.format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture.mipLevels);
+	}
+
+	//There is no staging buffer to destroy, the ring space is reclaimed when the copy finishes
+
+	//The view covers the whole mip chain
+	texture.view = createImageView(texture.image, texture.format, VK_IMAGE_ASPECT_COLOR_BIT, 0, texture.mipLevels);
+	return texture;
+}
+
+void VKApplication::loadTextureLevels(const std::string& path, std::vector<VKTextureLevel>& levels, VkFormat& format){
+	// Texture source, in order of preference
+	//1. A pre-compressed KTX2 file in a format the device supports, with its mip levels: nothing is decoded on the CPU
+	//2. The texture cache, the image at path baked by a previous run
+	//3. The image at path itself, decoded and baked (slow, the cache makes it happen only once)
+	VKKtx2File textureFile;
+	if (!openTextureFile(path, textureFile)) {
+		bakeTexture(path, levels, format);
+		return;
+	}
+
+	//The levels are copied out of the mapping here on the streaming worker, the file is paged in by this copy and not by the main thread's copy to the staging ring
+	format = textureFile.getFormat();
+	levels.resize(textureFile.getLevelCount());
+	for (uint32_t level = 0; level < levels.size(); level++) {
+		const char* levelData = textureFile.getLevelData(level);
+		levels[level].width = std::max(textureFile.getWidth() >> level, 1u);
+		levels[level].height = std::max(textureFile.getHeight() >> level, 1u);
+		levels[level].data.assign(levelData, levelData + textureFile.getLevelSize(level));
+	}
+}
+
+bool VKApplication::openTextureFile(const std::string& path, VKKtx2File& textureFile){
+	for (const std::string& suffix : TEXTURE_COMPRESSED_SUFFIXES) {
+		std::string compressedPath = replaceExtension(path, suffix);
+		if (textureFile.open(compressedPath)) {
+			if (isTextureFormatUsable(textureFile.getFormat())) {
+				std::cout << "Texture loaded from " << compressedPath << std::endl;
+				return true;
+			}
+			textureFile.close();
+		}
+	}
+
+	//The cache is only used if it was baked from the current source, by this version of the baker, in the format this device would bake
+	std::string cachePath = replaceExtension(path, TEXTURE_CACHE_SUFFIX);
+	if (!textureFile.open(cachePath)) {
+		return false;
+	}
+
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+	VKMappedFile::getStamp(path, sourceSize, sourceTime);
+	std::string stamp = std::to_string(TEXTURE_BAKE_VERSION) + " " + std::to_string(sourceSize) + " " + std::to_string(sourceTime);
+	//A missing source isn't a mismatch, the cache can be shipped without the image
+	bool sourceMatches = (sourceSize == 0 && sourceTime == 0) ? textureFile.getValue("VKSandbox.bakeVersion") == std::to_string(TEXTURE_BAKE_VERSION) : textureFile.getValue("VKSandbox.source") == stamp;
+	VkFormat bakedFormat = isTextureFormatUsable(VK_FORMAT_BC7_SRGB_BLOCK) ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_R8G8B8A8_SRGB;
+
+	if (!sourceMatches || textureFile.getFormat() != bakedFormat) {
+		std::cout << "Texture cache " << cachePath << " is out of date, baking it again from " << path << std::endl;
+		textureFile.close();
+		return false;
+	}
+	return true;
+}
+
+void VKApplication::bakeTexture(const std::string& path, std::vector<VKTextureLevel>& levels, VkFormat& format){
+	// Load image
+	int texWidth, texHeight, texChannels;
+	//The STBI_rgb_alpha value forces the image to be loaded with an alpha channel, even if it doesn't have one
+	stbi_uc* pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	//The pixels are laid out row by row with 4 bytes per pixel in the case of STBI_rgb_alpha for a total of texWidth * texHeight * 4 values.
+
+	if (!pixels) {
+		throw std::runtime_error("Failed to load texture image " + path + "!");
+	}
+
+	//BC7 takes 1 byte per texel instead of 4 and is decoded by the texture units, the levels are built and compressed here because blits can't write compressed images
+	//Without BC support level 0 is kept as it is and the GPU generates the mip chain
+	//The bake runs on a streaming worker, it is compressed on that thread alone and leaves the job system to the frames
+	if (isTextureFormatUsable(VK_FORMAT_BC7_SRGB_BLOCK)) {
+		format = VK_FORMAT_BC7_SRGB_BLOCK;
+		levels = VKTextureBaker::buildMipChain(pixels, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+		for (VKTextureLevel& level : levels) {
+			level = VKTextureBaker::compressBC7(level);
+		}
+	}
+	else {
+		format = VK_FORMAT_R8G8B8A8_SRGB;
+		levels.resize(1);
+		levels[0].width = static_cast<uint32_t>(texWidth);
+		levels[0].height = static_cast<uint32_t>(texHeight);
+		levels[0].data.assign(pixels, pixels + static_cast<size_t>(texWidth) * texHeight * 4);
+	}
+
+	//clean up the original pixel array
+	stbi_image_free(pixels);
+
+	//The source stamp and the baker version tell the next runs whether the cache can be used
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+	VKMappedFile::getStamp(path, sourceSize, sourceTime);
+	std::string stamp = std::to_string(TEXTURE_BAKE_VERSION) + " " + std::to_string(sourceSize) + " " + std::to_string(sourceTime);
+	std::string cachePath = replaceExtension(path, TEXTURE_CACHE_SUFFIX);
+	if (VKKtx2File::write(cachePath, format, levels, { { "VKSandbox.source", stamp }, { "VKSandbox.bakeVersion", std::to_string(TEXTURE_BAKE_VERSION) } })) {
+		std::cout << "Texture " << path << " baked to " << cachePath << std::endl;
+	}
+}
 
-	vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+void VKApplication::destroyTexture(VKTexture& texture){
+	vkDestroyImageView(logicalDevice, texture.view, nullptr);
+	vkDestroyImage(logicalDevice, texture.image, nullptr);
+	memoryAllocator.free(texture.allocation);
+	texture = VKTexture{};
 }
 
-void VKApplication::createTextureImageView(){
-	textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+bool VKApplication::isTextureFormatUsable(VkFormat format){
+	return isFormatSupported(format, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
 }
 
 void VKApplication::createTextureSampler(){
@@ -942,11 +1655,13 @@ void VKApplication::createTextureSampler(){
 	// This is mainly used for percentage-closer filtering on shadow maps.
 	samplerInfo.compareEnable = VK_FALSE;
 	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-	//All of these fields apply to mipmapping (in this case we don't need it)
+	//All of these fields apply to mipmapping
+	//Linear between the two nearest levels on top of the linear filtering inside them (trilinear filtering), no visible seams where the level changes
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
+	//The level of detail can go from the full resolution to the last level of the chain, the textures have different chains so the view of each one clamps it
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
 	//Note the sampler does not reference a VkImage anywhere. The sampler is a distinct object that provides an interface to extract colors from a texture
 	// It can be applied to any image you want, whether it is 1D, 2D or 3D.
@@ -955,86 +1670,391 @@ void VKApplication::createTextureSampler(){
 	}
 }
 
-void VKApplication::loadModel(){
-	//An OBJ file consists of positions, normals, texture coordinates and faces.
-	//Faces consist of an arbitrary amount of vertices, where each vertex refers to a position, normal and/or texture coordinate by index
-	//This makes it possible to not just reuse entire vertices, but also individual attributes.
-
-	tinyobj::attrib_t attrib;// holds all of the positions, normals and texture coordinates in its attrib.vertices, attrib.normals and attrib.texcoords vectors
-	std::vector<tinyobj::shape_t> shapes;// contains all of the separate objects and their faces. Each face consists of an array of vertices, and each vertex contains the indices of the position, normal and texture coordinate attributes.
-	std::vector<tinyobj::material_t> materials;//The err string contains errors and the warn string contains warnings that occurred while loading the file, like a missing material definition.
-	std::string warning, error;
+void VKApplication::startSceneLoad(){
+	streamer.init(STREAMING_WORKER_COUNT, STREAMING_TEXTURE_BUDGET);
 
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, MODEL_PATH.c_str())) {
-		throw std::runtime_error(warning + error);
-	}
+	//Pinned: the geometry stays resident, only the textures are evicted
+	sceneAsset = streamer.addAsset(true);
 
-	//Note: As mentioned above, faces in OBJ files can actually contain an arbitrary number of vertices, whereas our application can only render triangles.
-	//Luckily the LoadObj has an optional parameter to automatically triangulate such faces, which is enabled by default.
+	//Mapping the mesh cache (or parsing the OBJ file) and filling the scene run on a streaming worker, the main thread doesn't touch the scene until the job is collected
+	//The OBJ import splits its work on the job system, which is idle until then: the frames only use it to record the scene's draws
+	streamer.load(sceneAsset, [this]() {
+		loadModel();
+	});
+}
 
-	std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+void VKApplication::loadModel(){
+	uint32_t vertexStride = USE_PACKED_VERTICES ? sizeof(PackedVertex) : sizeof(Vertex);
+	scene.init(vertexStride);
+
+	//The first run parses the OBJ file and writes the mesh cache, the next runs map the cache: no parsing and no vertex deduplication
+	//The vertex and index blobs of the cache are the megabuffers, they are copied from the mapping to the staging ring
+	//The levels of detail are in the cache, it is rebuilt when the settings they were made with change
+	VKMeshCacheLodSettings lodSettings = { MAX_MESH_LODS, MESH_LOD_REDUCTION, MESH_LOD_MIN_TRIANGLES, MESH_LOD_MIN_GAIN, MESH_LOD_MAX_ERROR };
+	if (meshCache.open(MESH_CACHE_PATH, MODEL_PATH, vertexStride, lodSettings)) {
+		scene.setGeometry(meshCache.getVertexData(), meshCache.getVertexDataSize(), meshCache.getIndexData(), meshCache.getIndexDataSize(), meshCache.getIndexType());
+		//Added in the order they were written, so every material keeps its index
+		for (const std::string& texturePath : meshCache.getMaterialTexturePaths()) {
+			scene.addMaterial(texturePath);
+		}
 
-	//We're going to combine all of the faces in the file into a single model, so just iterate over all of the shapes
-	//The triangulation feature has already made sure that there are three vertices per face, so we can now directly iterate over the vertices and dump them straight into our vertices vector
-	for (const auto& shape : shapes) {
-		for (const auto& index : shape.mesh.indices) {
-			//The index variable is of type tinyobj::index_t, which contains the vertex_index, normal_index and texcoord_index members. 
-			// We need to use these indices to look up the actual vertex attributes in the attrib arrays
-			Vertex vertex{};
-			//attrib.vertices array is an array of float values instead of something like glm::vec3 (to take into account the 3 values needed for x, y, z), so you need to multiply the index by 3
-			//Multiplication (*) and division (/) have higher precedence than addition (+) and subtraction (-). Multiplication is performed first, followed by addition (evaluated from left to right when multiple multiplications are present)
-			vertex.pos = {
-				attrib.vertices[3 * index.vertex_index + 0], // X
-				attrib.vertices[3 * index.vertex_index + 1], // Y
-				attrib.vertices[3 * index.vertex_index + 2] // Z
-			};
-
-			//There are two texture coordinate components per entry (U and V)
-			vertex.texCoord = {
-				attrib.texcoords[2 * index.texcoord_index + 0],//U
-				attrib.texcoords[2 * index.texcoord_index + 1] //V
-			};
-
-			// The OBJ format assumes a coordinate system where a vertical coordinate of 0 means the bottom of the image, however we've uploaded our image into Vulkan in a top to bottom orientation where 0 means the top of the image
-			//Solve this by flipping the vertical component of the texture coordinates:
-			vertex.texCoord = {
-				attrib.texcoords[2 * index.texcoord_index + 0], //U
-				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]// Flip V
-			};
-
-			//Every time we read a vertex from the OBJ file, we check if we've already seen a vertex with the exact same position and texture coordinates before
-			//f not, we add it to vertices and store its index in the uniqueVertices container.
-			if (uniqueVertices.count(vertex) == 0) { //Return 0 if is not in the set
-				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-				vertices.push_back(vertex);
+		const VKMeshCacheMesh* cachedMeshes = meshCache.getMeshes();
+		for (uint32_t i = 0; i < meshCache.getMeshCount(); i++) {
+			//addMesh() checks the level count and ranges, a corrupted table can't read past the arrays
+			VKSceneMesh mesh{};
+			mesh.lodCount = cachedMeshes[i].lodCount;
+			for (uint32_t lod = 0; lod < std::min(mesh.lodCount, MAX_MESH_LODS); lod++) {
+				mesh.lods[lod].firstIndex = cachedMeshes[i].lods[lod].firstIndex;
+				mesh.lods[lod].indexCount = cachedMeshes[i].lods[lod].indexCount;
+				mesh.lods[lod].error = cachedMeshes[i].lods[lod].error;
 			}
-			//After that we add the index of the new vertex to indices. If we've seen the exact same vertex before, then we look up its index in uniqueVertices and store that index in indices.
-			indices.push_back(uniqueVertices[vertex]);
+			mesh.vertexOffset = cachedMeshes[i].vertexOffset;
+			mesh.vertexCount = cachedMeshes[i].vertexCount;
+			mesh.boundingSphere = glm::vec4(cachedMeshes[i].boundingSphere[0], cachedMeshes[i].boundingSphere[1], cachedMeshes[i].boundingSphere[2], cachedMeshes[i].boundingSphere[3]);
+			mesh.positionQuantization = glm::vec4(cachedMeshes[i].positionQuantization[0], cachedMeshes[i].positionQuantization[1], cachedMeshes[i].positionQuantization[2], cachedMeshes[i].positionQuantization[3]);
+			mesh.materialIndex = cachedMeshes[i].materialIndex;
+			scene.addMesh(mesh);
 		}
 	}
-}
-
-void VKApplication::createVertexBuffer(){
+	else {
+		loadObjModel();
+		//Stored in the cache, the next runs upload the indices with the size chosen here
+		scene.selectIndexType();
+		VKMeshCache::write(MESH_CACHE_PATH, MODEL_PATH, scene, lodSettings);
+	}
+
+	//Place copies of the model on a grid centered on the origin, the copies of a shape are the instances of its draw
+	//The grid lies on the model's XZ plane, the model matrix of the uniform buffer makes the model vertical
+	uint32_t meshCount = static_cast<uint32_t>(scene.getMeshes().size());
+	float gridOffset = (SCENE_GRID_SIZE - 1) * SCENE_GRID_SPACING * 0.5f;
+	for (uint32_t x = 0; x < SCENE_GRID_SIZE; x++) {
+		for (uint32_t z = 0; z < SCENE_GRID_SIZE; z++) {
+			glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x * SCENE_GRID_SPACING - gridOffset, 0.0f, z * SCENE_GRID_SPACING - gridOffset));
+			for (uint32_t meshIndex = 0; meshIndex < meshCount; meshIndex++) {
+				scene.addInstance(meshIndex, transform);
+			}
+		}
+	}
+
+	scene.buildDraws();
+}
+
+void VKApplication::finishSceneLoad(){
+	//All the uploads of the scene (vertices, indices, draw data and draw commands) are recorded into one command buffer and submitted once
+	//The geometry is copied to the staging ring by the main thread: a range of the ring belongs to the next submit, so it can't be filled ahead of time by a worker
+	beginUploadBatch();
+	createVertexBuffer();
+	createIndexBuffer();
+	//The geometry is in the staging ring now, the CPU copy (or the mapped cache) isn't needed anymore
+	scene.releaseGeometry();
+	meshCache.close();
+	createDrawDataBuffer();
+	createIndirectBuffer();
+	//The model can be drawn once the batch has been acquired by the graphics queue
+	sceneTransferValue = submitUploadBatch();
+	createInstanceBuffers();
+	createInstanceTransforms();
+	createCullingBuffers();
+
+	//Every material samples the placeholder until one of its instances is visible and its texture has streamed in
+	streamedTextures.resize(scene.getMaterials().size());
+	for (StreamedTexture& streamed : streamedTextures) {
+		streamed.asset = streamer.addAsset();
+	}
+	createMaterialBuffers();
+
+	sceneLoaded = true;
+	//The culling sets point to the scene's buffers, they were left unwritten until now
+	writeCullingDescriptorSets();
+
+	//Report how much device memory the loaded resources take per heap
+	memoryAllocator.printHeapUsage();
+}
+
+void VKApplication::loadObjModel(){
+	//An OBJ file consists of positions, normals, texture coordinates and faces.
+	//Faces consist of an arbitrary amount of vertices, where each vertex refers to a position, normal and/or texture coordinate by index
+	//This makes it possible to not just reuse entire vertices, but also individual attributes.
+
+	tinyobj::attrib_t attrib;// holds all of the positions, normals and texture coordinates in its attrib.vertices, attrib.normals and attrib.texcoords vectors
+	std::vector<tinyobj::shape_t> shapes;// contains all of the separate objects and their faces. Each face consists of an array of vertices, and each vertex contains the indices of the position, normal and texture coordinate attributes.
+	std::vector<tinyobj::material_t> materials;//The err string contains errors and the warn string contains warnings that occurred while loading the file, like a missing material definition.
+	std::string warning, error;
+
+	//The material library (mtllib) and the textures it names are relative to the folder of the model
+	std::string modelDirectory = std::filesystem::path(MODEL_PATH).parent_path().string();
+	if (!modelDirectory.empty()) {
+		modelDirectory += "/";
+	}
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, MODEL_PATH.c_str(), modelDirectory.c_str())) {
+		throw std::runtime_error(warning + error);
+	}
+
+	// Materials
+	//Material 0 is TEXTURE_PATH, for the shapes without a material and the materials without a diffuse texture
+	//The other materials only keep their diffuse texture for now, it is the element of the bindless array they sample
+	scene.addMaterial(TEXTURE_PATH);
+	std::vector<uint32_t> sceneMaterials(materials.size(), 0);
+	for (size_t m = 0; m < materials.size(); m++) {
+		if (!materials[m].diffuse_texname.empty()) {
+			sceneMaterials[m] = scene.addMaterial(modelDirectory + materials[m].diffuse_texname);
+		}
+	}
+
+	//Note: As mentioned above, faces in OBJ files can actually contain an arbitrary number of vertices, whereas our application can only render triangles.
+	//Luckily the LoadObj has an optional parameter to automatically triangulate such faces, which is enabled by default.
+
+	//Every shape of the file is a mesh of the scene
+	//The triangulation feature has already made sure that there are three vertices per face, so we can now directly iterate over the vertices and dump them straight into our vertices vector
 
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-	// Create the staging Buffer (Host-Visible Memory in RAM)
+	// Parallel deduplication
+	//1. Every shape is split in ranges of OBJ_IMPORT_INDICES_PER_JOB indices, a job builds the vertices of its range and deduplicates them locally
+	//2. A job per shape merges the unique vertices of its ranges in order and remaps their indices
+	//Vertices get their index in the order they first appear, like a single thread going through the whole shape, so the result (and the mesh cache) doesn't depend on the number of workers
+	struct ImportRange {
+		uint32_t shapeIndex;
+		size_t firstIndex;
+		size_t indexCount;
+		std::vector<Vertex> vertices;//Unique vertices of the range
+		std::vector<uint32_t> indices;//Into vertices
+	};
+
+	struct ImportMesh {
+		std::vector<Vertex> vertices;
+		std::vector<PackedVertex> packedVertices;//Only with USE_PACKED_VERTICES
+		std::vector<uint32_t> indices;
+		glm::vec4 boundingSphere;
+		glm::vec4 positionQuantization;
+		uint32_t materialIndex;//Material of the scene
+		bool hasNormals;//Whether the OBJ file has normals for the shape
+		size_t firstRange;
+		size_t rangeCount;
+		float acmrBefore;//Before and after the mesh optimization
+		float acmrAfter;
+		std::vector<std::vector<uint32_t>> lodIndices;//Levels after the full mesh, into its vertices
+		std::vector<float> lodErrors;
+	};
+
+	std::vector<ImportRange> ranges;
+	std::vector<ImportMesh> importMeshes(shapes.size());
+	for (uint32_t shapeIndex = 0; shapeIndex < shapes.size(); shapeIndex++) {
+		size_t shapeIndexCount = shapes[shapeIndex].mesh.indices.size();
+		importMeshes[shapeIndex].firstRange = ranges.size();
+		for (size_t first = 0; first < shapeIndexCount; first += OBJ_IMPORT_INDICES_PER_JOB) {
+			ranges.push_back({ shapeIndex, first, std::min<size_t>(OBJ_IMPORT_INDICES_PER_JOB, shapeIndexCount - first) });
+		}
+		importMeshes[shapeIndex].rangeCount = ranges.size() - importMeshes[shapeIndex].firstRange;
+		importMeshes[shapeIndex].hasNormals = shapeIndexCount > 0 && shapes[shapeIndex].mesh.indices[0].normal_index >= 0;
+
+		//A mesh is a single draw with a single material, a shape whose faces use several materials is drawn with the material of its first face
+		const std::vector<int>& materialIds = shapes[shapeIndex].mesh.material_ids;
+		int materialId = materialIds.empty() ? -1 : materialIds[0];
+		importMeshes[shapeIndex].materialIndex = (materialId >= 0 && materialId < static_cast<int>(sceneMaterials.size())) ? sceneMaterials[materialId] : 0;
+	}
+
+	//Every job only writes its own range, the OBJ data is only read
+	for (ImportRange& range : ranges) {
+		jobSystem.submit([&attrib, &shapes, &range](uint32_t) {
+			const std::vector<tinyobj::index_t>& shapeIndices = shapes[range.shapeIndex].mesh.indices;
+			VKVertexDedup<Vertex> uniqueVertices(range.indexCount);
+			range.indices.reserve(range.indexCount);
+
+			for (size_t i = range.firstIndex; i < range.firstIndex + range.indexCount; i++) {
+				const tinyobj::index_t& index = shapeIndices[i];
+
+				//The index variable is of type tinyobj::index_t, which contains the vertex_index, normal_index and texcoord_index members. 
+				// We need to use these indices to look up the actual vertex attributes in the attrib arrays
+				Vertex vertex{};
+				//attrib.vertices array is an array of float values instead of something like glm::vec3 (to take into account the 3 values needed for x, y, z), so you need to multiply the index by 3
+				//Multiplication (*) and division (/) have higher precedence than addition (+) and subtraction (-). Multiplication is performed first, followed by addition (evaluated from left to right when multiple multiplications are present)
+				vertex.pos = {
+					attrib.vertices[3 * index.vertex_index + 0], // X
+					attrib.vertices[3 * index.vertex_index + 1], // Y
+					attrib.vertices[3 * index.vertex_index + 2] // Z
+				};
+
+				//There are two texture coordinate components per entry (U and V)
+				// The OBJ format assumes a coordinate system where a vertical coordinate of 0 means the bottom of the image, however we've uploaded our image into Vulkan in a top to bottom orientation where 0 means the top of the image
+				//Solve this by flipping the vertical component of the texture coordinates:
+				vertex.texCoord = {
+					attrib.texcoords[2 * index.texcoord_index + 0], //U
+					1.0f - attrib.texcoords[2 * index.texcoord_index + 1]// Flip V
+				};
+
+				//Normals are optional in OBJ files, the merge job computes the missing ones
+				if (index.normal_index >= 0) {
+					vertex.normal = {
+						attrib.normals[3 * index.normal_index + 0],
+						attrib.normals[3 * index.normal_index + 1],
+						attrib.normals[3 * index.normal_index + 2]
+					};
+				}
+
+				//Every time we read a vertex from the OBJ file, we check if we've already seen a vertex with the exact same position and texture coordinates before
+				//If not, it is added to the vertices of the range. Either way we get its index with a single lookup
+				range.indices.push_back(uniqueVertices.insert(vertex, range.vertices));
+			}
+		});
+	}
+	jobSystem.wait();
+
+	for (ImportMesh& importMesh : importMeshes) {
+		jobSystem.submit([&ranges, &importMesh](uint32_t) {
+			size_t uniqueCount = 0;
+			size_t indexCount = 0;
+			for (size_t r = importMesh.firstRange; r < importMesh.firstRange + importMesh.rangeCount; r++) {
+				uniqueCount += ranges[r].vertices.size();
+				indexCount += ranges[r].indices.size();
+			}
+
+			//The same vertex can be unique in several ranges, merge them into the vertices of the mesh
+			VKVertexDedup<Vertex> uniqueVertices(uniqueCount);
+			importMesh.indices.reserve(indexCount);
+			std::vector<uint32_t> remap;
+			for (size_t r = importMesh.firstRange; r < importMesh.firstRange + importMesh.rangeCount; r++) {
+				ImportRange& range = ranges[r];
+				remap.resize(range.vertices.size());
+				for (size_t v = 0; v < range.vertices.size(); v++) {
+					remap[v] = uniqueVertices.insert(range.vertices[v], importMesh.vertices);
+				}
+				for (uint32_t index : range.indices) {
+					importMesh.indices.push_back(remap[index]);
+				}
+
+				//Free the range as soon as it is merged, a large scan would otherwise hold its vertices twice
+				std::vector<Vertex>().swap(range.vertices);
+				std::vector<uint32_t>().swap(range.indices);
+			}
+
+			//Shapes without normals get the average of the normals of the triangles around each vertex
+			//The cross product is twice the area of the triangle, so larger triangles weigh more
+			if (!importMesh.hasNormals) {
+				for (size_t t = 0; t + 2 < importMesh.indices.size(); t += 3) {
+					Vertex& a = importMesh.vertices[importMesh.indices[t + 0]];
+					Vertex& b = importMesh.vertices[importMesh.indices[t + 1]];
+					Vertex& c = importMesh.vertices[importMesh.indices[t + 2]];
+					glm::vec3 faceNormal = glm::cross(b.pos - a.pos, c.pos - a.pos);
+					a.normal += faceNormal;
+					b.normal += faceNormal;
+					c.normal += faceNormal;
+				}
+				for (Vertex& uniqueVertex : importMesh.vertices) {
+					float length = glm::length(uniqueVertex.normal);
+					if (length > 0.0f) {
+						uniqueVertex.normal = uniqueVertex.normal / length;
+					}
+				}
+			}
+
+			// Mesh optimization
+			//The triangles come in the order of the OBJ faces, which reuses few of the vertices still in the GPU's post-transform cache
+			//The optimized mesh is what the mesh cache stores, so only the import pays for it
+			importMesh.acmrBefore = VKMeshOptimizer::computeACMR(importMesh.indices, importMesh.vertices.size());
+			VKMeshOptimizer::optimizeVertexCache(importMesh.indices, importMesh.vertices.size());
+			VKMeshOptimizer::optimizeOverdraw(importMesh.indices, reinterpret_cast<const char*>(importMesh.vertices.data()), sizeof(Vertex), offsetof(Vertex, pos), importMesh.vertices.size());
+			importMesh.vertices.resize(VKMeshOptimizer::optimizeVertexFetch(importMesh.vertices.data(), importMesh.vertices.size(), sizeof(Vertex), importMesh.indices));
+			importMesh.acmrAfter = VKMeshOptimizer::computeACMR(importMesh.indices, importMesh.vertices.size());
+
+			//Bounding sphere for culling: centered on the bounding box, with the distance to the farthest vertex as radius
+			glm::vec3 minPosition(std::numeric_limits<float>::max());
+			glm::vec3 maxPosition(std::numeric_limits<float>::lowest());
+			for (const Vertex& uniqueVertex : importMesh.vertices) {
+				minPosition = glm::min(minPosition, uniqueVertex.pos);
+				maxPosition = glm::max(maxPosition, uniqueVertex.pos);
+			}
+			glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+			float radius = 0.0f;
+			for (const Vertex& uniqueVertex : importMesh.vertices) {
+				radius = std::max(radius, glm::length(uniqueVertex.pos - center));
+			}
+			importMesh.boundingSphere = glm::vec4(center, radius);
+
+			// Levels of detail
+			//Every level is simplified from the full mesh, so its error is measured against the surface that level 0 draws
+			//The levels share the vertices of the mesh, only their indices are new (and sorted for the vertex cache like the full mesh)
+			size_t previousIndexCount = importMesh.indices.size();
+			float previousError = 0.0f;
+			for (uint32_t lod = 1; lod < MAX_MESH_LODS; lod++) {
+				size_t targetIndexCount = static_cast<size_t>(importMesh.indices.size() / 3 * std::pow(MESH_LOD_REDUCTION, static_cast<float>(lod))) * 3;
+				if (targetIndexCount < MESH_LOD_MIN_TRIANGLES * 3) {
+					break;
+				}
+
+				std::vector<uint32_t> lodIndices;
+				float error = VKMeshOptimizer::simplify(lodIndices, importMesh.indices, reinterpret_cast<const char*>(importMesh.vertices.data()), sizeof(Vertex), offsetof(Vertex, pos), importMesh.vertices.size(), targetIndexCount, MESH_LOD_MAX_ERROR * radius);
+				if (lodIndices.size() > previousIndexCount * MESH_LOD_MIN_GAIN) {
+					break;
+				}
+				VKMeshOptimizer::optimizeVertexCache(lodIndices, importMesh.vertices.size());
+
+				//A coarser level is never picked before a finer one
+				previousError = std::max(previousError, error);
+				previousIndexCount = lodIndices.size();
+				importMesh.lodIndices.push_back(std::move(lodIndices));
+				importMesh.lodErrors.push_back(previousError);
+			}
+
+			//Packed positions are quantized inside the bounding cube of the mesh
+			//A cube instead of the box keeps the dequantization a uniform scale, so the vertex shader can transform the normals with the instance matrix
+			importMesh.positionQuantization = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			if (USE_PACKED_VERTICES) {
+				glm::vec3 extent = maxPosition - minPosition;
+				float size = std::max(extent.x, std::max(extent.y, extent.z));
+				if (!importMesh.vertices.empty() && size > 0.0f) {
+					importMesh.positionQuantization = glm::vec4(minPosition, size);
+				}
+
+				importMesh.packedVertices.resize(importMesh.vertices.size());
+				for (size_t v = 0; v < importMesh.vertices.size(); v++) {
+					importMesh.packedVertices[v] = PackedVertex::pack(importMesh.vertices[v], importMesh.positionQuantization);
+				}
+				std::vector<Vertex>().swap(importMesh.vertices);
+			}
+		});
+	}
+	jobSystem.wait();
+
+	//The scene packs the meshes at the end of the megabuffers in shape order, the indices of a mesh start at its first vertex
+	for (size_t i = 0; i < importMeshes.size(); i++) {
+		const ImportMesh& importMesh = importMeshes[i];
+		std::cout << "Mesh " << shapes[i].name << ": ACMR " << importMesh.acmrBefore << " -> " << importMesh.acmrAfter << ", triangles per level " << importMesh.indices.size() / 3;
+		for (const std::vector<uint32_t>& lodIndices : importMesh.lodIndices) {
+			std::cout << " " << lodIndices.size() / 3;
+		}
+		std::cout << std::endl;
+
+		uint32_t meshIndex;
+		if (USE_PACKED_VERTICES) {
+			meshIndex = scene.addMesh(importMesh.packedVertices.data(), static_cast<uint32_t>(importMesh.packedVertices.size()), importMesh.indices.data(), static_cast<uint32_t>(importMesh.indices.size()), importMesh.boundingSphere, importMesh.positionQuantization, importMesh.materialIndex);
+		}
+		else {
+			meshIndex = scene.addMesh(importMesh.vertices.data(), static_cast<uint32_t>(importMesh.vertices.size()), importMesh.indices.data(), static_cast<uint32_t>(importMesh.indices.size()), importMesh.boundingSphere, importMesh.positionQuantization, importMesh.materialIndex);
+		}
+		//Right after their mesh, the levels of a mesh are next to each other in the index megabuffer
+		for (size_t lod = 0; lod < importMesh.lodIndices.size(); lod++) {
+			scene.addMeshLod(meshIndex, importMesh.lodIndices[lod].data(), static_cast<uint32_t>(importMesh.lodIndices[lod].size()), importMesh.lodErrors[lod]);
+		}
+	}
+}
+
+void VKApplication::createVertexBuffer(){
+	//The vertices of every mesh of the scene go into this single buffer
+	VkDeviceSize bufferSize = scene.getVertexDataSize();
+	// Reserve space in the staging ring (Host-Visible Memory in RAM)
 	//A staging buffer allows you to upload data in a single batch and then efficiently transfer it to device-local memory (VRAM in GPU), minimizing PCIe traffic.
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	//Instead of creating a staging buffer for every upload we take a range of the staging ring, which is created once and reused by all uploads
+	VKStagingRegion stagingRegion = allocateStagingRegion(bufferSize);
 
 	// Filling the staging buffer
 
 	//It is now time to copy the vertex data to the buffer. This is done by mapping the buffer memory into CPU accessible memory with vkMapMemory.
 	//This function allows us to access a region of the specified memory resource defined by an offset and size.
 	//It is also possible to specify the special value VK_WHOLE_SIZE to map all of the memory.
-	void* data; //CPU accessible memory (Host-visible memory in RAM)
-	vkMapMemory(logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
+	//The ring buffer stays mapped for the application's whole lifetime, so the region already has a CPU pointer to its range (Host-visible memory in RAM)
 
 	//You can now simply memcpy the vertex data to the mapped memory
-	memcpy(data, vertices.data(), (size_t)bufferSize);
-
-	vkUnmapMemory(logicalDevice, stagingBufferMemory);
+	//When the model comes from the mesh cache this reads the mapped file, the OS pages it in as the copy goes
+	memcpy(stagingRegion.mapped, scene.getVertexData(), (size_t)bufferSize);
 
 	//Unfortunately the driver may not immediately copy the data into the buffer memory, for example because of caching. It is also possible that writes to the buffer are not visible in the mapped memory yet. 
 	// - Use a memory heap that is host coherent, indicated with VK_MEMORY_PROPERTY_HOST_COHERENT_BIT (we used this when finding a memory type)
@@ -1045,79 +2065,172 @@ void VKApplication::createVertexBuffer(){
 
 	// Create vertex buffer using device local memory
 
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferAllocation);
 
 
 	//Copy Staging buffer [Host-Visible] content to Vertex buffer [device local]
-	copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+	//The graphics queue reads it as vertex attributes
+	copyBuffer(stagingRegion.buffer, vertexBuffer, bufferSize, stagingRegion.offset, VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT);
 
-	//After copying the data from the staging buffer to the device buffer, we clean up staging buffer and staging  buffer memory
-	vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+	//Nothing to clean up, the ring range is reused once the transfer timeline reaches the value of the copy
 }
 
 void VKApplication::createIndexBuffer(){
 
 	//Same as creating a vertex buffer
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+	//16 or 32-bit indices, chosen by the scene from the size of its meshes
+	VkDeviceSize bufferSize = scene.getIndexDataSize();
 
-	//Create staging buffer (Host-visible) copy indices array into
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	//Reserve a range of the staging ring (Host-visible) copy indices array into
+	VKStagingRegion stagingRegion = allocateStagingRegion(bufferSize);
 
 	//Copy indices array content into stagin buffer
-	void* data;
-	vkMapMemory(logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(logicalDevice, stagingBufferMemory);
+	memcpy(stagingRegion.mapped, scene.getIndexData(), (size_t)bufferSize);
 
 	//Create index buffer, destination where we transfer the content of the staging buffer
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferAllocation);
 
 	//Copy content from staging buffer (Host-visible in RAM) to indexBuffer in (device local VRAM in GPU)
-	copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+	copyBuffer(stagingRegion.buffer, indexBuffer, bufferSize, stagingRegion.offset, VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT);
+}
 
-	//Cleanup temp staging buffer used for transfer
-	vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+void VKApplication::createDrawDataBuffer(){
+	//Per-draw data of the scene, uploaded once like the vertices (the meshes don't change)
+	std::vector<VKDrawData> drawData = scene.buildDrawData();
+	VkDeviceSize bufferSize = sizeof(VKDrawData) * drawData.size();
+
+	VKStagingRegion stagingRegion = allocateStagingRegion(bufferSize);
+	memcpy(stagingRegion.mapped, drawData.data(), (size_t)bufferSize);
+
+	//A storage buffer (SSBO) can be much larger than a uniform buffer, the culling shader indexes it with the draw of the instance
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawDataBuffer, drawDataBufferAllocation);
+
+	//Only the culling shader reads the bounding spheres
+	copyBuffer(stagingRegion.buffer, drawDataBuffer, bufferSize, stagingRegion.offset, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
 }
 
-void VKApplication::createUniformBuffers(){
-	//We're going to copy new data to the uniform buffer every frame, so it doesn't really make any sense to have a staging buffer. It would just add extra overhead .
+void VKApplication::createIndirectBuffer(){
+	//The parameters of every vkCmdDrawIndexed of the scene, the GPU reads them when executing vkCmdDrawIndexedIndirect
+	std::vector<VkDrawIndexedIndirectCommand> drawCommands = scene.buildDrawCommands();
+	VkDeviceSize bufferSize = sizeof(VkDrawIndexedIndirectCommand) * drawCommands.size();
+
+	//The culling shader counts the visible instances of every draw, so the draws start empty
+	for (VkDrawIndexedIndirectCommand& drawCommand : drawCommands) {
+		drawCommand.instanceCount = 0;
+	}
+
+	VKStagingRegion stagingRegion = allocateStagingRegion(bufferSize);
+	memcpy(stagingRegion.mapped, drawCommands.data(), (size_t)bufferSize);
+
+	//Never drawn directly, it is the source copied into the instanced indirect buffer of the frame before culling
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirectBuffer, indirectBufferAllocation);
 
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+	copyBuffer(stagingRegion.buffer, indirectBuffer, bufferSize, stagingRegion.offset, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+}
+
+void VKApplication::createInstanceBuffers(){
+	//Written by the CPU every frame like the uniform buffers, so there is no staging buffer and every frame in flight has its own
+	VkDeviceSize bufferSize = sizeof(VKInstanceData) * scene.getInstanceCount();
 
-	//We should have multiple buffers, because multiple frames may be in flight at the same time and we don't want to update the buffer in preparation of the next frame while a previous one is still reading from it!
-	//We need to have as many uniform buffers as we have frames in flight, and write to a uniform buffer that is not currently being read by the GPU
-	uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	instanceBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	instanceBuffersAllocation.resize(MAX_FRAMES_IN_FLIGHT);
+	instanceBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	culledInstanceBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	culledInstanceBuffersAllocation.resize(MAX_FRAMES_IN_FLIGHT);
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		//Create buffer
-		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
+		//Persistently mapped, read by the culling shader as a storage buffer
+		createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, instanceBuffers[i], instanceBuffersAllocation[i]);
+		instanceBuffersMapped[i] = static_cast<VKInstanceData*>(instanceBuffersAllocation[i].mapped);
 
-		//Map pointer to access in CPU the uniform buffer memory 
-		//We map the buffer right after creation using vkMapMemory to get a pointer to which we can write the data later on. 
-		//The buffer stays mapped to this pointer for the application's whole lifetime. This technique is called "persistent mapping" and works on all Vulkan implementations.
-		//Not having to map the buffer every time we need to update it increases performances, as mapping is not free.
-		vkMapMemory(logicalDevice, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+		//Written by the culling shader, read by the vertex input stage as the instance rate binding
+		//Every level of detail of a mesh has room for all its instances
+		createBuffer(sizeof(VKCulledInstanceData) * scene.getCulledInstanceCount(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, culledInstanceBuffers[i], culledInstanceBuffersAllocation[i]);
+	}
+}
 
-		//Instead of manually allocating memory for uniform buffers, many implementations use Vulkan descriptor sets to manage uniform buffer memory implicitly.
-		//vkAllocateDescriptorSets() and vkUpdateDescriptorSets() handle memory assignment and binding
+void VKApplication::createInstanceTransforms(){
+	//The instance transforms of the scene only translate, rotate and scale uniformly, so they split back into a position, a rotation and a scale
+	const std::vector<VKSceneInstance>& instances = scene.getInstances();
+	transforms.clear();
+	for (const VKSceneInstance& instance : instances) {
+		float scale = glm::length(glm::vec3(instance.transform[0]));
+		glm::quat rotation = glm::quat_cast(glm::mat3(instance.transform) / scale);
+		transforms.addNode(glm::vec3(instance.transform[3]), rotation, scale);
+	}
+	//Every instance spins around its own origin: the child's world matrix is instance.transform * spin, set by updateInstanceBuffer
+	firstSpinNode = transforms.getNodeCount();
+	for (uint32_t i = 0; i < instances.size(); i++) {
+		transforms.addNode(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 1.0f, i);
+	}
+
+	//The draw of an instance never changes, it is written once and the matrices every frame
+	instanceBuffersVersion.assign(MAX_FRAMES_IN_FLIGHT, 0);
+	for (size_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+		for (size_t i = 0; i < instances.size(); i++) {
+			instanceBuffersMapped[frame][i].drawIndex = instances[i].drawIndex;
+		}
 	}
 }
 
+void VKApplication::createCullingBuffers(){
+	//Written by the culling shader every frame, so every frame in flight has its own (like the uniform buffers)
+	VkDeviceSize bufferSize = sizeof(VkDrawIndexedIndirectCommand) * scene.getDrawCount();
+
+	instancedIndirectBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	instancedIndirectBuffersAllocation.resize(MAX_FRAMES_IN_FLIGHT);
+	culledIndirectBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	culledIndirectBuffersAllocation.resize(MAX_FRAMES_IN_FLIGHT);
+	drawCountBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	drawCountBuffersAllocation.resize(MAX_FRAMES_IN_FLIGHT);
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		//Reset from the indirect buffer with vkCmdCopyBuffer before the culling dispatch
+		createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instancedIndirectBuffers[i], instancedIndirectBuffersAllocation[i]);
+
+		createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, culledIndirectBuffers[i], culledIndirectBuffersAllocation[i]);
+
+		//A single uint, cleared with vkCmdFillBuffer before the culling dispatch
+		createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCountBuffers[i], drawCountBuffersAllocation[i]);
+	}
+}
+
+void VKApplication::createMaterialBuffers(){
+	//Written by the CPU every frame like the instance buffers, the culling shader copies the element of the instance's material next to its matrix
+	VkDeviceSize bufferSize = sizeof(uint32_t) * streamedTextures.size();
+
+	materialBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	materialBuffersAllocation.resize(MAX_FRAMES_IN_FLIGHT);
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, materialBuffers[i], materialBuffersAllocation[i]);
+	}
+}
+
+void VKApplication::createUniformBuffers(){
+	//We're going to copy new data to the uniform buffer every frame, so it doesn't really make any sense to have a staging buffer. It would just add extra overhead .
+
+	//We can't update the uniforms in preparation of the next frame while a previous one is still reading them, so every frame in flight has its own region of the ring
+	//Dynamic offsets must be multiples of minUniformBufferOffsetAlignment
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+	VkDeviceSize bufferSize = VKUniformRing::getBufferSize(UNIFORM_RING_FRAME_SIZE, MAX_FRAMES_IN_FLIGHT, alignment);
+
+	createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformRingBuffer, uniformRingAllocation);
+
+	//The allocator maps the host visible block right after allocating it, and the buffer stays mapped for the application's whole lifetime ("persistent mapping").
+	//Not having to map the buffer every time we need to update it increases performances, as mapping is not free.
+	uniformRing.init(uniformRingBuffer, uniformRingAllocation.mapped, UNIFORM_RING_FRAME_SIZE, MAX_FRAMES_IN_FLIGHT, alignment);
+}
+
 void VKApplication::createDescriptorPool() {
 	//Descriptor sets can't be created directly, they must be allocated from a pool like command buffers
 
 	// Describe which descriptor types our descriptor sets are going to contain and how many of them
-	std::array<VkDescriptorPoolSize, 2> poolSizes{};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);// We will allocate one of these descriptors for every frame.
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	std::array<VkDescriptorPoolSize, 1> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = 1;// A single descriptor for every frame, the dynamic offset selects the frame's region
 	
 	//Create info
 	VkDescriptorPoolCreateInfo poolInfo{};
@@ -1125,13 +2238,29 @@ void VKApplication::createDescriptorPool() {
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
 	//Aside from the maximum number of individual descriptors that are available, we also need to specify the maximum number of descriptor sets that may be allocated:
-	poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	poolInfo.maxSets = 1;
 
 	// Create Descriptor Pool
 	if (vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create descriptor pool!");
 	}
 
+	//The bindless set is a single set shared by every frame, the textures it points to don't change from one frame to the next
+	VkDescriptorPoolSize bindlessPoolSize{};
+	bindlessPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindlessPoolSize.descriptorCount = bindlessTextureCapacity;
+
+	VkDescriptorPoolCreateInfo bindlessPoolInfo{};
+	bindlessPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	bindlessPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	bindlessPoolInfo.poolSizeCount = 1;
+	bindlessPoolInfo.pPoolSizes = &bindlessPoolSize;
+	bindlessPoolInfo.maxSets = 1;
+
+	if (vkCreateDescriptorPool(logicalDevice, &bindlessPoolInfo, nullptr, &bindlessDescriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create bindless descriptor pool!");
+	}
+
 	//Notes:
 	// 
 	//- As of Vulkan 1.1: Inadequate descriptor pools are a good example of a problem that the validation layers will not catch
@@ -1148,58 +2277,241 @@ void VKApplication::createDescriptorSets(){
 	//You need to specify the descriptor pool to allocate from
 	//The number of descriptor sets to allocate
 	//The descriptor layout to base them on
-	std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
 	VkDescriptorSetAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT); //In our case we will create one descriptor set for each frame in flight, all with the same layout.
-	allocInfo.pSetLayouts = layouts.data();
+	allocInfo.descriptorSetCount = 1; //One set for every frame in flight, they only differ by the dynamic offset
+	allocInfo.pSetLayouts = &descriptorSetLayout;
 
 	//Allocate memory for descriptor set
-
-	descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-	if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+	if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, &descriptorSet) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate descriptor sets!");
 	}
 
 	//Note: You don't need to explicitly clean up descriptor sets, because they will be automatically freed when the descriptor pool is destroyed.
 
-	//The descriptor sets have been allocated now, but the descriptors within still need to be configured. We'll now add a loop to populate every descriptor
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		//Uniform: This structure specifies the buffer and the region within it that contains the data for the descriptor
-		VkDescriptorBufferInfo bufferInfo{};
-		bufferInfo.buffer = uniformBuffers[i]; //VkBuffer we want to bind to descriptor set
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
+	//Uniform: This structure specifies the buffer and the region within it that contains the data for the descriptor
+	//The range is the size of one block of uniforms, the dynamic offset given at bind time is added to offset
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = uniformRingBuffer; //VkBuffer we want to bind to descriptor set
+	bufferInfo.offset = 0;
+	bufferInfo.range = sizeof(UniformBufferObject);
+
+	//The configuration of descriptors is updated using the vkUpdateDescriptorSets function, which takes an array of VkWriteDescriptorSet structs as parameter.
+	std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
+
+	//Struct to update uniform descriptor
+	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[0].dstSet = descriptorSet;
+	descriptorWrites[0].dstBinding = 0; //We gave our uniform buffer binding index 0
+	descriptorWrites[0].dstArrayElement = 0;//Remember that descriptors can be arrays, so we also need to specify the first index in the array that we want to update. We're not using an array, so the index is simply 0.
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrites[0].descriptorCount = 1; //The descriptorCount field specifies how many array elements you want to update.
+	descriptorWrites[0].pBufferInfo = &bufferInfo; //Our descriptor is based on buffers, so we're using pBufferInfo.
+
+	//It accepts two kinds of arrays as parameters: an array of VkWriteDescriptorSet and an array of VkCopyDescriptorSet. The latter can be used to copy descriptors to each other, as its name implies.
+	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+	// Bindless texture array
+	//Allocated with the full capacity so textures added later only need a descriptor write, the elements past the textures are left unwritten (partially bound)
+	VkDescriptorSetVariableDescriptorCountAllocateInfo variableCountInfo{};
+	variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+	variableCountInfo.descriptorSetCount = 1;
+	variableCountInfo.pDescriptorCounts = &bindlessTextureCapacity;
+
+	VkDescriptorSetAllocateInfo bindlessAllocInfo{};
+	bindlessAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	bindlessAllocInfo.pNext = &variableCountInfo;
+	bindlessAllocInfo.descriptorPool = bindlessDescriptorPool;
+	bindlessAllocInfo.descriptorSetCount = 1;
+	bindlessAllocInfo.pSetLayouts = &bindlessDescriptorSetLayout;
+
+	if (vkAllocateDescriptorSets(logicalDevice, &bindlessAllocInfo, &bindlessDescriptorSet) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate bindless descriptor set!");
+	}
 
-		//The resources for a combined image sampler structure 
-		VkDescriptorImageInfo imageInfo{};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; //Image meant to be read in shader
-		imageInfo.imageView = textureImageView;
-		imageInfo.sampler = textureSampler;
+	//Element 0 is the placeholder, the streamed textures are written to the other elements when they become resident (updateStreaming)
+	//The image is only sampled once its upload has been acquired, the descriptor can point to it before that
+	VkDescriptorImageInfo placeholderInfo{};
+	placeholderInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; //Image meant to be read in shader
+	placeholderInfo.imageView = placeholderTexture.view;
+	placeholderInfo.sampler = textureSampler;
+
+	VkWriteDescriptorSet placeholderWrite{};
+	placeholderWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	placeholderWrite.dstSet = bindlessDescriptorSet;
+	placeholderWrite.dstBinding = 0;
+	placeholderWrite.dstArrayElement = 0;
+	placeholderWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	placeholderWrite.descriptorCount = 1;
+	placeholderWrite.pImageInfo = &placeholderInfo;
+	vkUpdateDescriptorSets(logicalDevice, 1, &placeholderWrite, 0, nullptr);
+
+	//Taken from the back, so the first textures get the first elements
+	for (uint32_t slot = bindlessTextureCapacity - 1; slot > 0; slot--) {
+		freeTextureSlots.push_back(slot);
+	}
+}
 
-		//The configuration of descriptors is updated using the vkUpdateDescriptorSets function, which takes an array of VkWriteDescriptorSet structs as parameter.
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+void VKApplication::createComputeDescriptorSets(){
+	//One culling and one compaction set per frame in flight and one depth reduce set per pyramid level
+	std::array<VkDescriptorPoolSize, 4> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * (5 + 3);
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) + depthPyramidLevels;
+	poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[3].descriptorCount = depthPyramidLevels;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2 + depthPyramidLevels;
+
+	if (vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &computeDescriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compute descriptor pool!");
+	}
+
+	// Culling sets
+
+	std::vector<VkDescriptorSetLayout> cullLayouts(MAX_FRAMES_IN_FLIGHT, cullDescriptorSetLayout);
+	VkDescriptorSetAllocateInfo cullAllocInfo{};
+	cullAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	cullAllocInfo.descriptorPool = computeDescriptorPool;
+	cullAllocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	cullAllocInfo.pSetLayouts = cullLayouts.data();
 
-		//Struct to update uniform descriptor
+	cullDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+	if (vkAllocateDescriptorSets(logicalDevice, &cullAllocInfo, cullDescriptorSets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate culling descriptor sets!");
+	}
+
+	// Compaction sets
+
+	std::vector<VkDescriptorSetLayout> compactLayouts(MAX_FRAMES_IN_FLIGHT, compactDescriptorSetLayout);
+	VkDescriptorSetAllocateInfo compactAllocInfo{};
+	compactAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	compactAllocInfo.descriptorPool = computeDescriptorPool;
+	compactAllocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	compactAllocInfo.pSetLayouts = compactLayouts.data();
+
+	compactDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+	if (vkAllocateDescriptorSets(logicalDevice, &compactAllocInfo, compactDescriptorSets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate compaction descriptor sets!");
+	}
+
+	//The culling and compaction sets point to the scene's buffers, they are written once it is loaded
+	if (sceneLoaded) {
+		writeCullingDescriptorSets();
+	}
+
+	// Depth reduce sets
+
+	std::vector<VkDescriptorSetLayout> reduceLayouts(depthPyramidLevels, depthReduceDescriptorSetLayout);
+	VkDescriptorSetAllocateInfo reduceAllocInfo{};
+	reduceAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	reduceAllocInfo.descriptorPool = computeDescriptorPool;
+	reduceAllocInfo.descriptorSetCount = depthPyramidLevels;
+	reduceAllocInfo.pSetLayouts = reduceLayouts.data();
+
+	depthReduceDescriptorSets.resize(depthPyramidLevels);
+	if (vkAllocateDescriptorSets(logicalDevice, &reduceAllocInfo, depthReduceDescriptorSets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate depth reduce descriptor sets!");
+	}
+
+	for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+		//Level 0 reads the depth image, every other level reads the level above it
+		VkDescriptorImageInfo srcInfo{};
+		srcInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+		srcInfo.imageView = level == 0 ? depthImageView : depthPyramidMipViews[level - 1];
+		srcInfo.sampler = depthPyramidSampler;
+
+		VkDescriptorImageInfo dstInfo{};
+		dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		dstInfo.imageView = depthPyramidMipViews[level];
+
+		std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
 		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[0].dstSet = descriptorSets[i];
-		descriptorWrites[0].dstBinding = 0; //We gave our uniform buffer binding index 0
-		descriptorWrites[0].dstArrayElement = 0;//Remember that descriptors can be arrays, so we also need to specify the first index in the array that we want to update. We're not using an array, so the index is simply 0.
-		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrites[0].descriptorCount = 1; //The descriptorCount field specifies how many array elements you want to update.
-		descriptorWrites[0].pBufferInfo = &bufferInfo; //Our descriptor is based on buffers, so we're using pBufferInfo.
-
-		//Struct to update combined image sampler
+		descriptorWrites[0].dstSet = depthReduceDescriptorSets[level];
+		descriptorWrites[0].dstBinding = 0;
+		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[0].descriptorCount = 1;
+		descriptorWrites[0].pImageInfo = &srcInfo;
+
 		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[1].dstSet = descriptorSets[i];
+		descriptorWrites[1].dstSet = depthReduceDescriptorSets[level];
 		descriptorWrites[1].dstBinding = 1;
-		descriptorWrites[1].dstArrayElement = 0;
-		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 		descriptorWrites[1].descriptorCount = 1;
-		descriptorWrites[1].pImageInfo = &imageInfo;
+		descriptorWrites[1].pImageInfo = &dstInfo;
+
+		vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	}
+}
+
+void VKApplication::writeCullingDescriptorSets(){
+	// Culling sets
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		//Same order as the bindings of cull.comp
+		std::array<VkDescriptorBufferInfo, 6> bufferInfos{};
+		bufferInfos[0] = { uniformRingBuffer, 0, sizeof(UniformBufferObject) };
+		bufferInfos[1] = { instanceBuffers[i], 0, VK_WHOLE_SIZE };
+		bufferInfos[2] = { drawDataBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[3] = { instancedIndirectBuffers[i], 0, VK_WHOLE_SIZE };
+		bufferInfos[4] = { culledInstanceBuffers[i], 0, VK_WHOLE_SIZE };
+		bufferInfos[5] = { materialBuffers[i], 0, VK_WHOLE_SIZE };
+
+		//The pyramid is always in VK_IMAGE_LAYOUT_GENERAL, it is written and read by compute shaders
+		VkDescriptorImageInfo pyramidInfo{};
+		pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		pyramidInfo.imageView = depthPyramidView;
+		pyramidInfo.sampler = depthPyramidSampler;
+
+		//Binding 5 is the pyramid, the buffers after it are shifted by one
+		std::array<VkWriteDescriptorSet, 7> descriptorWrites{};
+		for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+			descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[binding].dstSet = cullDescriptorSets[i];
+			descriptorWrites[binding].dstBinding = binding;
+			descriptorWrites[binding].dstArrayElement = 0;
+			descriptorWrites[binding].descriptorCount = 1;
+			if (binding != 5) {
+				descriptorWrites[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				descriptorWrites[binding].pBufferInfo = &bufferInfos[binding < 5 ? binding : binding - 1];
+			}
+			else {
+				descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				descriptorWrites[binding].pImageInfo = &pyramidInfo;
+			}
+		}
+
+		vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	}
+
+	// Compaction sets
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		//Same order as the bindings of compactdraws.comp
+		std::array<VkDescriptorBufferInfo, 3> bufferInfos{};
+		bufferInfos[0] = { instancedIndirectBuffers[i], 0, VK_WHOLE_SIZE };
+		bufferInfos[1] = { culledIndirectBuffers[i], 0, VK_WHOLE_SIZE };
+		bufferInfos[2] = { drawCountBuffers[i], 0, VK_WHOLE_SIZE };
+
+		std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+		for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+			descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[binding].dstSet = compactDescriptorSets[i];
+			descriptorWrites[binding].dstBinding = binding;
+			descriptorWrites[binding].dstArrayElement = 0;
+			descriptorWrites[binding].descriptorCount = 1;
+			descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+		}
 
-		//It accepts two kinds of arrays as parameters: an array of VkWriteDescriptorSet and an array of VkCopyDescriptorSet. The latter can be used to copy descriptors to each other, as its name implies.
 		vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 	}
 }
@@ -1225,29 +2537,52 @@ void VKApplication::createCommandBuffers(){
 	}
 }
 
+void VKApplication::createWorkerCommandPools(){
+	//Command pools are externally synchronized: a pool, and the command buffers allocated from it, can only be used by one thread at a time
+	//Giving every worker its own pool for every frame in flight means no locking while recording, and a frame's pools can be reset while the other frame is still executing
+	QueueFamilyIndices queueFamiliyIndices = findQueueFamilies(physicalDevice);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;//Re-recorded every frame, the whole pool is reset with vkResetCommandPool
+	poolInfo.queueFamilyIndex = queueFamiliyIndices.graphicsFamily.value();
+
+	workerCommandPools.resize(MAX_FRAMES_IN_FLIGHT);
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		workerCommandPools[i].resize(jobSystem.getWorkerCount());
+		for (WorkerCommandPool& workerPool : workerCommandPools[i]) {
+			if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &workerPool.pool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create worker command pool!");
+			}
+		}
+	}
+}
+
 void VKApplication::createSyncObjects(){
 	//Resize syncronization vectors for desired in flight frames
 	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
 
 	VkSemaphoreCreateInfo semaphoreInfo{};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	//inFlightFence is only signaled after a frame has finished rendering, yet since this is the first frame, there are no previous frames in which to signal the fence! Thus vkWaitForFences() blocks indefinitely, waiting on something which will never happen.
-	//reate the fence in the signaled state, so that the first call to vkWaitForFences() returns immediately since the fence is already signaled.
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
+	//There is no fence per frame: a frame waits on the graphics timeline value of the frame that used the same objects before it, the first frames have nothing to wait for
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		//Create semaphores and fence
+		//Create semaphores
 		if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-			vkCreateFence(logicalDevice, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+			vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create synchronization objects for a frame!");
 		}
 	}
+
+	//Flushed with the graphics timeline
+	deletionQueue.init();
+	frameArena.init(FRAME_ARENA_SIZE);
+}
+
+void VKApplication::createProfiler(){
+	//The frames are submitted to the graphics queue, its family decides if timestamps are supported
+	profiler.init(physicalDevice, logicalDevice, graphicsQueueFamily, MAX_FRAMES_IN_FLIGHT, pipelineStatisticsSupported, PROFILER_CSV_PATH);
 }
 
 bool VKApplication::checkValidationLayerSupport(){
@@ -1311,8 +2646,9 @@ bool VKApplication::isDeviceSuitable(VkPhysicalDevice device){
 
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
 	//Check for adequate swapChain support in surface with correct formats and presentation modes
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	//Headless: there is no surface, so no swap chain to check
+	bool swapChainAdequate = headless;
+	if (extensionsSupported && !headless) {
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
@@ -1321,10 +2657,26 @@ bool VKApplication::isDeviceSuitable(VkPhysicalDevice device){
 	VkPhysicalDeviceFeatures supportedFeatures;
 	vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-	return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+	//Features added after Vulkan 1.0 are queried chaining their structs to VkPhysicalDeviceFeatures2
+	VkPhysicalDeviceVulkan12Features supportedVulkan12Features{};
+	supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 supportedFeatures2{};
+	supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures2.pNext = &supportedVulkan12Features;
+	vkGetPhysicalDeviceFeatures2(device, &supportedFeatures2);
+
+	//The textures are only bound through the bindless array, there is no path without descriptor indexing
+	bool descriptorIndexingSupported = supportedVulkan12Features.runtimeDescriptorArray && supportedVulkan12Features.descriptorBindingVariableDescriptorCount && supportedVulkan12Features.descriptorBindingPartiallyBound &&
+		supportedVulkan12Features.descriptorBindingSampledImageUpdateAfterBind && supportedVulkan12Features.descriptorBindingUpdateUnusedWhilePending && supportedVulkan12Features.shaderSampledImageArrayNonUniformIndexing;
+
+	return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy && supportedFeatures.drawIndirectFirstInstance && supportedVulkan12Features.timelineSemaphore && descriptorIndexingSupported;
 }
 
 int VKApplication::ratePhysicalDeviceSuitability(VkPhysicalDevice device){
+	//A device without the queue families, extensions and features the application can't run without is never picked, whatever its score
+	if (!isDeviceSuitable(device)) {
+		return 0;
+	}
 
 	VkPhysicalDeviceProperties deviceProperties;
 	vkGetPhysicalDeviceProperties(device, &deviceProperties);
@@ -1356,11 +2708,13 @@ int VKApplication::ratePhysicalDeviceSuitability(VkPhysicalDevice device){
 
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
 	//Check for adequate swapChain support in surface with correct formats and presentation modes
-	bool swapChainAdequate = false;
+	bool swapChainAdequate = headless;
 	if (extensionsSupported) {
 		score += 1000;
-		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+		if (!headless) {
+			SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
+			swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+		}
 	}
 
 	if (indices.isComplete())
@@ -1387,26 +2741,41 @@ QueueFamilyIndices VKApplication::findQueueFamilies(VkPhysicalDevice device) con
 
 	int i = 0;
 	for (const auto& queueFamily : queueFamilies){
-		//Masks 32 bits, using VK_QUEUE_GRAPHICS_BIT position and if after the result is 1 this means the queue family has graphics capabilities
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT){
-			indices.graphicsFamily = i;
-		}
+		//Once graphics and presentation are found keep them, the loop only goes on looking for a transfer family
+		if (!indices.isComplete()) {
+			//Masks 32 bits, using VK_QUEUE_GRAPHICS_BIT position and if after the result is 1 this means the queue family has graphics capabilities
+			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT){
+				indices.graphicsFamily = i;
+			}
 
-		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+			//Headless: nothing is presented, the present family is the graphics one
+			VkBool32 presentSupport = headless && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+			if (!headless) {
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+			}
 
-		if (presentSupport) {
-			indices.presentFamily = i;
+			if (presentSupport) {
+				indices.presentFamily = i;
+			}
 		}
 
-		//Exit early if all required indices where found
-		if (indices.isComplete()) {
-			break;
+		//Dedicated transfer family: supports transfer but not graphics. On discrete GPUs these queues are the copy (DMA) engines, they copy over PCIe while the graphics queue keeps rendering
+		//A family with only VK_QUEUE_TRANSFER_BIT is preferred over a compute one
+		if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+			if (!indices.transferFamily.has_value() || 
+				(!(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && (queueFamilies[indices.transferFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT))) {
+				indices.transferFamily = i;
+			}
 		}
 
 		i++;
 	}
 
+	//No dedicated transfer family, uploads go to the graphics family (graphics queues implicitly support transfer operations)
+	if (!indices.transferFamily.has_value()) {
+		indices.transferFamily = indices.graphicsFamily;
+	}
+
 	return indices;
 }
 
@@ -1418,7 +2787,8 @@ bool VKApplication::checkDeviceExtensionSupport(VkPhysicalDevice device){
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-	std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+	std::vector<const char*> extensions = getDeviceExtensions();
+	std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
 	//Loop available extensions and remove them from requiredExtenisons if requiredExtensions is empty then it has all required extensions
 	for (const auto& extension : availableExtensions) {
@@ -1428,6 +2798,29 @@ bool VKApplication::checkDeviceExtensionSupport(VkPhysicalDevice device){
 	return requiredExtensions.empty();
 }
 
+std::vector<const char*> VKApplication::getDeviceExtensions() const{
+	//The swap chain extension is the only required one, and VK_IMAGE_LAYOUT_PRESENT_SRC_KHR comes with it
+	if (headless) {
+		return {};
+	}
+	return deviceExtensions;
+}
+
+bool VKApplication::isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName){
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& extension : availableExtensions) {
+		if (strcmp(extension.extensionName, extensionName) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
 SwapChainSupportDetails VKApplication::querySwapChainSupport(VkPhysicalDevice device) const{
 	SwapChainSupportDetails details;
 
@@ -1469,12 +2862,13 @@ VkSurfaceFormatKHR VKApplication::chooseSwapSurfaceFormat(const std::vector<VkSu
 }
 
 VkPresentModeKHR VKApplication::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes){
-	//VK_PRESENT_MODE_MAILBOX_KHR is a very nice trade-off if energy usage is not a concern. It allows us to avoid tearing 
-	// while still maintaining a fairly low latency by rendering new images that are as up-to-date as possible right until the vertical blank. 
-	// On mobile devices, where energy usage is more important, you will probably want to use VK_PRESENT_MODE_FIFO_KHR instead.
-	for (const auto& availablePresentMode : availablePresentModes) {
-		if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-			return availablePresentMode;
+	//The low latency profile prefers VK_PRESENT_MODE_IMMEDIATE_KHR then VK_PRESENT_MODE_MAILBOX_KHR, they show the newest image without waiting for the queue to drain
+	//The throughput profile uses VK_PRESENT_MODE_FIFO_KHR, which is also what mobile devices want since no rendered image is thrown away
+	for (VkPresentModeKHR presentMode : getFramePacingProfile().presentModes) {
+		for (const auto& availablePresentMode : availablePresentModes) {
+			if (availablePresentMode == presentMode) {
+				return availablePresentMode;
+			}
 		}
 	}
 	return VK_PRESENT_MODE_FIFO_KHR;
@@ -1520,44 +2914,6 @@ VkExtent2D VKApplication::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capab
 	}
 }
 
-std::vector<char> VKApplication::readFile(const std::string& filename){
-	//ate: Start reading at end of the file (so that we can use the read postion to deremine the size of the file). Opens the file and moves the read position to the end immediately
-	//binary: read the file as a binary file (avoid text transformation)
-
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-	if (!file.is_open()) {
-		std::cout << "Failed to open file!" << std::endl;
-		throw std::runtime_error("Failed to open file!");
-	}
-
-	//Initialize buffer with the size of the file
-	size_t fileSize = (size_t) file.tellg();//Return the current postion of the read pointer which is at the end of the file
-	std::vector<char> buffer(fileSize);
-	
-	//Seek back to the beginning of the file and read all of the bytes at once:
-	file.seekg(0); //Moves the read position back to the beginning of the file.
-	file.read(buffer.data(), fileSize);// Reads fileSize bytes into the buffer.
-	file.close();
-
-	return buffer;
-}
-
-VkShaderModule VKApplication::createShaderModule(const std::vector<char>& code) const{
-	//Struct that provide info for creating shader module
-	VkShaderModuleCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data()); //reinterpret_cast<const uint32_t*> is used to reinterpret std::vector<char> data as uint32_t* because Vulkan expects the shader in 32-bit words (fixed-size unit of data SPIR-V defines a word as 32 bits (4 bytes)).
-
-	//Create Shader Module
-	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(logicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create shader module!");
-	}
-
-	return shaderModule;
-}
-
 void VKApplication::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex){
 	// Begin Command buffer recording
 
@@ -1574,40 +2930,335 @@ void VKApplication::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
 		throw std::runtime_error("Failed to being recoring command buffer!");
 	}
 
-	// Starting render pass
+	//The queries of this frame in flight were read after its graphics value was waited on, they can be reset and written again
+	profiler.beginGpuFrame(commandBuffer, currentFrame);
 
-	VkRenderPassBeginInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = renderPass;
-	// We created a framebuffer for each swap chain image where it is specified as a color attachment.
-	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex]; // we need to bind the framebuffer for the swapchain image we want to draw to. Using the imageIndex parameter which was passed in, we can pick the right framebuffer for the current swapchain image.
-	//Define the size fo the render area
-	//he render area defines where shader loads and stores will take place. 
-	// The pixels outside this region will have undefined values. It should match the size of the attachments for best performance.
-	renderPassInfo.renderArea.offset = { 0, 0 }; 
-	renderPassInfo.renderArea.extent = swapChainExtent;
-	// define the clear values to use for VK_ATTACHMENT_LOAD_OP_CLEAR, which we used as load operation for the color and depth attachment.
-	std::array<VkClearValue, 2> clearValues{};
-	clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}}; //Black with 100% opacity.
-	//The range of depths in the depth buffer is 0.0 to 1.0 in Vulkan, where 1.0 lies at the far view plane and 0.0 at the near view plane. 
-	//he initial value at each point in the depth buffer should be the furthest possible depth, which is 1.0.
-	clearValues[1].depthStencil = { 1.0f, 0 };
+	//Take ownership of the resources the transfer queue finished uploading, they have to be acquired outside of the render pass
+	recordUploadAcquires(commandBuffer);
+	profiler.endGpuScope(commandBuffer, currentFrame, VKGpuScope::Uploads);
 
-	//Note: Note that the order of clearValues should be identical to the order of your attachments.
+	//The scene is loaded on a streaming worker and uploaded on the transfer queue while we render, until its buffers have been acquired the frame only clears the screen
+	bool sceneReady = sceneLoaded && sceneTransferValue <= acquiredTransferValue && scene.getDrawCount() > 0;
 
-	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-	renderPassInfo.pClearValues = clearValues.data();
+	//Compute work can't run inside a render pass, the draws it produces are culled first
+	if (sceneReady) {
+		recordCulling(commandBuffer);
+	}
+	profiler.endGpuScope(commandBuffer, currentFrame, VKGpuScope::Culling);
+
+	// Starting the main pass
+	beginRendering(commandBuffer, imageIndex);
+
+	if (sceneReady) {
+		// Multi-threaded recording
+		//The draws are split in contiguous ranges of the indirect buffer, every range is recorded into a secondary command buffer by a worker thread
+		//Recording a secondary command buffer has a fixed cost, so a job gets at least MIN_DRAWS_PER_RECORDING_JOB draws
+		//The compacted draws only have a count on the GPU, so with drawIndirectCount the whole scene is a single job
+		uint32_t drawCount = scene.getDrawCount();
+		uint32_t jobCount = drawIndirectCountSupported ? 1 : std::min(jobSystem.getWorkerCount(), (drawCount + MIN_DRAWS_PER_RECORDING_JOB - 1) / MIN_DRAWS_PER_RECORDING_JOB);
+		uint32_t drawsPerJob = (drawCount + jobCount - 1) / jobCount;
+
+		//Every job writes only its own slot, the primary executes them in the same order as the draws
+		//The slots and the jobs are in the frame arena, and the job function only captures two pointers so it fits in the small buffer of std::function: nothing is allocated on the heap
+		VkCommandBuffer* secondaryCommandBuffers = frameArena.allocate<VkCommandBuffer>(jobCount);
+		DrawRecordingJob* recordingJobs = frameArena.allocate<DrawRecordingJob>(jobCount);
+		for (uint32_t job = 0; job < jobCount; job++) {
+			DrawRecordingJob* recordingJob = &recordingJobs[job];
+			recordingJob->firstDraw = job * drawsPerJob;
+			recordingJob->drawCount = std::min(drawsPerJob, drawCount - recordingJob->firstDraw);
+			recordingJob->imageIndex = imageIndex;
+			recordingJob->commandBuffer = &secondaryCommandBuffers[job];
+
+			jobSystem.submit([this, recordingJob](uint32_t workerIndex) {
+				VkCommandBuffer secondaryCommandBuffer = beginSecondaryCommandBuffer(workerIndex, recordingJob->imageIndex);
+				recordDraws(secondaryCommandBuffer, recordingJob->firstDraw, recordingJob->drawCount);
+				if (vkEndCommandBuffer(secondaryCommandBuffer) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to record secondary command buffer!");
+				}
+				*recordingJob->commandBuffer = secondaryCommandBuffer;
+			});
+		}
+		jobSystem.wait();
+
+		//Run the secondary command buffers inside the render pass of the primary
+		vkCmdExecuteCommands(commandBuffer, jobCount, secondaryCommandBuffers);
+	}
+
+	// End the main pass
+
+	endRendering(commandBuffer, imageIndex);
+	profiler.endGpuScope(commandBuffer, currentFrame, VKGpuScope::MainPass);
 
-	// Command to begin render pass
+	//The depth of this frame is what the next frame is occlusion culled against
+	recordDepthPyramid(commandBuffer);
+	profiler.endGpuScope(commandBuffer, currentFrame, VKGpuScope::DepthPyramid);
+	profiler.endGpuFrame(commandBuffer, currentFrame);
+
+	//End Command buffer
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record command buffer!");
+	}
+}
+
+void VKApplication::beginRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex){
+	if (!dynamicRenderingEnabled) {
+		// Starting render pass
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = renderPass;
+		// We created a framebuffer for each swap chain image where it is specified as a color attachment.
+		renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex]; // we need to bind the framebuffer for the swapchain image we want to draw to. Using the imageIndex parameter which was passed in, we can pick the right framebuffer for the current swapchain image.
+		//Define the size fo the render area
+		//he render area defines where shader loads and stores will take place. 
+		// The pixels outside this region will have undefined values. It should match the size of the attachments for best performance.
+		renderPassInfo.renderArea.offset = { 0, 0 }; 
+		renderPassInfo.renderArea.extent = swapChainExtent;
+		// define the clear values to use for VK_ATTACHMENT_LOAD_OP_CLEAR, which we used as load operation for the color and depth attachment.
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}}; //Black with 100% opacity.
+		//The range of depths in the depth buffer is 0.0 to 1.0 in Vulkan, where 1.0 lies at the far view plane and 0.0 at the near view plane. 
+		//he initial value at each point in the depth buffer should be the furthest possible depth, which is 1.0.
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		//Note: Note that the order of clearValues should be identical to the order of your attachments.
+
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+
+		// Command to begin render pass
 	
-	//VkSubpassContents controls how the drawing commands within the render pass will be provided:
-	//	VK_SUBPASS_CONTENTS_INLINE: The render pass commands will be embedded in the primary command buffer itself and no secondary command buffers will be executed.
-	//	VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: The render pass commands will be executed from secondary command buffers.
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		//VkSubpassContents controls how the drawing commands within the render pass will be provided:
+		//	VK_SUBPASS_CONTENTS_INLINE: The render pass commands will be embedded in the primary command buffer itself and no secondary command buffers will be executed.
+		//	VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: The render pass commands will be executed from secondary command buffers.
+		//The draws are recorded by the worker threads, so the only commands allowed inside the render pass are vkCmdExecuteCommands
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		return;
+	}
+
+	// Dynamic rendering
+	//Without a render pass nothing transitions the attachments, every one of them starts the frame in the undefined layout (its content is cleared or resolved over)
+	//The source stages are the last ones that used the image: the previous frame that drew into it (and the depth reduction that sampled the depth image),
+	//for the swap chain image the color attachment output stage the submit waits on the acquire semaphore at
+	bool msaa = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+	VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (hasStencilComponent(depthFormat)) {
+		depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+
+	VkImageMemoryBarrier2 colorBarrier{};
+	colorBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	colorBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	colorBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+	colorBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	colorBarrier.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;//Resolves are color attachment writes too
+	colorBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	colorBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	colorBarrier.image = swapChainImages[imageIndex];
+	colorBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	frameBarriers.addImageBarrier(colorBarrier);
+
+	//The depth image only waits for the depth reduction of the previous frame, the depth writes of that frame were already made available to it
+	VkImageMemoryBarrier2 depthBarrier = colorBarrier;
+	depthBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	depthBarrier.srcAccessMask = VK_ACCESS_2_NONE;//Write after read only needs the execution dependency
+	depthBarrier.dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.image = depthImage;
+	depthBarrier.subresourceRange.aspectMask = depthAspect;
+	if (msaa) {
+		//The depth image is the resolve attachment, written in the color attachment output stage
+		depthBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		depthBarrier.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+	}
+	frameBarriers.addImageBarrier(depthBarrier);
+
+	if (msaa) {
+		//The multisampled attachments were last written by the previous frame (write after write)
+		VkImageMemoryBarrier2 msaaColorBarrier = colorBarrier;
+		msaaColorBarrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+		msaaColorBarrier.image = colorImage;
+		frameBarriers.addImageBarrier(msaaColorBarrier);
+
+		VkImageMemoryBarrier2 msaaDepthBarrier = depthBarrier;
+		msaaDepthBarrier.srcStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+		msaaDepthBarrier.srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		msaaDepthBarrier.dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+		msaaDepthBarrier.dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		msaaDepthBarrier.image = msaaDepthImage;
+		frameBarriers.addImageBarrier(msaaDepthBarrier);
+	}
+
+	//All the transitions in one barrier
+	frameBarriers.flush(commandBuffer);
+
+	//Same load and store operations as the render pass: cleared, the multisampled attachments are only resolved
+	VkRenderingAttachmentInfo colorAttachment{};
+	colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	colorAttachment.imageView = swapChainImageViews[imageIndex];
+	colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.clearValue.color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+
+	VkRenderingAttachmentInfo depthAttachment{};
+	depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depthAttachment.imageView = depthImageView;
+	depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;//Reduced into the depth pyramid
+	depthAttachment.clearValue.depthStencil = { 1.0f, 0 };
+
+	if (msaa) {
+		colorAttachment.imageView = colorImageView;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+		colorAttachment.resolveImageView = swapChainImageViews[imageIndex];
+		colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		depthAttachment.imageView = msaaDepthImageView;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.resolveMode = depthResolveMode;
+		depthAttachment.resolveImageView = depthImageView;
+		depthAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	}
+
+	VkRenderingInfo renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	//Like VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, the draws come from the worker threads
+	renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+	renderingInfo.renderArea.offset = { 0, 0 };
+	renderingInfo.renderArea.extent = swapChainExtent;
+	renderingInfo.layerCount = 1;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachments = &colorAttachment;
+	renderingInfo.pDepthAttachment = &depthAttachment;//The stencil component of the format (if any) isn't used
+
+	vkCmdBeginRendering(commandBuffer, &renderingInfo);
+}
+
+void VKApplication::endRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex){
+	if (!dynamicRenderingEnabled) {
+		//The final layouts and the dependency to the depth reduction are part of the render pass
+		vkCmdEndRenderPass(commandBuffer);
+		return;
+	}
+
+	vkCmdEndRendering(commandBuffer);
+
+	//The layouts the render pass would have finished in
+	//Depth: sampled by depthreduce.comp, written by the depth tests or (MSAA) by the resolve
+	VkImageMemoryBarrier2 depthBarrier{};
+	depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	depthBarrier.srcStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+	depthBarrier.srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = depthImage;
+	depthBarrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+	if (hasStencilComponent(depthFormat)) {
+		depthBarrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		depthBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		depthBarrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+	}
+	frameBarriers.addImageBarrier(depthBarrier);
+
+	//Swap chain image: presented after the submit signals the render finished semaphore, nothing waits on the barrier itself
+	//The offscreen images of the benchmark stay color attachments
+	if (!headless) {
+		VkImageMemoryBarrier2 presentBarrier{};
+		presentBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		presentBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		presentBarrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+		presentBarrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+		presentBarrier.dstAccessMask = VK_ACCESS_2_NONE;
+		presentBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		presentBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		presentBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		presentBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		presentBarrier.image = swapChainImages[imageIndex];
+		presentBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		frameBarriers.addImageBarrier(presentBarrier);
+	}
+
+	//Not flushed here: recordDepthPyramid records them together with the barrier of the pyramid
+}
+
+VkCommandBuffer VKApplication::beginSecondaryCommandBuffer(uint32_t workerIndex, uint32_t imageIndex){
+	//Only the worker that owns the pool touches it, so allocating and recording need no locking
+	WorkerCommandPool& workerPool = workerCommandPools[currentFrame][workerIndex];
+
+	//A worker can run more than one recording job in a frame, every job gets its own command buffer
+	if (workerPool.usedCount == workerPool.secondaryCommandBuffers.size()) {
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = workerPool.pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer secondaryCommandBuffer;
+		if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, &secondaryCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate secondary command buffer!");
+		}
+		workerPool.secondaryCommandBuffers.push_back(secondaryCommandBuffer);
+	}
+	VkCommandBuffer secondaryCommandBuffer = workerPool.secondaryCommandBuffers[workerPool.usedCount++];
+
+	//A secondary command buffer executed inside a render pass has to know the render pass, subpass and (optionally) framebuffer it will run in
+	VkCommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+
+	//With dynamic rendering there is no render pass, the formats and sample count of the attachments of vkCmdBeginRendering are given instead
+	VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo{};
+	inheritanceRenderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+	inheritanceRenderingInfo.colorAttachmentCount = 1;
+	inheritanceRenderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+	inheritanceRenderingInfo.depthAttachmentFormat = depthFormat;
+	inheritanceRenderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+	inheritanceRenderingInfo.rasterizationSamples = msaaSamples;
+	if (dynamicRenderingEnabled) {
+		inheritanceInfo.pNext = &inheritanceRenderingInfo;
+	}
+	else {
+		inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];//Knowing the framebuffer can let the driver optimize the commands
+	}
+	//The profiler's statistics query is active in the primary while they execute
+	inheritanceInfo.pipelineStatistics = profiler.getStatisticsFlags();
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	//VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT: the whole command buffer runs inside a render pass
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	if (vkBeginCommandBuffer(secondaryCommandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin recording secondary command buffer!");
+	}
+
+	return secondaryCommandBuffer;
+}
+
+void VKApplication::recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount){
+	//Secondary command buffers don't inherit any state from the primary, every one of them binds the pipeline, dynamic states, buffers and descriptor sets again
 
 	// Bind Pipeline
 	// controls how the drawing commands within the render pass will be provided.
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	//The pipeline was built at load time, get() only looks it up by the hash of its description
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineManager.get(opaquePipeline));
 
 	//With this we have told Vulkan which operations to execute in the graphics pipeline and which attachment to use in the fagment shader
 
@@ -1627,33 +3278,276 @@ void VKApplication::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
 	// Bind vertex buffer to command buffer
-	VkBuffer vertexBuffers[] = { vertexBuffer };
-	VkDeviceSize offsets[] = { 0 };
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+	//Binding 0 is the vertex megabuffer, binding 1 the model matrices of the visible instances of this frame
+	VkBuffer vertexBuffers[] = { vertexBuffer, culledInstanceBuffers[currentFrame] };
+	VkDeviceSize offsets[] = { 0, 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
 
 	// Bind index buffer to command buffer
-	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, scene.getIndexType());
+
+	//Bind the uniforms of this frame (the dynamic offset of its region of the ring) to the descriptors in the shader, and the textures of every material
+	std::array<VkDescriptorSet, 2> sets = { descriptorSet, bindlessDescriptorSet };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, static_cast<uint32_t>(sets.size()), sets.data(), 1, &frameUniformsOffset);
+
+	//The object drawn, the whole scene: its transform is applied on top of the one of every instance
+	ObjectPushConstants objectConstants{ sceneTransform };
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ObjectPushConstants), &objectConstants);
+
+	//Draw Indexed Indirect command
+	//Every draw of the range is a VkDrawIndexedIndirectCommand in the indirect buffer, with the same parameters as vkCmdDrawIndexed:
+	//indexCount: number of indices of the level of detail of the mesh
+	//instanceCount: Used for instanced rendering, the number of visible instances of the mesh counted by the culling shader.
+	//firstIndex : Used as an offset into the index buffer, where the level of the mesh starts in the index megabuffer.
+	//vertexOffset :offset to add to the indices in the index buffer, where the mesh starts in the vertex megabuffer.
+	//firstInstance : Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex. It is where the instances of the draw start in the instance rate vertex buffer
+	//The GPU reads the commands, so recording the range costs the same for one instance or thousands
+	VkDeviceSize offset = firstDraw * sizeof(VkDrawIndexedIndirectCommand);
+	if (drawIndirectCountSupported) {
+		//The draws with visible instances are packed at the start of the buffer, the GPU reads how many there are from the draw count buffer (drawCount is only the maximum)
+		vkCmdDrawIndexedIndirectCount(commandBuffer, culledIndirectBuffers[currentFrame], offset, drawCountBuffers[currentFrame], 0, drawCount, sizeof(VkDrawIndexedIndirectCommand));
+	}
+	else if (multiDrawIndirectSupported) {
+		//Draws without visible instances have instanceCount 0, they cost no vertex work
+		vkCmdDrawIndexedIndirect(commandBuffer, instancedIndirectBuffers[currentFrame], offset, drawCount, sizeof(VkDrawIndexedIndirectCommand));
+	}
+	else {
+		//Without multiDrawIndirect drawCount must be 0 or 1
+		for (uint32_t i = 0; i < drawCount; i++) {
+			vkCmdDrawIndexedIndirect(commandBuffer, instancedIndirectBuffers[currentFrame], offset + i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+		}
+	}
+}
 
-	//Bind the right descriptor set for each frame to the descriptors in the shader
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+void VKApplication::recordUploadAcquires(VkCommandBuffer commandBuffer){
+	//Only uploads that are already done are acquired, so the graphics submit never waits on a copy that is still running
+	size_t acquireCount = 0;
+	while (acquireCount < pendingAcquires.size() && pendingAcquires[acquireCount].transferValue <= completedTransferValue) {
+		acquireCount++;
+	}
+
+	//The submit of this command buffer waits on the transfer timeline at this value, which makes the uploads visible to the graphics queue
+	acquiredTransferValue = completedTransferValue;
+
+	if (acquireCount == 0) {
+		return;
+	}
+
+	//The textures that get their mip chain once acquired are in the frame arena, sized for the case where every acquire is one
+	PendingAcquire* mipmapAcquires = frameArena.allocate<PendingAcquire>(acquireCount);
+	uint32_t mipmapAcquireCount = 0;
+
+	//Every acquire keeps its own destination stage, with synchronization2 a vertex buffer acquire doesn't make the fragment shader wait; all of them are one barrier
+	for (size_t i = 0; i < acquireCount; i++) {
+		const PendingAcquire& acquire = pendingAcquires.front();
+		if (acquire.isImage) {
+			frameBarriers.addImageBarrier(acquire.imageBarrier);
+			if (acquire.mipLevels > 1) {
+				mipmapAcquires[mipmapAcquireCount++] = acquire;
+			}
+		}
+		else {
+			frameBarriers.addBufferBarrier(acquire.bufferBarrier);
+		}
+		pendingAcquires.pop_front();
+	}
+	frameBarriers.flush(commandBuffer);
 
-	//Draw Indexed command
-	//vertexCount: size of vertexBuffer
-	//instanceCount: Used for instanced rendering, use 1 if you're not doing that.
-	//firstIndex : Used as an offset into the index buffer, defines the lowest value of gl_VertexIndex.
-	//vertexOffset :offset to add to the indices in the index buffer.
-	//firstInstance : Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex.
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+	//The acquired textures get their mip chain before anything samples them, like the acquire it has to be outside of the render pass
+	for (uint32_t i = 0; i < mipmapAcquireCount; i++) {
+		const PendingAcquire& acquire = mipmapAcquires[i];
+		recordMipmapGeneration(commandBuffer, acquire.imageBarrier.image, acquire.width, acquire.height, acquire.mipLevels);
+	}
+}
+
+void VKApplication::recordMipmapGeneration(VkCommandBuffer commandBuffer, VkImage image, int32_t width, int32_t height, uint32_t mipLevels){
+	//Every level is a linear downscale of the previous one, so we go down the chain: level i - 1 is finished before it is blitted to level i
+	//Everything is in the blit stage (the acquire made the copy of level 0 visible to it), a finished level is sampled by the fragment shader
+	VkImageMemoryBarrier2 barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.levelCount = 1;//One level at a time
+
+	int32_t mipWidth = width;
+	int32_t mipHeight = height;
+
+	for (uint32_t level = 1; level < mipLevels; level++) {
+		//Wait for the copy (level 0) or the previous blit to write level - 1, then make it the source of the blit
+		barrier.subresourceRange.baseMipLevel = level - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+		frameBarriers.addImageBarrier(barrier);
+		frameBarriers.flush(commandBuffer);
+
+		//The source region is the whole level - 1 and the destination the whole level, half its size (a side that is already 1 stays 1)
+		VkImageBlit blit{};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = level - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = level;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+
+		//Source and destination are two levels of the same image, in different layouts
+		//VK_FILTER_LINEAR averages the texels, which is why the format must support linear filtering (checked in createTextureImage)
+		vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+		//Level - 1 isn't used by the chain anymore, it can be read by the fragment shader once the blit has read it
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+		//Nothing in the chain waits for it, it is recorded with the barrier of the next level
+		frameBarriers.addImageBarrier(barrier);
+
+		if (mipWidth > 1) {
+			mipWidth /= 2;
+		}
+		if (mipHeight > 1) {
+			mipHeight /= 2;
+		}
+	}
 
-	// End render pass
+	//The last level is never a blit source, it goes straight from the destination of the last blit to shader reads
+	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+	frameBarriers.addImageBarrier(barrier);
+	frameBarriers.flush(commandBuffer);
+}
 
-	vkCmdEndRenderPass(commandBuffer);
+void VKApplication::recordCulling(VkCommandBuffer commandBuffer){
+	//The instance counts and the draw count are incremented by the culling shaders, start from 0 every frame
+	VkBufferCopy resetRegion{};
+	resetRegion.size = sizeof(VkDrawIndexedIndirectCommand) * scene.getDrawCount();
+	vkCmdCopyBuffer(commandBuffer, indirectBuffer, instancedIndirectBuffers[currentFrame], 1, &resetRegion);
+	vkCmdFillBuffer(commandBuffer, drawCountBuffers[currentFrame], 0, sizeof(uint32_t), 0);
+
+	VkMemoryBarrier2 clearBarrier{};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	clearBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT;
+	clearBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	clearBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;//atomicAdd reads and writes
+
+	frameBarriers.addMemoryBarrier(clearBarrier);
+	frameBarriers.flush(commandBuffer);
+
+	// Instance culling
+	cullConstants.instanceCount = scene.getInstanceCount();
+	cullConstants.occlusionEnabled = depthPyramidValid ? 1 : 0;
+	//The shader projects the errors with the projection of the uniform buffer, to half heights of the viewport: the scale gives them in units of MESH_LOD_PIXEL_ERROR
+	cullConstants.lodErrorScale = MESH_LOD_PIXEL_ERROR > 0.0f ? swapChainExtent.height * 0.5f / MESH_LOD_PIXEL_ERROR : 0.0f;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineManager.get(cullPipeline));
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullDescriptorSets[currentFrame], 1, &frameUniformsOffset);
+	vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &cullConstants);
+
+	//One invocation per instance
+	vkCmdDispatch(commandBuffer, (cullConstants.instanceCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+	// Draw compaction
+	if (drawIndirectCountSupported) {
+		//The instance counts are final once every instance has been culled
+		VkMemoryBarrier2 countBarrier{};
+		countBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+		countBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		countBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+		countBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		countBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+		frameBarriers.addMemoryBarrier(countBarrier);
+		frameBarriers.flush(commandBuffer);
+
+		uint32_t drawCount = scene.getDrawCount();
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineManager.get(compactPipeline));
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compactPipelineLayout, 0, 1, &compactDescriptorSets[currentFrame], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, compactPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &drawCount);
+
+		//One invocation per draw
+		vkCmdDispatch(commandBuffer, (drawCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+	}
 
-	//End Command buffer
+	//The draw commands and the count are read as indirect parameters, the culled instances as vertex attributes by the draws of this frame
+	//The index buffer isn't written by the culling, so only the vertex attribute input waits (not the index input)
+	VkMemoryBarrier2 cullBarrier{};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	cullBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	cullBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	cullBarrier.dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT;
+
+	frameBarriers.addMemoryBarrier(cullBarrier);
+	frameBarriers.flush(commandBuffer);
+}
 
-	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to record command buffer!");
+void VKApplication::recordDepthPyramid(VkCommandBuffer commandBuffer){
+	//The render pass already made the depth image readable (final layout and the dependency to the compute stage), with dynamic rendering endRendering left that barrier in the batch
+	//The pyramid was read by the culling of this frame, wait for it before overwriting it. The first time it also leaves the undefined layout
+	VkImageMemoryBarrier2 pyramidBarrier{};
+	pyramidBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	pyramidBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	pyramidBarrier.srcAccessMask = VK_ACCESS_2_NONE;//Write after read only needs the execution dependency
+	pyramidBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	pyramidBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	pyramidBarrier.oldLayout = depthPyramidValid ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.image = depthPyramid;
+	pyramidBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	pyramidBarrier.subresourceRange.baseMipLevel = 0;
+	pyramidBarrier.subresourceRange.levelCount = depthPyramidLevels;
+	pyramidBarrier.subresourceRange.baseArrayLayer = 0;
+	pyramidBarrier.subresourceRange.layerCount = 1;
+
+	frameBarriers.addImageBarrier(pyramidBarrier);
+	frameBarriers.flush(commandBuffer);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineManager.get(depthReducePipeline));
+
+	//Every level reads the one above it, so every level waits for the previous dispatch
+	for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+		uint32_t levelWidth = std::max(1u, swapChainExtent.width >> level);
+		uint32_t levelHeight = std::max(1u, swapChainExtent.height >> level);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthReducePipelineLayout, 0, 1, &depthReduceDescriptorSets[level], 0, nullptr);
+		vkCmdDispatch(commandBuffer, (levelWidth + DEPTH_REDUCE_WORKGROUP_SIZE - 1) / DEPTH_REDUCE_WORKGROUP_SIZE, (levelHeight + DEPTH_REDUCE_WORKGROUP_SIZE - 1) / DEPTH_REDUCE_WORKGROUP_SIZE, 1);
+
+		//The level is read by the next level and by the culling of the next frame
+		VkImageMemoryBarrier2 levelBarrier = pyramidBarrier;
+		levelBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+		levelBarrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+		levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.subresourceRange.baseMipLevel = level;
+		levelBarrier.subresourceRange.levelCount = 1;
+
+		frameBarriers.addImageBarrier(levelBarrier);
+		frameBarriers.flush(commandBuffer);
 	}
+
+	depthPyramidValid = true;
 }
 
 void VKApplication::drawFrame(){
@@ -1666,20 +3560,60 @@ void VKApplication::drawFrame(){
 	// - Even if the CPU submits a new frame's command buffer quickly, the GPU wont execute it until previous submissions are finished
 	// - Synchronization objects (semaphores, fences) control execution order and prevent resource conflicts.
 	//What this allows is to reduce the time the CPU is idle by briging some of the work foward to the GPU, previously we had to wait for the GPU to finish excuting before starting submitting a new command buffer to the queue 
-	
-	//Takes an array of fences and waits on the host for either any or all of the fences to be signaled before returning. 
-	// - The VK_TRUE we pass here indicates that we want to wait for all fences, but in the case of a single one it doesn't matter.
-	// - This function also has a timeout parameter that we set to the maximum value of a 64 bit unsigned integer, UINT64_MAX, which effectively disables the timeout.
-	vkWaitForFences(logicalDevice, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+	//How many frames are in flight is set by the frame pacing profile (see FramePacing)
+
+	if (requestedFramePacing != framePacing) {
+		applyFramePacing();
+	}
+
+	profiler.beginFrame(frameNumber);
+
+	//Low latency: the previous frame is on screen before this one starts, so its input and animation are as recent as possible when it is displayed
+	//With one frame in flight its graphics value is reached by then, the wait below doesn't block
+	if (presentWaitSupported && getFramePacingProfile().waitForPresent && waitablePresentId > 0) {
+		VkResult presentResult = vkWaitForPresent(logicalDevice, swapChain, waitablePresentId, PRESENT_WAIT_TIMEOUT);
+		//An out of date swap chain is recreated by vkAcquireNextImageKHR below
+		if (presentResult != VK_SUCCESS && presentResult != VK_TIMEOUT && presentResult != VK_ERROR_OUT_OF_DATE_KHR && presentResult != VK_SUBOPTIMAL_KHR) {
+			throw std::runtime_error("Failed to wait for present!");
+		}
+	}
+
+	//Wait on the host until the frame that used the objects of this frame in flight is retired, the first frames have nothing to wait for
+	//This is a wait on the graphics timeline (vkWaitSemaphores), it returns right away when the value was already reached
+	//After a switch of the frame pacing profile every earlier frame is retired, so the frame framesInFlight ago is always the one to wait for
+	uint32_t framesInFlight = getFramePacingProfile().framesInFlight;
+	profiler.beginCpu(VKCpuScope::FenceWait);
+	if (frameNumber >= framesInFlight) {
+		frameScheduler.waitForFrame(frameNumber - framesInFlight);
+	}
+	profiler.endCpu(VKCpuScope::FenceWait);
+
+	//The frame that last used these queries is done, their results are ready
+	profiler.collect(currentFrame);
+
+	//Everything retired before the frames that are done is released, and so is the CPU data of the last frame
+	deletionQueue.flush(frameScheduler.getCompletedValue(VKQueue::Graphics));
+	frameArena.reset();
+
+	//Pipelines rebuilt by the shader hot reload replace the old ones before anything is recorded, the frames in flight may still use the old ones
+	pipelineManager.applyReloads([this](VkPipeline pipeline) {
+		deletionQueue.push([this, pipeline]() { vkDestroyPipeline(logicalDevice, pipeline, nullptr); });
+	});
 
 	// Acquiring an image for the swap chain
 
-	uint32_t imageIndex;
+	//Headless: the offscreen image of this frame in flight, nothing is acquired
+	uint32_t imageIndex = currentFrame;
+	VkResult result = VK_SUCCESS;
 	//The third parameter specifies a timeout in nanoseconds for an image to become available. Using the maximum value of a 64 bit unsigned integer means we effectively disable the timeout.
 	// The next two parameters specify synchronization objects that are to be signaled when the presentation engine is finished using the image. That's the point in time where we can start drawing to it. 
 	//The last parameter specifies a variable to output the index of the swap chain image that has become available.
 	//The index refers to the VkImage in our swapChainImages array. We're going to use that index to pick the VkFrameBuffer.
-	VkResult result = vkAcquireNextImageKHR(logicalDevice, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	if (!headless) {
+		profiler.beginCpu(VKCpuScope::Acquire);
+		result = vkAcquireNextImageKHR(logicalDevice, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		profiler.endCpu(VKCpuScope::Acquire);
+	}
 
 	//Recreate Swap chain if current is no longer compatible
 	// VK_ERROR_OUT_OF_DATE_KHR: The swap chain has become incompatible with the surface and can no longer be used for rendering. Usually happens after a window resize.
@@ -1692,48 +3626,69 @@ void VKApplication::drawFrame(){
 		throw std::runtime_error("Failed to acquire swap chain image!");
 	}
 
+	profiler.beginCpu(VKCpuScope::Update);
 	//Generate a new transformation every frame to make the geometry spin around
 	updateUniformBuffer(currentFrame);
+	//Collect the finished loads, upload what fits in the budget and swap in the textures the graphics queue has acquired, before the frame's buffers are written
+	updateStreaming();
+	updateInstanceBuffer(currentFrame);
+	updateMaterialBuffer(currentFrame);
 
-	//After waiting, we need to manually reset the fence to the unsignaled state
-	//Delay resetting the fence until after we know for sure we will be submitting work with it. Thus, if we return early, the fence is still signaled and vkWaitForFences wont deadlock the next time we use the same fence object.
-	vkResetFences(logicalDevice, 1, &inFlightFences[currentFrame]);
+	//Check how far the transfer queue got without blocking, and free the upload command buffers that are done
+	completedTransferValue = frameScheduler.getCompletedValue(VKQueue::Transfer);
+	retireUploads(false);
+	profiler.endCpu(VKCpuScope::Update);
+
+	//Nothing to reset: if we return before the submit, the frame number doesn't advance and the next drawFrame waits for the same frame again
 
 	// Recording the command buffer
 
 	//Makes sure the command buffer is able to be recorded
 	//The second parameter of vkResetCommandBuffer is a VkCommandBufferResetFlagBits flag. Since we don't want to do anything special, we leave it as 0.
 	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+
+	//The wait also guarantees the secondary command buffers of this frame are done, resetting the pools resets all of them at once
+	for (WorkerCommandPool& workerPool : workerCommandPools[currentFrame]) {
+		vkResetCommandPool(logicalDevice, workerPool.pool, 0);
+		workerPool.usedCount = 0;
+	}
 	
 	//Record commands to command buffer
+	profiler.beginCpu(VKCpuScope::Record);
 	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+	profiler.endCpu(VKCpuScope::Record);
 
 	// Submitting the command buffer in queue
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame]};
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	//The first three parameters specify which semaphores to wait on before execution begins and in which stage(s) of the pipeline to wait. 
 	//We want to wait with writing colors to the image until it's available, so we're specifying the stage of the graphics pipeline that writes to the color attachment. 
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-	//The next two parameters specify which command buffers to actually submit for execution.
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-	// The signalSemaphoreCount and pSignalSemaphores parameters specify which semaphores to signal once the command buffer(s) have finished execution. 
-	//In our case we're using the renderFinishedSemaphore for that purpose.
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame]};
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
+	//Headless: no image was acquired, only the transfer timeline is waited on
+	if (!headless) {
+		frameScheduler.waitForBinary(imageAvailableSemaphores[currentFrame], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	}
+	//The uploads acquired in this command buffer are read by the mipmap blits, the culling shader, as vertices, indices, in the vertex shader and in the fragment shader, so the transfer timeline is waited on at those stages
+	//The value was already reached when it was read, the wait never stalls the GPU, it only makes the transfer writes visible to this submit
+	frameScheduler.waitFor(VKQueue::Transfer, acquiredTransferValue, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	//The renderFinishedSemaphore is signaled once the command buffer has finished execution, presentation waits on it
+	//Headless: nothing waits for the frame on the GPU, and a signaled binary semaphore would have to be waited on before being signaled again
+	if (!headless) {
+		frameScheduler.signalBinary(renderFinishedSemaphores[currentFrame]);
+	}
 
-	//Submit the command buffer to the graphics queue using vkQueueSubmit
-	//The last parameter references an optional fence that will be signaled when the command buffers finish execution.
-	// This allows us to know when it is safe for the command buffer to be reused
-	// Now on the next frame, the CPU will wait for this command buffer to finish executing before it records new commands into it.
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to submit draw command buffer!");
+	//The submit also signals the next graphics timeline value, the frame is retired once it is reached
+	//Now on the next frame that uses the same objects, the CPU will wait for that value before it records new commands into this command buffer.
+	profiler.beginCpu(VKCpuScope::Submit);
+	uint64_t frameValue = frameScheduler.submit(VKQueue::Graphics, &commandBuffers[currentFrame], 1);
+	frameScheduler.endFrame(frameNumber);
+	//What was retired until now is released once the graphics timeline reaches this submit
+	deletionQueue.submit(frameValue);
+	profiler.endCpu(VKCpuScope::Submit);
+
+	//Headless: the frame is done once it is submitted, the graphics value of the frame in flight protects its offscreen image
+	if (headless) {
+		profiler.endFrame(currentFrame);
+		currentFrame = (currentFrame + 1) % framesInFlight;
+		frameNumber++;
+		return;
 	}
 
 	// Presentation
@@ -1744,7 +3699,7 @@ void VKApplication::drawFrame(){
 	//The first two parameters specify which semaphores to wait on before presentation can happen
 	//Since we want to wait on the command buffer to finish execution, thus our triangle being drawn, we take the semaphores which will be signalled and wait on them
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
 	//The next two parameters specify the swap chains to present images to and the index of the image for each swap chain. 
 	VkSwapchainKHR swapChains[] = { swapChain };
 	presentInfo.swapchainCount = 1;
@@ -1753,8 +3708,25 @@ void VKApplication::drawFrame(){
 	// It allows you to specify an array of VkResult values to check for every individual swap chain if presentation was successful. It's not necessary if you're only using a single swap chain, because you can simply use the return value of the present function.
 	presentInfo.pResults = nullptr; // Optional
 
+	//Tag the present with an id the low latency profile can wait on
+	uint64_t nextPresentId = presentId + 1;
+	VkPresentIdKHR presentIdInfo{};
+	presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+	presentIdInfo.swapchainCount = 1;
+	presentIdInfo.pPresentIds = &nextPresentId;
+	if (presentWaitSupported) {
+		presentInfo.pNext = &presentIdInfo;
+	}
+
 	//Submit the request to present an image to the swap chain
+	profiler.beginCpu(VKCpuScope::Present);
 	result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	profiler.endCpu(VKCpuScope::Present);
+	profiler.endFrame(currentFrame);
+	if (presentWaitSupported && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)) {
+		presentId = nextPresentId;
+		waitablePresentId = presentId;
+	}
 
 	//Recreate Swap chain if current is no longer compatible
 	//It is important to check framebufferResized this after vkQueuePresentKHR to ensure that the semaphores are in a consistent state, otherwise a signaled semaphore may never be properly waited upon.
@@ -1766,8 +3738,15 @@ void VKApplication::drawFrame(){
 		throw std::runtime_error("failed to present swap chain image!");
 	}
 
+	//The overlay: averages of the last frames in the window title
+	std::string profileSummary;
+	if (profiler.getSummary(profileSummary, PROFILER_SUMMARY_INTERVAL)) {
+		glfwSetWindowTitle(window, ("VulkanSandbox Window | " + std::string(getFramePacingProfile().name) + " | " + profileSummary).c_str());
+	}
+
 	//Advance to the next frame every time
-	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT; //By using the modulo (%) operator, we ensure that the frame index loops around after every MAX_FRAMES_IN_FLIGHT enqueued frames.
+	currentFrame = (currentFrame + 1) % framesInFlight; //By using the modulo (%) operator, we ensure that the frame index loops around after every framesInFlight enqueued frames.
+	frameNumber++;
 }
 
 void VKApplication::recreateSwapChain(){
@@ -1781,23 +3760,77 @@ void VKApplication::recreateSwapChain(){
 		glfwWaitEvents();
 	}
 	
-	//We first call vkDeviceWaitIdle, because we shouldn't touch resources that may still be in use
-	vkDeviceWaitIdle(logicalDevice);
-
-	//Clean old swapchain
-	cleanupSwapChain();
-
-	createSwapChain();
+	//No vkDeviceWaitIdle: the frames in flight may still render with the old objects, they go to the deletion queue instead of being destroyed
+	//The GPU keeps working on the frames already submitted while the new swap chain is created
+	RetiredSwapChain retired{};
+	retired.swapChain = swapChain;
+	retired.imageViews = std::move(swapChainImageViews);
+	retired.framebuffers = std::move(swapChainFramebuffers);
+	retired.depthImage = depthImage;
+	retired.depthImageView = depthImageView;
+	retired.colorImage = colorImage;
+	retired.colorImageView = colorImageView;
+	retired.msaaDepthImage = msaaDepthImage;
+	retired.msaaDepthImageView = msaaDepthImageView;
+	retired.depthPyramid = depthPyramid;
+	retired.depthPyramidAllocation = depthPyramidAllocation;
+	retired.depthPyramidView = depthPyramidView;
+	retired.depthPyramidMipViews = std::move(depthPyramidMipViews);
+	retired.computeDescriptorPool = computeDescriptorPool;
+	VKAllocation previousDepthAllocation = depthImageAllocation;
+	VKAllocation previousColorAllocation = colorImageAllocation;
+	VKAllocation previousMsaaDepthAllocation = msaaDepthImageAllocation;
+
+	//Present ids belong to the swap chain they were presented to
+	waitablePresentId = 0;
+
+	createSwapChain();//Created from the old one (oldSwapchain)
 	createImageViews();//The image views need to be recreated because they are based directly on the swap chain images
+	createColorResources();
 	createDepthResources();
+	createDepthPyramid();//Same size as the depth image
+	createComputeDescriptorSets();//They reference the depth image and the depth pyramid
 	createFramebuffers();//the framebuffers directly depend on the swap chain images
+
+	//The depth and multisampled images only get a new allocation when they no longer fit in the previous one, which is then freed with the other old objects
+	auto replaced = [](const VKAllocation& previous, const VKAllocation& current) {
+		return previous.memory != current.memory || previous.offset != current.offset;
+	};
+	if (replaced(previousDepthAllocation, depthImageAllocation)) {
+		retired.depthImageAllocation = previousDepthAllocation;
+	}
+	if (replaced(previousColorAllocation, colorImageAllocation)) {
+		retired.colorImageAllocation = previousColorAllocation;
+	}
+	if (replaced(previousMsaaDepthAllocation, msaaDepthImageAllocation)) {
+		retired.msaaDepthImageAllocation = previousMsaaDepthAllocation;
+	}
+	deletionQueue.push([this, retired = std::move(retired)]() mutable { destroyRetiredSwapChain(retired); });
 }
 
 void VKApplication::cleanupSwapChain(){
 	//Depth buffering clean up
 	vkDestroyImageView(logicalDevice, depthImageView, nullptr);
 	vkDestroyImage(logicalDevice, depthImage, nullptr);
-	vkFreeMemory(logicalDevice, depthImageMemory, nullptr);
+	memoryAllocator.free(depthImageAllocation);
+
+	//MSAA attachments, null handles without MSAA
+	vkDestroyImageView(logicalDevice, colorImageView, nullptr);
+	vkDestroyImage(logicalDevice, colorImage, nullptr);
+	memoryAllocator.free(colorImageAllocation);
+	vkDestroyImageView(logicalDevice, msaaDepthImageView, nullptr);
+	vkDestroyImage(logicalDevice, msaaDepthImage, nullptr);
+	memoryAllocator.free(msaaDepthImageAllocation);
+
+	//Destroying the pool frees the culling and depth reduce descriptor sets
+	vkDestroyDescriptorPool(logicalDevice, computeDescriptorPool, nullptr);
+	for (VkImageView mipView : depthPyramidMipViews) {
+		vkDestroyImageView(logicalDevice, mipView, nullptr);
+	}
+	depthPyramidMipViews.clear();
+	vkDestroyImageView(logicalDevice, depthPyramidView, nullptr);
+	vkDestroyImage(logicalDevice, depthPyramid, nullptr);
+	memoryAllocator.free(depthPyramidAllocation);
 
 	for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
 		vkDestroyFramebuffer(logicalDevice, swapChainFramebuffers[i], nullptr);
@@ -1807,9 +3840,46 @@ void VKApplication::cleanupSwapChain(){
 		vkDestroyImageView(logicalDevice, swapChainImageViews[i], nullptr);
 	}
 
+	if (headless) {
+		for (size_t i = 0; i < swapChainImages.size(); i++) {
+			vkDestroyImage(logicalDevice, swapChainImages[i], nullptr);
+			memoryAllocator.free(offscreenImagesAllocation[i]);
+		}
+		return;
+	}
 	vkDestroySwapchainKHR(logicalDevice, swapChain, nullptr);
 }
 
+void VKApplication::destroyRetiredSwapChain(RetiredSwapChain& retired){
+	for (VkFramebuffer framebuffer : retired.framebuffers) {
+		vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+	}
+	for (VkImageView imageView : retired.imageViews) {
+		vkDestroyImageView(logicalDevice, imageView, nullptr);
+	}
+
+	vkDestroyImageView(logicalDevice, retired.depthImageView, nullptr);
+	vkDestroyImage(logicalDevice, retired.depthImage, nullptr);
+	memoryAllocator.free(retired.depthImageAllocation);
+	vkDestroyImageView(logicalDevice, retired.colorImageView, nullptr);
+	vkDestroyImage(logicalDevice, retired.colorImage, nullptr);
+	memoryAllocator.free(retired.colorImageAllocation);
+	vkDestroyImageView(logicalDevice, retired.msaaDepthImageView, nullptr);
+	vkDestroyImage(logicalDevice, retired.msaaDepthImage, nullptr);
+	memoryAllocator.free(retired.msaaDepthImageAllocation);
+
+	vkDestroyDescriptorPool(logicalDevice, retired.computeDescriptorPool, nullptr);
+	for (VkImageView mipView : retired.depthPyramidMipViews) {
+		vkDestroyImageView(logicalDevice, mipView, nullptr);
+	}
+	vkDestroyImageView(logicalDevice, retired.depthPyramidView, nullptr);
+	vkDestroyImage(logicalDevice, retired.depthPyramid, nullptr);
+	memoryAllocator.free(retired.depthPyramidAllocation);
+
+	//Every image of the old swap chain that was acquired has been presented
+	vkDestroySwapchainKHR(logicalDevice, retired.swapChain, nullptr);
+}
+
 void VKApplication::framebufferResizeCallback(GLFWwindow* window, int width, int height){
 	//Get pointer for vulkan application instance
 	auto app = reinterpret_cast<VKApplication*>(glfwGetWindowUserPointer(window));
@@ -1817,6 +3887,30 @@ void VKApplication::framebufferResizeCallback(GLFWwindow* window, int width, int
 	app->framebufferResized = true;
 }
 
+void VKApplication::applyFramePacing(){
+	framePacing = requestedFramePacing;
+
+	//Wait for the device to be idle: every timeline value is reached and the frames past the new count are no longer used, so the rotation can start over
+	vkDeviceWaitIdle(logicalDevice);
+	//The deletion lists of the frames past the new count would never be flushed
+	deletionQueue.flushAll();
+	//The present mode is a swap chain parameter, the new swap chain is created with the first one of the profile the surface supports
+	recreateSwapChain();
+	//The frames past the new count won't be waited on again, their queries are read now
+	profiler.collectAll();
+	currentFrame = 0;
+
+	const FramePacingProfile& profile = getFramePacingProfile();
+	std::cout << "Frame pacing: " << profile.name << ", " << profile.framesInFlight << " frame(s) in flight" << (profile.waitForPresent && presentWaitSupported ? ", waiting for present" : "") << std::endl;
+}
+
+void VKApplication::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods){
+	auto app = reinterpret_cast<VKApplication*>(glfwGetWindowUserPointer(window));
+	if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+		app->requestedFramePacing = app->requestedFramePacing == FramePacing::LowLatency ? FramePacing::Throughput : FramePacing::LowLatency;
+	}
+}
+
 uint32_t VKApplication::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const{
 	//Query info about the available types of memory in physical device
 	VkPhysicalDeviceMemoryProperties memProperties;
@@ -1835,7 +3929,7 @@ uint32_t VKApplication::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlag
 	throw std::runtime_error("Failed to find suitable memory type!");
 }
 
-void VKApplication::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory){
+void VKApplication::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VKAllocation& bufferAllocation){
 	// Create vertex Buffer
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1861,68 +3955,84 @@ void VKApplication::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, Vk
 
 	//Graphics cards can offer different types of memory to allocate from. Each type of memory varies in terms of allowed operations and performance characteristics. We need to combine the requirements of the buffer and our own application requirements to find the right type of memory to use
 	//Memory allocation is now as simple as specifying the size and type, both of which are derived from the memory requirements of the vertex buffer and the desired property.
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate buffer memory!");
-	}
+	//The allocator hands out a range of a bigger memory block of that type instead of calling vkAllocateMemory for every buffer (buffers are linear resources)
+	bufferAllocation = memoryAllocator.allocate(memRequirements, findMemoryType(memRequirements.memoryTypeBits, properties), true);
 
 	// Associate this memory with the buffer
-	//Since this memory is allocated specifically for this the vertex buffer, the offset is simply 0. If the offset is non-zero, then it is required to be divisible by memRequirements.alignment.
-	vkBindBufferMemory(logicalDevice, buffer, bufferMemory, 0);
+	//The buffer lives at an offset inside the block, the allocator already rounded it up to be divisible by memRequirements.alignment.
+	vkBindBufferMemory(logicalDevice, buffer, bufferAllocation.memory, bufferAllocation.offset);
 }
 
-void VKApplication::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size){
+void VKApplication::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask){
 	// Allocate temporary commadn buffer to execute memory transfer operations
-	
-	//TODO Optimization: You may wish to create a separate command pool for these kinds of short-lived buffers, because the implementation may be able to apply memory allocation optimizations. You should use the VK_COMMAND_POOL_CREATE_TRANSIENT_BIT flag during command pool generation in that case.
+	//The command buffer comes from the transfer pool (created with VK_COMMAND_POOL_CREATE_TRANSIENT_BIT) and is submitted to the transfer queue
 
 	//Begin command buffer recording
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	VkCommandBuffer commandBuffer = beginTransferCommands();
 
 	// Transfer content of src buffer to dst buffer command
 
 	//It is not possible to specify VK_WHOLE_SIZE here, unlike the vkMapMemory command.
 	VkBufferCopy copyRegion{};
-	copyRegion.srcOffset = 0;
+	copyRegion.srcOffset = srcOffset;//Position of the data inside the source buffer (e.g. a range of the staging ring)
 	copyRegion.dstOffset = 0;
 	copyRegion.size = size;
 	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
+	// Queue family ownership transfer
+	//Resources created with VK_SHARING_MODE_EXCLUSIVE belong to one queue family at a time. When the transfer family is not the graphics family the buffer has to be
+	//released here (after the copy) and acquired on the graphics queue before it is used, both barriers must use the same queue family indices
+	//With a single family nothing is needed, the graphics submit waiting on the transfer timeline already makes the copy visible
+	if (transferQueueFamily != graphicsQueueFamily) {
+		VkBufferMemoryBarrier2 barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;//Ignored in the release, the submit signals the transfer timeline after it
+		barrier.dstAccessMask = VK_ACCESS_2_NONE;//Ignored in the release, the access mask of the acquire makes the data visible
+		barrier.srcQueueFamilyIndex = transferQueueFamily;
+		barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+		barrier.buffer = dstBuffer;
+		barrier.offset = 0;
+		barrier.size = size;
+
+		VKBarrierBatch release;
+		release.init(synchronization2Enabled);
+		release.addBufferBarrier(barrier);
+		release.flush(commandBuffer);
+
+		//The acquire waits in the stage that uses the buffer, which is one of the stages the submit waits on the transfer timeline at
+		PendingAcquire acquire{};
+		acquire.transferValue = frameScheduler.getNextValue(VKQueue::Transfer);//Signaled by the submit of this command buffer
+		acquire.isImage = false;
+		acquire.bufferBarrier = barrier;
+		acquire.bufferBarrier.srcStageMask = dstStageMask;
+		acquire.bufferBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+		acquire.bufferBarrier.dstStageMask = dstStageMask;
+		acquire.bufferBarrier.dstAccessMask = dstAccessMask;
+		pendingAcquires.push_back(acquire);
+	}
+
 	//End command buffer recording
-	endSingleTimeCommands(commandBuffer);
+	endTransferCommands(commandBuffer);
 }
 
 void VKApplication::updateUniformBuffer(uint32_t currentImage){
-	// This make sure that the geometry rotates 90 degrees per second regardless of frame rate
-	static auto startTime = std::chrono::high_resolution_clock::now(); //It remains the same across multiple function calls due to the static keyword
-	
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	//currentTime - startTime:  produces a duration object representing the time difference.
-	//std::chrono::duration<float, std::chrono::seconds::period>: converts the duration into seconds as a float.
-	//.count(): extracts the actual numerical value.
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+	//The frame that used this frame in flight before has been waited on, the GPU is done reading its region of the ring
+	uniformRing.beginFrame(currentImage);
 
 	//Update model view and proj
 	UniformBufferObject ubo{};
 
-	//The model rotation will be a simple rotation around the Z-axis using the time variable:
-
 	// Model: Transform object coordinates from local to world space
 	//The glm::rotate function takes an existing transformation, rotation angle and rotation axis as parameters.
 	//The glm::mat4(1.0f) constructor returns an identity matrix. 
-	//Using a rotation angle of time * glm::radians(90.0f) accomplishes the purpose of rotation 90 degrees per second.
-
-	// First, rotate the model to be vertical
-	glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-
-	// Then, apply continuous yaw rotation
-	model = glm::rotate(model, time * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	//Applied to the whole scene on top of the transform of every instance (the continuous rotation is part of the instance transforms)
+	//It is the transform of the object drawn, so it goes to the push constants of the draws and of the culling shader instead of the uniforms
 
-	ubo.model = model;
+	// Rotate the model to be vertical
+	sceneTransform = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	cullConstants.model = sceneTransform;
 	
 	// View: from world space to view space (camera view)
 	//View/Camera looks at at the geometry from above at a 45 degree angle
@@ -1947,11 +4057,252 @@ void VKApplication::updateUniformBuffer(uint32_t currentImage){
 	//GLM was originally designed for OpenGL, where the Y coordinate of the clip coordinates is inverted. The easiest way to compensate for that is to flip the sign on the scaling factor of the Y axis in the projection matrix.
 	ubo.proj[1][1] = ubo.proj[1][1] * -1;
 
-	//Copy the data in the uniform buffer object to the current uniform buffer.
-	memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+	//Frustum planes for the culling shader, extracted from the rows of proj * view (Gribb and Hartmann)
+	//A world space point p is inside when dot(plane.xyz, p) + plane.w >= 0 for the 6 planes, the depth range is 0 to 1 so the near plane is the third row alone
+	glm::mat4 viewProj = glm::transpose(ubo.proj * ubo.view);//Transposed so the rows are columns, glm indexes columns
+	ubo.frustumPlanes[0] = viewProj[3] + viewProj[0];//Left
+	ubo.frustumPlanes[1] = viewProj[3] - viewProj[0];//Right
+	ubo.frustumPlanes[2] = viewProj[3] + viewProj[1];//Bottom (top, the Y axis is flipped)
+	ubo.frustumPlanes[3] = viewProj[3] - viewProj[1];//Top (bottom)
+	ubo.frustumPlanes[4] = viewProj[2];//Near
+	ubo.frustumPlanes[5] = viewProj[3] - viewProj[2];//Far
+	for (glm::vec4& plane : ubo.frustumPlanes) {
+		//Normalized, so the distance can be compared with the radius of a bounding sphere
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	//Copy the data in the uniform buffer object to the frame's region of the ring, once for everything drawn in the frame
+	frameUniforms = ubo;
+	frameUniformsOffset = uniformRing.push(frameUniforms);
+}
+
+void VKApplication::updateInstanceBuffer(uint32_t currentImage){
+	//Nothing to write until the scene is loaded, the frame only clears the screen
+	if (!sceneLoaded) {
+		return;
+	}
+
+	// This make sure that the geometry rotates 90 degrees per second regardless of frame rate
+	static auto startTime = std::chrono::high_resolution_clock::now(); //It remains the same across multiple function calls due to the static keyword
+	
+	auto currentTime = std::chrono::high_resolution_clock::now();
+	//currentTime - startTime:  produces a duration object representing the time difference.
+	//std::chrono::duration<float, std::chrono::seconds::period>: converts the duration into seconds as a float.
+	//.count(): extracts the actual numerical value.
+	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+	//Headless: the replayed frame sets the time, every run renders the same spin whatever the frame rate (0 during the warm-up)
+	if (headless) {
+		time = replayFrame * benchmarkSettings.timeStep;
+	}
+
+	//Continuous yaw rotation, using a rotation angle of time * glm::radians(90.0f) accomplishes the purpose of rotation 90 degrees per second.
+	glm::quat spin = glm::angleAxis(time * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	//Only the spin nodes are dirty, the world matrices of the instances they hang from are reused
+	uint32_t instanceCount = scene.getInstanceCount();
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		transforms.setRotation(firstSpinNode + i, spin);
+	}
+	transforms.update();
+
+	//The buffer is persistently mapped and the frame that used this frame in flight before has been waited on, so the GPU is done reading it
+	//The matrices go straight from the transform system to the mapped buffer, the ones that didn't change since this buffer was last written are skipped
+	VKInstanceData* instanceData = instanceBuffersMapped[currentImage];
+	transforms.writeWorldMatrices(&instanceData[0].model, sizeof(VKInstanceData), firstSpinNode, instanceCount, instanceBuffersVersion[currentImage]);
+}
+
+void VKApplication::updateMaterialBuffer(uint32_t currentImage){
+	if (!sceneLoaded) {
+		return;
+	}
+
+	//Like the instance buffer, that frame has been waited on so the GPU is done reading it
+	//An evicted texture is 0 from this frame on, the frames still in flight keep the element they were recorded with
+	uint32_t* textureSlots = static_cast<uint32_t*>(materialBuffersAllocation[currentImage].mapped);
+	for (size_t i = 0; i < streamedTextures.size(); i++) {
+		textureSlots[i] = streamedTextures[i].slot;
+	}
+}
+
+bool VKApplication::isStreamingIdle() const{
+	//The model is drawn once its upload was acquired by a frame
+	if (!sceneLoaded || sceneTransferValue > acquiredTransferValue) {
+		return false;
+	}
+	//Failed textures keep their placeholder, they don't hold the benchmark back
+	for (const StreamedTexture& streamed : streamedTextures) {
+		VKAssetState state = streamer.getAsset(streamed.asset).state;
+		if (state == VKAssetState::Loading || state == VKAssetState::Loaded || state == VKAssetState::Uploading) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void VKApplication::updateStreaming(){
+	// Finished loads
+	for (const VKAssetLoadResult& result : streamer.collectLoaded()) {
+		if (result.asset == sceneAsset) {
+			//Nothing can be rendered without the model
+			if (result.error) {
+				std::rethrow_exception(result.error);
+			}
+			finishSceneLoad();
+		}
+		else if (result.error) {
+			//A texture that can't be loaded isn't fatal, its material keeps the placeholder
+			try {
+				std::rethrow_exception(result.error);
+			}
+			catch (const std::exception& error) {
+				std::cerr << error.what() << " The placeholder is used instead." << std::endl;
+			}
+		}
+	}
+
+	if (!sceneLoaded) {
+		return;
+	}
+
+	requestVisibleTextures();
+	uploadStreamedTextures();
+
+	// Swap the placeholders for the acquired textures
+	//acquiredTransferValue was reached by the command buffer of a previous frame, which acquired these textures and generated their mip chains before this frame samples them
+	for (StreamedTexture& streamed : streamedTextures) {
+		//Without a free element the texture waits for an eviction to give one back
+		if (streamer.getAsset(streamed.asset).state != VKAssetState::Uploading || streamed.transferValue > acquiredTransferValue || freeTextureSlots.empty()) {
+			continue;
+		}
+
+		streamed.slot = freeTextureSlots.back();
+		freeTextureSlots.pop_back();
+
+		//The element was free, no pending command buffer samples it (unused while pending)
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = streamed.texture.view;
+		imageInfo.sampler = textureSampler;
+
+		VkWriteDescriptorSet textureWrite{};
+		textureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		textureWrite.dstSet = bindlessDescriptorSet;
+		textureWrite.dstBinding = 0;
+		textureWrite.dstArrayElement = streamed.slot;
+		textureWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		textureWrite.descriptorCount = 1;
+		textureWrite.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(logicalDevice, 1, &textureWrite, 0, nullptr);
+
+		streamer.setResident(streamed.asset);
+	}
+}
+
+void VKApplication::requestVisibleTextures(){
+	//Same frustum test as the culling shader, without occlusion: a texture is needed as soon as an instance using it is in view
+	//The spin of an instance turns its bounding sphere around the instance's Y axis, the sphere is grown to cover every angle so the result doesn't change from one frame to the next
+	const std::vector<VKSceneMesh>& meshes = scene.getMeshes();
+	const std::vector<VKSceneMaterial>& materials = scene.getMaterials();
+	for (const VKSceneInstance& instance : scene.getInstances()) {
+		const VKSceneMesh& mesh = meshes[instance.meshIndex];
+		glm::mat4 model = sceneTransform * instance.transform;
+		glm::vec3 center = glm::vec3(model * glm::vec4(0.0f, mesh.boundingSphere.y, 0.0f, 1.0f));
+		float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+		float radius = (mesh.boundingSphere.w + glm::length(glm::vec2(mesh.boundingSphere.x, mesh.boundingSphere.z))) * scale;
+
+		bool visible = true;
+		for (const glm::vec4& plane : frameUniforms.frustumPlanes) {
+			visible = visible && glm::dot(glm::vec3(plane), center) + plane.w > -radius;
+		}
+		if (!visible) {
+			continue;
+		}
+
+		StreamedTexture& streamed = streamedTextures[mesh.materialIndex];
+		streamer.markUsed(streamed.asset, frameNumber);
+		if (streamer.getAsset(streamed.asset).state == VKAssetState::Unloaded) {
+			//The vector is never resized once the scene is loaded, the job can keep a reference to its element
+			std::string path = materials[mesh.materialIndex].texturePath;
+			streamer.load(streamed.asset, [this, &streamed, path]() {
+				loadTextureLevels(path, streamed.levels, streamed.format);
+			});
+		}
+	}
+}
+
+void VKApplication::uploadStreamedTextures(){
+	//The levels are copied to the staging ring here on the main thread: a range of the ring belongs to the next submit, so it can't be filled ahead of time by a worker
+	//At most STREAMING_UPLOAD_BYTES_PER_FRAME are copied per frame, except for the first texture so a large one still goes through
+	VkDeviceSize uploadedBytes = 0;
+	std::vector<StreamedTexture*> uploads;
+	std::vector<uint32_t> evictions;
+	for (StreamedTexture& streamed : streamedTextures) {
+		if (streamer.getAsset(streamed.asset).state != VKAssetState::Loaded) {
+			continue;
+		}
+
+		//Device memory of the texture, a third more when the GPU generates the mip chain of a single level
+		VkDeviceSize textureBytes = 0;
+		for (const VKTextureLevel& level : streamed.levels) {
+			textureBytes += level.data.size();
+		}
+		if (streamed.levels.size() == 1) {
+			textureBytes += textureBytes / 3;
+		}
+
+		if (!uploads.empty() && uploadedBytes + textureBytes > STREAMING_UPLOAD_BYTES_PER_FRAME) {
+			break;
+		}
+
+		//When the textures used this frame already fill the budget the texture stays loaded and is tried again next frame
+		if (!streamer.selectEvictions(textureBytes, frameNumber, evictions)) {
+			continue;
+		}
+		for (uint32_t asset : evictions) {
+			evictTexture(asset);
+		}
+
+		//Every texture of the frame goes into one batch, submitted once with one timeline value
+		if (uploads.empty()) {
+			beginUploadBatch();
+		}
+		streamed.texture = createTextureImage(streamed.levels, streamed.format);
+		std::vector<VKTextureLevel>().swap(streamed.levels);
+		streamer.setUploading(streamed.asset, streamed.texture.allocation.size);
+
+		uploads.push_back(&streamed);
+		uploadedBytes += textureBytes;
+	}
+
+	if (!uploads.empty()) {
+		uint64_t transferValue = submitUploadBatch();
+		for (StreamedTexture* streamed : uploads) {
+			streamed->transferValue = transferValue;
+		}
+	}
+}
+
+void VKApplication::evictTexture(uint32_t asset){
+	for (StreamedTexture& streamed : streamedTextures) {
+		if (streamed.asset != asset) {
+			continue;
+		}
+
+		//The material samples the placeholder from this frame on, the frames in flight may still sample the texture
+		//Its bindless element is only free again once they are done
+		VKTexture texture = streamed.texture;
+		uint32_t slot = streamed.slot;
+		deletionQueue.push([this, texture, slot]() mutable {
+			destroyTexture(texture);
+			freeTextureSlots.push_back(slot);
+		});
+		streamed.texture = VKTexture{};
+		streamed.slot = 0;
+		streamer.setUnloaded(asset);
+	}
 }
 
-void VKApplication::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory){
+VkImage VKApplication::createImageObject(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, uint32_t mipLevels, VkSampleCountFlagBits numSamples){
 	//Create Info for Image we are going to feel with data from the staging buffer
 	VkImageCreateInfo imageInfo{};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1965,7 +4316,7 @@ void VKApplication::createImage(uint32_t width, uint32_t height, VkFormat format
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1; //Means there is no depth component 
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = format;//use the same format for the texels as the pixels in the buffer
 	//VK_IMAGE_TILING_LINEAR: Texels are laid out in row-major order like our pixels array
@@ -1982,32 +4333,59 @@ void VKApplication::createImage(uint32_t width, uint32_t height, VkFormat format
 	imageInfo.usage = usage;
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;//The image will only be used by one queue family: the one that supports graphics (and therefore also) transfer operations.
 	//The samples flag is related to multisampling. This is only relevant for images that will be used as attachments
-	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.samples = numSamples;
 	imageInfo.flags = 0; // Optional: Sparse images are images where only certain regions are actually backed by memory. If you were using a 3D texture for a voxel terrain, for example, then you could use this to avoid allocating memory to store large volumes of "air" values. 
 
 	//Create Image
+	VkImage image;
 	if (vkCreateImage(logicalDevice, &imageInfo, nullptr, &image) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create image!");
 	}
+	return image;
+}
+
+void VKApplication::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VKAllocation& imageAllocation, uint32_t mipLevels){
+	image = createImageObject(width, height, format, tiling, usage, mipLevels);
 
 	//Get memory requrments for image
 	//Allocating memory for an image works in exactly the same way as allocating memory for a buffer. Use vkGetImageMemoryRequirements instead of vkGetBufferMemoryRequirements
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(logicalDevice, image, &memRequirements);
 
-	//Allocation info
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
 	//Allocate memory for image
-	if (vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate image memory!");
-	}
+	//Optimal tiling images are kept in different blocks than buffers and linear images, so they never share a bufferImageGranularity page
+	imageAllocation = memoryAllocator.allocate(memRequirements, findMemoryType(memRequirements.memoryTypeBits, properties), tiling == VK_IMAGE_TILING_LINEAR);
 
 	//Bind image memory with textureImage
-	vkBindImageMemory(logicalDevice, image, imageMemory, 0);
+	vkBindImageMemory(logicalDevice, image, imageAllocation.memory, imageAllocation.offset);
+}
+
+void VKApplication::createImageInAllocation(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VKAllocation& imageAllocation, uint32_t mipLevels, VkSampleCountFlagBits numSamples){
+	image = createImageObject(width, height, format, tiling, usage, mipLevels, numSamples);
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(logicalDevice, image, &memRequirements);
+
+	//Lazily allocated memory (committed only if the GPU needs to spill the attachment out of tile memory) exists on tiled GPUs, elsewhere transient attachments use regular device local memory
+	if (properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+		const VkPhysicalDeviceMemoryProperties& memProperties = memoryAllocator.getMemoryProperties();
+		bool lazilyAllocatedSupported = false;
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+			lazilyAllocatedSupported = lazilyAllocatedSupported || ((memRequirements.memoryTypeBits & (1u << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties);
+		}
+		if (!lazilyAllocatedSupported) {
+			properties &= ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+		}
+	}
+
+	//The same kind of image with a smaller or equal extent needs at most the same size, the offset was aligned for the image that was there before
+	bool fits = imageAllocation.memory != VK_NULL_HANDLE && memRequirements.size <= imageAllocation.size && imageAllocation.offset % memRequirements.alignment == 0
+		&& (memRequirements.memoryTypeBits & (1u << imageAllocation.memoryTypeIndex)) != 0;
+	if (!fits) {
+		imageAllocation = memoryAllocator.allocate(memRequirements, findMemoryType(memRequirements.memoryTypeBits, properties), tiling == VK_IMAGE_TILING_LINEAR);
+	}
+
+	vkBindImageMemory(logicalDevice, image, imageAllocation.memory, imageAllocation.offset);
 }
 
 VkCommandBuffer VKApplication::beginSingleTimeCommands(){
@@ -2046,25 +4424,126 @@ void VKApplication::endSingleTimeCommands(VkCommandBuffer commandBuffer){
 	// The buffer copy command requires a queue family that supports transfer operations, which is indicated using VK_QUEUE_TRANSFER_BIT
 	//The good news is that any queue family with VK_QUEUE_GRAPHICS_BIT or VK_QUEUE_COMPUTE_BIT capabilities already implicitly support VK_QUEUE_TRANSFER_BIT operations.
 	//he implementation is not required to explicitly list it in queueFlags in those cases.
-	vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
 	//Unlike the draw commands, there are no events we need to wait on this time. We just want to execute the transfer on the buffers immediately. 
 	// There are again two possible ways to wait on this transfer to complete:
 	// - We could use a fence and wait with vkWaitForFences (A fence would allow you to schedule multiple transfers simultaneously and wait for all of them complete, instead of executing one at a time.)
 	// - Simply wait for the transfer queue to become idle with vkQueueWaitIdle
-	vkQueueWaitIdle(graphicsQueue);
+	//We use the graphics timeline value of the submit, so the CPU keeps going while this one executes
+	uint64_t value = frameScheduler.submit(VKQueue::Graphics, &commandBuffer, 1);
+
+	// Clean up the command buffer used for the transfer operation once it has finished executing.
+	pendingUploads.push_back(PendingUpload{ commandBuffer, commandPool, VKQueue::Graphics, value });
+	retireUploads(false);
+}
+
+VkCommandBuffer VKApplication::beginTransferCommands(){
+	//Inside a batch every transfer command is recorded into the batch command buffer
+	if (uploadBatch != VK_NULL_HANDLE) {
+		return uploadBatch;
+	}
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = transferCommandPool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(logicalDevice, &allocInfo, &commandBuffer);
 
-	// Clean up the command buffer used for the transfer operation.
-	vkFreeCommandBuffers(logicalDevice, commandPool, 1, &commandBuffer);
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	return commandBuffer;
+}
+
+uint64_t VKApplication::endTransferCommands(VkCommandBuffer commandBuffer){
+	//The batch is submitted by submitUploadBatch, its commands signal the value of that submit
+	if (commandBuffer == uploadBatch) {
+		return frameScheduler.getNextValue(VKQueue::Transfer);
+	}
+
+	vkEndCommandBuffer(commandBuffer);
+
+	//The submit signals the next value of the transfer timeline, the graphics queue waits on that value before using the uploaded resources
+	//The same value frees the staging ring ranges and the command buffer, no fence is needed
+	uint64_t signalValue = frameScheduler.submit(VKQueue::Transfer, &commandBuffer, 1);
+
+	//Every staging ring range written since the last submit is read by this command buffer
+	stagingRing.markSubmitted(signalValue);
+
+	pendingUploads.push_back(PendingUpload{ commandBuffer, transferCommandPool, VKQueue::Transfer, signalValue });
+	retireUploads(false);
+
+	return signalValue;
+}
+
+void VKApplication::beginUploadBatch(){
+	if (uploadBatch != VK_NULL_HANDLE) {
+		throw std::runtime_error("Upload batch is already open!");
+	}
+
+	uploadBatch = beginTransferCommands();
+}
+
+uint64_t VKApplication::submitUploadBatch(){
+	if (uploadBatch == VK_NULL_HANDLE) {
+		throw std::runtime_error("No upload batch to submit!");
+	}
+
+	//Close the batch first, so endTransferCommands submits the command buffer instead of treating it as part of the batch
+	VkCommandBuffer commandBuffer = uploadBatch;
+	uploadBatch = VK_NULL_HANDLE;
+
+	return endTransferCommands(commandBuffer);
+}
+
+VKStagingRegion VKApplication::allocateStagingRegion(VkDeviceSize size){
+	//The ring can only reuse space of submitted uploads. A batch that keeps recording could fill it with ranges nothing will ever free,
+	//so once a batch takes half of the ring it is submitted and a new one is started
+	if (uploadBatch != VK_NULL_HANDLE && stagingRing.getOpenBytes() > 0 && stagingRing.getOpenBytes() + size > stagingRing.getCapacity() / 2) {
+		submitUploadBatch();
+		beginUploadBatch();
+	}
+
+	return stagingRing.allocate(size);
+}
+
+void VKApplication::retireUploads(bool wait){
+	//Uploads are retired in submission order, stopping at the first one whose queue hasn't reached its value yet
+	while (!pendingUploads.empty()) {
+		PendingUpload& upload = pendingUploads.front();
+
+		if (wait) {
+			frameScheduler.wait(upload.queue, upload.value);
+		}
+		else if (!frameScheduler.isRetired(upload.queue, upload.value)) {
+			break;
+		}
+
+		vkFreeCommandBuffers(logicalDevice, upload.commandPool, 1, &upload.commandBuffer);
+		pendingUploads.pop_front();
+	}
+
+	//The ring reads the transfer timeline itself, what these uploads read is given back too
+	stagingRing.reclaim();
 }
 
-void VKApplication::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout){
+void VKApplication::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels){
+	//Texture transitions are recorded on the transfer queue next to the copy, the depth image is only ever used by the graphics queue
+	bool onTransferQueue = newLayout != VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
 	// Begin command buffer recording
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	VkCommandBuffer commandBuffer = onTransferQueue ? beginTransferCommands() : beginSingleTimeCommands();
 
 	// One of the most common ways to perform layout transitions is using an image memory barrier.
 	//A pipeline barrier like that is generally used to synchronize access to resources, like ensuring that a write to a buffer completes before reading from it, but it can also be used to transition image layouts and transfer queue family ownership 
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	//With synchronization2 every barrier carries its own stage masks (VkImageMemoryBarrier2), VKBarrierBatch translates them for the legacy vkCmdPipelineBarrier
+	VkImageMemoryBarrier2 barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
 	barrier.oldLayout = oldLayout; //It is possible to use VK_IMAGE_LAYOUT_UNDEFINED as oldLayout if you don't care about the existing contents of the image.
 	barrier.newLayout = newLayout;
 	//If you are using the barrier to transfer queue family ownership
@@ -2084,9 +4563,9 @@ void VKApplication::transitionImageLayout(VkImage image, VkFormat format, VkImag
 	else {
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	}
-	//Our image is not an array and does not have mipmapping levels, so only one level and layer are specified.
+	//Our image is not an array, so only one layer is specified. Every mip level is transitioned
 	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.levelCount = mipLevels;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = 1;
 	//Barriers are primarily used for synchronization purposes, so you must specify which types of operations that involve the resource must happen before the barrier, and which operations that involve the resource must wait on the barrier
@@ -2094,68 +4573,133 @@ void VKApplication::transitionImageLayout(VkImage image, VkFormat format, VkImag
 	//There are two transitions we need to handle:
 	//- Undefined to transfer destination: transfer writes that don't need to wait on anything
 	//- Transfer destination to shader reading: shader reads should wait on transfer writes, specifically the shader reads in the fragment shader, because that's where we're going to use the texture
-	VkPipelineStageFlags sourceStage;
-	VkPipelineStageFlags destinationStage;
-
 	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
 		//Form undefined layout to transfer dst layout
-		barrier.srcAccessMask = 0; // (Operation to wait on) Undefined doesn't matter (Don't need to wait on anything). set srcAccessMask to 0 if you ever needed a VK_ACCESS_HOST_WRITE_BIT dependency in a layout transition. Command buffer submission results in implicit VK_ACCESS_HOST_WRITE_BIT synchronization at the beginning. 
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT; //(operation to do after waiting to the previous srcAccessMask operation to complete) Transfer write operation, in this case it doesn't wait for any operation becuase srcAccessMask is 0
+		barrier.srcAccessMask = VK_ACCESS_2_NONE; // (Operation to wait on) Undefined doesn't matter (Don't need to wait on anything). set srcAccessMask to 0 if you ever needed a VK_ACCESS_HOST_WRITE_BIT dependency in a layout transition. Command buffer submission results in implicit VK_ACCESS_HOST_WRITE_BIT synchronization at the beginning. 
+		barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT; //(operation to do after waiting to the previous srcAccessMask operation to complete) Transfer write operation, in this case it doesn't wait for any operation becuase srcAccessMask is 0
 
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;// Since the writes don't have to wait on anything, you may specify an empty access mask and the earliest possible pipeline stage VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
-		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;//transfer writes must occur in the pipeline transfer stage (is not a real stage within the graphics and compute pipelines. It is more of a pseudo-stage where transfers happen)
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;// Since the writes don't have to wait on anything, you may specify an empty access mask and no stage (the earliest possible pipeline stage VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT in the legacy barrier)
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;//Only the copy of the texels waits, not every transfer command (with the legacy barrier it is the whole transfer stage)
 	}
 	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		//The image will be written in the same pipeline stage (transfer stage) and subsequently read by the fragment shader, which is why we specify shader reading access in the fragment shader pipeline stage.
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT; //Wait for transfer write
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT; // Read in shader texture image, after waiting fo the transfer write operation to complete
-
-		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT; 
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		//The image will be written in the same pipeline stage (transfer stage) and subsequently read by the fragment shader
+		//A transfer queue has no fragment shader stage, so the shader read dependency is left to the graphics queue:
+		//- Here we only wait for the transfer write and do the layout transition (release)
+		//- The graphics queue waits on the transfer timeline and acquires the image for VK_ACCESS_SHADER_READ_BIT in the fragment shader stage
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT; //Wait for transfer write
+		barrier.dstAccessMask = VK_ACCESS_2_NONE;
+
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+
+		//Queue family ownership transfer, the release and the acquire must have the same layouts and queue family indices
+		if (transferQueueFamily != graphicsQueueFamily) {
+			barrier.srcQueueFamilyIndex = transferQueueFamily;
+			barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+
+			PendingAcquire acquire{};
+			acquire.transferValue = frameScheduler.getNextValue(VKQueue::Transfer);//Signaled by the submit of this command buffer
+			acquire.isImage = true;
+			acquire.imageBarrier = barrier;
+			acquire.imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;//Where the submit waits on the transfer timeline for it
+			acquire.imageBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+			acquire.imageBarrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+			acquire.imageBarrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+			pendingAcquires.push_back(acquire);
+		}
 	}
 	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
 		//Depth image layout transition
 		//The depth buffer will be read from to perform depth tests to see if a fragment is visible, and will be written to when a new fragment is drawn.
-		barrier.srcAccessMask = 0; 
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_NONE; 
+		barrier.dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;//You should pick the earliest pipeline stage that matches the specified operations, so that it is ready for usage as depth attachment when it needs to be.
-		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;//Read happens at this stage
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT;//You should pick the earliest pipeline stage that matches the specified operations, so that it is ready for usage as depth attachment when it needs to be. Read happens at this stage
 	}
 	else {
 		throw std::invalid_argument("unsupported layout transition!");
 	}
 
-	//All types of pipeline barriers are submitted using the same function
-	//The first parameter after the command buffer specifies in which pipeline stage the operations occur that should happen before the barrier.
-	//The second parameter specifies the pipeline stage in which operations will wait on the barrier. 
+	//All types of pipeline barriers are submitted using the same function (vkCmdPipelineBarrier2, or vkCmdPipelineBarrier without synchronization2)
+	//The source stage mask specifies in which pipeline stage the operations occur that should happen before the barrier.
+	//The destination stage mask specifies the pipeline stage in which operations will wait on the barrier. 
 	//    The pipeline stages that you are allowed to specify before and after the barrier depend on how you use the resource before and after the barrier. 
 	//    if you're going to read from a uniform after the barrier: VK_ACCESS_UNIFORM_READ_BIT
 	//    and the earliest shader that will read from the uniform as pipeline stage: VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT 
 	//    It would not make sense to specify a non-shader pipeline stage for this type of usage and the validation layers will warn you when you specify a pipeline stage that does not match the type of usage.
-	//The third parameter is either 0 or VK_DEPENDENCY_BY_REGION_BIT
+	//The dependency flags are either 0 or VK_DEPENDENCY_BY_REGION_BIT
 	//    The latter turns the barrier into a per-region condition. 
 	//    That means that the implementation is allowed to already begin reading from the parts of a resource that were written so far
-	//The last three pairs of parameters reference arrays of pipeline barriers of the three available types: memory barriers, buffer memory barriers, and image memory barriers
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		sourceStage, destinationStage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
+	//A barrier command takes arrays of the three available types: memory barriers, buffer memory barriers, and image memory barriers
+	VKBarrierBatch barriers;
+	barriers.init(synchronization2Enabled);
+	barriers.addImageBarrier(barrier);
+	barriers.flush(commandBuffer);
 	
 	// End command buffer recoding and submit
-	endSingleTimeCommands(commandBuffer);
+	if (onTransferQueue) {
+		endTransferCommands(commandBuffer);
+	}
+	else {
+		endSingleTimeCommands(commandBuffer);
+	}
+}
+
+void VKApplication::releaseForMipmapGeneration(VkImage image, int32_t width, int32_t height, uint32_t mipLevels){
+	VkCommandBuffer commandBuffer = beginTransferCommands();
+
+	//The layout doesn't change, the blits write the levels in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+	VkImageMemoryBarrier2 barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.dstAccessMask = VK_ACCESS_2_NONE;//Ignored in the release, the access mask of the acquire makes the data visible
+
+	//Queue family ownership transfer, without it the barrier of the acquire is enough
+	if (transferQueueFamily != graphicsQueueFamily) {
+		barrier.srcQueueFamilyIndex = transferQueueFamily;
+		barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+		VKBarrierBatch release;
+		release.init(synchronization2Enabled);
+		release.addImageBarrier(barrier);
+		release.flush(commandBuffer);
+	}
+
+	//The acquire is always needed, it is where the blits are recorded (recordMipmapGeneration starts from the blit stage)
+	PendingAcquire acquire{};
+	acquire.transferValue = frameScheduler.getNextValue(VKQueue::Transfer);//Signaled by the submit of this command buffer
+	acquire.isImage = true;
+	acquire.imageBarrier = barrier;
+	acquire.imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;//Where the submit waits on the transfer timeline for it
+	acquire.imageBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+	acquire.imageBarrier.dstStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;
+	acquire.imageBarrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	acquire.mipLevels = mipLevels;
+	acquire.width = width;
+	acquire.height = height;
+	pendingAcquires.push_back(acquire);
+
+	endTransferCommands(commandBuffer);
 }
 
-void VKApplication::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height){
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+void VKApplication::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, VkDeviceSize bufferOffset, uint32_t mipLevel){
+	VkCommandBuffer commandBuffer = beginTransferCommands();
 
 	//Specify which part of the buffer is going to be copied to which part of the image
 	VkBufferImageCopy region{};
-	region.bufferOffset = 0;// specifies the byte offset in the buffer at which the pixel values start
+	region.bufferOffset = bufferOffset;// specifies the byte offset in the buffer at which the pixel values start
 	//he bufferRowLength and bufferImageHeight fields specify how the pixels are laid out in memory. For example, you could have some padding bytes between rows of the image.
 	//Specifying 0 for both indicates that the pixels are simply tightly packed like they are in our case.
 	region.bufferRowLength = 0;
@@ -2163,7 +4707,7 @@ void VKApplication::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t w
 
 	// The imageSubresource, imageOffset and imageExtent fields indicate to which part of the image we want to copy the pixels.
 	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.mipLevel = mipLevel;//Width and height are the size of this level
 	region.imageSubresource.baseArrayLayer = 0;
 	region.imageSubresource.layerCount = 1;
 
@@ -2185,10 +4729,10 @@ void VKApplication::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t w
 		&region
 	);
 
-	endSingleTimeCommands(commandBuffer);
+	endTransferCommands(commandBuffer);
 }
 
-VkImageView VKApplication::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+VkImageView VKApplication::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel, uint32_t levelCount)
 {
 	VkImageViewCreateInfo viewInfo{};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -2204,8 +4748,8 @@ VkImageView VKApplication::createImageView(VkImage image, VkFormat format, VkIma
 
 	//The subresourceRange field describes what the image's purpose is and which part of the image should be accessed. Our images will be used as color targets without any mipmapping levels or multiple layers.
 	viewInfo.subresourceRange.aspectMask = aspectFlags;
-	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+	viewInfo.subresourceRange.levelCount = levelCount;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 
@@ -2221,20 +4765,7 @@ VkImageView VKApplication::createImageView(VkImage image, VkFormat format, VkIma
 VkFormat VKApplication::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features){
 	//The support of a format depends on the tiling mode and usage, so we must also include these as parameters
 	for (VkFormat format : candidates) {
-		//VkFormatProperties struct contains three fields:
-		// - linearTilingFeatures: Use cases that are supported with linear tiling
-		// - optimalTilingFeatures: Use cases that are supported with optimal tiling
-		// - bufferFeatures: Use cases that are supported for buffers
-		//Only the first two are relevant here, and the one we check depends on the tiling
-		VkFormatProperties props;
-		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
-
-		
-		// Cheks if props linear tiling features flags have the feature we want and the tiling is linear
-		if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features) {
-			return format;
-		}
-		else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features) {
+		if (isFormatSupported(format, tiling, features)) {
 			return format;
 		}
 	}
@@ -2242,13 +4773,29 @@ VkFormat VKApplication::findSupportedFormat(const std::vector<VkFormat>& candida
 	throw std::runtime_error("Failed to find supported format!");
 }
 
+bool VKApplication::isFormatSupported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features){
+	//VkFormatProperties struct contains three fields:
+	// - linearTilingFeatures: Use cases that are supported with linear tiling
+	// - optimalTilingFeatures: Use cases that are supported with optimal tiling
+	// - bufferFeatures: Use cases that are supported for buffers
+	//Only the first two are relevant here, and the one we check depends on the tiling
+	VkFormatProperties props;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+
+	// Cheks if props linear tiling features flags have the feature we want and the tiling is linear
+	if (tiling == VK_IMAGE_TILING_LINEAR) {
+		return (props.linearTilingFeatures & features) == features;
+	}
+	return tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features;
+}
+
 VkFormat VKApplication::findDepthFormat(){
 	//Find supported format for depth
 	//All of these candidate formats contain a depth component, but the latter two also contain a stencil component.
 	return findSupportedFormat(
 		{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
 		VK_IMAGE_TILING_OPTIMAL,
-		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT //The depth pyramid is built by sampling the depth image
 	);
 }
 
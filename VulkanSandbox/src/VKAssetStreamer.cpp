@@ -0,0 +1,122 @@
+#include "VKAssetStreamer.h"
+#include <algorithm>
+#include <stdexcept>
+
+void VKAssetStreamer::init(uint32_t workerCount, uint64_t budgetBytes){
+	budget = budgetBytes;
+	residentBytes = 0;
+	assets.clear();
+	finished.clear();
+	stopping = false;
+	workers.init(workerCount);
+}
+
+void VKAssetStreamer::shutdown(){
+	stopping = true;
+	workers.shutdown();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	finished.clear();
+}
+
+uint32_t VKAssetStreamer::addAsset(bool pinned){
+	VKStreamedAsset asset{};
+	asset.pinned = pinned;
+	assets.push_back(asset);
+	return static_cast<uint32_t>(assets.size() - 1);
+}
+
+void VKAssetStreamer::load(uint32_t asset, std::function<void()> job){
+	if (assets[asset].state != VKAssetState::Unloaded) {
+		throw std::runtime_error("Failed to load asset, it is already loading or loaded!");
+	}
+	assets[asset].state = VKAssetState::Loading;
+
+	//The exception is kept for the main thread instead of going to the job system, nothing ever waits on the streaming workers
+	workers.submit([this, asset, job = std::move(job)](uint32_t) {
+		if (stopping) {
+			return;
+		}
+
+		VKAssetLoadResult result{ asset, nullptr };
+		try {
+			job();
+		}
+		catch (...) {
+			result.error = std::current_exception();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		finished.push_back(result);
+	});
+}
+
+std::vector<VKAssetLoadResult> VKAssetStreamer::collectLoaded(){
+	std::vector<VKAssetLoadResult> results;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		results.swap(finished);
+	}
+
+	for (const VKAssetLoadResult& result : results) {
+		assets[result.asset].state = result.error ? VKAssetState::Failed : VKAssetState::Loaded;
+	}
+	return results;
+}
+
+void VKAssetStreamer::markUsed(uint32_t asset, uint64_t frame){
+	assets[asset].lastUsedFrame = std::max(assets[asset].lastUsedFrame, frame);
+}
+
+void VKAssetStreamer::setUploading(uint32_t asset, uint64_t bytes){
+	assets[asset].state = VKAssetState::Uploading;
+	assets[asset].bytes = bytes;
+	if (!assets[asset].pinned) {
+		residentBytes += bytes;
+	}
+}
+
+void VKAssetStreamer::setResident(uint32_t asset){
+	assets[asset].state = VKAssetState::Resident;
+}
+
+void VKAssetStreamer::setUnloaded(uint32_t asset){
+	if (!assets[asset].pinned) {
+		residentBytes -= assets[asset].bytes;
+	}
+	assets[asset].state = VKAssetState::Unloaded;
+	assets[asset].bytes = 0;
+}
+
+bool VKAssetStreamer::selectEvictions(uint64_t bytes, uint64_t frame, std::vector<uint32_t>& evictions) const{
+	evictions.clear();
+	if (residentBytes + bytes <= budget) {
+		return true;
+	}
+
+	//Only resident assets are candidates, an upload in flight can't be stopped
+	std::vector<uint32_t> candidates;
+	for (uint32_t i = 0; i < assets.size(); i++) {
+		if (assets[i].state == VKAssetState::Resident && !assets[i].pinned && assets[i].lastUsedFrame < frame) {
+			candidates.push_back(i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+		return assets[a].lastUsedFrame < assets[b].lastUsedFrame;
+	});
+
+	uint64_t remainingBytes = residentBytes;
+	for (uint32_t candidate : candidates) {
+		if (remainingBytes + bytes <= budget) {
+			break;
+		}
+		evictions.push_back(candidate);
+		remainingBytes -= assets[candidate].bytes;
+	}
+
+	if (remainingBytes + bytes > budget) {
+		evictions.clear();
+		return false;
+	}
+	return true;
+}
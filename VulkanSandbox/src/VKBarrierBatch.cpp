@@ -0,0 +1,138 @@
+#include "VKBarrierBatch.h"
+
+void VKBarrierBatch::init(bool synchronization2Enabled){
+	synchronization2 = synchronization2Enabled;
+}
+
+void VKBarrierBatch::addMemoryBarrier(const VkMemoryBarrier2& barrier){
+	memoryBarriers.push_back(barrier);
+}
+
+void VKBarrierBatch::addBufferBarrier(const VkBufferMemoryBarrier2& barrier){
+	bufferBarriers.push_back(barrier);
+}
+
+void VKBarrierBatch::addImageBarrier(const VkImageMemoryBarrier2& barrier){
+	imageBarriers.push_back(barrier);
+}
+
+void VKBarrierBatch::flush(VkCommandBuffer commandBuffer){
+	if (isEmpty()) {
+		return;
+	}
+
+	if (synchronization2) {
+		VkDependencyInfo dependencyInfo{};
+		dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependencyInfo.memoryBarrierCount = static_cast<uint32_t>(memoryBarriers.size());
+		dependencyInfo.pMemoryBarriers = memoryBarriers.data();
+		dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+		dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+		dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+		dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+		vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+	}
+	else {
+		flushLegacy(commandBuffer);
+	}
+
+	memoryBarriers.clear();
+	bufferBarriers.clear();
+	imageBarriers.clear();
+}
+
+void VKBarrierBatch::flushLegacy(VkCommandBuffer commandBuffer){
+	//The legacy barrier has one pair of stage masks for the whole call
+	VkPipelineStageFlags2 srcStages = 0;
+	VkPipelineStageFlags2 dstStages = 0;
+
+	legacyMemoryBarriers.clear();
+	for (const VkMemoryBarrier2& barrier : memoryBarriers) {
+		VkMemoryBarrier legacy{};
+		legacy.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		legacy.srcAccessMask = toLegacyAccesses(barrier.srcAccessMask);
+		legacy.dstAccessMask = toLegacyAccesses(barrier.dstAccessMask);
+		legacyMemoryBarriers.push_back(legacy);
+		srcStages |= barrier.srcStageMask;
+		dstStages |= barrier.dstStageMask;
+	}
+
+	legacyBufferBarriers.clear();
+	for (const VkBufferMemoryBarrier2& barrier : bufferBarriers) {
+		VkBufferMemoryBarrier legacy{};
+		legacy.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		legacy.srcAccessMask = toLegacyAccesses(barrier.srcAccessMask);
+		legacy.dstAccessMask = toLegacyAccesses(barrier.dstAccessMask);
+		legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+		legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+		legacy.buffer = barrier.buffer;
+		legacy.offset = barrier.offset;
+		legacy.size = barrier.size;
+		legacyBufferBarriers.push_back(legacy);
+		srcStages |= barrier.srcStageMask;
+		dstStages |= barrier.dstStageMask;
+	}
+
+	legacyImageBarriers.clear();
+	for (const VkImageMemoryBarrier2& barrier : imageBarriers) {
+		VkImageMemoryBarrier legacy{};
+		legacy.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		legacy.srcAccessMask = toLegacyAccesses(barrier.srcAccessMask);
+		legacy.dstAccessMask = toLegacyAccesses(barrier.dstAccessMask);
+		legacy.oldLayout = barrier.oldLayout;
+		legacy.newLayout = barrier.newLayout;
+		legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+		legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+		legacy.image = barrier.image;
+		legacy.subresourceRange = barrier.subresourceRange;
+		legacyImageBarriers.push_back(legacy);
+		srcStages |= barrier.srcStageMask;
+		dstStages |= barrier.dstStageMask;
+	}
+
+	//A legacy stage mask can't be 0: nothing to wait for is the top of the pipe, nothing that waits is the bottom
+	VkPipelineStageFlags srcStageMask = toLegacyStages(srcStages);
+	VkPipelineStageFlags dstStageMask = toLegacyStages(dstStages);
+	if (srcStageMask == 0) {
+		srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	}
+	if (dstStageMask == 0) {
+		dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	}
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		srcStageMask, dstStageMask,
+		0,
+		static_cast<uint32_t>(legacyMemoryBarriers.size()), legacyMemoryBarriers.data(),
+		static_cast<uint32_t>(legacyBufferBarriers.size()), legacyBufferBarriers.data(),
+		static_cast<uint32_t>(legacyImageBarriers.size()), legacyImageBarriers.data()
+	);
+}
+
+VkPipelineStageFlags VKBarrierBatch::toLegacyStages(VkPipelineStageFlags2 stages){
+	//The first 32 bits have the same meaning in both APIs, the stages above them only exist in synchronization2
+	VkPipelineStageFlags legacy = static_cast<VkPipelineStageFlags>(stages & 0xFFFFFFFFull);
+	if (stages & (VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT | VK_PIPELINE_STAGE_2_RESOLVE_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT)) {
+		legacy |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+	if (stages & (VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT)) {
+		legacy |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+	}
+	if (stages & VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT) {
+		legacy |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;//The only pre-rasterization shader stage the pipelines use
+	}
+	return legacy;
+}
+
+VkAccessFlags VKBarrierBatch::toLegacyAccesses(VkAccessFlags2 accesses){
+	//Same as the stages: the first 32 bits are shared, the split shader accesses are merged back
+	VkAccessFlags legacy = static_cast<VkAccessFlags>(accesses & 0xFFFFFFFFull);
+	if (accesses & (VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT)) {
+		legacy |= VK_ACCESS_SHADER_READ_BIT;
+	}
+	if (accesses & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT) {
+		legacy |= VK_ACCESS_SHADER_WRITE_BIT;
+	}
+	return legacy;
+}
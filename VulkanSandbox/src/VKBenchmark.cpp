@@ -0,0 +1,75 @@
+#include "VKBenchmark.h"
+#include <algorithm>
+#include <numeric>
+#include <fstream>
+#include <cmath>
+
+namespace {
+	void writeStats(std::ofstream& file, const char* name, const VKBenchmarkStats& stats) {
+		file << "\t\"" << name << "\": { \"mean\": " << stats.mean << ", \"p50\": " << stats.p50 << ", \"p90\": " << stats.p90
+			<< ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << " },\n";
+	}
+
+	//The device name is the only string that comes from outside, quotes and backslashes are escaped
+	std::string escapeJson(const std::string& text) {
+		std::string escaped;
+		for (char c : text) {
+			if (c == '"' || c == '\\') {
+				escaped += '\\';
+			}
+			escaped += c;
+		}
+		return escaped;
+	}
+}
+
+VKBenchmarkStats VKBenchmarkStats::compute(std::vector<double> samples){
+	VKBenchmarkStats stats;
+	if (samples.empty()) {
+		return stats;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p * samples.size()));
+		return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+	};
+
+	stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+	stats.p50 = percentile(0.50);
+	stats.p90 = percentile(0.90);
+	stats.p95 = percentile(0.95);
+	stats.p99 = percentile(0.99);
+	stats.max = samples.back();
+	return stats;
+}
+
+bool VKBenchmarkReport::writeJson(const std::string& path) const{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	file << "{\n";
+	file << "\t\"device\": \"" << escapeJson(deviceName) << "\",\n";
+	file << "\t\"width\": " << width << ",\n";
+	file << "\t\"height\": " << height << ",\n";
+	file << "\t\"framesInFlight\": " << framesInFlight << ",\n";
+	file << "\t\"warmupFrames\": " << warmupFrames << ",\n";
+	file << "\t\"frames\": " << frameCount << ",\n";
+	file << "\t\"msaaSamples\": " << msaaSamples << ",\n";
+	file << "\t\"sampleRateShading\": " << (sampleRateShading ? "true" : "false") << ",\n";
+	file << "\t\"dynamicRendering\": " << (dynamicRendering ? "true" : "false") << ",\n";
+	file << "\t\"synchronization2\": " << (synchronization2 ? "true" : "false") << ",\n";
+	file << "\t\"totalSeconds\": " << totalSeconds << ",\n";
+	file << "\t\"framesPerSecond\": " << framesPerSecond << ",\n";
+	writeStats(file, "cpuFrameMs", cpuFrameMs);
+	if (gpuTimingsAvailable) {
+		writeStats(file, "gpuFrameMs", gpuFrameMs);
+	}
+	file << "\t\"memory\": { \"deviceLocalUsedBytes\": " << deviceLocalUsedBytes << ", \"deviceLocalAllocatedBytes\": " << deviceLocalAllocatedBytes
+		<< ", \"hostUsedBytes\": " << hostUsedBytes << ", \"hostAllocatedBytes\": " << hostAllocatedBytes
+		<< ", \"streamedTextureBytes\": " << streamedTextureBytes << " }\n";
+	file << "}\n";
+	return file.good();
+}
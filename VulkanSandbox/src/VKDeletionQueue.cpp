@@ -0,0 +1,58 @@
+#include "VKDeletionQueue.h"
+
+void VKDeletionQueue::init(){
+	pending.clear();
+	submitted.clear();
+	spare.clear();
+}
+
+void VKDeletionQueue::push(Release release){
+	pending.push_back(std::move(release));
+}
+
+void VKDeletionQueue::submit(uint64_t value){
+	if (pending.empty()) {
+		return;
+	}
+
+	//Several submits before a flush with the same value (nothing else was submitted in between) share a list
+	if (!submitted.empty() && submitted.back().value == value) {
+		for (Release& release : pending) {
+			submitted.back().releases.push_back(std::move(release));
+		}
+		pending.clear();
+		return;
+	}
+
+	submitted.push_back(Submitted{ value, std::move(pending) });
+	pending.clear();
+	if (!spare.empty()) {
+		std::swap(pending, spare.back());
+		spare.pop_back();
+	}
+}
+
+void VKDeletionQueue::flush(uint64_t completedValue){
+	//Values only grow, stop at the first list that is still in use
+	while (!submitted.empty() && submitted.front().value <= completedValue) {
+		release(submitted.front().releases);
+		spare.push_back(std::move(submitted.front().releases));
+		submitted.pop_front();
+	}
+}
+
+void VKDeletionQueue::flushAll(){
+	for (Submitted& list : submitted) {
+		release(list.releases);
+	}
+	submitted.clear();
+	release(pending);
+}
+
+void VKDeletionQueue::release(std::vector<Release>& releases){
+	//In the order they were pushed
+	for (Release& release : releases) {
+		release();
+	}
+	releases.clear();
+}
@@ -0,0 +1,38 @@
+#include "VKFrameArena.h"
+#include <cstdint>
+
+void VKFrameArena::init(size_t arenaCapacity){
+	capacity = arenaCapacity;
+	block.reset(new char[capacity]);
+	head = 0;
+	overflowBlocks.clear();
+	overflowBytes = 0;
+}
+
+void VKFrameArena::reset(){
+	//The last frame didn't fit, the block grows to what it used so the next frames don't overflow
+	if (overflowBytes > 0) {
+		capacity += overflowBytes;
+		block.reset(new char[capacity]);
+		overflowBlocks.clear();
+		overflowBytes = 0;
+	}
+	head = 0;
+}
+
+void* VKFrameArena::allocate(size_t size, size_t alignment){
+	//The alignment is applied to the address, the block itself is only aligned for the fundamental types
+	uintptr_t base = reinterpret_cast<uintptr_t>(block.get());
+	uintptr_t address = (base + head + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+	if (address + size <= base + capacity) {
+		head = address + size - base;
+		return reinterpret_cast<void*>(address);
+	}
+
+	//Enough for the data at any alignment
+	size_t overflowSize = size + alignment;
+	overflowBlocks.emplace_back(new char[overflowSize]);
+	overflowBytes += overflowSize;
+	uintptr_t overflowBase = reinterpret_cast<uintptr_t>(overflowBlocks.back().get());
+	return reinterpret_cast<void*>((overflowBase + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1));
+}
@@ -0,0 +1,183 @@
+#include "VKFrameScheduler.h"
+#include <stdexcept>
+
+void VKFrameScheduler::init(VkDevice device, VkQueue graphicsQueue, VkQueue transferQueue){
+	logicalDevice = device;
+	queues[static_cast<size_t>(VKQueue::Graphics)].queue = graphicsQueue;
+	queues[static_cast<size_t>(VKQueue::Transfer)].queue = transferQueue;
+
+	//A timeline semaphore holds a 64 bit counter instead of a signaled/unsignaled state, it starts at 0: nothing submitted, nothing to wait for
+	VkSemaphoreTypeCreateInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &timelineInfo;
+
+	for (Queue& queue : queues) {
+		if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &queue.timeline) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create timeline semaphore!");
+		}
+		queue.submittedValue = 0;
+		queue.completedValue = 0;
+	}
+
+	frames.fill(FrameRecord{});
+	lastFrame = UINT64_MAX;
+}
+
+void VKFrameScheduler::destroy(){
+	for (Queue& queue : queues) {
+		vkDestroySemaphore(logicalDevice, queue.timeline, nullptr);
+		queue.timeline = VK_NULL_HANDLE;
+	}
+}
+
+void VKFrameScheduler::waitFor(VKQueue queue, uint64_t value, VkPipelineStageFlags stageMask){
+	if (value == 0) {
+		return;
+	}
+
+	waitSemaphores.push_back(getTimeline(queue));
+	waitValues.push_back(value);
+	waitStages.push_back(stageMask);
+}
+
+void VKFrameScheduler::waitForBinary(VkSemaphore semaphore, VkPipelineStageFlags stageMask){
+	waitSemaphores.push_back(semaphore);
+	waitValues.push_back(0);
+	waitStages.push_back(stageMask);
+}
+
+void VKFrameScheduler::signalBinary(VkSemaphore semaphore){
+	signalSemaphores.push_back(semaphore);
+	signalValues.push_back(0);
+}
+
+uint64_t VKFrameScheduler::submit(VKQueue queueType, const VkCommandBuffer* commandBuffers, uint32_t commandBufferCount){
+	Queue& queue = queues[static_cast<size_t>(queueType)];
+
+	//Values are signaled in submission order on a queue, so the values of a timeline only ever increase
+	uint64_t signalValue = queue.submittedValue + 1;
+	signalSemaphores.push_back(queue.timeline);
+	signalValues.push_back(signalValue);
+
+	//Timeline values are passed chaining VkTimelineSemaphoreSubmitInfo, one value per semaphore in pWaitSemaphores and pSignalSemaphores
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+	timelineInfo.pWaitSemaphoreValues = waitValues.data();
+	timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+	timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data();
+	submitInfo.commandBufferCount = commandBufferCount;
+	submitInfo.pCommandBuffers = commandBuffers;
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+	submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+	//No fence: the timeline value is what the host waits on
+	VkResult result = vkQueueSubmit(queue.queue, 1, &submitInfo, VK_NULL_HANDLE);
+
+	waitSemaphores.clear();
+	waitValues.clear();
+	waitStages.clear();
+	signalSemaphores.clear();
+	signalValues.clear();
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit command buffer!");
+	}
+
+	queue.submittedValue = signalValue;
+	return signalValue;
+}
+
+uint64_t VKFrameScheduler::getCompletedValue(VKQueue queueType){
+	Queue& queue = queues[static_cast<size_t>(queueType)];
+	vkGetSemaphoreCounterValue(logicalDevice, queue.timeline, &queue.completedValue);
+	return queue.completedValue;
+}
+
+bool VKFrameScheduler::isRetired(VKQueue queueType, uint64_t value){
+	//The cached value only grows, the device is only asked when it isn't enough
+	if (queues[static_cast<size_t>(queueType)].completedValue >= value) {
+		return true;
+	}
+	return getCompletedValue(queueType) >= value;
+}
+
+void VKFrameScheduler::wait(VKQueue queueType, uint64_t value){
+	if (isRetired(queueType, value)) {
+		return;
+	}
+
+	Queue& queue = queues[static_cast<size_t>(queueType)];
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &queue.timeline;
+	waitInfo.pValues = &value;
+	if (vkWaitSemaphores(logicalDevice, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to wait for timeline semaphore!");
+	}
+	queue.completedValue = value;
+}
+
+void VKFrameScheduler::waitIdle(){
+	for (size_t i = 0; i < queues.size(); i++) {
+		wait(static_cast<VKQueue>(i), queues[i].submittedValue);
+	}
+}
+
+void VKFrameScheduler::endFrame(uint64_t frame){
+	FrameRecord& record = frames[frame % FRAME_HISTORY];
+	record.frame = frame;
+	record.graphicsValue = getSubmittedValue(VKQueue::Graphics);
+	lastFrame = frame;
+}
+
+bool VKFrameScheduler::isFrameRetired(uint64_t frame){
+	uint64_t graphicsValue;
+	if (!findFrame(frame, graphicsValue)) {
+		return false;
+	}
+	return isRetired(VKQueue::Graphics, graphicsValue);
+}
+
+void VKFrameScheduler::waitForFrame(uint64_t frame){
+	uint64_t graphicsValue;
+	if (!findFrame(frame, graphicsValue)) {
+		throw std::runtime_error("Waiting for a frame that was never submitted!");
+	}
+	wait(VKQueue::Graphics, graphicsValue);
+}
+
+bool VKFrameScheduler::findFrame(uint64_t frame, uint64_t& graphicsValue) const{
+	if (lastFrame == UINT64_MAX || frame > lastFrame) {
+		return false;
+	}
+
+	const FrameRecord& record = frames[frame % FRAME_HISTORY];
+	if (record.frame == frame) {
+		graphicsValue = record.graphicsValue;
+		return true;
+	}
+
+	//Not in the history: either older than it, or a number that was skipped. The values only grow, so the first frame recorded after it is retired later than it
+	bool found = false;
+	for (const FrameRecord& newer : frames) {
+		if (newer.frame != UINT64_MAX && newer.frame > frame && (!found || newer.graphicsValue < graphicsValue)) {
+			graphicsValue = newer.graphicsValue;
+			found = true;
+		}
+	}
+	return found;
+}
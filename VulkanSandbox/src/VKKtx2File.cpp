@@ -0,0 +1,297 @@
+#include "VKKtx2File.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	//Offsets inside the file are aligned to this, a multiple of every texel block size the renderer writes and of the 4 bytes KTX2 requires
+	const uint64_t KTX2_LEVEL_ALIGNMENT = 16;
+
+	uint64_t alignUp(uint64_t value, uint64_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+bool VKKtx2File::open(const std::string& path){
+	close();
+	uint32_t blockWidth = 0;
+	uint32_t blockHeight = 0;
+	uint32_t blockBytes = 0;
+
+	if (!file.open(path)) {
+		return false;
+	}
+
+	if (file.size() < sizeof(VKKtx2Header) || memcmp(file.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+		std::cerr << "Texture " << path << " isn't a KTX2 file" << std::endl;
+		close();
+		return false;
+	}
+	header = reinterpret_cast<const VKKtx2Header*>(file.data());
+
+	//levelCount 0 asks the loader to generate the mip chain, the file then holds level 0 only
+	//The renderer treats it like a single level, it generates the chain itself when the format allows it
+	const char* unsupported = nullptr;
+	if (header->vkFormat == VK_FORMAT_UNDEFINED || header->supercompressionScheme != 0) {
+		unsupported = "supercompressed (transcode it to a GPU format first)";
+	}
+	else if (header->pixelWidth == 0 || header->pixelHeight == 0 || header->pixelDepth > 1 || header->layerCount > 1 || header->faceCount != 1) {
+		unsupported = "not a 2D texture";
+	}
+	else if (!getBlockFormat(static_cast<VkFormat>(header->vkFormat), blockWidth, blockHeight, blockBytes)) {
+		unsupported = "in a format the renderer doesn't know the size of";
+	}
+	else if (header->levelCount > getMaxLevelCount(header->pixelWidth, header->pixelHeight)) {
+		unsupported = "made of more mip levels than its size has";
+	}
+	else if (file.size() < sizeof(VKKtx2Header) + sizeof(VKKtx2Level) * static_cast<uint64_t>(std::max(header->levelCount, 1u))) {
+		unsupported = "truncated";
+	}
+	else {
+		//Every level must be inside the file and hold all the blocks of its size, the upload would otherwise read past the end of the file or of the level
+		//The offset is checked against the size first so the sum can't overflow
+		for (uint32_t level = 0; level < std::max(header->levelCount, 1u); level++) {
+			const VKKtx2Level& levelIndex = getLevelIndex()[level];
+			uint64_t width = std::max(header->pixelWidth >> level, 1u);
+			uint64_t height = std::max(header->pixelHeight >> level, 1u);
+			uint64_t levelSize = (width + blockWidth - 1) / blockWidth * ((height + blockHeight - 1) / blockHeight) * blockBytes;
+			if (levelIndex.byteOffset > file.size() || levelIndex.byteLength > file.size() - levelIndex.byteOffset || levelIndex.byteLength < levelSize) {
+				unsupported = "truncated";
+			}
+		}
+	}
+
+	if (unsupported) {
+		std::cerr << "Texture " << path << " can't be used, it is " << unsupported << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+uint32_t VKKtx2File::getMaxLevelCount(uint32_t width, uint32_t height){
+	//floor(log2(max(width, height))) + 1, the last level is 1x1
+	uint32_t levelCount = 1;
+	for (uint32_t size = std::max(width, height); size > 1; size >>= 1) {
+		levelCount++;
+	}
+	return levelCount;
+}
+
+bool VKKtx2File::getBlockFormat(VkFormat format, uint32_t& blockWidth, uint32_t& blockHeight, uint32_t& blockBytes){
+	blockWidth = 4;
+	blockHeight = 4;
+	switch (format) {
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		blockWidth = 1;
+		blockHeight = 1;
+		blockBytes = 4;
+		return true;
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+		blockBytes = 8;
+		return true;
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		blockBytes = 16;
+		return true;
+	default:
+		break;
+	}
+
+	//ASTC blocks are always 16 bytes, the formats go by pairs (UNORM then SRGB) in the order of their footprints
+	if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+		const uint32_t footprints[14][2] = { { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 }, { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 } };
+		uint32_t footprint = (format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2;
+		blockWidth = footprints[footprint][0];
+		blockHeight = footprints[footprint][1];
+		blockBytes = 16;
+		return true;
+	}
+	return false;
+}
+
+const char* VKKtx2File::getLevelData(uint32_t level) const{
+	return file.data() + getLevelIndex()[level].byteOffset;
+}
+
+size_t VKKtx2File::getLevelSize(uint32_t level) const{
+	return static_cast<size_t>(getLevelIndex()[level].byteLength);
+}
+
+std::string VKKtx2File::getValue(const std::string& key) const{
+	if (static_cast<uint64_t>(header->kvdByteOffset) + header->kvdByteLength > file.size()) {
+		return std::string();
+	}
+
+	//Every entry is its size (4 bytes), the key, a 0, the value and padding up to a multiple of 4
+	const char* entry = file.data() + header->kvdByteOffset;
+	const char* end = entry + header->kvdByteLength;
+	while (entry + sizeof(uint32_t) <= end) {
+		uint32_t entrySize;
+		memcpy(&entrySize, entry, sizeof(entrySize));
+		const char* keyStart = entry + sizeof(uint32_t);
+		if (entrySize > static_cast<size_t>(end - keyStart)) {
+			break;
+		}
+
+		const char* keyEnd = static_cast<const char*>(memchr(keyStart, 0, entrySize));
+		if (keyEnd && key.compare(0, std::string::npos, keyStart, keyEnd - keyStart) == 0) {
+			//String values are stored with their terminating 0
+			std::string value(keyEnd + 1, keyStart + entrySize);
+			if (!value.empty() && value.back() == '\0') {
+				value.pop_back();
+			}
+			return value;
+		}
+
+		entry = keyStart + alignUp(entrySize, 4);
+	}
+
+	return std::string();
+}
+
+bool VKKtx2File::write(const std::string& path, VkFormat format, const std::vector<VKTextureLevel>& levels, const std::vector<std::pair<std::string, std::string>>& keyValues){
+	std::vector<uint32_t> dataFormatDescriptor = buildDataFormatDescriptor(format);
+	if (dataFormatDescriptor.empty() || levels.empty()) {
+		std::cerr << "Failed to save the texture " << path << ", its format can't be written to a KTX2 file" << std::endl;
+		return false;
+	}
+
+	//The entries have to be sorted by key
+	std::vector<std::pair<std::string, std::string>> sortedKeyValues = keyValues;
+	std::sort(sortedKeyValues.begin(), sortedKeyValues.end());
+	std::vector<char> keyValueData;
+	for (const std::pair<std::string, std::string>& keyValue : sortedKeyValues) {
+		uint32_t entrySize = static_cast<uint32_t>(keyValue.first.size() + 1 + keyValue.second.size() + 1);
+		keyValueData.insert(keyValueData.end(), reinterpret_cast<const char*>(&entrySize), reinterpret_cast<const char*>(&entrySize) + sizeof(entrySize));
+		keyValueData.insert(keyValueData.end(), keyValue.first.c_str(), keyValue.first.c_str() + keyValue.first.size() + 1);
+		keyValueData.insert(keyValueData.end(), keyValue.second.c_str(), keyValue.second.c_str() + keyValue.second.size() + 1);
+		keyValueData.resize(alignUp(keyValueData.size(), 4));
+	}
+
+	// Layout
+	//Header, level index, data format descriptor, key/value data, then the levels from the smallest to the largest (the order KTX2 requires)
+	VKKtx2Header fileHeader{};
+	memcpy(fileHeader.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	fileHeader.vkFormat = static_cast<uint32_t>(format);
+	fileHeader.typeSize = 1;
+	fileHeader.pixelWidth = levels[0].width;
+	fileHeader.pixelHeight = levels[0].height;
+	fileHeader.faceCount = 1;
+	fileHeader.levelCount = static_cast<uint32_t>(levels.size());
+	fileHeader.dfdByteOffset = static_cast<uint32_t>(sizeof(VKKtx2Header) + sizeof(VKKtx2Level) * levels.size());
+	fileHeader.dfdByteLength = static_cast<uint32_t>(sizeof(uint32_t) * dataFormatDescriptor.size());
+	fileHeader.kvdByteOffset = keyValueData.empty() ? 0 : fileHeader.dfdByteOffset + fileHeader.dfdByteLength;
+	fileHeader.kvdByteLength = static_cast<uint32_t>(keyValueData.size());
+
+	std::vector<VKKtx2Level> levelIndex(levels.size());
+	uint64_t offset = alignUp(static_cast<uint64_t>(fileHeader.dfdByteOffset) + fileHeader.dfdByteLength + fileHeader.kvdByteLength, KTX2_LEVEL_ALIGNMENT);
+	for (size_t level = levels.size(); level-- > 0;) {
+		levelIndex[level].byteOffset = offset;
+		levelIndex[level].byteLength = levels[level].data.size();
+		levelIndex[level].uncompressedByteLength = levels[level].data.size();
+		offset = alignUp(offset + levels[level].data.size(), KTX2_LEVEL_ALIGNMENT);
+	}
+
+	//Write to a temporary file and rename it like the mesh cache, a truncated file is never left behind
+	std::string tempPath = path + ".tmp";
+	std::ofstream output(tempPath, std::ios::binary | std::ios::trunc);
+	if (!output.is_open()) {
+		std::cerr << "Failed to open " << tempPath << " to save the texture" << std::endl;
+		return false;
+	}
+
+	const char padding[KTX2_LEVEL_ALIGNMENT] = {};
+	output.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+	output.write(reinterpret_cast<const char*>(levelIndex.data()), sizeof(VKKtx2Level) * levelIndex.size());
+	output.write(reinterpret_cast<const char*>(dataFormatDescriptor.data()), fileHeader.dfdByteLength);
+	output.write(keyValueData.data(), keyValueData.size());
+	uint64_t written = static_cast<uint64_t>(fileHeader.dfdByteOffset) + fileHeader.dfdByteLength + fileHeader.kvdByteLength;
+	for (size_t level = levels.size(); level-- > 0;) {
+		output.write(padding, static_cast<std::streamsize>(levelIndex[level].byteOffset - written));
+		output.write(reinterpret_cast<const char*>(levels[level].data.data()), levels[level].data.size());
+		written = levelIndex[level].byteOffset + levelIndex[level].byteLength;
+	}
+	output.close();
+	if (!output) {
+		std::cerr << "Failed to write the texture to " << tempPath << std::endl;
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error) {
+		std::cerr << "Failed to save the texture to " << path << ": " << error.message() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+std::vector<uint32_t> VKKtx2File::buildDataFormatDescriptor(VkFormat format){
+	//Basic descriptor block of the Khronos Data Format Specification: color model, primaries, transfer function, block size and one sample per channel
+	//Values: KHR_DF_MODEL_RGBSDA = 1, KHR_DF_MODEL_BC7 = 134, KHR_DF_PRIMARIES_BT709 = 1, KHR_DF_TRANSFER_SRGB = 2
+	struct Sample {
+		uint32_t bitOffset;
+		uint32_t bitLength;
+		uint32_t channelType;//Channel id, and KHR_DF_SAMPLE_DATATYPE_LINEAR (0x10) for the alpha of an sRGB format
+		uint32_t upper;
+	};
+
+	uint32_t colorModel;
+	uint32_t blockDimensions;//Texel block size - 1 on each axis
+	uint32_t bytesPlane0;
+	std::vector<Sample> samples;
+	if (format == VK_FORMAT_R8G8B8A8_SRGB) {
+		colorModel = 1;
+		blockDimensions = 0;
+		bytesPlane0 = 4;
+		samples = { { 0, 8, 0, 255 }, { 8, 8, 1, 255 }, { 16, 8, 2, 255 }, { 24, 8, 15 | 0x10, 255 } };
+	}
+	else if (format == VK_FORMAT_BC7_SRGB_BLOCK) {
+		colorModel = 134;
+		blockDimensions = 3 | (3 << 8);
+		bytesPlane0 = 16;
+		samples = { { 0, 128, 0, 0xFFFFFFFF } };
+	}
+	else {
+		return std::vector<uint32_t>();
+	}
+
+	uint32_t blockSize = static_cast<uint32_t>(24 + 16 * samples.size());
+	std::vector<uint32_t> descriptor;
+	descriptor.push_back(sizeof(uint32_t) + blockSize);//Total size, including this word
+	descriptor.push_back(0);//Khronos vendor, basic descriptor type
+	descriptor.push_back(2 | (blockSize << 16));//Version 2 (KDFS 1.3)
+	descriptor.push_back(colorModel | (1 << 8) | (2 << 16));//Straight alpha
+	descriptor.push_back(blockDimensions);
+	descriptor.push_back(bytesPlane0);
+	descriptor.push_back(0);
+	for (const Sample& sample : samples) {
+		descriptor.push_back(sample.bitOffset | ((sample.bitLength - 1) << 16) | (sample.channelType << 24));
+		descriptor.push_back(0);//Sample position
+		descriptor.push_back(0);//Lower
+		descriptor.push_back(sample.upper);
+	}
+	return descriptor;
+}
@@ -0,0 +1,112 @@
+#include "VKMappedFile.h"
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool VKMappedFile::open(const std::string& path){
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize{};
+	//A mapping of an empty file can't be created
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = mapping;
+	mappedData = static_cast<const char*>(view);
+	mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat fileStat{};
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+		::close(file);
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	//The mapping keeps its own reference to the file, the descriptor isn't needed anymore
+	::close(file);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+
+	//The whole file is read once from start to end
+	madvise(view, static_cast<size_t>(fileStat.st_size), MADV_SEQUENTIAL);
+
+	mappedData = static_cast<const char*>(view);
+	mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+
+	return true;
+}
+
+void VKMappedFile::close(){
+	if (mappedData == nullptr) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(mappedData);
+	CloseHandle(mappingHandle);
+	CloseHandle(fileHandle);
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	munmap(const_cast<char*>(mappedData), mappedSize);
+#endif
+
+	mappedData = nullptr;
+	mappedSize = 0;
+}
+
+void VKMappedFile::getStamp(const std::string& path, uint64_t& size, int64_t& time){
+	std::error_code error;
+	size = 0;
+	time = 0;
+
+	uintmax_t fileSize = std::filesystem::file_size(path, error);
+	if (error) {
+		return;
+	}
+	std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(path, error);
+	if (error) {
+		return;
+	}
+
+	size = static_cast<uint64_t>(fileSize);
+	time = static_cast<int64_t>(writeTime.time_since_epoch().count());
+}
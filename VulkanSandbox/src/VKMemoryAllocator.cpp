@@ -0,0 +1,229 @@
+#include "VKMemoryAllocator.h"
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+
+void VKMemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize){
+	logicalDevice = device;
+	preferredBlockSize = blockSize;
+
+	//Heaps and memory types are needed to know the heap of every block and if the memory can be mapped
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+}
+
+void VKMemoryAllocator::destroy(){
+	for (uint32_t i = 0; i < blocks.size(); i++) {
+		if (blocks[i].memory != VK_NULL_HANDLE) {
+			//Anything still alive here is a resource that was never destroyed
+			if (blocks[i].allocationCount > 0) {
+				std::cerr << "Memory block " << i << " destroyed with " << blocks[i].allocationCount << " live allocations" << std::endl;
+			}
+			releaseBlock(i);
+		}
+	}
+	blocks.clear();
+}
+
+VKAllocation VKMemoryAllocator::allocate(const VkMemoryRequirements& memRequirements, uint32_t memoryTypeIndex, bool linear){
+	VKAllocation allocation{};
+	VkDeviceSize blockSize = getBlockSize(memoryTypeIndex);
+
+	//Big resources (e.g. a 4k texture) would waste most of a block, so they get their own memory
+	if (memRequirements.size > blockSize / 2) {
+		uint32_t blockIndex = createBlock(memRequirements.size, memoryTypeIndex, linear, true);
+		if (!allocateFromBlock(blockIndex, memRequirements, allocation)) {
+			throw std::runtime_error("Failed to sub-allocate dedicated memory block!");
+		}
+		return allocation;
+	}
+
+	//Try the existing blocks of the same memory type and resource kind
+	for (uint32_t i = 0; i < blocks.size(); i++) {
+		const Block& block = blocks[i];
+		if (block.memory == VK_NULL_HANDLE || block.dedicated || block.memoryTypeIndex != memoryTypeIndex || block.linear != linear) {
+			continue;
+		}
+		if (allocateFromBlock(i, memRequirements, allocation)) {
+			return allocation;
+		}
+	}
+
+	//No block has room left, allocate a new one from the driver
+	uint32_t blockIndex = createBlock(blockSize, memoryTypeIndex, linear, false);
+	if (!allocateFromBlock(blockIndex, memRequirements, allocation)) {
+		throw std::runtime_error("Failed to sub-allocate memory block!");
+	}
+	return allocation;
+}
+
+void VKMemoryAllocator::free(VKAllocation& allocation){
+	if (allocation.blockIndex == UINT32_MAX) {
+		return;
+	}
+
+	Block& block = blocks[allocation.blockIndex];
+
+	//Insert the range back keeping the list sorted by offset
+	auto it = std::lower_bound(block.freeRanges.begin(), block.freeRanges.end(), allocation.offset,
+		[](const FreeRange& range, VkDeviceSize offset) { return range.offset < offset; });
+	it = block.freeRanges.insert(it, FreeRange{ allocation.offset, allocation.size });
+
+	//Merge with the next free range
+	auto next = it + 1;
+	if (next != block.freeRanges.end() && it->offset + it->size == next->offset) {
+		it->size += next->size;
+		block.freeRanges.erase(next);
+	}
+	//Merge with the previous free range
+	if (it != block.freeRanges.begin()) {
+		auto prev = it - 1;
+		if (prev->offset + prev->size == it->offset) {
+			prev->size += it->size;
+			block.freeRanges.erase(it);
+		}
+	}
+
+	block.used -= allocation.size;
+	block.allocationCount--;
+
+	//Dedicated blocks only ever hold one resource
+	if (block.dedicated && block.allocationCount == 0) {
+		releaseBlock(allocation.blockIndex);
+	}
+
+	allocation = VKAllocation{};
+}
+
+VkDeviceSize VKMemoryAllocator::getHeapUsage(uint32_t heapIndex) const{
+	VkDeviceSize used = 0;
+	for (const Block& block : blocks) {
+		if (block.memory != VK_NULL_HANDLE && memProperties.memoryTypes[block.memoryTypeIndex].heapIndex == heapIndex) {
+			used += block.used;
+		}
+	}
+	return used;
+}
+
+VkDeviceSize VKMemoryAllocator::getHeapAllocated(uint32_t heapIndex) const{
+	VkDeviceSize allocated = 0;
+	for (const Block& block : blocks) {
+		if (block.memory != VK_NULL_HANDLE && memProperties.memoryTypes[block.memoryTypeIndex].heapIndex == heapIndex) {
+			allocated += block.size;
+		}
+	}
+	return allocated;
+}
+
+void VKMemoryAllocator::printHeapUsage() const{
+	std::cout << "Device memory usage:" << std::endl;
+	for (uint32_t heapIndex = 0; heapIndex < memProperties.memoryHeapCount; heapIndex++) {
+		uint32_t blockCount = 0;
+		for (const Block& block : blocks) {
+			if (block.memory != VK_NULL_HANDLE && memProperties.memoryTypes[block.memoryTypeIndex].heapIndex == heapIndex) {
+				blockCount++;
+			}
+		}
+
+		const VkMemoryHeap& heap = memProperties.memoryHeaps[heapIndex];
+		std::cout << "\tHeap " << heapIndex << ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : " (host)")
+			<< ": " << getHeapUsage(heapIndex) / 1024 << " KB used, "
+			<< getHeapAllocated(heapIndex) / 1024 << " KB allocated in " << blockCount << " blocks, "
+			<< heap.size / (1024 * 1024) << " MB heap size" << std::endl;
+	}
+}
+
+uint32_t VKMemoryAllocator::createBlock(VkDeviceSize size, uint32_t memoryTypeIndex, bool linear, bool dedicated){
+	Block block{};
+	block.size = size;
+	block.memoryTypeIndex = memoryTypeIndex;
+	block.linear = linear;
+	block.dedicated = dedicated;
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	if (vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &block.memory) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate memory block!");
+	}
+
+	//Persistent mapping of the whole block, every range gets a pointer inside it
+	if (memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(logicalDevice, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to map memory block!");
+		}
+	}
+
+	//At the beginning the whole block is free
+	block.freeRanges.push_back(FreeRange{ 0, size });
+
+	//Reuse a released slot
+	for (uint32_t i = 0; i < blocks.size(); i++) {
+		if (blocks[i].memory == VK_NULL_HANDLE) {
+			blocks[i] = std::move(block);
+			return i;
+		}
+	}
+
+	blocks.push_back(std::move(block));
+	return static_cast<uint32_t>(blocks.size() - 1);
+}
+
+void VKMemoryAllocator::releaseBlock(uint32_t blockIndex){
+	Block& block = blocks[blockIndex];
+
+	if (block.mapped != nullptr) {
+		vkUnmapMemory(logicalDevice, block.memory);
+	}
+	vkFreeMemory(logicalDevice, block.memory, nullptr);
+
+	block = Block{};
+}
+
+bool VKMemoryAllocator::allocateFromBlock(uint32_t blockIndex, const VkMemoryRequirements& memRequirements, VKAllocation& allocation){
+	Block& block = blocks[blockIndex];
+
+	for (size_t i = 0; i < block.freeRanges.size(); i++) {
+		FreeRange range = block.freeRanges[i];
+
+		//Round the offset up to the alignment required by the resource (alignment is always a power of two)
+		VkDeviceSize alignedOffset = (range.offset + memRequirements.alignment - 1) & ~(memRequirements.alignment - 1);
+		VkDeviceSize padding = alignedOffset - range.offset;
+
+		if (padding + memRequirements.size > range.size) {
+			continue;
+		}
+
+		//Split the free range: the padding before the aligned offset stays free (it can be merged back later) and so does the tail after the resource
+		VkDeviceSize tailOffset = alignedOffset + memRequirements.size;
+		VkDeviceSize tailSize = range.offset + range.size - tailOffset;
+
+		block.freeRanges.erase(block.freeRanges.begin() + i);
+		if (tailSize > 0) {
+			block.freeRanges.insert(block.freeRanges.begin() + i, FreeRange{ tailOffset, tailSize });
+		}
+		if (padding > 0) {
+			block.freeRanges.insert(block.freeRanges.begin() + i, FreeRange{ range.offset, padding });
+		}
+
+		block.used += memRequirements.size;
+		block.allocationCount++;
+
+		allocation.memory = block.memory;
+		allocation.offset = alignedOffset;
+		allocation.size = memRequirements.size;
+		allocation.memoryTypeIndex = block.memoryTypeIndex;
+		allocation.blockIndex = blockIndex;
+		allocation.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + alignedOffset : nullptr;
+		return true;
+	}
+
+	return false;
+}
+
+VkDeviceSize VKMemoryAllocator::getBlockSize(uint32_t memoryTypeIndex) const{
+	VkDeviceSize heapSize = memProperties.memoryHeaps[memProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+	//Never take more than 1/8 of a heap in a single block
+	return std::min(preferredBlockSize, heapSize / 8);
+}
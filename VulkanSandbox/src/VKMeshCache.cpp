@@ -0,0 +1,138 @@
+#include "VKMeshCache.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <cstring>
+
+bool VKMeshCache::open(const std::string& path, const std::string& sourcePath, uint32_t vertexStride, const VKMeshCacheLodSettings& lodSettings){
+	close();
+
+	if (!file.open(path)) {
+		return false;
+	}
+
+	if (file.size() < sizeof(VKMeshCacheHeader)) {
+		close();
+		return false;
+	}
+	//The mapping starts at a page boundary, the header can be read in place
+	header = reinterpret_cast<const VKMeshCacheHeader*>(file.data());
+
+	//A missing source isn't a mismatch, the cache can be shipped without the model
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+	VKMappedFile::getStamp(sourcePath, sourceSize, sourceTime);
+	bool sourceMatches = (sourceSize == 0 && sourceTime == 0) || (header->sourceSize == sourceSize && header->sourceTime == sourceTime);
+
+	uint64_t expectedSize = sizeof(VKMeshCacheHeader) + sizeof(VKMeshCacheMesh) * static_cast<uint64_t>(header->meshCount) + header->vertexDataSize + header->indexDataSize + header->materialDataSize;
+	bool indexTypeValid = header->indexType == VK_INDEX_TYPE_UINT16 || header->indexType == VK_INDEX_TYPE_UINT32;
+	//Compared bit for bit, the settings are constants written the same way every run
+	bool lodSettingsMatch = memcmp(&header->lodSettings, &lodSettings, sizeof(VKMeshCacheLodSettings)) == 0;
+
+	if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION || header->vertexStride != vertexStride || !indexTypeValid || !lodSettingsMatch || !sourceMatches || file.size() != expectedSize) {
+		std::cout << "Mesh cache " << path << " is out of date, rebuilding it from " << sourcePath << std::endl;
+		close();
+		return false;
+	}
+
+	//The material blob must hold exactly materialCount paths, the meshes would otherwise index materials that don't exist
+	if (getMaterialTexturePaths().size() != header->materialCount) {
+		std::cout << "Mesh cache " << path << " is out of date, rebuilding it from " << sourcePath << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void VKMeshCache::write(const std::string& path, const std::string& sourcePath, const VKScene& scene, const VKMeshCacheLodSettings& lodSettings){
+	const std::vector<VKSceneMesh>& meshes = scene.getMeshes();
+
+	VKMeshCacheHeader fileHeader{};
+	fileHeader.magic = MESH_CACHE_MAGIC;
+	fileHeader.version = MESH_CACHE_VERSION;
+	fileHeader.vertexStride = scene.getVertexStride();
+	fileHeader.meshCount = static_cast<uint32_t>(meshes.size());
+	fileHeader.indexType = static_cast<uint32_t>(scene.getIndexType());
+	fileHeader.lodSettings = lodSettings;
+	VKMappedFile::getStamp(sourcePath, fileHeader.sourceSize, fileHeader.sourceTime);
+	fileHeader.vertexDataSize = scene.getVertexDataSize();
+	fileHeader.indexDataSize = scene.getIndexDataSize();
+
+	std::string materialData;
+	for (const VKSceneMaterial& material : scene.getMaterials()) {
+		materialData.append(material.texturePath.c_str(), material.texturePath.size() + 1);
+	}
+	fileHeader.materialCount = static_cast<uint32_t>(scene.getMaterials().size());
+	fileHeader.materialDataSize = static_cast<uint32_t>(materialData.size());
+
+	std::vector<VKMeshCacheMesh> meshTable(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++) {
+		meshTable[i].lodCount = meshes[i].lodCount;
+		for (uint32_t lod = 0; lod < meshes[i].lodCount; lod++) {
+			meshTable[i].lods[lod].firstIndex = meshes[i].lods[lod].firstIndex;
+			meshTable[i].lods[lod].indexCount = meshes[i].lods[lod].indexCount;
+			meshTable[i].lods[lod].error = meshes[i].lods[lod].error;
+		}
+		meshTable[i].vertexOffset = meshes[i].vertexOffset;
+		meshTable[i].vertexCount = meshes[i].vertexCount;
+		for (int c = 0; c < 4; c++) {
+			meshTable[i].boundingSphere[c] = meshes[i].boundingSphere[c];
+			meshTable[i].positionQuantization[c] = meshes[i].positionQuantization[c];
+		}
+		meshTable[i].materialIndex = meshes[i].materialIndex;
+	}
+
+	//Write to a temporary file and rename it like the pipeline cache, a truncated file is never left behind
+	std::string tempPath = path + ".tmp";
+	std::ofstream output(tempPath, std::ios::binary | std::ios::trunc);
+	if (!output.is_open()) {
+		std::cerr << "Failed to open " << tempPath << " to save the mesh cache" << std::endl;
+		return;
+	}
+	output.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+	output.write(reinterpret_cast<const char*>(meshTable.data()), sizeof(VKMeshCacheMesh) * meshTable.size());
+	output.write(scene.getVertexData(), scene.getVertexDataSize());
+	output.write(scene.getIndexData(), scene.getIndexDataSize());
+	output.write(materialData.data(), materialData.size());
+	output.close();
+	if (!output) {
+		std::cerr << "Failed to write the mesh cache to " << tempPath << std::endl;
+		return;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error) {
+		std::cerr << "Failed to save the mesh cache to " << path << ": " << error.message() << std::endl;
+	}
+}
+
+const VKMeshCacheMesh* VKMeshCache::getMeshes() const{
+	return reinterpret_cast<const VKMeshCacheMesh*>(file.data() + sizeof(VKMeshCacheHeader));
+}
+
+const char* VKMeshCache::getVertexData() const{
+	return file.data() + sizeof(VKMeshCacheHeader) + sizeof(VKMeshCacheMesh) * header->meshCount;
+}
+
+const char* VKMeshCache::getIndexData() const{
+	return getVertexData() + header->vertexDataSize;
+}
+
+std::vector<std::string> VKMeshCache::getMaterialTexturePaths() const{
+	std::vector<std::string> texturePaths;
+	const char* path = getIndexData() + header->indexDataSize;
+	const char* end = path + header->materialDataSize;
+	while (path < end) {
+		const char* pathEnd = static_cast<const char*>(memchr(path, 0, end - path));
+		if (!pathEnd) {
+			//Not terminated, the count check of open() rejects the file
+			break;
+		}
+		texturePaths.emplace_back(path, pathEnd);
+		path = pathEnd + 1;
+	}
+	return texturePaths;
+}
@@ -0,0 +1,523 @@
+#include "VKMeshOptimizer.h"
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cmath>
+#include <unordered_set>
+#include <limits>
+
+namespace {
+	struct Vec3 {
+		float x, y, z;
+	};
+
+	Vec3 readPosition(const char* vertexData, size_t vertexStride, size_t positionOffset, uint32_t vertex) {
+		Vec3 position;
+		memcpy(&position, vertexData + vertex * vertexStride + positionOffset, sizeof(position));
+		return position;
+	}
+
+	//FIFO cache of VERTEX_CACHE_SIZE entries modeled with timestamps: a vertex is in the cache if it was added less than VERTEX_CACHE_SIZE misses ago
+	struct CacheSimulator {
+		std::vector<uint32_t> timestamps;
+		uint32_t time = VERTEX_CACHE_SIZE + 1;
+
+		explicit CacheSimulator(size_t vertexCount) : timestamps(vertexCount, 0) {}
+
+		//Returns 1 on a miss
+		uint32_t access(uint32_t vertex) {
+			if (time - timestamps[vertex] > VERTEX_CACHE_SIZE) {
+				timestamps[vertex] = time++;
+				return 1;
+			}
+			return 0;
+		}
+
+		void reset() { time += VERTEX_CACHE_SIZE + 1; }
+	};
+
+	Vec3 subtract(const Vec3& a, const Vec3& b) {
+		return { a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+
+	Vec3 cross(const Vec3& a, const Vec3& b) {
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	float dot(const Vec3& a, const Vec3& b) {
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	//Sum of the squared distances to planes, each one weighted (Garland and Heckbert, Surface Simplification Using Quadric Error Metrics, 1997)
+	//The symmetric 4x4 matrix of the planes is kept as its 10 distinct elements
+	struct Quadric {
+		float a00 = 0.0f, a11 = 0.0f, a22 = 0.0f, a10 = 0.0f, a20 = 0.0f, a21 = 0.0f;
+		float b0 = 0.0f, b1 = 0.0f, b2 = 0.0f, c = 0.0f;
+		float weight = 0.0f;
+
+		//Plane through the triangle, weighted by its area so small triangles don't count as much as large ones
+		static Quadric fromTriangle(const Vec3& p0, const Vec3& p1, const Vec3& p2) {
+			Quadric q;
+			Vec3 normal = cross(subtract(p1, p0), subtract(p2, p0));
+			float length = std::sqrt(dot(normal, normal));
+			if (length == 0.0f) {
+				return q;
+			}
+			Vec3 n = { normal.x / length, normal.y / length, normal.z / length };
+			float d = -dot(n, p0);
+			float w = length * 0.5f;
+
+			q.a00 = w * n.x * n.x; q.a11 = w * n.y * n.y; q.a22 = w * n.z * n.z;
+			q.a10 = w * n.y * n.x; q.a20 = w * n.z * n.x; q.a21 = w * n.z * n.y;
+			q.b0 = w * n.x * d; q.b1 = w * n.y * d; q.b2 = w * n.z * d;
+			q.c = w * d * d;
+			q.weight = w;
+			return q;
+		}
+
+		void add(const Quadric& q) {
+			a00 += q.a00; a11 += q.a11; a22 += q.a22; a10 += q.a10; a20 += q.a20; a21 += q.a21;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c;
+			weight += q.weight;
+		}
+
+		//Mean squared distance of p to the planes
+		float error(const Vec3& p) const {
+			if (weight == 0.0f) {
+				return 0.0f;
+			}
+			float squared = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+				+ 2.0f * (a10 * p.x * p.y + a20 * p.x * p.z + a21 * p.y * p.z)
+				+ 2.0f * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+			return std::max(squared, 0.0f) / weight;
+		}
+	};
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		float error;
+	};
+}
+
+void VKMeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount){
+	tipsify(indices, vertexCount, nullptr);
+}
+
+void VKMeshOptimizer::tipsify(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>* clusters){
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Adjacency
+	//Triangles of every vertex, in one array: the triangles of vertex v are adjacency[offsets[v]] to adjacency[offsets[v + 1] - 1]
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);//Triangles of the vertex not emitted yet
+	for (uint32_t index : indices) {
+		liveTriangles[index]++;
+	}
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) {
+		offsets[v + 1] = offsets[v] + liveTriangles[v];
+	}
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++) {
+		adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	uint32_t time = VERTEX_CACHE_SIZE + 1;
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnds;//Vertices of the emitted triangles, the most recent ones are likely still in the cache
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	std::vector<uint32_t> candidates;
+	size_t cursor = 0;//Next vertex to try when the dead end stack is empty, vertices before it have no live triangles
+
+	if (clusters) {
+		clusters->clear();
+		clusters->push_back(0);
+	}
+
+	int64_t fanning = indices[0];
+	while (fanning >= 0) {
+		// Emit every live triangle around the fanning vertex
+		candidates.clear();
+		for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle]) {
+				continue;
+			}
+			for (uint32_t corner = 0; corner < 3; corner++) {
+				uint32_t vertex = indices[triangle * 3 + corner];
+				output.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				if (time - cacheTime[vertex] > VERTEX_CACHE_SIZE) {
+					cacheTime[vertex] = time++;
+				}
+			}
+			emitted[triangle] = true;
+		}
+
+		// Next fanning vertex
+		//Among the vertices just used, the one that stays in the cache while its remaining triangles are emitted (each adds at most 2 vertices), picking the oldest one
+		int64_t next = -1;
+		uint32_t bestPriority = 0;
+		for (uint32_t vertex : candidates) {
+			if (liveTriangles[vertex] == 0) {
+				continue;
+			}
+			uint32_t priority = 0;
+			if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= VERTEX_CACHE_SIZE) {
+				priority = time - cacheTime[vertex];
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+
+		// Dead end
+		//Go back through the recent vertices, then through the whole mesh in order
+		if (next < 0) {
+			while (!deadEnds.empty()) {
+				uint32_t vertex = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveTriangles[vertex] > 0) {
+					next = vertex;
+					break;
+				}
+			}
+			while (next < 0 && cursor < vertexCount) {
+				if (liveTriangles[cursor] > 0) {
+					next = static_cast<int64_t>(cursor);
+				}
+				cursor++;
+			}
+			//The vertices of the new run aren't in the cache anymore, it is a hard boundary for the overdraw clusters
+			if (next >= 0 && clusters) {
+				clusters->push_back(static_cast<uint32_t>(output.size() / 3));
+			}
+		}
+
+		fanning = next;
+	}
+
+	indices.swap(output);
+}
+
+void VKMeshOptimizer::optimizeOverdraw(std::vector<uint32_t>& indices, const char* vertexData, size_t vertexStride, size_t positionOffset, size_t vertexCount, float threshold){
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Hard boundaries
+	//Tipsify again to get where its runs start, the order is the same if the indices were already sorted by it
+	std::vector<uint32_t> hardClusters;
+	tipsify(indices, vertexCount, &hardClusters);
+	hardClusters.push_back(static_cast<uint32_t>(triangleCount));
+
+	// Soft boundaries
+	//A hard cluster is split again when the ACMR since the last split gets close enough to the ACMR of the whole cluster: small clusters sort better and keep most of the cache hits
+	CacheSimulator cache(vertexCount);
+	std::vector<uint32_t> clusters;
+	for (size_t c = 0; c + 1 < hardClusters.size(); c++) {
+		uint32_t start = hardClusters[c];
+		uint32_t end = hardClusters[c + 1];
+
+		cache.reset();
+		uint32_t clusterMisses = 0;
+		for (uint32_t t = start; t < end; t++) {
+			clusterMisses += cache.access(indices[t * 3 + 0]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+		}
+		float clusterThreshold = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+		clusters.push_back(start);
+		cache.reset();
+		uint32_t runningMisses = 0;
+		uint32_t runningTriangles = 0;
+		for (uint32_t t = start; t < end; t++) {
+			runningMisses += cache.access(indices[t * 3 + 0]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+			runningTriangles++;
+			if (static_cast<float>(runningMisses) / static_cast<float>(runningTriangles) <= clusterThreshold && t + 1 < end) {
+				clusters.push_back(t + 1);
+				cache.reset();
+				runningMisses = 0;
+				runningTriangles = 0;
+			}
+		}
+	}
+	clusters.push_back(static_cast<uint32_t>(triangleCount));
+
+	// Sort key
+	//Clusters whose normal points away from the center of the mesh are on its outside, drawing them first lets the depth test reject what is behind them
+	Vec3 meshCentroid = { 0.0f, 0.0f, 0.0f };
+	for (uint32_t index : indices) {
+		Vec3 position = readPosition(vertexData, vertexStride, positionOffset, index);
+		meshCentroid.x += position.x;
+		meshCentroid.y += position.y;
+		meshCentroid.z += position.z;
+	}
+	meshCentroid.x /= indices.size();
+	meshCentroid.y /= indices.size();
+	meshCentroid.z /= indices.size();
+
+	size_t clusterCount = clusters.size() - 1;
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) {
+		//Area weighted centroid and normal, the cross product of two edges is the normal scaled by twice the area
+		Vec3 centroid = { 0.0f, 0.0f, 0.0f };
+		Vec3 normal = { 0.0f, 0.0f, 0.0f };
+		float area = 0.0f;
+		for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			Vec3 p0 = readPosition(vertexData, vertexStride, positionOffset, indices[t * 3 + 0]);
+			Vec3 p1 = readPosition(vertexData, vertexStride, positionOffset, indices[t * 3 + 1]);
+			Vec3 p2 = readPosition(vertexData, vertexStride, positionOffset, indices[t * 3 + 2]);
+			Vec3 e1 = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+			Vec3 e2 = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+			Vec3 cross = { e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x };
+			float triangleArea = std::sqrt(cross.x * cross.x + cross.y * cross.y + cross.z * cross.z);
+
+			centroid.x += (p0.x + p1.x + p2.x) / 3.0f * triangleArea;
+			centroid.y += (p0.y + p1.y + p2.y) / 3.0f * triangleArea;
+			centroid.z += (p0.z + p1.z + p2.z) / 3.0f * triangleArea;
+			normal.x += cross.x;
+			normal.y += cross.y;
+			normal.z += cross.z;
+			area += triangleArea;
+		}
+
+		float inverseArea = area == 0.0f ? 0.0f : 1.0f / area;
+		centroid = { centroid.x * inverseArea, centroid.y * inverseArea, centroid.z * inverseArea };
+		float normalLength = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+		float inverseLength = normalLength == 0.0f ? 0.0f : 1.0f / normalLength;
+		normal = { normal.x * inverseLength, normal.y * inverseLength, normal.z * inverseLength };
+
+		sortKeys[c] = (centroid.x - meshCentroid.x) * normal.x + (centroid.y - meshCentroid.y) * normal.y + (centroid.z - meshCentroid.z) * normal.z;
+	}
+
+	//Stable, clusters with the same key keep the vertex cache order
+	std::vector<uint32_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (uint32_t c : order) {
+		output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	}
+	indices.swap(output);
+}
+
+size_t VKMeshOptimizer::optimizeVertexFetch(void* vertexData, size_t vertexCount, size_t vertexStride, std::vector<uint32_t>& indices){
+	char* vertices = static_cast<char*>(vertexData);
+	const uint32_t unused = UINT32_MAX;
+	std::vector<uint32_t> remap(vertexCount, unused);
+
+	//Vertices are copied to a new array in first use order, then back
+	std::vector<char> output(vertexCount * vertexStride);
+	size_t newVertexCount = 0;
+	for (uint32_t& index : indices) {
+		if (remap[index] == unused) {
+			memcpy(output.data() + newVertexCount * vertexStride, vertices + static_cast<size_t>(index) * vertexStride, vertexStride);
+			remap[index] = static_cast<uint32_t>(newVertexCount++);
+		}
+		index = remap[index];
+	}
+
+	memcpy(vertices, output.data(), newVertexCount * vertexStride);
+	return newVertexCount;
+}
+
+float VKMeshOptimizer::simplify(std::vector<uint32_t>& destination, const std::vector<uint32_t>& indices, const char* vertexData, size_t vertexStride, size_t positionOffset, size_t vertexCount, size_t targetIndexCount, float targetError){
+	destination = indices;
+	std::vector<Vec3> positions(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		positions[v] = readPosition(vertexData, vertexStride, positionOffset, static_cast<uint32_t>(v));
+	}
+
+	// Locked vertices
+	//Moving a vertex of a UV or normal seam (several vertices at the same position) would open a crack between the two sides, moving a border vertex would shrink the hole or the edge it is on
+	//Sorting gives the vertices that share a position the same id, the borders are the edges between positions that no triangle crosses the other way
+	std::vector<uint32_t> order(vertexCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&positions](uint32_t a, uint32_t b) {
+		const Vec3& pa = positions[a];
+		const Vec3& pb = positions[b];
+		return pa.x != pb.x ? pa.x < pb.x : (pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z);
+	});
+	std::vector<uint32_t> positionIds(vertexCount);
+	std::vector<bool> locked(vertexCount, false);
+	for (size_t i = 0; i < vertexCount; i++) {
+		bool sameAsPrevious = i > 0 && memcmp(&positions[order[i]], &positions[order[i - 1]], sizeof(Vec3)) == 0;
+		positionIds[order[i]] = sameAsPrevious ? positionIds[order[i - 1]] : order[i];
+		if (sameAsPrevious) {
+			locked[order[i]] = true;
+			locked[order[i - 1]] = true;
+		}
+	}
+
+	std::unordered_set<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		for (int e = 0; e < 3; e++) {
+			edges.insert(static_cast<uint64_t>(positionIds[indices[i + e]]) << 32 | positionIds[indices[i + (e + 1) % 3]]);
+		}
+	}
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		for (int e = 0; e < 3; e++) {
+			uint32_t a = indices[i + e];
+			uint32_t b = indices[i + (e + 1) % 3];
+			if (edges.count(static_cast<uint64_t>(positionIds[b]) << 32 | positionIds[a]) == 0) {
+				locked[a] = true;
+				locked[b] = true;
+			}
+		}
+	}
+
+	// Quadrics
+	//Every vertex starts with the planes of its triangles, a collapse adds the quadric of the removed vertex to the one it is merged into
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		Quadric q = Quadric::fromTriangle(positions[indices[i + 0]], positions[indices[i + 1]], positions[indices[i + 2]]);
+		quadrics[indices[i + 0]].add(q);
+		quadrics[indices[i + 1]].add(q);
+		quadrics[indices[i + 2]].add(q);
+	}
+
+	// Edge collapses
+	//Every pass sorts the edges by the error their collapse adds and makes the cheapest ones, a collapse moves the vertex "from" onto the vertex "to" (a vertex of the mesh, so no new vertex is made)
+	//The vertices around a collapse can't be part of another one in the same pass, the flip test of every collapse then sees the triangles as they are
+	float maxError = 0.0f;
+	float errorLimit = targetError * targetError;
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<uint32_t> offsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+	while (destination.size() > targetIndexCount) {
+		size_t triangleCount = destination.size() / 3;
+
+		//Triangles of every vertex, like the adjacency of tipsify
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (uint32_t index : destination) {
+			offsets[index + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++) {
+			offsets[v + 1] += offsets[v];
+		}
+		adjacency.resize(destination.size());
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < destination.size(); i++) {
+			adjacency[fill[destination[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		//Both directions of every edge, the cheapest one that moves an unlocked vertex
+		collapses.clear();
+		for (size_t i = 0; i < destination.size(); i += 3) {
+			for (int e = 0; e < 3; e++) {
+				uint32_t a = destination[i + e];
+				uint32_t b = destination[i + (e + 1) % 3];
+				if (locked[a] && locked[b]) {
+					continue;
+				}
+
+				//The error of a collapse is the one of the merged quadric at the kept position
+				Quadric merged = quadrics[a];
+				merged.add(quadrics[b]);
+				float errorAB = locked[a] ? std::numeric_limits<float>::max() : merged.error(positions[b]);
+				float errorBA = locked[b] ? std::numeric_limits<float>::max() : merged.error(positions[a]);
+				if (errorAB <= errorBA) {
+					collapses.push_back({ a, b, errorAB });
+				}
+				else {
+					collapses.push_back({ b, a, errorBA });
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		//A collapse removes the two triangles of its edge, don't go much past the target in a single pass
+		size_t collapseLimit = (triangleCount - targetIndexCount / 3) / 2 + 1;
+		size_t collapseCount = 0;
+		std::iota(remap.begin(), remap.end(), 0);
+		std::fill(touched.begin(), touched.end(), false);
+		for (const Collapse& collapse : collapses) {
+			if (collapse.error > errorLimit || collapseCount >= collapseLimit) {
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+
+			//The triangles that keep their area after the collapse must keep facing the same way
+			bool flips = false;
+			for (uint32_t a = offsets[collapse.from]; a < offsets[collapse.from + 1] && !flips; a++) {
+				const uint32_t* triangle = &destination[adjacency[a] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+					continue;
+				}
+				Vec3 before[3];
+				Vec3 after[3];
+				for (int c = 0; c < 3; c++) {
+					before[c] = positions[triangle[c]];
+					after[c] = triangle[c] == collapse.from ? positions[collapse.to] : before[c];
+				}
+				Vec3 normalBefore = cross(subtract(before[1], before[0]), subtract(before[2], before[0]));
+				Vec3 normalAfter = cross(subtract(after[1], after[0]), subtract(after[2], after[0]));
+				flips = dot(normalBefore, normalAfter) <= 0.0f;
+			}
+			if (flips) {
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			maxError = std::max(maxError, collapse.error);
+			collapseCount++;
+			for (uint32_t a = offsets[collapse.from]; a < offsets[collapse.from + 1]; a++) {
+				const uint32_t* triangle = &destination[adjacency[a] * 3];
+				touched[triangle[0]] = true;
+				touched[triangle[1]] = true;
+				touched[triangle[2]] = true;
+			}
+		}
+		if (collapseCount == 0) {
+			break;
+		}
+
+		//The triangles of the collapsed edges are left with two indices of the same vertex, they cover no area
+		size_t kept = 0;
+		for (size_t i = 0; i < destination.size(); i += 3) {
+			uint32_t a = remap[destination[i + 0]];
+			uint32_t b = remap[destination[i + 1]];
+			uint32_t c = remap[destination[i + 2]];
+			if (a != b && b != c && c != a) {
+				destination[kept++] = a;
+				destination[kept++] = b;
+				destination[kept++] = c;
+			}
+		}
+		destination.resize(kept);
+	}
+
+	return std::sqrt(maxError);
+}
+
+float VKMeshOptimizer::computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount){
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return 0.0f;
+	}
+
+	CacheSimulator cache(vertexCount);
+	uint64_t misses = 0;
+	for (uint32_t index : indices) {
+		misses += cache.access(index);
+	}
+	return static_cast<float>(misses) / static_cast<float>(triangleCount);
+}
@@ -0,0 +1,88 @@
+#include "VKPipelineCache.h"
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <cstring>
+
+void VKPipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& cachePath){
+	logicalDevice = device;
+	path = cachePath;
+
+	//vendorID, deviceID and pipelineCacheUUID identify the driver and GPU the cache data belongs to
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	//Read the previous run's cache, if there is one
+	std::vector<char> data;
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (file.is_open()) {
+		data.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(data.data(), data.size());
+		file.close();
+
+		if (!isCompatible(data.data(), data.size())) {
+			std::cout << "Pipeline cache " << path << " was created by a different driver or GPU, starting with an empty cache" << std::endl;
+			data.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = data.size();
+	createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(logicalDevice, &createInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create pipeline cache!");
+	}
+}
+
+void VKPipelineCache::save() const{
+	//The first call gets the size, the second one the data
+	size_t size = 0;
+	if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0) {
+		return;
+	}
+
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &size, data.data()) != VK_SUCCESS) {
+		std::cerr << "Failed to read pipeline cache data" << std::endl;
+		return;
+	}
+
+	//Write to a temporary file and rename it, so a crash or power loss while writing never leaves a truncated cache behind
+	std::string tempPath = path + ".tmp";
+	std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open " << tempPath << " to save the pipeline cache" << std::endl;
+		return;
+	}
+	file.write(data.data(), size);
+	file.close();
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error) {
+		std::cerr << "Failed to save the pipeline cache to " << path << ": " << error.message() << std::endl;
+	}
+}
+
+void VKPipelineCache::destroy(){
+	vkDestroyPipelineCache(logicalDevice, pipelineCache, nullptr);
+	pipelineCache = VK_NULL_HANDLE;
+}
+
+bool VKPipelineCache::isCompatible(const char* data, size_t size) const{
+	VkPipelineCacheHeaderVersionOne header{};
+	if (size < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	return header.headerSize >= sizeof(header) && header.headerSize <= size &&
+		header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header.vendorID == deviceProperties.vendorID &&
+		header.deviceID == deviceProperties.deviceID &&
+		memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
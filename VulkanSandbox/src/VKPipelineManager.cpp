@@ -0,0 +1,559 @@
+#include "VKPipelineManager.h"
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+//FNV-1a, folds every byte of the value into the hash
+static void hashBytes(uint64_t& hash, const void* data, size_t size){
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+template<typename T>
+static void hashValue(uint64_t& hash, const T& value){
+	hashBytes(hash, &value, sizeof(T));
+}
+
+uint64_t VKPipelineDesc::hash() const{
+	uint64_t hash = 14695981039346656037ull;
+
+	hashBytes(hash, vertShader.data(), vertShader.size());
+	//Separator, so moving characters from one name to the other changes the hash
+	hashValue(hash, '\0');
+	hashBytes(hash, fragShader.data(), fragShader.size());
+
+	//The vertex input structs only hold 32 bit fields, there is no padding to hash
+	hashValue(hash, bindings.size());
+	hashBytes(hash, bindings.data(), bindings.size() * sizeof(VkVertexInputBindingDescription));
+	hashValue(hash, attributes.size());
+	hashBytes(hash, attributes.data(), attributes.size() * sizeof(VkVertexInputAttributeDescription));
+	hashValue(hash, topology);
+
+	hashValue(hash, polygonMode);
+	hashValue(hash, cullMode);
+	hashValue(hash, frontFace);
+	hashValue(hash, depthBiasEnable);
+	hashValue(hash, depthBiasConstantFactor);
+	hashValue(hash, depthBiasSlopeFactor);
+
+	hashValue(hash, rasterizationSamples);
+	hashValue(hash, sampleShadingEnable);
+	hashValue(hash, minSampleShading);
+
+	hashValue(hash, depthTestEnable);
+	hashValue(hash, depthWriteEnable);
+	hashValue(hash, depthCompareOp);
+
+	hashValue(hash, blendEnable);
+	hashValue(hash, colorWriteMask);
+
+	hashValue(hash, colorFormat);
+	hashValue(hash, depthFormat);
+
+	return hash;
+}
+
+void VKPipelineManager::init(VkDevice device, VkPipelineCache cache, JobSystem* jobs, bool fillModeNonSolidSupported){
+	logicalDevice = device;
+	pipelineCache = cache;
+	jobSystem = jobs;
+	fillModeNonSolid = fillModeNonSolidSupported;
+}
+
+std::vector<uint64_t> VKPipelineManager::build(const std::vector<VKPipelineDesc>& descs, VkPipelineLayout layout, VkRenderPass renderPass){
+	std::vector<uint64_t> keys(descs.size());
+	std::vector<size_t> toBuild;
+	for (size_t i = 0; i < descs.size(); i++) {
+		keys[i] = descs[i].hash();
+
+		//Skip pipelines that are already built (or appear twice in the list)
+		bool duplicate = pipelines.count(keys[i]) > 0;
+		for (size_t j : toBuild) {
+			duplicate = duplicate || keys[j] == keys[i];
+		}
+		if (!duplicate) {
+			toBuild.push_back(i);
+		}
+	}
+
+	//Load every SPIR-V file once, before the workers start (the modules are only read by the workers)
+	std::unordered_map<std::string, VkShaderModule> shaderModules;
+	for (size_t i : toBuild) {
+		for (const std::string& shader : { descs[i].vertShader, descs[i].fragShader }) {
+			if (!shader.empty() && shaderModules.count(shader) == 0) {
+				shaderModules[shader] = createShaderModule(loadShaderCode(shader));
+			}
+		}
+	}
+
+	//One job per pipeline, each job only writes its own slot of results
+	std::vector<VkPipeline> results(toBuild.size(), VK_NULL_HANDLE);
+	//The descriptions as they are built, after the fallbacks
+	std::vector<VKPipelineDesc> builtDescs(toBuild.size());
+	for (size_t n = 0; n < toBuild.size(); n++) {
+		VKPipelineDesc& desc = builtDescs[n];
+		desc = descs[toBuild[n]];
+
+		//Without fillModeNonSolid wireframe can't be rasterized, build it filled so the key still finds a usable pipeline
+		if (desc.polygonMode != VK_POLYGON_MODE_FILL && !fillModeNonSolid) {
+			std::cout << "fillModeNonSolid is not supported, " << desc.vertShader << " wireframe pipeline falls back to VK_POLYGON_MODE_FILL" << std::endl;
+			desc.polygonMode = VK_POLYGON_MODE_FILL;
+		}
+
+		VkShaderModule vertShaderModule = shaderModules[desc.vertShader];
+		VkShaderModule fragShaderModule = desc.fragShader.empty() ? VK_NULL_HANDLE : shaderModules[desc.fragShader];
+
+		jobSystem->submit([this, desc, vertShaderModule, fragShaderModule, layout, renderPass, &results, n](uint32_t) {
+			results[n] = createPipeline(desc, vertShaderModule, fragShaderModule, layout, renderPass);
+		});
+	}
+
+	//Destroy the shader modules even if a pipeline failed to compile
+	std::exception_ptr buildException;
+	try {
+		jobSystem->wait();
+	}
+	catch (...) {
+		buildException = std::current_exception();
+	}
+
+	//Shader modules are only needed while the pipelines are created
+	//The compilation and linking of the SPIR-V bytecode to machine code for execution by the GPU doesn't happen until the graphics pipeline is created.
+	for (auto& shaderModule : shaderModules) {
+		vkDestroyShaderModule(logicalDevice, shaderModule.second, nullptr);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t n = 0; n < toBuild.size(); n++) {
+			if (results[n] != VK_NULL_HANDLE) {
+				pipelines[keys[toBuild[n]]] = PipelineEntry{ results[n], builtDescs[n], std::string(), layout, renderPass };
+			}
+		}
+	}
+
+	if (buildException) {
+		std::rethrow_exception(buildException);
+	}
+
+	return keys;
+}
+
+uint64_t VKPipelineManager::buildCompute(const std::string& compShader, VkPipelineLayout layout){
+	uint64_t key = 14695981039346656037ull;
+	hashBytes(key, compShader.data(), compShader.size());
+	hashValue(key, layout);
+	if (pipelines.count(key) > 0) {
+		return key;
+	}
+
+	VkShaderModule compShaderModule = createShaderModule(loadShaderCode(compShader));
+
+	VkPipeline pipeline;
+	try {
+		pipeline = createComputePipeline(compShaderModule, layout);
+	}
+	catch (...) {
+		vkDestroyShaderModule(logicalDevice, compShaderModule, nullptr);
+		throw;
+	}
+	vkDestroyShaderModule(logicalDevice, compShaderModule, nullptr);
+
+	PipelineEntry entry{};
+	entry.pipeline = pipeline;
+	entry.compShader = compShader;
+	entry.layout = layout;
+	entry.renderPass = VK_NULL_HANDLE;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	pipelines[key] = entry;
+	return key;
+}
+
+VkPipeline VKPipelineManager::get(uint64_t key) const{
+	auto it = pipelines.find(key);
+	if (it == pipelines.end()) {
+		throw std::runtime_error("Pipeline permutation was not built!");
+	}
+	return it->second.pipeline;
+}
+
+uint32_t VKPipelineManager::prepareReload(const std::string& shader, const std::vector<char>& spirv){
+	//Copy the entries using the shader, the main thread may add pipelines while they are built
+	std::vector<std::pair<uint64_t, PipelineEntry>> affected;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		reloadedShaders[shader] = spirv;
+		for (const auto& pipeline : pipelines) {
+			const PipelineEntry& entry = pipeline.second;
+			if (entry.compShader == shader || (entry.compShader.empty() && (entry.desc.vertShader == shader || entry.desc.fragShader == shader))) {
+				affected.push_back(pipeline);
+			}
+		}
+	}
+
+	//The other stage of a graphics pipeline keeps its current code, every module is loaded once
+	std::unordered_map<std::string, VkShaderModule> shaderModules;
+	std::vector<std::pair<uint64_t, VkPipeline>> rebuilt;
+	try {
+		for (const auto& pipeline : affected) {
+			const PipelineEntry& entry = pipeline.second;
+			for (const std::string& name : { entry.compShader, entry.desc.vertShader, entry.desc.fragShader }) {
+				if (!name.empty() && shaderModules.count(name) == 0) {
+					shaderModules[name] = createShaderModule(loadShaderCode(name));
+				}
+			}
+
+			VkPipeline newPipeline;
+			if (!entry.compShader.empty()) {
+				newPipeline = createComputePipeline(shaderModules[entry.compShader], entry.layout);
+			}
+			else {
+				VkShaderModule fragShaderModule = entry.desc.fragShader.empty() ? VK_NULL_HANDLE : shaderModules[entry.desc.fragShader];
+				newPipeline = createPipeline(entry.desc, shaderModules[entry.desc.vertShader], fragShaderModule, entry.layout, entry.renderPass);
+			}
+			rebuilt.emplace_back(pipeline.first, newPipeline);
+		}
+	}
+	catch (...) {
+		//All or nothing: the pipelines of a shader are never half from the old code and half from the new one
+		for (auto& pipeline : rebuilt) {
+			vkDestroyPipeline(logicalDevice, pipeline.second, nullptr);
+		}
+		for (auto& shaderModule : shaderModules) {
+			vkDestroyShaderModule(logicalDevice, shaderModule.second, nullptr);
+		}
+		throw;
+	}
+
+	for (auto& shaderModule : shaderModules) {
+		vkDestroyShaderModule(logicalDevice, shaderModule.second, nullptr);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	preparedReloads.insert(preparedReloads.end(), rebuilt.begin(), rebuilt.end());
+	hasPreparedReloads = !preparedReloads.empty();
+	return static_cast<uint32_t>(rebuilt.size());
+}
+
+void VKPipelineManager::applyReloads(const std::function<void(VkPipeline)>& retire){
+	if (!hasPreparedReloads) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	//In the order they were prepared, a pipeline reloaded twice ends up with the latest version and the earlier one is retired too
+	for (auto& reload : preparedReloads) {
+		PipelineEntry& entry = pipelines[reload.first];
+		retire(entry.pipeline);
+		entry.pipeline = reload.second;
+	}
+	preparedReloads.clear();
+	hasPreparedReloads = false;
+}
+
+void VKPipelineManager::destroy(){
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& pipeline : pipelines) {
+		vkDestroyPipeline(logicalDevice, pipeline.second.pipeline, nullptr);
+	}
+	pipelines.clear();
+	for (auto& reload : preparedReloads) {
+		vkDestroyPipeline(logicalDevice, reload.second, nullptr);
+	}
+	preparedReloads.clear();
+	hasPreparedReloads = false;
+	reloadedShaders.clear();
+}
+
+VkPipeline VKPipelineManager::createPipeline(const VKPipelineDesc& desc, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, VkPipelineLayout layout, VkRenderPass renderPass) const{
+	//Shader stage creation
+
+	//Vertex shader stage
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vertShaderStageInfo.module = vertShaderModule;
+	vertShaderStageInfo.pName = "main"; //Entrypoint of shader
+
+	//Fragment shader stage
+	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	fragShaderStageInfo.module = fragShaderModule;
+	fragShaderStageInfo.pName = "main";
+
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+
+	//Vertex Input
+	//Describes the format of the vertex data that will be passed to the vertex shader
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.bindings.size());
+	vertexInputInfo.pVertexBindingDescriptions = desc.bindings.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.attributes.size());
+	vertexInputInfo.pVertexAttributeDescriptions = desc.attributes.data();
+
+	//Input Assembly
+	//Describes what kind o feometry will be drawn form the vertices (points, lines, or triangles), and the topology type
+	//VK_PRIMITIVE_TOPOLOGY_POINT_LIST: points from vertices
+	//VK_PRIMITIVE_TOPOLOGY_LINE_LIST: line from every 2 vertices without reuse
+	//VK_PRIMITIVE_TOPOLOGY_LINE_STRIP : the end vertex of every line is used as start vertex for the next line
+	//VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST : triangle from every 3 vertices without reuse
+	//VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP : the second and third vertex of every triangle are used as first two vertices of the next triangle
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = desc.topology;
+	inputAssembly.primitiveRestartEnable = VK_FALSE; //If you set the primitiveRestartEnable member to VK_TRUE, then it's possible to break up lines and triangles in the _STRIP topology modes by using a special index of 0xFFFF or 0xFFFFFFFF in the vertex buffer.
+
+	//Viewports and Sissors
+	//Viewports (transformation) define the transformation from the image to the framebuffer
+	//Sissor (filter) rectangles define in which regions pixels will actually be stored, any pixels outside the siccor rectangles will be discarded by rasterizer
+	
+	//Scissor that covers entire framebuffer (only needed to specify when we don use dynamic states)
+	//VkRect2D scissor{};
+	//scissor.offset = { 0, 0 };
+	//scissor.extent = swapChainExtent;
+
+	//Enable Dynamic states for scissor and viewport
+	//Viewport(s) and scissor rectangle(s) can either be specified as a static part of the pipeline or as a dynamic state set in the command buffer. 
+	
+	//Viewport
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	//Rasterizer
+	//Takes the geometry that is shaped by hte vertices from the vertex shader and turns it into fragments
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE; //If depthClampEnable is set to VK_TRUE, then fragments that are beyond the near and far planes are clamped to them as opposed to discarding them. This is useful in some special cases like shadow maps.
+	rasterizer.rasterizerDiscardEnable = VK_FALSE; //If rasterizerDiscardEnable is set to VK_TRUE, then geometry never passes through the rasterizer stage. This basically disables any output to the framebuffer.
+	rasterizer.polygonMode = desc.polygonMode;
+	//The polygonMode determines how fragments are generated for geometry. The following modes are available:
+	//VK_POLYGON_MODE_FILL: fill the area of the polygon with fragments
+	//VK_POLYGON_MODE_LINE : polygon edges are drawn as lines
+	//VK_POLYGON_MODE_POINT : polygon vertices are drawn as points
+	rasterizer.lineWidth = 1.0f;//escribes the thickness of lines in terms of number of fragments. The maximum line width that is supported depends on the hardware and any line thicker than 1.0f requires you to enable the wideLines GPU feature.
+	//because of the Y-flip we did in the projection matrix, the vertices are now being drawn in counter-clockwise order instead of clockwise order. This causes backface culling to kick in and prevents any geometry from being drawn.
+	rasterizer.cullMode = desc.cullMode;// The cullMode variable determines the type of face culling to use. You can disable culling, cull the front faces, cull the back faces or both.
+	rasterizer.frontFace = desc.frontFace;// The frontFace variable specifies the vertex order for faces to be considered front-facing and can be clockwise or counterclockwise.
+	rasterizer.depthBiasEnable = desc.depthBiasEnable ? VK_TRUE : VK_FALSE;
+	//The rasterizer can alter the depth values by adding a constant value or biasing them based on a fragment's slope. 
+	rasterizer.depthBiasConstantFactor = desc.depthBiasConstantFactor;
+	rasterizer.depthBiasClamp = 0.0f; // Optional
+	rasterizer.depthBiasSlopeFactor = desc.depthBiasSlopeFactor;
+
+	//Multisampling
+	//One of the ways to perform anti-aliasing. It works by combining the fragment shader results of multiple polygons that rasterize to the same pixel. This mainly occurs along edges, which is also where the most noticeable aliasing artifacts occur.
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	//Sample shading runs the fragment shader per sample (at least minSampleShading * samples times per pixel) instead of once per pixel
+	multisampling.sampleShadingEnable = desc.sampleShadingEnable ? VK_TRUE : VK_FALSE;
+	multisampling.rasterizationSamples = desc.rasterizationSamples;
+	multisampling.minSampleShading = desc.minSampleShading;
+	multisampling.pSampleMask = nullptr; // Optional
+	multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
+	multisampling.alphaToOneEnable = VK_FALSE; // Optional
+
+	//Depth Stencil
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = desc.depthTestEnable ? VK_TRUE : VK_FALSE; //specifies if the depth of new fragments should be compared to the depth buffer to see if they should be discarded.
+	depthStencil.depthWriteEnable = desc.depthWriteEnable ? VK_TRUE : VK_FALSE;//specifies if the new depth of fragments that pass the depth test should actually be written to the depth buffer.
+	depthStencil.depthCompareOp = desc.depthCompareOp; //pecifies the comparison that is performed to keep or discard fragments. We're sticking to the convention of lower depth = closer, so the depth of new fragments should be less.
+	depthStencil.depthBoundsTestEnable = VK_FALSE;//The depthBoundsTestEnable, minDepthBounds and maxDepthBounds fields are used for the optional depth bound test. Basically, this allows you to only keep fragments that fall within the specified depth range. We won't be using this functionality.
+	depthStencil.minDepthBounds = 0.0f; // Optional
+	depthStencil.maxDepthBounds = 1.0f; // Optional
+	//The last three fields configure stencil buffer operations
+	//If you want to use these operations, then you will have to make sure that the format of the depth/stencil image contains a stencil component.
+	depthStencil.stencilTestEnable = VK_FALSE;
+	depthStencil.front = {}; // Optional
+	depthStencil.back = {}; // Optional
+
+	//Color blending
+	//After a fragment shader has returned a color, it needs to be combined with the color that is already in the framebuffer. This transformation is known as color blending and there are two ways to do it:
+	//		Mix the old and new value to produce a final color
+	//		Combine the old and new value using a bitwise operation
+
+	//Color blend attachment: contains the configuration per attached framebuffer and the second
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = desc.colorWriteMask;
+	colorBlendAttachment.blendEnable = desc.blendEnable ? VK_TRUE : VK_FALSE;
+	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	//Pseudocode that represent how previous struct uses the paramenters to calculate the blend
+	/*if (blendEnable) {
+		finalColor.rgb = (srcColorBlendFactor * newColor.rgb) < colorBlendOp > (dstColorBlendFactor * oldColor.rgb);
+		finalColor.a = (srcAlphaBlendFactor * newColor.a) < alphaBlendOp > (dstAlphaBlendFactor * oldColor.a);
+	}
+	else {
+		finalColor = newColor;
+	}
+
+	finalColor = finalColor & colorWriteMask;
+	
+	//The parameters we passed are using alpha blending, where we want the new color to be blended with the old color based on opacity
+
+	finalColor.rgb = newAlpha * newColor + (1 - newAlpha) * oldColor;
+	finalColor.a = newAlpha.a;
+	*/
+
+	//Color blending State: contains the global color blending settings. In our case we only have one framebuffer
+
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE; //If you want to use the second method of blending (bitwise combination), then you should set logicOpEnable to VK_TRUE
+	colorBlending.logicOp = VK_LOGIC_OP_COPY; // The bitwise operation can then be specified in the logicOp field. Note that this will automatically disable the first method, as if you had set blendEnable to VK_FALSE
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+	//Source and destination values are combined according to the blend operation, quadruplets of source and destination weighting factors determined by the blend factors, and a blend constant, to obtain a new set of R, G, B, and A values
+	colorBlending.blendConstants[0] = 0.0f; // Optional Rc
+	colorBlending.blendConstants[1] = 0.0f; // Optional Gc
+	colorBlending.blendConstants[2] = 0.0f; // Optional Bc
+	colorBlending.blendConstants[3] = 0.0f; // Optional Ac
+
+	//Dynamic States: scissor and viewport
+	//While most of the pipeline state needs to be baked into the pipeline state, a limited amount of the state can actually be changed without recreating the pipeline at draw time
+	std::vector<VkDynamicState> dynamicStates = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
+
+	//Create Graphics Pipeline using:
+	//Shader stages: the shader modules that define the functionality of the programmable stages of the graphics pipeline
+	//Fixed-function state: all of the structures that define the fixed-function stages of the pipeline, like input assembly, rasterizer, viewport and color blending
+	//Pipeline layout: the uniform and push values referenced by the shader that can be updated at draw time
+	//Render pass: the attachments referenced by the pipeline stages and their usage
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	//Shader stages
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = fragShaderModule != VK_NULL_HANDLE ? 2 : 1; //Vertex shader and fragment shader (depth only pipelines don't have a fragment shader)
+	pipelineInfo.pStages = shaderStages;
+	//Fixed-functions states
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	//Pipeline layout
+	pipelineInfo.layout = layout;
+	//Render pass
+	pipelineInfo.renderPass = renderPass;
+	pipelineInfo.subpass = 0;// index of the sub pass where this graphics pipeline will be used.
+
+	//Without a render pass the pipeline is told the formats of the attachments vkCmdBeginRendering will bind
+	VkPipelineRenderingCreateInfo renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = &desc.colorFormat;
+	renderingInfo.depthAttachmentFormat = desc.depthFormat;
+	renderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;//No stencil attachment is bound
+	if (renderPass == VK_NULL_HANDLE) {
+		pipelineInfo.pNext = &renderingInfo;
+	}
+	//Vulkan allows you to create a new graphics pipeline by deriving from an existing pipeline. The idea of pipeline derivatives is that it is less expensive to set up pipelines when they have much functionality in common with an existing pipeline and switching between pipelines from the same parent can also be done quicker. Using either the handle of an exisiting pipeline or reference another pipeline that is about to be created by index with 
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+	pipelineInfo.basePipelineIndex = -1; // Optional
+
+	//The cache is internally synchronized, every worker thread can create its pipelines through the same cache at the same time
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create graphics pipeline!");
+	}
+
+	return pipeline;
+
+}
+
+VkPipeline VKPipelineManager::createComputePipeline(VkShaderModule compShaderModule, VkPipelineLayout layout) const{
+	VkPipelineShaderStageCreateInfo compShaderStageInfo{};
+	compShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	compShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	compShaderStageInfo.module = compShaderModule;
+	compShaderStageInfo.pName = "main";
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = compShaderStageInfo;
+	pipelineInfo.layout = layout;
+
+	VkPipeline pipeline;
+	if (vkCreateComputePipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compute pipeline!");
+	}
+
+	return pipeline;
+}
+
+std::vector<char> VKPipelineManager::loadShaderCode(const std::string& shader){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = reloadedShaders.find(shader);
+		if (it != reloadedShaders.end()) {
+			return it->second;
+		}
+	}
+	return readFile(shader);
+}
+
+std::vector<char> VKPipelineManager::readFile(const std::string& filename){
+	//ate: Start reading at end of the file (so that we can use the read postion to deremine the size of the file). Opens the file and moves the read position to the end immediately
+	//binary: read the file as a binary file (avoid text transformation)
+
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	//The SPIR-V files (the compute shaders of the culling, Hi-Z and compaction passes too) only exist once the Shaders target has compiled them with glslc
+	if (!file.is_open()) {
+		std::cout << "Failed to open " << filename << ", build the Shaders target to compile it" << std::endl;
+		throw std::runtime_error("Failed to open file " + filename + "!");
+	}
+
+	//Initialize buffer with the size of the file
+	size_t fileSize = (size_t) file.tellg();//Return the current postion of the read pointer which is at the end of the file
+	std::vector<char> buffer(fileSize);
+	
+	//Seek back to the beginning of the file and read all of the bytes at once:
+	file.seekg(0); //Moves the read position back to the beginning of the file.
+	file.read(buffer.data(), fileSize);// Reads fileSize bytes into the buffer.
+	file.close();
+
+	return buffer;
+}
+
+VkShaderModule VKPipelineManager::createShaderModule(const std::vector<char>& code) const{
+	//Struct that provide info for creating shader module
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = code.size();
+	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data()); //reinterpret_cast<const uint32_t*> is used to reinterpret std::vector<char> data as uint32_t* because Vulkan expects the shader in 32-bit words (fixed-size unit of data SPIR-V defines a word as 32 bits (4 bytes)).
+
+	//Create Shader Module
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(logicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create shader module!");
+	}
+
+	return shaderModule;
+}
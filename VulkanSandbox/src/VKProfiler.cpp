@@ -0,0 +1,238 @@
+#include "VKProfiler.h"
+#include <stdexcept>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+const VkQueryPipelineStatisticFlags VKProfiler::STATISTICS_FLAGS =
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+const char* const VKProfiler::CPU_SCOPE_NAMES[] = { "wait", "acquire", "update", "record", "submit", "present" };
+const char* const VKProfiler::GPU_SCOPE_NAMES[] = { "uploads", "culling", "main", "pyramid" };
+const char* const VKProfiler::STATISTIC_NAMES[] = { "input_vertices", "input_primitives", "vertex_invocations", "clipping_invocations", "clipping_primitives", "fragment_invocations", "compute_invocations" };
+
+void VKProfiler::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t frameCount, bool statistics, const std::string& csvPath){
+	logicalDevice = device;
+	statisticsEnabled = statistics;
+
+	//Timestamps are optional per queue family, timestampPeriod converts their ticks to nanoseconds
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+	uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	timestampsEnabled = validBits > 0;
+	timestampPeriod = properties.limits.timestampPeriod;
+	timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	slots.resize(frameCount);
+	for (FrameSlot& slot : slots) {
+		if (timestampsEnabled) {
+			VkQueryPoolCreateInfo timestampInfo{};
+			timestampInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			timestampInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			timestampInfo.queryCount = static_cast<uint32_t>(VKGpuScope::Count) + 1;//The start of the frame and the end of every pass
+			if (vkCreateQueryPool(logicalDevice, &timestampInfo, nullptr, &slot.timestampPool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create timestamp query pool!");
+			}
+		}
+
+		if (statisticsEnabled) {
+			VkQueryPoolCreateInfo statisticsInfo{};
+			statisticsInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			statisticsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			statisticsInfo.queryCount = 1;
+			statisticsInfo.pipelineStatistics = STATISTICS_FLAGS;
+			if (vkCreateQueryPool(logicalDevice, &statisticsInfo, nullptr, &slot.statisticsPool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create pipeline statistics query pool!");
+			}
+		}
+	}
+
+	//A failure to open the file isn't fatal, the summary still works
+	csv.open(csvPath, std::ios::trunc);
+	if (!csv.is_open()) {
+		std::cerr << "Failed to open " << csvPath << ", the frame timings aren't exported" << std::endl;
+	}
+	else {
+		csv << "frame";
+		for (const char* name : CPU_SCOPE_NAMES) {
+			csv << ",cpu_" << name << "_ms";
+		}
+		for (const char* name : GPU_SCOPE_NAMES) {
+			csv << ",gpu_" << name << "_ms";
+		}
+		for (const char* name : STATISTIC_NAMES) {
+			csv << "," << name;
+		}
+		csv << "\n";
+	}
+
+	summaryStart = std::chrono::steady_clock::now();
+}
+
+void VKProfiler::destroy(){
+	for (FrameSlot& slot : slots) {
+		vkDestroyQueryPool(logicalDevice, slot.timestampPool, nullptr);
+		vkDestroyQueryPool(logicalDevice, slot.statisticsPool, nullptr);
+	}
+	slots.clear();
+	csv.close();
+}
+
+void VKProfiler::beginFrame(uint64_t frame){
+	currentFrame = VKProfilerFrame{};
+	currentFrame.frame = frame;
+}
+
+void VKProfiler::beginCpu(VKCpuScope scope){
+	cpuStart[static_cast<size_t>(scope)] = std::chrono::steady_clock::now();
+}
+
+void VKProfiler::endCpu(VKCpuScope scope){
+	std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - cpuStart[static_cast<size_t>(scope)];
+	currentFrame.cpuMs[static_cast<size_t>(scope)] += duration.count();
+}
+
+void VKProfiler::endFrame(uint32_t slot){
+	slots[slot].frame = currentFrame;
+	slots[slot].pending = true;
+}
+
+void VKProfiler::collect(uint32_t slotIndex){
+	FrameSlot& slot = slots[slotIndex];
+	if (!slot.pending) {
+		return;
+	}
+	slot.pending = false;
+
+	//No VK_QUERY_RESULT_WAIT_BIT: the frame was retired so the results are available, VK_NOT_READY would mean they were never written and the frame keeps 0
+	if (timestampsEnabled) {
+		std::array<uint64_t, static_cast<size_t>(VKGpuScope::Count) + 1> timestamps{};
+		if (vkGetQueryPoolResults(logicalDevice, slot.timestampPool, 0, static_cast<uint32_t>(timestamps.size()), sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			for (size_t i = 0; i < slot.frame.gpuMs.size(); i++) {
+				//The subtraction is done in the valid bits so a wrap of the counter still gives the right duration
+				uint64_t ticks = (timestamps[i + 1] - timestamps[i]) & timestampMask;
+				slot.frame.gpuMs[i] = static_cast<double>(ticks) * timestampPeriod / 1000000.0;
+			}
+		}
+	}
+
+	if (statisticsEnabled) {
+		vkGetQueryPoolResults(logicalDevice, slot.statisticsPool, 0, 1, sizeof(slot.frame.statistics), slot.frame.statistics.data(), sizeof(slot.frame.statistics), VK_QUERY_RESULT_64_BIT);
+	}
+
+	recordFrame(slot.frame);
+}
+
+void VKProfiler::collectAll(){
+	for (uint32_t i = 0; i < slots.size(); i++) {
+		collect(i);
+	}
+}
+
+void VKProfiler::beginGpuFrame(VkCommandBuffer commandBuffer, uint32_t slot){
+	//Queries have to be reset before they are written again, outside of a render pass
+	if (timestampsEnabled) {
+		vkCmdResetQueryPool(commandBuffer, slots[slot].timestampPool, 0, static_cast<uint32_t>(VKGpuScope::Count) + 1);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slots[slot].timestampPool, 0);
+	}
+	if (statisticsEnabled) {
+		vkCmdResetQueryPool(commandBuffer, slots[slot].statisticsPool, 0, 1);
+		vkCmdBeginQuery(commandBuffer, slots[slot].statisticsPool, 0, 0);
+	}
+}
+
+void VKProfiler::endGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, VKGpuScope scope){
+	if (timestampsEnabled) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slots[slot].timestampPool, static_cast<uint32_t>(scope) + 1);
+	}
+}
+
+void VKProfiler::endGpuFrame(VkCommandBuffer commandBuffer, uint32_t slot){
+	if (statisticsEnabled) {
+		vkCmdEndQuery(commandBuffer, slots[slot].statisticsPool, 0);
+	}
+}
+
+bool VKProfiler::getSummary(std::string& summary, double summaryInterval){
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - summaryStart;
+	if (elapsed.count() < summaryInterval || summaryFrameCount == 0) {
+		return false;
+	}
+
+	double cpuTotal = 0.0;
+	double gpuTotal = 0.0;
+	for (size_t i = 0; i < summarySum.cpuMs.size(); i++) {
+		cpuTotal += summarySum.cpuMs[i];
+	}
+	for (size_t i = 0; i < summarySum.gpuMs.size(); i++) {
+		gpuTotal += summarySum.gpuMs[i];
+	}
+
+	//Averages per frame: a large frame wait means the GPU is the limit, a large acquire or present means the presentation engine is
+	std::ostringstream stream;
+	stream << std::fixed << std::setprecision(2);
+	stream << static_cast<double>(summaryFrameCount) / elapsed.count() << " fps | CPU " << cpuTotal / summaryFrameCount << " ms (";
+	for (size_t i = 0; i < summarySum.cpuMs.size(); i++) {
+		stream << (i > 0 ? ", " : "") << CPU_SCOPE_NAMES[i] << " " << summarySum.cpuMs[i] / summaryFrameCount;
+	}
+	stream << ")";
+	if (timestampsEnabled) {
+		stream << " | GPU " << gpuTotal / summaryFrameCount << " ms (";
+		for (size_t i = 0; i < summarySum.gpuMs.size(); i++) {
+			stream << (i > 0 ? ", " : "") << GPU_SCOPE_NAMES[i] << " " << summarySum.gpuMs[i] / summaryFrameCount;
+		}
+		stream << ")";
+	}
+	if (statisticsEnabled) {
+		stream << std::setprecision(0) << " | " << static_cast<double>(summarySum.statistics[static_cast<size_t>(VKPipelineStatistic::InputPrimitives)]) / summaryFrameCount << " triangles, "
+			<< static_cast<double>(summarySum.statistics[static_cast<size_t>(VKPipelineStatistic::FragmentInvocations)]) / summaryFrameCount << " fragments";
+	}
+	summary = stream.str();
+
+	summarySum = VKProfilerFrame{};
+	summaryFrameCount = 0;
+	summaryStart = std::chrono::steady_clock::now();
+	return true;
+}
+
+void VKProfiler::recordFrame(const VKProfilerFrame& frame){
+	if (keepFrames) {
+		frames.push_back(frame);
+	}
+
+	if (csv.is_open()) {
+		csv << frame.frame;
+		for (double ms : frame.cpuMs) {
+			csv << "," << ms;
+		}
+		for (double ms : frame.gpuMs) {
+			csv << "," << ms;
+		}
+		for (uint64_t statistic : frame.statistics) {
+			csv << "," << statistic;
+		}
+		csv << "\n";
+	}
+
+	for (size_t i = 0; i < frame.cpuMs.size(); i++) {
+		summarySum.cpuMs[i] += frame.cpuMs[i];
+	}
+	for (size_t i = 0; i < frame.gpuMs.size(); i++) {
+		summarySum.gpuMs[i] += frame.gpuMs[i];
+	}
+	for (size_t i = 0; i < frame.statistics.size(); i++) {
+		summarySum.statistics[i] += frame.statistics[i];
+	}
+	summaryFrameCount++;
+}
@@ -0,0 +1,212 @@
+#include "VKScene.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+void VKScene::init(uint32_t stride){
+	vertexStride = stride;
+	vertexData.clear();
+	indexData.clear();
+	shortIndexData.clear();
+	indexType = VK_INDEX_TYPE_UINT32;
+	externalVertexData = nullptr;
+	externalVertexDataSize = 0;
+	externalIndexData = nullptr;
+	externalIndexDataSize = 0;
+	materials.clear();
+	meshes.clear();
+	instances.clear();
+	draws.clear();
+	culledInstanceCount = 0;
+}
+
+uint32_t VKScene::addMaterial(const std::string& texturePath){
+	//A model has a few materials at most, a linear search is enough
+	for (uint32_t i = 0; i < materials.size(); i++) {
+		if (materials[i].texturePath == texturePath) {
+			return i;
+		}
+	}
+
+	materials.push_back({ texturePath });
+	return static_cast<uint32_t>(materials.size() - 1);
+}
+
+uint32_t VKScene::addMesh(const void* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, const glm::vec4& boundingSphere, const glm::vec4& positionQuantization, uint32_t materialIndex){
+	if (externalVertexData || indexType != VK_INDEX_TYPE_UINT32) {
+		throw std::runtime_error("Failed to add mesh, the scene geometry is already complete!");
+	}
+	if (materialIndex >= materials.size()) {
+		throw std::runtime_error("Failed to add mesh, its material doesn't exist!");
+	}
+
+	VKSceneMesh mesh{};
+	mesh.lodCount = 1;
+	mesh.lods[0] = { static_cast<uint32_t>(indexData.size()), indexCount, 0.0f };
+	mesh.vertexOffset = static_cast<int32_t>(vertexData.size() / vertexStride);
+	mesh.vertexCount = vertexCount;
+	mesh.boundingSphere = boundingSphere;
+	mesh.positionQuantization = positionQuantization;
+	mesh.materialIndex = materialIndex;
+
+	//Append the mesh at the end of the megabuffers
+	size_t vertexBytes = static_cast<size_t>(vertexCount) * vertexStride;
+	vertexData.resize(vertexData.size() + vertexBytes);
+	memcpy(vertexData.data() + vertexData.size() - vertexBytes, vertices, vertexBytes);
+	indexData.insert(indexData.end(), indices, indices + indexCount);
+
+	meshes.push_back(mesh);
+	return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+void VKScene::addMeshLod(uint32_t meshIndex, const uint32_t* indices, uint32_t indexCount, float error){
+	if (externalVertexData || indexType != VK_INDEX_TYPE_UINT32) {
+		throw std::runtime_error("Failed to add mesh level of detail, the scene geometry is already complete!");
+	}
+	if (meshIndex >= meshes.size()) {
+		throw std::runtime_error("Failed to add mesh level of detail, the mesh doesn't exist!");
+	}
+	VKSceneMesh& mesh = meshes[meshIndex];
+	if (mesh.lodCount == MAX_MESH_LODS) {
+		throw std::runtime_error("Failed to add mesh level of detail, the mesh already has MAX_MESH_LODS levels!");
+	}
+
+	//The levels of a mesh index its vertices, they only add indices at the end of the index megabuffer
+	mesh.lods[mesh.lodCount++] = { static_cast<uint32_t>(indexData.size()), indexCount, error };
+	indexData.insert(indexData.end(), indices, indices + indexCount);
+}
+
+void VKScene::selectIndexType(){
+	if (externalVertexData || indexType != VK_INDEX_TYPE_UINT32) {
+		return;
+	}
+
+	//An index of a mesh is at most its vertex count - 1, 0xFFFF stays free in case primitive restart gets enabled
+	for (const VKSceneMesh& mesh : meshes) {
+		if (mesh.vertexCount >= 65536) {
+			return;
+		}
+	}
+
+	//Half the index buffer and half the index bandwidth of every draw
+	shortIndexData.assign(indexData.begin(), indexData.end());
+	std::vector<uint32_t>().swap(indexData);
+	indexType = VK_INDEX_TYPE_UINT16;
+}
+
+void VKScene::setGeometry(const char* vertices, size_t vertexDataSize, const char* indices, size_t indexDataSize, VkIndexType type){
+	externalVertexData = vertices;
+	externalVertexDataSize = vertexDataSize;
+	externalIndexData = indices;
+	externalIndexDataSize = indexDataSize;
+	indexType = type;
+}
+
+uint32_t VKScene::addMesh(const VKSceneMesh& mesh){
+	//The range must be inside the geometry, a corrupted cache would otherwise read out of bounds on the GPU
+	uint64_t vertexCount = getVertexDataSize() / vertexStride;
+	if (mesh.lodCount == 0 || mesh.lodCount > MAX_MESH_LODS || mesh.vertexOffset < 0 || static_cast<uint64_t>(mesh.vertexOffset) + mesh.vertexCount > vertexCount) {
+		throw std::runtime_error("Failed to add mesh, its range is outside of the scene geometry!");
+	}
+	for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+		if (static_cast<uint64_t>(mesh.lods[lod].firstIndex) + mesh.lods[lod].indexCount > getIndexCount()) {
+			throw std::runtime_error("Failed to add mesh, its range is outside of the scene geometry!");
+		}
+	}
+	if (mesh.materialIndex >= materials.size()) {
+		throw std::runtime_error("Failed to add mesh, its material doesn't exist!");
+	}
+
+	meshes.push_back(mesh);
+	return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+void VKScene::releaseGeometry(){
+	//swap frees the memory, clear() would keep the capacity
+	std::vector<char>().swap(vertexData);
+	std::vector<uint32_t>().swap(indexData);
+	std::vector<uint16_t>().swap(shortIndexData);
+	externalVertexData = nullptr;
+	externalVertexDataSize = 0;
+	externalIndexData = nullptr;
+	externalIndexDataSize = 0;
+}
+
+const char* VKScene::getIndexData() const{
+	if (externalIndexData) {
+		return externalIndexData;
+	}
+	return indexType == VK_INDEX_TYPE_UINT16 ? reinterpret_cast<const char*>(shortIndexData.data()) : reinterpret_cast<const char*>(indexData.data());
+}
+
+size_t VKScene::getIndexDataSize() const{
+	if (externalIndexData) {
+		return externalIndexDataSize;
+	}
+	return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) * shortIndexData.size() : sizeof(uint32_t) * indexData.size();
+}
+
+void VKScene::addInstance(uint32_t meshIndex, const glm::mat4& transform){
+	if (meshIndex >= meshes.size()) {
+		throw std::runtime_error("Failed to add scene instance, the mesh doesn't exist!");
+	}
+
+	instances.push_back({ meshIndex, 0, transform });
+}
+
+void VKScene::buildDraws(){
+	//Stable so the instances of a mesh keep the order they were added in
+	std::stable_sort(instances.begin(), instances.end(), [](const VKSceneInstance& a, const VKSceneInstance& b) {
+		return a.meshIndex < b.meshIndex;
+	});
+
+	//The levels of a mesh are consecutive draws, the instances point to the draw of level 0 and the culling shader adds the level it picks
+	draws.clear();
+	culledInstanceCount = 0;
+	uint32_t first = 0;
+	while (first < instances.size()) {
+		uint32_t meshIndex = instances[first].meshIndex;
+		uint32_t end = first;
+		while (end < instances.size() && instances[end].meshIndex == meshIndex) {
+			instances[end++].drawIndex = static_cast<uint32_t>(draws.size());
+		}
+
+		for (uint32_t lod = 0; lod < meshes[meshIndex].lodCount; lod++) {
+			draws.push_back({ meshIndex, lod, culledInstanceCount, end - first });
+			culledInstanceCount += end - first;
+		}
+		first = end;
+	}
+}
+
+std::vector<VkDrawIndexedIndirectCommand> VKScene::buildDrawCommands() const{
+	std::vector<VkDrawIndexedIndirectCommand> commands(draws.size());
+	for (size_t i = 0; i < draws.size(); i++) {
+		const VKSceneMesh& mesh = meshes[draws[i].meshIndex];
+		const VKSceneMeshLod& lod = mesh.lods[draws[i].lod];
+
+		//Same parameters as vkCmdDrawIndexed, read by the GPU from the indirect buffer
+		commands[i].indexCount = lod.indexCount;
+		commands[i].instanceCount = draws[i].instanceCount;
+		commands[i].firstIndex = lod.firstIndex;
+		commands[i].vertexOffset = mesh.vertexOffset;
+		commands[i].firstInstance = draws[i].firstInstance;//First element read from the instance rate vertex binding
+	}
+	return commands;
+}
+
+std::vector<VKDrawData> VKScene::buildDrawData() const{
+	std::vector<VKDrawData> drawData(draws.size());
+	for (size_t i = 0; i < draws.size(); i++) {
+		const VKSceneMesh& mesh = meshes[draws[i].meshIndex];
+		drawData[i].boundingSphere = mesh.boundingSphere;
+		drawData[i].positionQuantization = mesh.positionQuantization;
+		drawData[i].materialIndex = mesh.materialIndex;
+		//Only read from the draw of level 0, the one the instances point to
+		drawData[i].lodCount = mesh.lodCount;
+		for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+			drawData[i].lodErrors[lod] = mesh.lods[lod].error;
+		}
+	}
+	return drawData;
+}
@@ -0,0 +1,144 @@
+#include "VKShaderCompiler.h"
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+#include <chrono>
+
+#ifdef VKSANDBOX_SHADERC
+#include <shaderc/shaderc.hpp>
+#endif
+
+void VKShaderCompiler::init(const std::string& directory){
+	cacheDir = directory;
+
+	//A cache that can't be created isn't fatal, the shaders are compiled every time
+	std::error_code error;
+	std::filesystem::create_directories(cacheDir, error);
+}
+
+bool VKShaderCompiler::isAvailable(){
+#ifdef VKSANDBOX_SHADERC
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool VKShaderCompiler::compile(const std::string& sourcePath, const std::vector<std::string>& defines, std::vector<char>& spirv, std::string& log){
+	std::vector<char> contents;
+	if (!readFile(sourcePath, contents)) {
+		log = "Failed to open " + sourcePath;
+		return false;
+	}
+	std::string source(contents.begin(), contents.end());
+	std::string extension = std::filesystem::path(sourcePath).extension().string();
+
+	//Same source, defines and stage: compiled before, the SPIR-V is in the cache
+	std::string cachePath = getCachePath(hashSource(source, defines, extension));
+	if (readFile(cachePath, spirv) && !spirv.empty() && spirv.size() % 4 == 0) {
+		return true;
+	}
+
+#ifdef VKSANDBOX_SHADERC
+	shaderc_shader_kind kind;
+	if (extension == ".vert") {
+		kind = shaderc_vertex_shader;
+	}
+	else if (extension == ".frag") {
+		kind = shaderc_fragment_shader;
+	}
+	else if (extension == ".comp") {
+		kind = shaderc_compute_shader;
+	}
+	else {
+		log = "Unknown shader stage of " + sourcePath;
+		return false;
+	}
+
+	//The same target as the descriptor indexing the shaders use, core in Vulkan 1.2
+	shaderc::CompileOptions options;
+	options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+	options.SetOptimizationLevel(shaderc_optimization_level_performance);
+	for (const std::string& define : defines) {
+		size_t separator = define.find('=');
+		if (separator == std::string::npos) {
+			options.AddMacroDefinition(define);
+		}
+		else {
+			options.AddMacroDefinition(define.substr(0, separator), define.substr(separator + 1));
+		}
+	}
+
+	//A compiler per call: compile() is only called from the hot reload worker, and creating one is cheap next to compiling
+	shaderc::Compiler compiler;
+	shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(source, kind, sourcePath.c_str(), options);
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+		log = result.GetErrorMessage();
+		return false;
+	}
+
+	spirv.assign(reinterpret_cast<const char*>(result.cbegin()), reinterpret_cast<const char*>(result.cend()));
+
+	//Written to a temporary file and renamed like the mesh and pipeline caches, so a crash never leaves a truncated entry behind
+	//The temporary name is unique, another instance of the application compiling the same shader doesn't write to the same file
+	//A failed write only means the next run compiles it again
+	std::string tempPath = cachePath + "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+	std::ofstream cacheFile(tempPath, std::ios::binary | std::ios::trunc);
+	if (cacheFile.is_open()) {
+		cacheFile.write(spirv.data(), spirv.size());
+		cacheFile.close();
+
+		std::error_code error;
+		if (cacheFile) {
+			std::filesystem::rename(tempPath, cachePath, error);
+		}
+		if (!cacheFile || error) {
+			std::filesystem::remove(tempPath, error);
+		}
+	}
+	return true;
+#else
+	log = "Built without shaderc (VKSANDBOX_SHADERC), " + sourcePath + " can't be compiled at runtime";
+	return false;
+#endif
+}
+
+uint64_t VKShaderCompiler::hashSource(const std::string& source, const std::vector<std::string>& defines, const std::string& extension){
+	//FNV-1a, like the pipeline descriptions. Every string is followed by a separator so moving characters from one to the next changes the hash
+	uint64_t hash = 14695981039346656037ull;
+	auto hashString = [&hash](const std::string& value) {
+		for (char c : value) {
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ull;
+		}
+		//Separator: a 0 byte, the xor changes nothing so only the multiplication is left
+		hash *= 1099511628211ull;
+	};
+
+	hashString(std::to_string(CACHE_VERSION));
+	hashString(extension);
+	for (const std::string& define : defines) {
+		hashString(define);
+	}
+	hashString(source);
+	return hash;
+}
+
+std::string VKShaderCompiler::getCachePath(uint64_t key) const{
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+	return cacheDir + "/" + name + ".spv";
+}
+
+bool VKShaderCompiler::readFile(const std::string& path, std::vector<char>& contents){
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	contents.resize(fileSize);
+	file.seekg(0);
+	file.read(contents.data(), fileSize);
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,76 @@
+#include "VKShaderHotReload.h"
+#include <iostream>
+#include <chrono>
+
+bool VKShaderHotReload::init(const std::vector<VKShaderSource>& sources, const std::string& cacheDir, double interval, Compiled compiled){
+	if (!VKShaderCompiler::isAvailable()) {
+		return false;
+	}
+
+	compiler.init(cacheDir);
+	onCompiled = std::move(compiled);
+	pollInterval = interval;
+
+	//The versions on disk now are the ones the SPIR-V files were compiled from
+	watched.clear();
+	for (const VKShaderSource& source : sources) {
+		std::error_code error;
+		std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(source.source, error);
+		watched.push_back(WatchedSource{ source, error ? std::filesystem::file_time_type::min() : writeTime });
+	}
+
+	stopping = false;
+	worker = std::thread(&VKShaderHotReload::workerLoop, this);
+	return true;
+}
+
+void VKShaderHotReload::shutdown(){
+	if (!worker.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+void VKShaderHotReload::workerLoop(){
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!wake.wait_for(lock, std::chrono::duration<double>(pollInterval), [this]() { return stopping; })) {
+		//Compiling doesn't hold the lock, shutdown() only waits for the current source
+		lock.unlock();
+		poll();
+		lock.lock();
+	}
+}
+
+void VKShaderHotReload::poll(){
+	for (WatchedSource& source : watched) {
+		//A file that is being saved can be missing for a moment, it is checked again on the next poll
+		std::error_code error;
+		std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(source.shader.source, error);
+		if (error || writeTime == source.writeTime) {
+			continue;
+		}
+		source.writeTime = writeTime;
+
+		std::vector<char> spirv;
+		std::string log;
+		if (!compiler.compile(source.shader.source, source.shader.defines, spirv, log)) {
+			std::cerr << "Failed to compile " << source.shader.source << ", keeping the previous version:\n" << log << std::endl;
+			continue;
+		}
+
+		//The old pipelines stay in use if the new ones can't be created
+		try {
+			onCompiled(source.shader, spirv);
+			std::cout << "Reloaded " << source.shader.source << std::endl;
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Failed to rebuild the pipelines of " << source.shader.source << ": " << e.what() << std::endl;
+		}
+	}
+}
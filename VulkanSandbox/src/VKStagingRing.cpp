@@ -0,0 +1,124 @@
+#include "VKStagingRing.h"
+#include <stdexcept>
+#include <cstdint>
+
+void VKStagingRing::init(VkDevice device, VkBuffer ringBuffer, void* ringMapped, VkDeviceSize size, VkSemaphore ringTimeline){
+	logicalDevice = device;
+	buffer = ringBuffer;
+	timeline = ringTimeline;
+	mapped = static_cast<char*>(ringMapped);
+	capacity = size;
+	head = 0;
+	tail = 0;
+	used = 0;
+	openBytes = 0;
+	submittedRegions.clear();
+}
+
+VKStagingRegion VKStagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment){
+	if (size > capacity) {
+		throw std::runtime_error("Upload is bigger than the staging ring!");
+	}
+
+	//Free any range the GPU is already done with before looking for space
+	reclaim();
+
+	while (true) {
+		VkDeviceSize offset = (head + alignment - 1) & ~(alignment - 1);
+
+		if (used == 0) {
+			//Empty ring, start again from the beginning so the whole buffer is available
+			head = 0;
+			tail = 0;
+			offset = 0;
+		}
+
+		if (head >= tail) {
+			//Free space is [head, capacity) and [0, tail)
+			if (offset + size <= capacity) {
+				VkDeviceSize bytes = offset + size - head;
+				head = offset + size;
+				used += bytes;
+				openBytes += bytes;
+				return VKStagingRegion{ buffer, offset, mapped + offset };
+			}
+			//Not enough space at the end, wrap around and skip the rest of the buffer (strictly less than tail, head == tail would look empty)
+			if (size < tail) {
+				VkDeviceSize bytes = capacity - head + size;
+				head = size;
+				used += bytes;
+				openBytes += bytes;
+				return VKStagingRegion{ buffer, 0, mapped };
+			}
+		}
+		else if (offset + size < tail) {
+			//Free space is [head, tail)
+			VkDeviceSize bytes = offset + size - head;
+			head = offset + size;
+			used += bytes;
+			openBytes += bytes;
+			return VKStagingRegion{ buffer, offset, mapped + offset };
+		}
+
+		//The ring is full, the only way to get space is waiting for the oldest upload to finish
+		if (submittedRegions.empty()) {
+			//Everything in the ring was allocated since the last submit, nothing will ever be freed
+			throw std::runtime_error("Staging ring is full, submit the pending uploads first!");
+		}
+
+		waitForValue(submittedRegions.front().value);
+		retireOldest();
+	}
+}
+
+void VKStagingRing::markSubmitted(uint64_t value){
+	if (openBytes == 0) {
+		return;
+	}
+
+	submittedRegions.push_back(SubmittedRegion{ value, head, openBytes });
+	openBytes = 0;
+}
+
+void VKStagingRing::reclaim(){
+	if (submittedRegions.empty()) {
+		return;
+	}
+
+	//Regions are submitted in order, so every region up to the value the timeline has reached is free
+	uint64_t completedValue = 0;
+	vkGetSemaphoreCounterValue(logicalDevice, timeline, &completedValue);
+	while (!submittedRegions.empty() && submittedRegions.front().value <= completedValue) {
+		retireOldest();
+	}
+}
+
+void VKStagingRing::waitIdle(){
+	if (submittedRegions.empty()) {
+		return;
+	}
+
+	//Waiting for the newest region is waiting for all of them
+	waitForValue(submittedRegions.back().value);
+	while (!submittedRegions.empty()) {
+		retireOldest();
+	}
+}
+
+void VKStagingRing::waitForValue(uint64_t value){
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &timeline;
+	waitInfo.pValues = &value;
+	if (vkWaitSemaphores(logicalDevice, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to wait for staging ring upload!");
+	}
+}
+
+void VKStagingRing::retireOldest(){
+	const SubmittedRegion& region = submittedRegions.front();
+	tail = region.end;
+	used -= region.bytes;
+	submittedRegions.pop_front();
+}
@@ -0,0 +1,297 @@
+#include "VKTextureBaker.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <array>
+
+namespace {
+	//sRGB to linear of every 8-bit value, built on first use
+	//Several streaming workers bake at the same time, the initialization of a local static runs once and the others wait for it
+	const float* getSrgbToLinearTable() {
+		static const std::array<float, 256> table = []() {
+			std::array<float, 256> values{};
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			return values;
+		}();
+		return table.data();
+	}
+
+	uint8_t linearToSrgb(float c) {
+		c = std::clamp(c, 0.0f, 1.0f);
+		float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+		return static_cast<uint8_t>(s * 255.0f + 0.5f);
+	}
+
+	//Interpolation weights of the 4-bit indices, in 64ths (from the BC7 specification)
+	const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	//Mode 6 endpoints: 7 bits per channel plus a shared lowest bit (p-bit) per endpoint
+	struct BC7Endpoints {
+		int quantized[2][4];
+		int pbit[2];
+		int value[2][4];//8-bit values the decoder reconstructs
+	};
+
+	//Quantize two float endpoints, each endpoint picks the p-bit that reconstructs it best
+	BC7Endpoints quantizeEndpoints(const float endpoints[2][4]) {
+		BC7Endpoints result{};
+		for (int e = 0; e < 2; e++) {
+			float bestError = -1.0f;
+			for (int p = 0; p < 2; p++) {
+				int quantized[4];
+				float error = 0.0f;
+				for (int c = 0; c < 4; c++) {
+					quantized[c] = std::clamp(static_cast<int>(std::lround((endpoints[e][c] - p) * 0.5f)), 0, 127);
+					float difference = static_cast<float>((quantized[c] << 1) | p) - endpoints[e][c];
+					error += difference * difference;
+				}
+				if (bestError < 0.0f || error < bestError) {
+					bestError = error;
+					result.pbit[e] = p;
+					for (int c = 0; c < 4; c++) {
+						result.quantized[e][c] = quantized[c];
+						result.value[e][c] = (quantized[c] << 1) | p;
+					}
+				}
+			}
+		}
+		return result;
+	}
+
+	//Picks the closest of the 16 interpolated colors for every texel, returns the total squared error
+	int assignIndices(const uint8_t texels[16][4], const BC7Endpoints& endpoints, int indices[16]) {
+		int palette[16][4];
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 4; c++) {
+				palette[i][c] = ((64 - BC7_WEIGHTS4[i]) * endpoints.value[0][c] + BC7_WEIGHTS4[i] * endpoints.value[1][c] + 32) >> 6;
+			}
+		}
+
+		int totalError = 0;
+		for (int t = 0; t < 16; t++) {
+			int bestError = -1;
+			for (int i = 0; i < 16; i++) {
+				int error = 0;
+				for (int c = 0; c < 4; c++) {
+					int difference = palette[i][c] - texels[t][c];
+					error += difference * difference;
+				}
+				if (bestError < 0 || error < bestError) {
+					bestError = error;
+					indices[t] = i;
+				}
+			}
+			totalError += bestError;
+		}
+		return totalError;
+	}
+
+	//Appends bits to a 128-bit block, least significant bit first
+	struct BitWriter {
+		uint8_t* block;
+		int position = 0;
+
+		void write(uint32_t value, int count) {
+			for (int i = 0; i < count; i++, position++) {
+				if ((value >> i) & 1) {
+					block[position >> 3] |= static_cast<uint8_t>(1 << (position & 7));
+				}
+			}
+		}
+	};
+}
+
+std::vector<VKTextureLevel> VKTextureBaker::buildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height){
+	const float* toLinear = getSrgbToLinearTable();
+
+	std::vector<VKTextureLevel> levels;
+	levels.push_back({ width, height, std::vector<uint8_t>(pixels, pixels + static_cast<size_t>(width) * height * 4) });
+
+	while (levels.back().width > 1 || levels.back().height > 1) {
+		const VKTextureLevel& source = levels.back();
+		VKTextureLevel level{};
+		level.width = std::max(source.width / 2, 1u);
+		level.height = std::max(source.height / 2, 1u);
+		level.data.resize(static_cast<size_t>(level.width) * level.height * 4);
+
+		for (uint32_t y = 0; y < level.height; y++) {
+			//A side of 1 texel covers only one texel of the level above (odd sides drop their last row or column, like the GPU blits)
+			uint32_t y0 = std::min(y * 2, source.height - 1);
+			uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+			for (uint32_t x = 0; x < level.width; x++) {
+				uint32_t x0 = std::min(x * 2, source.width - 1);
+				uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+				const uint8_t* covered[4] = {
+					&source.data[(static_cast<size_t>(y0) * source.width + x0) * 4],
+					&source.data[(static_cast<size_t>(y0) * source.width + x1) * 4],
+					&source.data[(static_cast<size_t>(y1) * source.width + x0) * 4],
+					&source.data[(static_cast<size_t>(y1) * source.width + x1) * 4]
+				};
+
+				uint8_t* texel = &level.data[(static_cast<size_t>(y) * level.width + x) * 4];
+				for (int c = 0; c < 3; c++) {
+					float sum = toLinear[covered[0][c]] + toLinear[covered[1][c]] + toLinear[covered[2][c]] + toLinear[covered[3][c]];
+					texel[c] = linearToSrgb(sum * 0.25f);
+				}
+				//Alpha is linear
+				texel[3] = static_cast<uint8_t>((covered[0][3] + covered[1][3] + covered[2][3] + covered[3][3] + 2) / 4);
+			}
+		}
+
+		levels.push_back(std::move(level));
+	}
+
+	return levels;
+}
+
+VKTextureLevel VKTextureBaker::compressBC7(const VKTextureLevel& level){
+	VKTextureLevel compressed{};
+	compressed.width = level.width;
+	compressed.height = level.height;
+	compressed.data.resize(static_cast<size_t>((level.width + 3) / 4) * ((level.height + 3) / 4) * 16);
+
+	compressBC7Rows(level, compressed, 0, (level.height + 3) / 4);
+	return compressed;
+}
+
+void VKTextureBaker::compressBC7Rows(const VKTextureLevel& level, VKTextureLevel& compressed, uint32_t firstRow, uint32_t lastRow){
+	uint32_t blocksX = (level.width + 3) / 4;
+	uint8_t texels[16][4];
+	for (uint32_t by = firstRow; by < lastRow; by++) {
+		for (uint32_t bx = 0; bx < blocksX; bx++) {
+			//Blocks over the edge of a level that isn't a multiple of 4 repeat the last row and column, the decoder ignores them
+			for (uint32_t t = 0; t < 16; t++) {
+				uint32_t x = std::min(bx * 4 + t % 4, level.width - 1);
+				uint32_t y = std::min(by * 4 + t / 4, level.height - 1);
+				memcpy(texels[t], &level.data[(static_cast<size_t>(y) * level.width + x) * 4], 4);
+			}
+			encodeBC7Block(texels, &compressed.data[(static_cast<size_t>(by) * blocksX + bx) * 16]);
+		}
+	}
+}
+
+void VKTextureBaker::encodeBC7Block(const uint8_t texels[16][4], uint8_t block[16]){
+	// Endpoints along the principal axis
+	//The colors of a block are usually close to a line in RGBA space, the endpoints are the extremes of the texels projected on it
+	float mean[4] = {};
+	for (int t = 0; t < 16; t++) {
+		for (int c = 0; c < 4; c++) {
+			mean[c] += texels[t][c] / 16.0f;
+		}
+	}
+
+	float covariance[4][4] = {};
+	for (int t = 0; t < 16; t++) {
+		for (int i = 0; i < 4; i++) {
+			for (int j = 0; j < 4; j++) {
+				covariance[i][j] += (texels[t][i] - mean[i]) * (texels[t][j] - mean[j]);
+			}
+		}
+	}
+
+	//Power iteration converges to the eigenvector of the largest eigenvalue, the direction of largest variance
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {};
+		for (int i = 0; i < 4; i++) {
+			for (int j = 0; j < 4; j++) {
+				next[i] += covariance[i][j] * axis[j];
+			}
+		}
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if (length < 1e-6f) {
+			break;//Every texel has the same color, any axis works
+		}
+		for (int c = 0; c < 4; c++) {
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float minT = 0.0f;
+	float maxT = 0.0f;
+	for (int t = 0; t < 16; t++) {
+		float projection = 0.0f;
+		for (int c = 0; c < 4; c++) {
+			projection += (texels[t][c] - mean[c]) * axis[c];
+		}
+		minT = std::min(minT, projection);
+		maxT = std::max(maxT, projection);
+	}
+
+	float endpoints[2][4];
+	for (int c = 0; c < 4; c++) {
+		endpoints[0][c] = std::clamp(mean[c] + minT * axis[c], 0.0f, 255.0f);
+		endpoints[1][c] = std::clamp(mean[c] + maxT * axis[c], 0.0f, 255.0f);
+	}
+
+	BC7Endpoints best = quantizeEndpoints(endpoints);
+	int bestIndices[16];
+	int bestError = assignIndices(texels, best, bestIndices);
+
+	// Refinement
+	//With the indices fixed the best endpoints are a least squares fit, which moves them off the axis where it helps
+	int indices[16];
+	memcpy(indices, bestIndices, sizeof(indices));
+	for (int iteration = 0; iteration < 2 && bestError > 0; iteration++) {
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[4] = {}, bx[4] = {};
+		for (int t = 0; t < 16; t++) {
+			float b = BC7_WEIGHTS4[indices[t]] / 64.0f;
+			float a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < 4; c++) {
+				ax[c] += a * texels[t][c];
+				bx[c] += b * texels[t][c];
+			}
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (std::abs(determinant) < 1e-6f) {
+			break;//All the texels use the same index
+		}
+		for (int c = 0; c < 4; c++) {
+			endpoints[0][c] = std::clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.0f, 255.0f);
+			endpoints[1][c] = std::clamp((aa * bx[c] - ab * ax[c]) / determinant, 0.0f, 255.0f);
+		}
+
+		BC7Endpoints refined = quantizeEndpoints(endpoints);
+		int error = assignIndices(texels, refined, indices);
+		if (error >= bestError) {
+			break;
+		}
+		best = refined;
+		bestError = error;
+		memcpy(bestIndices, indices, sizeof(bestIndices));
+	}
+
+	//The index of the first texel is stored with 3 bits, its highest bit is implied 0: swap the endpoints if it is set
+	if (bestIndices[0] >= 8) {
+		for (int c = 0; c < 4; c++) {
+			std::swap(best.quantized[0][c], best.quantized[1][c]);
+		}
+		std::swap(best.pbit[0], best.pbit[1]);
+		for (int t = 0; t < 16; t++) {
+			bestIndices[t] = 15 - bestIndices[t];
+		}
+	}
+
+	// Mode 6 layout
+	//Mode (bit 6 set), R0 R1 G0 G1 B0 B1 A0 A1 (7 bits each), P0 P1, then the indices
+	memset(block, 0, 16);
+	BitWriter writer{ block };
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writer.write(best.quantized[0][c], 7);
+		writer.write(best.quantized[1][c], 7);
+	}
+	writer.write(best.pbit[0], 1);
+	writer.write(best.pbit[1], 1);
+	for (int t = 0; t < 16; t++) {
+		writer.write(bestIndices[t], t == 0 ? 3 : 4);
+	}
+}
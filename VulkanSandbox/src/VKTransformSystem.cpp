@@ -0,0 +1,231 @@
+#include "VKTransformSystem.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VK_TRANSFORM_SSE
+#include <immintrin.h>
+#endif
+
+namespace {
+	//r = a * b, r must not be a or b
+	inline void multiplyMatrices(const glm::mat4& a, const glm::mat4& b, glm::mat4& r) {
+#if defined(VK_TRANSFORM_SSE) && defined(__AVX__)
+		//Two columns of the result at once, every lane of a 256 bit register holds the columns of a
+		__m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[0].x));
+		__m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[1].x));
+		__m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[2].x));
+		__m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[3].x));
+		for (int column = 0; column < 4; column += 2) {
+			__m256 bColumns = _mm256_loadu_ps(&b[column].x);
+			__m256 result = _mm256_mul_ps(a0, _mm256_permute_ps(bColumns, 0x00));
+			result = _mm256_add_ps(result, _mm256_mul_ps(a1, _mm256_permute_ps(bColumns, 0x55)));
+			result = _mm256_add_ps(result, _mm256_mul_ps(a2, _mm256_permute_ps(bColumns, 0xAA)));
+			result = _mm256_add_ps(result, _mm256_mul_ps(a3, _mm256_permute_ps(bColumns, 0xFF)));
+			_mm256_storeu_ps(&r[column].x, result);
+		}
+#elif defined(VK_TRANSFORM_SSE)
+		//Every column of the result is the columns of a weighted by the elements of the column of b
+		__m128 a0 = _mm_loadu_ps(&a[0].x);
+		__m128 a1 = _mm_loadu_ps(&a[1].x);
+		__m128 a2 = _mm_loadu_ps(&a[2].x);
+		__m128 a3 = _mm_loadu_ps(&a[3].x);
+		for (int column = 0; column < 4; column++) {
+			__m128 bColumn = _mm_loadu_ps(&b[column].x);
+			__m128 result = _mm_mul_ps(a0, _mm_shuffle_ps(bColumn, bColumn, 0x00));
+			result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_shuffle_ps(bColumn, bColumn, 0x55)));
+			result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_shuffle_ps(bColumn, bColumn, 0xAA)));
+			result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_shuffle_ps(bColumn, bColumn, 0xFF)));
+			_mm_storeu_ps(&r[column].x, result);
+		}
+#else
+		r = a * b;
+#endif
+	}
+}
+
+uint32_t VKTransformSystem::addNode(const glm::vec3& position, const glm::quat& rotation, float scale, uint32_t parent){
+	if (parent != NO_PARENT && parent >= nodeCount) {
+		throw std::runtime_error("Failed to add transform node, its parent doesn't exist!");
+	}
+
+	//Grow by 4 identity nodes at a time, the padding is never dirty so it is never updated
+	if (nodeCount % 4 == 0) {
+		size_t size = nodeCount + 4;
+		positionX.resize(size, 0.0f);
+		positionY.resize(size, 0.0f);
+		positionZ.resize(size, 0.0f);
+		rotationX.resize(size, 0.0f);
+		rotationY.resize(size, 0.0f);
+		rotationZ.resize(size, 0.0f);
+		rotationW.resize(size, 1.0f);
+		scales.resize(size, 1.0f);
+		parents.resize(size, NO_PARENT);
+		dirty.resize(size, 0);
+		changedVersion.resize(size, 0);
+		worldMatrices.resize(size, glm::mat4(1.0f));
+	}
+
+	uint32_t node = nodeCount++;
+	parents[node] = parent;
+	setPosition(node, position);
+	setRotation(node, rotation);
+	setScale(node, scale);
+	return node;
+}
+
+void VKTransformSystem::clear(){
+	//The version keeps counting, so a destination written before the clear is still rewritten
+	nodeCount = 0;
+	firstDirty = NO_PARENT;
+	positionX.clear();
+	positionY.clear();
+	positionZ.clear();
+	rotationX.clear();
+	rotationY.clear();
+	rotationZ.clear();
+	rotationW.clear();
+	scales.clear();
+	parents.clear();
+	dirty.clear();
+	changedVersion.clear();
+	worldMatrices.clear();
+}
+
+void VKTransformSystem::setPosition(uint32_t node, const glm::vec3& position){
+	positionX[node] = position.x;
+	positionY[node] = position.y;
+	positionZ[node] = position.z;
+	dirty[node] = 1;
+	firstDirty = std::min(firstDirty, node);
+}
+
+void VKTransformSystem::setRotation(uint32_t node, const glm::quat& rotation){
+	rotationX[node] = rotation.x;
+	rotationY[node] = rotation.y;
+	rotationZ[node] = rotation.z;
+	rotationW[node] = rotation.w;
+	dirty[node] = 1;
+	firstDirty = std::min(firstDirty, node);
+}
+
+void VKTransformSystem::setScale(uint32_t node, float scale){
+	scales[node] = scale;
+	dirty[node] = 1;
+	firstDirty = std::min(firstDirty, node);
+}
+
+uint32_t VKTransformSystem::update(){
+	if (firstDirty == NO_PARENT) {
+		return 0;
+	}
+	version++;
+
+	//One pass over groups of 4 nodes, parents come first so a parent is already updated when its children are reached
+	//A node changes if it is dirty or its parent changed in this update, nothing before the first dirty node can change
+	//The local matrices aren't stored: they are rebuilt from the SoA arrays (half the size of a matrix) for the groups that changed, and used while they are in registers or the cache
+	uint32_t changedCount = 0;
+	glm::mat4 localMatrices[4];
+	for (uint32_t first = firstDirty & ~3u; first < nodeCount; first += 4) {
+		bool changed[4];
+		bool groupChanged = false;
+		for (uint32_t lane = 0; lane < 4; lane++) {
+			//A parent in the same group isn't updated yet, its lane tells if it will be
+			uint32_t parent = parents[first + lane];
+			bool parentChanged = parent != NO_PARENT && (parent >= first ? changed[parent - first] : changedVersion[parent] == version);
+			changed[lane] = dirty[first + lane] || parentChanged;
+			groupChanged = groupChanged || changed[lane];
+		}
+		if (!groupChanged) {
+			continue;
+		}
+
+		//A whole group is rebuilt as soon as one of them changed, it costs the same as one node
+		buildLocalMatrices4(first, localMatrices);
+		for (uint32_t lane = 0; lane < 4; lane++) {
+			uint32_t node = first + lane;
+			if (!changed[lane]) {
+				continue;
+			}
+
+			uint32_t parent = parents[node];
+			if (parent == NO_PARENT) {
+				worldMatrices[node] = localMatrices[lane];
+			}
+			else {
+				multiplyMatrices(worldMatrices[parent], localMatrices[lane], worldMatrices[node]);
+			}
+			dirty[node] = 0;
+			changedVersion[node] = version;
+			changedCount++;
+		}
+	}
+	firstDirty = NO_PARENT;
+	return changedCount;
+}
+
+uint32_t VKTransformSystem::writeWorldMatrices(void* dst, size_t stride, uint32_t firstNode, uint32_t count, uint64_t& writtenVersion) const{
+	char* output = static_cast<char*>(dst);
+	uint32_t writtenCount = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t node = firstNode + i;
+		if (changedVersion[node] <= writtenVersion) {
+			continue;
+		}
+
+		const float* source = &worldMatrices[node][0].x;
+		float* destination = reinterpret_cast<float*>(output + i * stride);
+		memcpy(destination, source, sizeof(glm::mat4));
+		writtenCount++;
+	}
+
+	writtenVersion = version;
+	return writtenCount;
+}
+
+void VKTransformSystem::buildLocalMatrices4(uint32_t first, glm::mat4* localMatrices) const{
+	//translate(position) * mat4_cast(rotation) * scale(scale), the rotation is a unit quaternion
+#ifdef VK_TRANSFORM_SSE
+	//One node per lane
+	__m128 x = _mm_loadu_ps(&rotationX[first]);
+	__m128 y = _mm_loadu_ps(&rotationY[first]);
+	__m128 z = _mm_loadu_ps(&rotationZ[first]);
+	__m128 w = _mm_loadu_ps(&rotationW[first]);
+	__m128 s = _mm_loadu_ps(&scales[first]);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 zero = _mm_setzero_ps();
+
+	//2 * s is folded into the products, so every element is one multiply away
+	__m128 s2 = _mm_add_ps(s, s);
+	__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+	__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+	__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+	//Columns of the 4 matrices, one row per register
+	__m128 columns[4][4] = {
+		{ _mm_sub_ps(s, _mm_mul_ps(s2, _mm_add_ps(yy, zz))), _mm_mul_ps(s2, _mm_add_ps(xy, wz)), _mm_mul_ps(s2, _mm_sub_ps(xz, wy)), zero },
+		{ _mm_mul_ps(s2, _mm_sub_ps(xy, wz)), _mm_sub_ps(s, _mm_mul_ps(s2, _mm_add_ps(xx, zz))), _mm_mul_ps(s2, _mm_add_ps(yz, wx)), zero },
+		{ _mm_mul_ps(s2, _mm_add_ps(xz, wy)), _mm_mul_ps(s2, _mm_sub_ps(yz, wx)), _mm_sub_ps(s, _mm_mul_ps(s2, _mm_add_ps(xx, yy))), zero },
+		{ _mm_loadu_ps(&positionX[first]), _mm_loadu_ps(&positionY[first]), _mm_loadu_ps(&positionZ[first]), one }
+	};
+
+	//Transposed, every register is then the column of one node
+	for (int column = 0; column < 4; column++) {
+		__m128* rows = columns[column];
+		_MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+		for (int lane = 0; lane < 4; lane++) {
+			_mm_storeu_ps(&localMatrices[lane][column].x, rows[lane]);
+		}
+	}
+#else
+	for (uint32_t node = first; node < first + 4; node++) {
+		float x = rotationX[node], y = rotationY[node], z = rotationZ[node], w = rotationW[node], s = scales[node];
+		glm::mat4& m = localMatrices[node - first];
+		m[0] = glm::vec4(s * (1.0f - 2.0f * (y * y + z * z)), s * 2.0f * (x * y + w * z), s * 2.0f * (x * z - w * y), 0.0f);
+		m[1] = glm::vec4(s * 2.0f * (x * y - w * z), s * (1.0f - 2.0f * (x * x + z * z)), s * 2.0f * (y * z + w * x), 0.0f);
+		m[2] = glm::vec4(s * 2.0f * (x * z + w * y), s * 2.0f * (y * z - w * x), s * (1.0f - 2.0f * (x * x + y * y)), 0.0f);
+		m[3] = glm::vec4(positionX[node], positionY[node], positionZ[node], 1.0f);
+	}
+#endif
+}
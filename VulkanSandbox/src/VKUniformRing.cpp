@@ -0,0 +1,38 @@
+#include "VKUniformRing.h"
+#include <stdexcept>
+#include <cstring>
+
+void VKUniformRing::init(VkBuffer ringBuffer, void* ringMapped, VkDeviceSize size, uint32_t count, VkDeviceSize ringAlignment){
+	buffer = ringBuffer;
+	mapped = static_cast<char*>(ringMapped);
+	alignment = ringAlignment;
+	frameSize = (size + alignment - 1) & ~(alignment - 1);
+	frameCount = count;
+	frameStart = 0;
+	head = 0;
+}
+
+VkDeviceSize VKUniformRing::getBufferSize(VkDeviceSize frameSize, uint32_t frameCount, VkDeviceSize alignment){
+	return ((frameSize + alignment - 1) & ~(alignment - 1)) * frameCount;
+}
+
+void VKUniformRing::beginFrame(uint32_t frame){
+	if (frame >= frameCount) {
+		throw std::runtime_error("Uniform ring has no region for this frame!");
+	}
+	frameStart = frame * frameSize;
+	head = 0;
+}
+
+uint32_t VKUniformRing::push(const void* data, VkDeviceSize size){
+	//Regions start aligned, so aligning the position in the region aligns the offset in the buffer
+	VkDeviceSize offset = (head + alignment - 1) & ~(alignment - 1);
+	if (offset + size > frameSize) {
+		throw std::runtime_error("Uniform ring region is full!");
+	}
+	head = offset + size;
+
+	//Written in order without reading it back, host visible memory can be write combined and slow to read
+	memcpy(mapped + frameStart + offset, data, size);
+	return static_cast<uint32_t>(frameStart + offset);
+}
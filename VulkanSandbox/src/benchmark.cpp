@@ -0,0 +1,102 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <stdexcept>
+#include <cstdint>
+#include "VKApplication.h"
+
+//Headless benchmark: VulkanSandboxBenchmark [--frames N] [--width W] [--height H] [--output report.json] [--msaa SAMPLES] [--sample-rate-shading 0|1] [--dynamic-rendering 0|1]
+static const char* USAGE = "Usage: VulkanSandboxBenchmark [--frames N] [--width W] [--height H] [--output report.json] [--msaa SAMPLES] [--sample-rate-shading 0|1] [--dynamic-rendering 0|1]";
+
+//Whole value as an unsigned 32-bit number: no sign (std::stoul would wrap -1), no trailing characters (640x) and nothing out of range
+static bool parseCount(const std::string& value, uint32_t& count) {
+	if (value.empty() || value[0] < '0' || value[0] > '9') {
+		return false;
+	}
+	try
+	{
+		size_t end = 0;
+		unsigned long parsed = std::stoul(value, &end);
+		if (end != value.size() || parsed > UINT32_MAX) {
+			return false;
+		}
+		count = static_cast<uint32_t>(parsed);
+		return true;
+	}
+	catch (const std::logic_error&)
+	{
+		return false;
+	}
+}
+
+int main(int argc, char** argv) {
+	VKBenchmarkSettings settings;
+	for (int i = 1; i < argc; i += 2) {
+		std::string option = argv[i];
+		//Every option takes a value, a run with a dropped option would silently measure the defaults
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for option " << option << "\n" << USAGE << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::string value = argv[i + 1];
+
+		//The sizes and the frame count can't be 0, the sample count is a VkSampleCountFlagBits: a single bit from 1 to 64
+		uint32_t count = 0;
+		bool valid = true;
+		if (option == "--frames") {
+			valid = parseCount(value, count) && count > 0;
+			settings.frameCount = count;
+		}
+		else if (option == "--width") {
+			valid = parseCount(value, count) && count > 0;
+			settings.width = count;
+		}
+		else if (option == "--height") {
+			valid = parseCount(value, count) && count > 0;
+			settings.height = count;
+		}
+		else if (option == "--output") {
+			settings.outputPath = value;
+		}
+		else if (option == "--msaa") {
+			valid = parseCount(value, count) && count >= 1 && count <= 64 && (count & (count - 1)) == 0;
+			settings.msaaSamples = count;
+		}
+		else if (option == "--sample-rate-shading") {
+			valid = value == "0" || value == "1";
+			settings.sampleRateShading = value == "1";
+		}
+		else if (option == "--dynamic-rendering") {
+			valid = value == "0" || value == "1";
+			settings.dynamicRendering = value == "1";
+		}
+		else {
+			std::cerr << "Unknown option " << option << "\n" << USAGE << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		if (!valid) {
+			std::cerr << "Invalid value " << value << " for option " << option << "\n" << USAGE << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	VKApplication app;
+	VKBenchmarkReport report;
+	try
+	{
+		app.runBenchmark(settings, report);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (!report.writeJson(settings.outputPath)) {
+		std::cerr << "Failed to write " << settings.outputPath << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << report.frameCount << " frames on " << report.deviceName << ": " << report.framesPerSecond << " fps, p99 " << report.cpuFrameMs.p99 << " ms, written to " << settings.outputPath << std::endl;
+	return EXIT_SUCCESS;
+}
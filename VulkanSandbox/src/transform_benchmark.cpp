@@ -0,0 +1,158 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <stdexcept>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "VKTransformSystem.h"
+
+//Same layout as VKInstanceData, without the Vulkan headers
+struct BenchmarkInstance {
+	alignas(16) glm::mat4 model;
+	uint32_t drawIndex;
+	uint32_t padding[3];
+};
+
+namespace {
+	//Median of the per-frame times in milliseconds
+	template<typename Function>
+	double timeFrames(uint32_t frameCount, Function&& function) {
+		std::vector<double> times;
+		for (uint32_t frame = 0; frame < frameCount; frame++) {
+			auto start = std::chrono::steady_clock::now();
+			function(frame);
+			times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		if (times.empty()) {
+			return 0.0;
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+
+	//Whole value as an unsigned 32-bit number, like the options of the headless benchmark
+	bool parseCount(const std::string& value, uint32_t& count) {
+		if (value.empty() || value[0] < '0' || value[0] > '9') {
+			return false;
+		}
+		try
+		{
+			size_t end = 0;
+			unsigned long parsed = std::stoul(value, &end);
+			if (end != value.size() || parsed > UINT32_MAX) {
+				return false;
+			}
+			count = static_cast<uint32_t>(parsed);
+			return true;
+		}
+		catch (const std::logic_error&)
+		{
+			return false;
+		}
+	}
+
+	const char* USAGE = "Usage: VulkanSandboxTransformBenchmark [instances] [frames], both above 0";
+
+	float spinAngle(uint32_t frame) {
+		return frame * (1.0f / 60.0f) * glm::radians(90.0f);
+	}
+}
+
+//Instance matrix update: the glm path of updateInstanceBuffer against VKTransformSystem
+//VulkanSandboxTransformBenchmark [instances] [frames]
+int main(int argc, char** argv) {
+	uint32_t instanceCount = 100000;
+	uint32_t frameCount = 200;
+	//The median of 0 frames doesn't exist, and 0 instances has nothing to measure
+	if (argc > 3 || (argc > 1 && (!parseCount(argv[1], instanceCount) || instanceCount == 0)) || (argc > 2 && (!parseCount(argv[2], frameCount) || frameCount == 0))) {
+		std::cerr << USAGE << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	//A grid like the scene's, every instance spins around its own origin
+	std::vector<glm::mat4> instanceTransforms(instanceCount);
+	uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instanceCount))));
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		instanceTransforms[i] = glm::translate(glm::mat4(1.0f), glm::vec3((i % gridSize) * 20.0f, 0.0f, (i / gridSize) * 20.0f));
+	}
+
+	std::vector<BenchmarkInstance> glmOutput(instanceCount);
+	std::vector<BenchmarkInstance> systemOutput(instanceCount);
+
+	// glm: one rotate per frame and a matrix product per instance, every matrix written every frame
+	double glmMs = timeFrames(frameCount, [&](uint32_t frame) {
+		glm::mat4 spin = glm::rotate(glm::mat4(1.0f), spinAngle(frame), glm::vec3(0.0f, 1.0f, 0.0f));
+		for (uint32_t i = 0; i < instanceCount; i++) {
+			glmOutput[i].model = instanceTransforms[i] * spin;
+			glmOutput[i].drawIndex = 0;
+		}
+	});
+
+	// Transform system: static instance nodes with a spinning child each, like the application
+	VKTransformSystem transforms;
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		transforms.addNode(glm::vec3(instanceTransforms[i][3]), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 1.0f);
+	}
+	uint32_t firstSpinNode = transforms.getNodeCount();
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		transforms.addNode(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 1.0f, i);
+	}
+	uint64_t writtenVersion = 0;
+
+	double systemMs = timeFrames(frameCount, [&](uint32_t frame) {
+		glm::quat spin = glm::angleAxis(spinAngle(frame), glm::vec3(0.0f, 1.0f, 0.0f));
+		for (uint32_t i = 0; i < instanceCount; i++) {
+			transforms.setRotation(firstSpinNode + i, spin);
+		}
+		transforms.update();
+		transforms.writeWorldMatrices(&systemOutput[0].model, sizeof(BenchmarkInstance), firstSpinNode, instanceCount, writtenVersion);
+	});
+
+	//Both paths ended on the same frame, their matrices must match
+	float maxError = 0.0f;
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		for (int column = 0; column < 4; column++) {
+			for (int row = 0; row < 4; row++) {
+				maxError = std::max(maxError, std::abs(glmOutput[i].model[column][row] - systemOutput[i].model[column][row]));
+			}
+		}
+	}
+
+	//One instance in 10 moves, the glm path would still rebuild and write every matrix
+	double partialMs = timeFrames(frameCount, [&](uint32_t frame) {
+		glm::quat spin = glm::angleAxis(spinAngle(frame), glm::vec3(0.0f, 1.0f, 0.0f));
+		for (uint32_t i = 0; i < instanceCount; i += 10) {
+			transforms.setRotation(firstSpinNode + i, spin);
+		}
+		transforms.update();
+		transforms.writeWorldMatrices(&systemOutput[0].model, sizeof(BenchmarkInstance), firstSpinNode, instanceCount, writtenVersion);
+	});
+
+	//Nothing moves: the update and the copy find nothing to do
+	double staticMs = timeFrames(frameCount, [&](uint32_t) {
+		transforms.update();
+		transforms.writeWorldMatrices(&systemOutput[0].model, sizeof(BenchmarkInstance), firstSpinNode, instanceCount, writtenVersion);
+	});
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << instanceCount << " instances, median of " << frameCount << " frames" << std::endl;
+	std::cout << "glm, every instance:              " << glmMs << " ms" << std::endl;
+	std::cout << "transform system, every instance: " << systemMs << " ms (" << glmMs / systemMs << "x)" << std::endl;
+	std::cout << "transform system, 1 in 10 moves:  " << partialMs << " ms (" << glmMs / partialMs << "x)" << std::endl;
+	std::cout << "transform system, static:         " << staticMs << " ms" << std::endl;
+	std::cout << "max difference:                   " << maxError << std::endl;
+
+	//The spin only moves the matrices by rounding errors, anything bigger is a wrong kernel
+	if (maxError > 1e-3f) {
+		std::cerr << "The transform system doesn't match glm!" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}